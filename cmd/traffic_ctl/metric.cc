@@ -23,6 +23,8 @@
 
 #include "traffic_ctl.h"
 #include <P_RecUtils.h>
+#include <I_RecSnapshot.h>
+#include "ts/Regex.h"
 
 static int
 metric_get(unsigned argc, const char **argv)
@@ -77,6 +79,46 @@ metric_match(unsigned argc, const char **argv)
   return CTRL_EX_OK;
 }
 
+static int
+metric_snapshot(unsigned argc, const char **argv)
+{
+  if (!CtrlProcessArguments(argc, argv, nullptr, 0)) {
+    return CtrlCommandUsage("metric snapshot [REGEX ...]", nullptr, 0);
+  }
+
+  std::string path = RecSnapshotPath();
+  RecSnapshotReader reader;
+  std::vector<RecSnapshotRecord> records;
+
+  if (path.empty() || !reader.read(path.c_str(), records)) {
+    fprintf(stderr, "%s: failed to read the stats snapshot %s\n", program_name, path.c_str());
+    return CTRL_EX_ERROR;
+  }
+
+  std::vector<Regex> regexes(n_file_arguments);
+  for (unsigned i = 0; i < n_file_arguments; ++i) {
+    if (!regexes[i].compile(file_arguments[i])) {
+      fprintf(stderr, "%s: invalid regular expression %s\n", program_name, file_arguments[i]);
+      return CTRL_EX_ERROR;
+    }
+  }
+
+  for (const auto &record : records) {
+    bool match = regexes.empty();
+    for (auto &regex : regexes) {
+      if (regex.exec(record.name.c_str())) {
+        match = true;
+        break;
+      }
+    }
+    if (match) {
+      printf("%s %s\n", record.name.c_str(), record.value().c_str());
+    }
+  }
+
+  return CTRL_EX_OK;
+}
+
 static int
 metric_clear(unsigned argc, const char **argv)
 {
@@ -116,6 +158,7 @@ subcommand_metric(unsigned argc, const char **argv)
     {CtrlUnimplementedCommand, "describe", "Show detailed information about one or more metric values"},
     {metric_match, "match", "Get metrics matching a regular expression"},
     {CtrlUnimplementedCommand, "monitor", "Display the value of a metric over time"},
+    {metric_snapshot, "snapshot", "Get metrics from the stats snapshot, without traffic_manager"},
 
     // We could allow clearing all the metrics in the "clear" subcommand, but that seems error-prone. It
     // would be too easy to just expect a help message and accidentally nuke all the metrics.
@@ -22,6 +22,11 @@
  */
 
 #include "traffic_ctl.h"
+#include "I_RecCore.h"
+#include "ts/I_Layout.h"
+#include "I_EventProfiler.h"
+
+#include <sys/stat.h>
 
 static int drain   = 0;
 static int manager = 0;
@@ -203,6 +208,83 @@ server_drain(unsigned argc, const char **argv)
   return CTRL_EX_OK;
 }
 
+static int
+server_profile(unsigned argc, const char **argv)
+{
+  TSMgmtError error;
+  const char *usage = "server profile [OPTIONS] start|stop|reset|dump";
+  int summary       = 0;
+
+  const ArgumentDescription opts[] = {
+    {"summary", '-', "Dump a table of counts and percentiles instead of folded stacks", "F", &summary, nullptr, nullptr},
+  };
+
+  if (!CtrlProcessArguments(argc, argv, opts, countof(opts)) || n_file_arguments != 1) {
+    return CtrlCommandUsage(usage, opts, countof(opts));
+  }
+
+  std::string command = file_arguments[0];
+  if (command != "start" && command != "stop" && command != "reset" && command != "dump") {
+    return CtrlCommandUsage(usage, opts, countof(opts));
+  }
+
+  std::string path;
+  struct stat before;
+
+  if (command == "dump") {
+    ats_scoped_str filename;
+
+    if (RecGetRecordString_Xmalloc("proxy.config.exec_thread.profile.filename", (RecString *)&filename) != REC_ERR_OKAY ||
+        !filename || *filename == '\0') {
+      fprintf(stderr, "%s: proxy.config.exec_thread.profile.filename is not set\n", program_name);
+      return CTRL_EX_ERROR;
+    }
+    ats_scoped_str rundir(RecConfigReadRuntimeDir());
+
+    path = Layout::relative_to(rundir.get(), filename.get());
+    if (stat(path.c_str(), &before) != 0) {
+      before.st_ino = 0;
+    }
+    if (summary) {
+      command += " summary";
+    }
+  }
+
+  error = TSLifecycleMessage(EVENT_PROFILER_MESSAGE_TAG, command.c_str(), command.size() + 1);
+  if (error != TS_ERR_OKAY) {
+    CtrlMgmtError(error, "server profile %s failed", file_arguments[0]);
+    return CTRL_EX_ERROR;
+  }
+
+  if (path.empty()) {
+    return CTRL_EX_OK;
+  }
+
+  // The message is asynchronous, wait for traffic_server to replace the report.
+  for (int i = 0; i < 50; ++i) {
+    struct stat after;
+
+    if (stat(path.c_str(), &after) == 0 && after.st_ino != before.st_ino) {
+      FILE *fp = fopen(path.c_str(), "r");
+      char buf[4096];
+      size_t n;
+
+      while (fp && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        fwrite(buf, 1, n, stdout);
+      }
+      if (fp) {
+        fclose(fp);
+        return CTRL_EX_OK;
+      }
+      break;
+    }
+    usleep(100000);
+  }
+
+  fprintf(stderr, "%s: failed to read the event profile %s\n", program_name, path.c_str());
+  return CTRL_EX_ERROR;
+}
+
 int
 subcommand_server(unsigned argc, const char **argv)
 {
@@ -211,7 +293,8 @@ subcommand_server(unsigned argc, const char **argv)
                                  {server_start, "start", "Start the proxy"},
                                  {server_status, "status", "Show the proxy status"},
                                  {server_stop, "stop", "Stop the proxy"},
-                                 {server_drain, "drain", "Drain the requests"}};
+                                 {server_drain, "drain", "Drain the requests"},
+                                 {server_profile, "profile", "Control the event and lock profiler of traffic_server"}};
 
   return CtrlGenericSubcommand("server", commands, countof(commands), argc, argv);
 }
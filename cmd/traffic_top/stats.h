@@ -24,6 +24,7 @@
 #include <curl/curl.h>
 #endif
 #include <map>
+#include <list>
 #include <string>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -31,6 +32,7 @@
 #include <cinttypes>
 #include <sys/time.h>
 #include "mgmtapi.h"
+#include "I_RecSnapshot.h"
 
 using namespace std;
 
@@ -83,7 +85,8 @@ public:
       char hostname[25];
       hostname[sizeof(hostname) - 1] = '\0';
       gethostname(hostname, sizeof(hostname) - 1);
-      _host = hostname;
+      _host          = hostname;
+      _snapshot_path = RecSnapshotPath();
     }
 
     _time_diff = 0;
@@ -242,12 +245,60 @@ public:
     // ratio
     lookup_table.insert(make_pair("client_req_time", LookupItem("Resp (ms)", "total_time", "client_req", 3)));
     lookup_table.insert(make_pair("client_dyn_ka", LookupItem("Dynamic KA", "ka_total", "ka_count", 3)));
+
+    // latency histograms, in microseconds shown as milliseconds
+    static const char *const latency_phases[][2] = {
+      {"ttfb", "TTFB"},
+      {"total", "Total"},
+      {"cache_lookup", "Cache"},
+      {"dns_lookup", "DNS"},
+      {"server_connect", "Connect"},
+      {"server_response", "Origin"},
+    };
+    static const char *const latency_percentiles[] = {"p50", "p90", "p99", "p999", "max"};
+    for (const auto &phase : latency_phases) {
+      string key  = string("lat_") + phase[0];
+      string name = string("proxy.process.http.latency.") + phase[0];
+
+      latency_names.push_back(name + ".count");
+      lookup_table.insert(make_pair(key + "_count", LookupItem(phase[1], latency_names.back().c_str(), 2)));
+      for (const char *percentile : latency_percentiles) {
+        latency_names.push_back(name + "." + percentile);
+        lookup_table.insert(make_pair(key + "_" + percentile, LookupItem(phase[1], latency_names.back().c_str(), 9)));
+      }
+    }
+  }
+
+  // Read the stats from the snapshot of traffic_server, if there is one.
+  bool
+  getSnapshot()
+  {
+    if (_snapshot_path.empty() || !_snapshot.read(_snapshot_path.c_str(), _snapshot_records)) {
+      return false;
+    }
+
+    delete _old_stats;
+    _old_stats = _stats;
+    _stats     = new map<string, string>;
+    for (const auto &record : _snapshot_records) {
+      (*_stats)[record.name] = record.value();
+    }
+
+    gettimeofday(&_time, nullptr);
+    _old_time  = _now;
+    _now       = _time.tv_sec + (double)_time.tv_usec / 1000000;
+    _time_diff = _now - _old_time;
+    return true;
   }
 
   void
   getStats()
   {
     if (_url == "") {
+      if (getSnapshot()) {
+        return;
+      }
+
       int64_t value = 0;
       if (_old_stats != nullptr) {
         delete _old_stats;
@@ -262,7 +313,7 @@ public:
       for (map<string, LookupItem>::const_iterator lookup_it = lookup_table.begin(); lookup_it != lookup_table.end(); ++lookup_it) {
         const LookupItem &item = lookup_it->second;
 
-        if (item.type == 1 || item.type == 2 || item.type == 5 || item.type == 8) {
+        if (item.type == 1 || item.type == 2 || item.type == 5 || item.type == 8 || item.type == 9) {
           if (strcmp(item.pretty, "Version") == 0) {
             // special case for Version information
             TSString strValue = nullptr;
@@ -360,7 +411,7 @@ public:
   getStat(const string &key, string &value)
   {
     map<string, LookupItem>::const_iterator lookup_it = lookup_table.find(key);
-    assert(lookup_it != lookup_table.end());
+    ink_assert(lookup_it != lookup_table.end());
     const LookupItem &item = lookup_it->second;
 
     map<string, string>::const_iterator stats_it = _stats->find(item.name);
@@ -375,7 +426,7 @@ public:
   getStat(const string &key, double &value, string &prettyName, int &type, int overrideType = 0)
   {
     map<string, LookupItem>::const_iterator lookup_it = lookup_table.find(key);
-    assert(lookup_it != lookup_table.end());
+    ink_assert(lookup_it != lookup_table.end());
     const LookupItem &item = lookup_it->second;
     prettyName             = item.pretty;
     if (overrideType != 0) {
@@ -384,11 +435,14 @@ public:
       type = item.type;
     }
 
-    if (type == 1 || type == 2 || type == 5 || type == 8) {
+    if (type == 1 || type == 2 || type == 5 || type == 8 || type == 9) {
       value = getValue(item.name, _stats);
       if (key == "total_time") {
         value = value / 10000000;
       }
+      if (type == 9) {
+        value = value / 1000;
+      }
 
       if ((type == 2 || type == 5 || type == 8) && _old_stats != nullptr && _absolute == false) {
         double old = getValue(item.name, _old_stats);
@@ -506,7 +560,11 @@ private:
   map<string, string> *_stats;
   map<string, string> *_old_stats;
   map<string, LookupItem> lookup_table;
+  list<string> latency_names; // storage of the names of the latency lookup items
   string _url;
+  string _snapshot_path;
+  RecSnapshotReader _snapshot;
+  vector<RecSnapshotRecord> _snapshot_records;
   string _host;
   double _old_time;
   double _now;
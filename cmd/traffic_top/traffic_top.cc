@@ -221,6 +221,41 @@ response_code_page(Stats &stats)
   makeTable(42, 1, response3, stats);
 }
 
+//----------------------------------------------------------------------------
+static void
+latency_page(Stats &stats)
+{
+  attron(COLOR_PAIR(colorPair::border));
+  attron(A_BOLD);
+  mvprintw(0, 0, "                          LATENCY PERCENTILES (ms)                             ");
+  attroff(COLOR_PAIR(colorPair::border));
+  attroff(A_BOLD);
+
+  static const char *const phases[]  = {"ttfb", "total", "cache_lookup", "dns_lookup", "server_connect", "server_response"};
+  static const char *const columns[] = {"count", "p50", "p90", "p99", "p999", "max"};
+
+  attron(A_BOLD);
+  mvprintw(2, 0, "            Req/s      p50      p90      p99    p99.9      max");
+  attroff(A_BOLD);
+
+  int y = 3;
+  for (const char *phase : phases) {
+    string prettyName;
+    double value = 0;
+    int type;
+    int x = 10;
+
+    for (const char *column : columns) {
+      stats.getStat(string("lat_") + phase + "_" + column, value, prettyName, type);
+      prettyPrint(x, y, value, type);
+      x += 9;
+    }
+    mvprintw(y++, 0, prettyName.c_str());
+  }
+
+  mvprintw(y + 1, 0, "Percentiles are of the last stats sync interval, counts are per second.");
+}
+
 //----------------------------------------------------------------------------
 static void
 help(const string &host, const string &version)
@@ -254,6 +289,8 @@ help(const string &host, const string &version)
     mvprintw(11, 0, "Changed    => Requests that required entries in cache to be updated");
     mvprintw(12, 0, "Changed    => Requests that can't be cached for some reason");
     mvprintw(12, 0, "No Cache   => Requests that the client sent Cache-Control: no-cache header");
+    mvprintw(13, 0, "TTFB       => Time from the client connection to the first byte of the response");
+    mvprintw(14, 0, "Origin     => Time from the request to the origin server to its first response byte");
 
     attron(COLOR_PAIR(colorPair::border));
     attron(A_BOLD);
@@ -417,8 +454,12 @@ main(int argc, const char **argv)
   case 0: {
     ats_scoped_str rundir(RecConfigReadRuntimeDir());
 
+    // The stats snapshot of traffic_server can be read without traffic_manager.
+    string snapshot   = RecSnapshotPath();
+    bool has_snapshot = !snapshot.empty() && access(snapshot.c_str(), R_OK) == 0;
+
     TSMgmtError err = TSInit(rundir, static_cast<TSInitOptionT>(TS_MGMT_OPT_NO_EVENTS | TS_MGMT_OPT_NO_SOCK_TESTS));
-    if (err != TS_ERR_OKAY) {
+    if (err != TS_ERR_OKAY && !has_snapshot) {
       fprintf(stderr, "Error: connecting to local manager: %s\n", TSGetErrorMessage(err));
       exit(1);
     }
@@ -458,9 +499,10 @@ main(int argc, const char **argv)
   enum Page {
     MAIN_PAGE,
     RESPONSE_PAGE,
+    LATENCY_PAGE,
   };
   Page page       = MAIN_PAGE;
-  string page_alt = "(r)esponse";
+  string page_alt = "(r)esponse (l)atency";
 
   while (true) {
     attron(COLOR_PAIR(colorPair::border));
@@ -481,6 +523,8 @@ main(int argc, const char **argv)
       main_stats_page(stats);
     } else if (page == RESPONSE_PAGE) {
       response_code_page(stats);
+    } else if (page == LATENCY_PAGE) {
+      latency_page(stats);
     }
 
     curs_set(0);
@@ -496,11 +540,15 @@ main(int argc, const char **argv)
       goto quit;
     case 'm':
       page     = MAIN_PAGE;
-      page_alt = "(r)esponse";
+      page_alt = "(r)esponse (l)atency";
       break;
     case 'r':
       page     = RESPONSE_PAGE;
-      page_alt = "(m)ain";
+      page_alt = "(m)ain (l)atency";
+      break;
+    case 'l':
+      page     = LATENCY_PAGE;
+      page_alt = "(m)ain (r)esponse";
       break;
     case 'a':
       absolute = stats.toggleAbsolute();
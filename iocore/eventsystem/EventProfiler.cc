@@ -0,0 +1,383 @@
+/** @file
+
+  Event handler run time and lock contention profiler.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "P_EventSystem.h"
+#include "I_EventProfiler.h"
+
+#include <cxxabi.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+std::atomic<bool> EventProfiler::enabled{false};
+
+namespace
+{
+const int PROFILE_TABLE_SIZE = 1024; // sites per thread
+const int PROFILE_MAX_PROBES = 16;
+const int PROFILE_BUCKETS    = 40; // log2 of nanoseconds, bucket i holds [2^(i-1), 2^i)
+
+const char *const profile_kind_name[] = {"handler", "reschedule", "lock_wait", "lock_hold", "lock_miss"};
+
+// The owning thread is the only writer, the atomics let dump() read while it records.
+struct ProfileEntry {
+  std::atomic<const char *> site; // set last, when the entry is claimed
+  const char *detail;
+  int line;
+  int kind;
+  std::atomic<int64_t> count;
+  std::atomic<int64_t> total;
+  std::atomic<int64_t> max;
+  std::atomic<int64_t> buckets[PROFILE_BUCKETS];
+};
+
+struct ProfileTable {
+  ink_thread thread;
+  std::atomic<uint64_t> generation;
+  std::atomic<int64_t> overflow;
+  ProfileEntry entries[PROFILE_TABLE_SIZE];
+
+  LINK(ProfileTable, link);
+};
+
+// reset() bumps the generation, and each thread clears its own table when it sees the change.
+std::atomic<uint64_t> profile_generation{1};
+
+ink_mutex profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+Queue<ProfileTable> profile_tables;
+
+thread_local ProfileTable *profile_table = nullptr;
+
+inline void
+relaxed_add(std::atomic<int64_t> &counter, int64_t value)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+int
+bucket_index(ink_hrtime duration)
+{
+  if (duration <= 0) {
+    return 0;
+  }
+  return std::min(64 - __builtin_clzll(duration), PROFILE_BUCKETS - 1);
+}
+
+ProfileTable *
+profile_table_get()
+{
+  uint64_t generation = profile_generation.load(std::memory_order_acquire);
+
+  if (profile_table == nullptr) {
+    profile_table         = new ProfileTable();
+    profile_table->thread = ink_thread_self();
+    profile_table->generation.store(generation, std::memory_order_release);
+
+    ink_scoped_mutex_lock lock(profile_mutex);
+    profile_tables.push(profile_table);
+  } else if (profile_table->generation.load(std::memory_order_relaxed) != generation) {
+    for (auto &e : profile_table->entries) {
+      e.site.store(nullptr, std::memory_order_relaxed);
+      e.count.store(0, std::memory_order_relaxed);
+      e.total.store(0, std::memory_order_relaxed);
+      e.max.store(0, std::memory_order_relaxed);
+      for (auto &b : e.buckets) {
+        b.store(0, std::memory_order_relaxed);
+      }
+    }
+    profile_table->overflow.store(0, std::memory_order_relaxed);
+    profile_table->generation.store(generation, std::memory_order_release);
+  }
+
+  return profile_table;
+}
+
+std::string
+demangle(const char *name)
+{
+  int status = 0;
+  char *s    = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+  std::string result(status == 0 && s ? s : name);
+
+  free(s);
+  return result;
+}
+
+// The frames of the site, ';' separated: the continuation type or the lock location, then the handler or function.
+std::string
+site_frames(const ProfileEntry &e, const char *site)
+{
+  std::string frames;
+
+  if (e.line) {
+    const char *base = strrchr(site, '/');
+    frames           = base ? base + 1 : site;
+    frames += ':' + std::to_string(e.line);
+  } else {
+    frames = demangle(site);
+  }
+  if (e.detail) {
+    frames += ';';
+    frames += e.detail;
+  }
+  // ';' and ' ' are separators in the folded format.
+  std::replace(frames.begin(), frames.end(), ' ', '_');
+  return frames;
+}
+
+struct ProfileSummary {
+  int64_t buckets[PROFILE_BUCKETS] = {0};
+
+  int64_t count = 0;
+  int64_t total = 0;
+  int64_t max   = 0;
+
+  int64_t
+  percentile(double fraction) const
+  {
+    int64_t rank = std::max<int64_t>(1, static_cast<int64_t>(fraction * count + 0.5));
+    for (int i = 0; i < PROFILE_BUCKETS; ++i) {
+      rank -= buckets[i];
+      if (rank <= 0) {
+        return std::min<int64_t>(i ? INT64_C(1) << i : 0, max);
+      }
+    }
+    return max;
+  }
+};
+
+} // namespace
+
+void
+EventProfiler::record(EventProfileKind kind, const char *site, int line, const char *detail, ink_hrtime duration)
+{
+  ProfileTable *table = profile_table_get();
+  uintptr_t hash      = reinterpret_cast<uintptr_t>(site) ^ (reinterpret_cast<uintptr_t>(detail) >> 3);
+
+  hash ^= (static_cast<uintptr_t>(line) << 4) ^ kind;
+  hash ^= hash >> 17;
+  hash *= 0x9E3779B97F4A7C15ULL;
+  hash >>= 20;
+
+  for (int i = 0; i < PROFILE_MAX_PROBES; ++i) {
+    ProfileEntry &e = table->entries[(hash + i) & (PROFILE_TABLE_SIZE - 1)];
+    const char *s   = e.site.load(std::memory_order_relaxed);
+
+    if (s == nullptr) {
+      e.detail = detail;
+      e.line   = line;
+      e.kind   = kind;
+      e.site.store(site, std::memory_order_release);
+    } else if (s != site || e.line != line || e.detail != detail || e.kind != kind) {
+      continue;
+    }
+
+    relaxed_add(e.count, 1);
+    relaxed_add(e.total, duration);
+    relaxed_add(e.buckets[bucket_index(duration)], 1);
+    if (duration > e.max.load(std::memory_order_relaxed)) {
+      e.max.store(duration, std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  relaxed_add(table->overflow, 1);
+}
+
+void
+EventProfiler::start()
+{
+  enabled.store(true, std::memory_order_relaxed);
+  Note("event profiler started");
+}
+
+void
+EventProfiler::stop()
+{
+  enabled.store(false, std::memory_order_relaxed);
+  Note("event profiler stopped");
+}
+
+void
+EventProfiler::reset()
+{
+  profile_generation.fetch_add(1, std::memory_order_release);
+}
+
+bool
+EventProfiler::dump(const char *path, bool summary)
+{
+  typedef std::tuple<int, std::string> SummaryKey; // kind, site frames
+  std::map<SummaryKey, ProfileSummary> summaries;
+  std::string tmp     = std::string(path) + ".tmp";
+  uint64_t generation = profile_generation.load(std::memory_order_acquire);
+  int64_t overflow    = 0;
+  FILE *fp            = fopen(tmp.c_str(), "w");
+
+  if (fp == nullptr) {
+    Error("failed to write the event profile %s: %s", tmp.c_str(), strerror(errno));
+    return false;
+  }
+
+  ink_scoped_mutex_lock lock(profile_mutex);
+
+  for (ProfileTable *table = profile_tables.head; table; table = table->link.next) {
+    char thread_name[64] = "";
+
+    if (table->generation.load(std::memory_order_acquire) != generation) {
+      continue; // Not used since the reset.
+    }
+#if defined(HAVE_PTHREAD_SETNAME_NP_2) // and its pthread_getname_np() counterpart
+    pthread_getname_np(table->thread, thread_name, sizeof(thread_name));
+#endif
+    if (*thread_name == '\0') {
+      snprintf(thread_name, sizeof(thread_name), "thread %lu", static_cast<unsigned long>(table->thread));
+    }
+    overflow += table->overflow.load(std::memory_order_relaxed);
+
+    for (auto &e : table->entries) {
+      const char *site = e.site.load(std::memory_order_acquire);
+      if (site == nullptr) {
+        continue;
+      }
+
+      std::string frames = site_frames(e, site);
+      int64_t total      = e.total.load(std::memory_order_relaxed);
+
+      if (summary) {
+        ProfileSummary &s = summaries[SummaryKey(e.kind, frames)];
+        s.count += e.count.load(std::memory_order_relaxed);
+        s.total += total;
+        s.max = std::max(s.max, e.max.load(std::memory_order_relaxed));
+        for (int i = 0; i < PROFILE_BUCKETS; ++i) {
+          s.buckets[i] += e.buckets[i].load(std::memory_order_relaxed);
+        }
+      } else if (total >= HRTIME_USECOND) {
+        // Only the timed kinds, a flame graph cannot mix times and counts.
+        fprintf(fp, "%s;%s;%s %" PRId64 "\n", thread_name, profile_kind_name[e.kind], frames.c_str(), total / HRTIME_USECOND);
+      }
+    }
+  }
+
+  if (summary) {
+    std::vector<std::pair<SummaryKey, ProfileSummary>> sorted(summaries.begin(), summaries.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<SummaryKey, ProfileSummary> &a,
+                                               const std::pair<SummaryKey, ProfileSummary> &b) {
+      return a.second.total != b.second.total ? a.second.total > b.second.total : a.second.count > b.second.count;
+    });
+
+    fprintf(fp, "%-10s %10s %12s %10s %10s %10s %s\n", "# kind", "count", "total_us", "p50_us", "p99_us", "max_us", "site");
+    for (auto &entry : sorted) {
+      const ProfileSummary &s = entry.second;
+      fprintf(fp, "%-10s %10" PRId64 " %12" PRId64 " %10" PRId64 " %10" PRId64 " %10" PRId64 " %s\n",
+              profile_kind_name[std::get<0>(entry.first)], s.count, s.total / HRTIME_USECOND, s.percentile(0.5) / HRTIME_USECOND,
+              s.percentile(0.99) / HRTIME_USECOND, s.max / HRTIME_USECOND, std::get<1>(entry.first).c_str());
+    }
+  }
+  if (overflow) {
+    Warning("the event profile missed %" PRId64 " events, too many sites", overflow);
+  }
+
+  if (fclose(fp) != 0 || rename(tmp.c_str(), path) != 0) {
+    Error("failed to write the event profile %s: %s", path, strerror(errno));
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+#if TS_HAS_TESTS
+#include "ts/TestBox.h"
+
+struct EventProfilerTestSite {
+  virtual ~EventProfilerTestSite() {}
+};
+
+REGRESSION_TEST(EventProfiler)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  EventProfilerTestSite site;
+  const char *type = typeid(site).name();
+  char path[]      = "/tmp/event_profile_XXXXXX";
+  int fd           = mkstemp(path);
+  char line[512];
+  bool found = false;
+
+  box.check(fd >= 0, "failed to create %s", path);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+
+  EventProfiler::reset();
+  for (int i = 1; i <= 100; ++i) {
+    EventProfiler::record(EVENT_PROFILE_HANDLER, type, 0, "test_handler", i * HRTIME_USECOND);
+  }
+  EventProfiler::record(EVENT_PROFILE_RESCHEDULE, type, 0, nullptr, 0);
+
+  box.check(EventProfiler::dump(path, false), "failed to dump the folded profile");
+  FILE *fp = fopen(path, "r");
+  while (fp && fgets(line, sizeof(line), fp)) {
+    if (strstr(line, ";handler;EventProfilerTestSite;test_handler 5050\n")) {
+      found = true;
+    }
+    box.check(strstr(line, "reschedule") == nullptr, "counts must not be in the folded profile: %s", line);
+  }
+  if (fp) {
+    fclose(fp);
+  }
+  box.check(found, "the handler time is not in the folded profile");
+
+  found = false;
+  box.check(EventProfiler::dump(path, true), "failed to dump the profile summary");
+  fp = fopen(path, "r");
+  while (fp && fgets(line, sizeof(line), fp)) {
+    int64_t count, total, p50, p99, max;
+    char kind[32], frames[256];
+    if (sscanf(line, "%31s %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %255s", kind, &count, &total, &p50, &p99,
+               &max, frames) == 7 &&
+        strcmp(kind, "handler") == 0 && strcmp(frames, "EventProfilerTestSite;test_handler") == 0) {
+      found = true;
+      box.check(count == 100 && total == 5050 && max == 100, "wrong summary %s", line);
+      box.check(p50 >= 50 && p50 <= 66 && p99 >= 99 && p99 <= 100, "wrong percentiles %s", line);
+    }
+  }
+  if (fp) {
+    fclose(fp);
+  }
+  box.check(found, "the handler is not in the profile summary");
+
+  EventProfiler::reset();
+  box.check(EventProfiler::dump(path, false), "failed to dump the folded profile");
+  fp = fopen(path, "r");
+  box.check(fp && fgets(line, sizeof(line), fp) == nullptr, "the profile is not empty after a reset");
+  if (fp) {
+    fclose(fp);
+  }
+  unlink(path);
+}
+#endif
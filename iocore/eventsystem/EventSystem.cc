@@ -36,6 +36,7 @@ ink_event_system_init(ModuleVersion v)
   ink_release_assert(!checkModuleVersion(v, EVENT_SYSTEM_MODULE_VERSION));
   int config_max_iobuffer_size = DEFAULT_MAX_BUFFER_SIZE;
   int iobuffer_advice          = 0;
+  int profile                  = 0;
 
   // For backwards compatability make sure to allow thread_freelist_size
   // This needs to change in 6.0
@@ -63,4 +64,9 @@ ink_event_system_init(ModuleVersion v)
 #endif
 
   init_buffer_allocators(iobuffer_advice);
+
+  REC_ReadConfigInteger(profile, "proxy.config.exec_thread.profile.enabled");
+  if (profile) {
+    EventProfiler::start();
+  }
 }
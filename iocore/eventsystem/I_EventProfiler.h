@@ -0,0 +1,97 @@
+/** @file
+
+  Event handler run time and lock contention profiler.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#pragma once
+
+#include "ts/ink_platform.h"
+#include "ts/ink_hrtime.h"
+
+#include <atomic>
+#include <typeinfo>
+
+// Tag of the lifecycle messages that control the profiler, see traffic_ctl server profile.
+#define EVENT_PROFILER_MESSAGE_TAG "traffic_server.profile"
+
+enum EventProfileKind {
+  EVENT_PROFILE_HANDLER,    // run time of an event handler
+  EVENT_PROFILE_RESCHEDULE, // event rescheduled because the continuation's lock was busy
+  EVENT_PROFILE_LOCK_WAIT,  // time waiting for a ProxyMutex, DEBUG builds only
+  EVENT_PROFILE_LOCK_HOLD,  // time holding a ProxyMutex, DEBUG builds only
+  EVENT_PROFILE_LOCK_MISS,  // failed MUTEX_TRY_LOCK, DEBUG builds only
+  EVENT_PROFILE_KINDS
+};
+
+/**
+  Opt-in profiler of the event system.
+
+  While it is enabled, each thread records the event handler run times
+  and the lock contention into its own table of histograms, keyed by
+  call site: the continuation type and, in DEBUG builds, its handler
+  name or the SourceLocation of the lock. Nothing is shared between
+  the threads when recording, so the cost of a disabled profiler is
+  one relaxed load.
+
+  The call site strings must be static, they are compared by address.
+*/
+class EventProfiler
+{
+public:
+  static bool
+  is_enabled()
+  {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  /// Record an event of @a kind at the call site @a site, @a line and @a detail.
+  static void record(EventProfileKind kind, const char *site, int line, const char *detail, ink_hrtime duration);
+
+  /// Call the handler of the continuation @a c, recording its run time.
+  template <class C>
+  static int
+  handle_event(C *c, int event, void *data)
+  {
+    // Look at the continuation before the call, it may be gone after.
+    const char *type = typeid(*c).name();
+#ifdef DEBUG
+    const char *handler = c->handler_name;
+#else
+    const char *handler = nullptr;
+#endif
+    ink_hrtime start = ink_get_hrtime_internal();
+    int result       = c->handleEvent(event, data);
+
+    record(EVENT_PROFILE_HANDLER, type, 0, handler, ink_get_hrtime_internal() - start);
+    return result;
+  }
+
+  static void start();
+  static void stop();
+  /// Forget everything recorded so far.
+  static void reset();
+
+  /// Write the report to @a path. It is in the folded stack format of flame graph tools, with the
+  /// microseconds spent at each site, or a table of counts and percentiles if @a summary is set.
+  static bool dump(const char *path, bool summary);
+
+  static std::atomic<bool> enabled;
+};
@@ -26,6 +26,7 @@
 #include "ts/ink_platform.h"
 #include "ts/Diags.h"
 #include "I_Thread.h"
+#include "I_EventProfiler.h"
 
 #define MAX_LOCK_TIME HRTIME_MSECONDS(200)
 #define THREAD_MUTEX_THREAD_HOLDING (-1024 * 1024)
@@ -288,6 +289,9 @@ Mutex_trylock(
     if (!ink_mutex_try_acquire(&m->the_mutex)) {
 #ifdef DEBUG
       lock_waiting(m->srcloc, m->handler);
+      if (EventProfiler::is_enabled()) {
+        EventProfiler::record(EVENT_PROFILE_LOCK_MISS, location.file, location.line, location.func, 0);
+      }
 #ifdef LOCK_CONTENTION_PROFILING
       m->unsuccessful_nonblocking_acquires++;
       m->nonblocking_acquires++;
@@ -301,7 +305,7 @@ Mutex_trylock(
 #ifdef DEBUG
     m->srcloc    = location;
     m->handler   = ahandler;
-    m->hold_time = Thread::get_hrtime();
+    m->hold_time = EventProfiler::is_enabled() ? ink_get_hrtime_internal() : Thread::get_hrtime();
 #ifdef MAX_LOCK_TAKEN
     m->taken++;
 #endif // MAX_LOCK_TAKEN
@@ -351,6 +355,9 @@ Mutex_trylock_spin(
     if (!locked) {
 #ifdef DEBUG
       lock_waiting(m->srcloc, m->handler);
+      if (EventProfiler::is_enabled()) {
+        EventProfiler::record(EVENT_PROFILE_LOCK_MISS, location.file, location.line, location.func, 0);
+      }
 #ifdef LOCK_CONTENTION_PROFILING
       m->unsuccessful_nonblocking_acquires++;
       m->nonblocking_acquires++;
@@ -365,7 +372,7 @@ Mutex_trylock_spin(
 #ifdef DEBUG
     m->srcloc    = location;
     m->handler   = ahandler;
-    m->hold_time = Thread::get_hrtime();
+    m->hold_time = EventProfiler::is_enabled() ? ink_get_hrtime_internal() : Thread::get_hrtime();
 #ifdef MAX_LOCK_TAKEN
     m->taken++;
 #endif // MAX_LOCK_TAKEN
@@ -397,6 +404,19 @@ Mutex_trylock_spin(
     m.get(), t, spincnt);
 }
 
+#ifdef DEBUG
+/// Acquire the mutex, recording the time spent waiting for it in the event profiler.
+inline void
+Mutex_acquire_profiled(const SourceLocation &location, ProxyMutex *m)
+{
+  if (!ink_mutex_try_acquire(&m->the_mutex)) {
+    ink_hrtime start = ink_get_hrtime_internal();
+    ink_mutex_acquire(&m->the_mutex);
+    EventProfiler::record(EVENT_PROFILE_LOCK_WAIT, location.file, location.line, location.func, ink_get_hrtime_internal() - start);
+  }
+}
+#endif
+
 inline int
 Mutex_lock(
 #ifdef DEBUG
@@ -406,13 +426,18 @@ Mutex_lock(
 {
   ink_assert(t != nullptr);
   if (m->thread_holding != t) {
-    ink_mutex_acquire(&m->the_mutex);
+#ifdef DEBUG
+    if (EventProfiler::is_enabled()) {
+      Mutex_acquire_profiled(location, m);
+    } else
+#endif
+      ink_mutex_acquire(&m->the_mutex);
     m->thread_holding = t;
     ink_assert(m->thread_holding);
 #ifdef DEBUG
     m->srcloc    = location;
     m->handler   = ahandler;
-    m->hold_time = Thread::get_hrtime();
+    m->hold_time = EventProfiler::is_enabled() ? ink_get_hrtime_internal() : Thread::get_hrtime();
 #ifdef MAX_LOCK_TAKEN
     m->taken++;
 #endif // MAX_LOCK_TAKEN
@@ -453,6 +478,10 @@ Mutex_unlock(ProxyMutex *m, EThread *t)
 #ifdef DEBUG
       if (Thread::get_hrtime() - m->hold_time > MAX_LOCK_TIME)
         lock_holding(m->srcloc, m->handler);
+      if (EventProfiler::is_enabled() && m->srcloc.valid()) {
+        EventProfiler::record(EVENT_PROFILE_LOCK_HOLD, m->srcloc.file, m->srcloc.line, m->srcloc.func,
+                              ink_get_hrtime_internal() - m->hold_time);
+      }
 #ifdef MAX_LOCK_TAKEN
       if (m->taken > MAX_LOCK_TAKEN)
         lock_taken(m->srcloc, m->handler);
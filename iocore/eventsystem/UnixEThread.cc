@@ -121,6 +121,9 @@ EThread::process_event(Event *e, int calling_code)
   ink_assert((!e->in_the_prot_queue && !e->in_the_priority_queue));
   MUTEX_TRY_LOCK_FOR(lock, e->mutex, this, e->continuation);
   if (!lock.is_locked()) {
+    if (EventProfiler::is_enabled()) {
+      EventProfiler::record(EVENT_PROFILE_RESCHEDULE, typeid(*e->continuation).name(), 0, nullptr, 0);
+    }
     e->timeout_at = cur_time + DELAY_FOR_RETRY;
     EventQueueExternal.enqueue_local(e);
   } else {
@@ -129,7 +132,11 @@ EThread::process_event(Event *e, int calling_code)
       return;
     }
     Continuation *c_temp = e->continuation;
-    e->continuation->handleEvent(calling_code, e);
+    if (EventProfiler::is_enabled()) {
+      EventProfiler::handle_event(e->continuation, calling_code, e);
+    } else {
+      e->continuation->handleEvent(calling_code, e);
+    }
     ink_assert(!e->in_the_priority_queue);
     ink_assert(c_temp == e->continuation);
     MUTEX_RELEASE(lock);
@@ -28,40 +28,239 @@
 #include "P_SSLConfig.h"
 #include "P_SSLUtils.h"
 
+#include "ts/TestBox.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 // Maxiumum OCSP stapling response size.
 // This should be the response for a single certificate and will typically include the responder certificate chain,
 // so 10K should be more than enough.
 #define MAX_STAPLING_DER 10240
 
-// Cached info stored in SSL_CTX ex_info
-struct certinfo {
-  unsigned char idx[20]; // Index in session cache SHA1 hash of certificate
-  OCSP_CERTID *cid;      // Certificate ID for OCSP requests or nullptr if ID cannot be determined
-  char *uri;             // Responder details
-  char *certname;
-  ink_mutex stapling_mutex;
-  unsigned char resp_der[MAX_STAPLING_DER];
-  unsigned int resp_derlen;
-  bool is_expire;
-  time_t expire_time;
+// How often the responder connections are polled while queries are in flight.
+#define OCSP_POLL_INTERVAL HRTIME_MSECONDS(10)
+
+namespace
+{
+// The response for a certificate. It is shared by all the contexts of the
+// certificate, so that a reload or a rebuilt lazy context staples right away.
+struct OCSPStaple {
+  OCSPStaple() { ink_mutex_init(&mutex); }
+  ~OCSPStaple()
+  {
+    if (cid) {
+      OCSP_CERTID_free(cid);
+    }
+    if (uri) {
+      OPENSSL_free(uri);
+    }
+    ink_mutex_destroy(&mutex);
+  }
+
+  std::string idx; // SHA1 hash of certificate
+
+  // Set with the first context of the certificate, then left alone.
+  OCSP_CERTID *cid = nullptr; // Certificate ID for OCSP requests
+  char *uri        = nullptr; // Responder details
+  std::string certname;
+
+  ink_mutex mutex;
+  std::vector<unsigned char> resp_der;
+  time_t expire_time  = 0;
+  time_t refresh_time = 0;
+  bool queued         = false;
 };
 
-void
-certinfo_free(void * /*parent*/, void *ptr, CRYPTO_EX_DATA * /*ad*/, int /*idx*/, long /*argl*/, void * /*argp*/)
+using OCSPStaplePtr = std::shared_ptr<OCSPStaple>;
+
+// The responses by certificate hash. They can be saved to a file, so that
+// a restart does not wait for the responders.
+class OCSPStapleCache
 {
-  certinfo *cinf = (certinfo *)ptr;
+public:
+  OCSPStapleCache() { ink_mutex_init(&mutex); }
+  ~OCSPStapleCache() { ink_mutex_destroy(&mutex); }
 
-  if (!cinf) {
-    return;
+  OCSPStaplePtr get(const std::string &idx);
+
+  // Queue the staples in use that are due for a refresh in @a due, the most
+  // overdue first, and forget the unused ones that expired. Returns the
+  // number of staples in use without a valid response.
+  int64_t due(time_t now, std::vector<OCSPStaplePtr> &due);
+
+  bool save(const char *path);
+  bool load(const char *path, time_t now);
+
+private:
+  ink_mutex mutex;
+  std::unordered_map<std::string, OCSPStaplePtr> staples;
+};
+
+OCSPStaplePtr
+OCSPStapleCache::get(const std::string &idx)
+{
+  ink_scoped_mutex_lock lock(mutex);
+  OCSPStaplePtr &staple = staples[idx];
+
+  if (!staple) {
+    staple      = std::make_shared<OCSPStaple>();
+    staple->idx = idx;
   }
-  if (cinf->uri) {
-    OPENSSL_free(cinf->uri);
+  return staple;
+}
+
+int64_t
+OCSPStapleCache::due(time_t now, std::vector<OCSPStaplePtr> &due)
+{
+  std::vector<std::pair<time_t, OCSPStaplePtr>> refresh;
+  int64_t stale = 0;
+
+  ink_scoped_mutex_lock lock(mutex);
+  for (auto spot = staples.begin(); spot != staples.end();) {
+    OCSPStaple *staple = spot->second.get();
+    bool unused        = spot->second.use_count() == 1;
+    bool fresh;
+
+    ink_mutex_acquire(&staple->mutex);
+    fresh = !staple->resp_der.empty() && staple->expire_time > now;
+    if (!unused && staple->cid && staple->uri && !staple->queued && staple->refresh_time <= now) {
+      staple->queued = true;
+      refresh.emplace_back(staple->refresh_time, spot->second);
+    }
+    ink_mutex_release(&staple->mutex);
+
+    if (unused && !fresh) {
+      spot = staples.erase(spot);
+      continue;
+    }
+    if (!unused && !fresh) {
+      ++stale;
+    }
+    ++spot;
   }
-  if (cinf->certname) {
-    ats_free(cinf->certname);
+
+  std::sort(refresh.begin(), refresh.end(),
+            [](const std::pair<time_t, OCSPStaplePtr> &a, const std::pair<time_t, OCSPStaplePtr> &b) { return a.first < b.first; });
+  for (auto &r : refresh) {
+    due.push_back(r.second);
   }
-  ink_mutex_destroy(&cinf->stapling_mutex);
-  OPENSSL_free(cinf);
+  return stale;
+}
+
+// The file is a magic followed by the responses: hash, expiry and refresh
+// times, length and DER of each.
+const char OCSP_CACHE_MAGIC[8] = {'T', 'S', 'O', 'C', 'S', 'P', '1', '\n'};
+
+bool
+OCSPStapleCache::save(const char *path)
+{
+  std::string tmp = std::string(path) + ".tmp";
+  FILE *fp        = fopen(tmp.c_str(), "w");
+  size_t count    = 0;
+
+  if (fp == nullptr) {
+    Warning("failed to save the OCSP responses to %s: %s", tmp.c_str(), strerror(errno));
+    return false;
+  }
+
+  fwrite(OCSP_CACHE_MAGIC, sizeof(OCSP_CACHE_MAGIC), 1, fp);
+  {
+    ink_scoped_mutex_lock lock(mutex);
+    for (auto &spot : staples) {
+      OCSPStaple *staple = spot.second.get();
+      ink_scoped_mutex_lock staple_lock(staple->mutex);
+
+      if (staple->resp_der.empty()) {
+        continue;
+      }
+      int64_t times[2] = {staple->expire_time, staple->refresh_time};
+      uint32_t len     = staple->resp_der.size();
+      fwrite(staple->idx.data(), SHA_DIGEST_LENGTH, 1, fp);
+      fwrite(times, sizeof(times), 1, fp);
+      fwrite(&len, sizeof(len), 1, fp);
+      fwrite(staple->resp_der.data(), len, 1, fp);
+      ++count;
+    }
+  }
+
+  bool ok = !ferror(fp);
+  if (fclose(fp) != 0 || !ok || rename(tmp.c_str(), path) != 0) {
+    Warning("failed to save the OCSP responses to %s: %s", path, strerror(errno));
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  Debug("ssl_ocsp", "saved %zu OCSP responses to %s", count, path);
+  return true;
+}
+
+bool
+OCSPStapleCache::load(const char *path, time_t now)
+{
+  FILE *fp     = fopen(path, "r");
+  size_t count = 0;
+  char magic[sizeof(OCSP_CACHE_MAGIC)];
+
+  if (fp == nullptr) {
+    Debug("ssl_ocsp", "no OCSP responses loaded from %s: %s", path, strerror(errno));
+    return false;
+  }
+  if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, OCSP_CACHE_MAGIC, sizeof(magic)) != 0) {
+    Warning("ignoring %s, it does not hold OCSP responses", path);
+    fclose(fp);
+    return false;
+  }
+
+  for (;;) {
+    char idx[SHA_DIGEST_LENGTH];
+    int64_t times[2];
+    uint32_t len;
+
+    if (fread(idx, sizeof(idx), 1, fp) != 1 || fread(times, sizeof(times), 1, fp) != 1 || fread(&len, sizeof(len), 1, fp) != 1 ||
+        len > MAX_STAPLING_DER) {
+      break;
+    }
+    std::vector<unsigned char> resp_der(len);
+    if (fread(resp_der.data(), len, 1, fp) != 1) {
+      break;
+    }
+    if (times[0] <= now) {
+      continue;
+    }
+
+    OCSPStaplePtr staple = get(std::string(idx, sizeof(idx)));
+    ink_scoped_mutex_lock lock(staple->mutex);
+    staple->resp_der.swap(resp_der);
+    staple->expire_time  = times[0];
+    staple->refresh_time = times[1];
+    ++count;
+  }
+  fclose(fp);
+
+  Note("loaded %zu OCSP responses from %s", count, path);
+  return true;
+}
+
+OCSPStapleCache staple_cache;
+
+} // namespace
+
+// Cached info stored in SSL_CTX ex_info
+struct certinfo {
+  OCSPStaplePtr staple;
+};
+
+void
+certinfo_free(void * /*parent*/, void *ptr, CRYPTO_EX_DATA * /*ad*/, int /*idx*/, long /*argl*/, void * /*argp*/)
+{
+  delete static_cast<certinfo *>(ptr);
 }
 
 static int ssl_stapling_index = -1;
@@ -136,134 +335,103 @@ end:
 bool
 ssl_stapling_init_cert(SSL_CTX *ctx, X509 *cert, const char *certname)
 {
-  certinfo *cinf;
   scoped_X509 issuer;
-  STACK_OF(OPENSSL_STRING) *aia = nullptr;
+  unsigned char idx[SHA_DIGEST_LENGTH];
 
   if (!cert) {
     Error("null cert passed in for %s", certname);
     return false;
   }
 
-  cinf = (certinfo *)SSL_CTX_get_ex_data(ctx, ssl_stapling_index);
-  if (cinf) {
+  if (SSL_CTX_get_ex_data(ctx, ssl_stapling_index)) {
     Note("certificate already initialized for %s", certname);
     return false;
   }
 
-  cinf = (certinfo *)OPENSSL_malloc(sizeof(certinfo));
-  if (!cinf) {
-    Error("error allocating memory for %s", certname);
-    return false;
-  }
-
-  // Initialize certinfo
-  cinf->cid         = nullptr;
-  cinf->uri         = nullptr;
-  cinf->certname    = ats_strdup(certname);
-  cinf->resp_derlen = 0;
-  ink_mutex_init(&cinf->stapling_mutex);
-  cinf->is_expire   = true;
-  cinf->expire_time = 0;
-
-  SSL_CTX_set_ex_data(ctx, ssl_stapling_index, cinf);
-
   issuer = stapling_get_issuer(ctx, cert);
   if (issuer == nullptr) {
     Note("cannot get issuer certificate from %s", certname);
     return false;
   }
 
-  cinf->cid = OCSP_cert_to_id(nullptr, cert, issuer);
-  if (!cinf->cid) {
-    return false;
+  // The saved responses are there before the first certificate asks for its own.
+  if (SSLConfigParams::ssl_ocsp_cache_filename) {
+    static bool loaded = staple_cache.load(SSLConfigParams::ssl_ocsp_cache_filename, time(nullptr));
+    (void)loaded;
   }
-  X509_digest(cert, EVP_sha1(), cinf->idx, nullptr);
 
-  aia = X509_get1_ocsp(cert);
-  if (aia) {
-    cinf->uri = sk_OPENSSL_STRING_pop(aia);
-  }
-  if (!cinf->uri) {
-    Note("no responder URI for %s", certname);
-  }
-  if (aia) {
-    X509_email_free(aia);
+  X509_digest(cert, EVP_sha1(), idx, nullptr);
+  OCSPStaplePtr staple = staple_cache.get(std::string(reinterpret_cast<char *>(idx), sizeof(idx)));
+
+  ink_mutex_acquire(&staple->mutex);
+  if (staple->cid == nullptr) {
+    staple->cid = OCSP_cert_to_id(nullptr, cert, issuer);
+    if (staple->cid == nullptr) {
+      ink_mutex_release(&staple->mutex);
+      return false;
+    }
+    staple->certname = certname;
+
+    STACK_OF(OPENSSL_STRING) *aia = X509_get1_ocsp(cert);
+    if (aia) {
+      staple->uri = sk_OPENSSL_STRING_pop(aia);
+      X509_email_free(aia);
+    }
+    if (!staple->uri) {
+      Note("no responder URI for %s", certname);
+    }
   }
+  ink_mutex_release(&staple->mutex);
+
+  SSL_CTX_set_ex_data(ctx, ssl_stapling_index, new certinfo{staple});
 
   Note("successfully initialized certinfo for %s into SSL_CTX: %p", certname, ctx);
   return true;
 }
 
-static certinfo *
-stapling_get_cert_info(SSL_CTX *ctx)
+static OCSPStaple *
+stapling_get_staple(SSL_CTX *ctx)
 {
-  certinfo *cinf;
-
-  cinf = (certinfo *)SSL_CTX_get_ex_data(ctx, ssl_stapling_index);
-  if (cinf && cinf->cid) {
-    return cinf;
-  }
+  certinfo *cinf = (certinfo *)SSL_CTX_get_ex_data(ctx, ssl_stapling_index);
 
-  return nullptr;
+  return cinf ? cinf->staple.get() : nullptr;
 }
 
-static bool
-stapling_cache_response(OCSP_RESPONSE *rsp, certinfo *cinf)
+// Refresh between half and three quarters of the lifetime of the response, so
+// that the certificates loaded together do not query their responders together
+// ever after.
+static time_t
+stapling_refresh_time(time_t now, time_t expire_time)
 {
-  unsigned char resp_der[MAX_STAPLING_DER];
-  unsigned char *p;
-  unsigned int resp_derlen;
-
-  p           = resp_der;
-  resp_derlen = i2d_OCSP_RESPONSE(rsp, &p);
-
-  if (resp_derlen == 0) {
-    Error("stapling_cache_response: cannot decode OCSP response for %s", cinf->certname);
-    return false;
-  }
-
-  if (resp_derlen > MAX_STAPLING_DER) {
-    Error("stapling_cache_response: OCSP response too big (%u bytes) for %s", resp_derlen, cinf->certname);
-    return false;
-  }
-
-  ink_mutex_acquire(&cinf->stapling_mutex);
-  memcpy(cinf->resp_der, resp_der, resp_derlen);
-  cinf->resp_derlen = resp_derlen;
-  cinf->is_expire   = false;
-  cinf->expire_time = time(nullptr) + SSLConfigParams::ssl_ocsp_cache_timeout;
-  ink_mutex_release(&cinf->stapling_mutex);
+  time_t spread = (expire_time - now) / 4;
 
-  Debug("ssl_ocsp", "stapling_cache_response: success to cache response");
-  return true;
+  return now + 2 * spread + (spread > 0 ? this_ethread()->generator.random() % spread : 0);
 }
 
-static int
-stapling_check_response(certinfo *cinf, OCSP_RESPONSE *rsp)
+// Count the certificate status of @a rsp, and get when it must be refreshed at the latest.
+static void
+stapling_check_response(OCSPStaple *staple, OCSP_RESPONSE *rsp, time_t now, time_t &next_update)
 {
-  int status, reason;
+  int status = -1, reason;
   OCSP_BASICRESP *bs = nullptr;
   ASN1_GENERALIZEDTIME *rev, *thisupd, *nextupd;
-  int response_status = OCSP_response_status(rsp);
-
-  // Check to see if response is an error.
-  // If so we automatically accept it because it would have expired from the cache if it was time to retry.
-  if (response_status != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
-    return SSL_TLSEXT_ERR_NOACK;
-  }
 
   bs = OCSP_response_get1_basic(rsp);
   if (bs == nullptr) {
     // If we can't parse response just pass it back to client
-    Error("stapling_check_response: cannot parse response for %s", cinf->certname);
-    return SSL_TLSEXT_ERR_OK;
+    Error("stapling_check_response: cannot parse response for %s", staple->certname.c_str());
+    return;
   }
-  if (!OCSP_resp_find_status(bs, cinf->cid, &status, &reason, &rev, &thisupd, &nextupd)) {
+  if (!OCSP_resp_find_status(bs, staple->cid, &status, &reason, &rev, &thisupd, &nextupd)) {
     // If ID not present just pass it back to client
-    Error("stapling_check_response: certificate ID not present in response for %s", cinf->certname);
+    Error("stapling_check_response: certificate ID not present in response for %s", staple->certname.c_str());
   } else {
+    int days, seconds;
+
     OCSP_check_validity(thisupd, nextupd, 300, -1);
+    if (nextupd && ASN1_TIME_diff(&days, &seconds, nullptr, nextupd)) {
+      next_update = now + days * 86400 + seconds;
+    }
   }
 
   switch (status) {
@@ -280,198 +448,532 @@ stapling_check_response(certinfo *cinf, OCSP_RESPONSE *rsp)
   }
 
   OCSP_BASICRESP_free(bs);
-
-  return SSL_TLSEXT_ERR_OK;
 }
 
-static OCSP_RESPONSE *
-query_responder(BIO *b, char *host, char *path, OCSP_REQUEST *req, int req_timeout)
+static bool
+stapling_cache_response(OCSP_RESPONSE *rsp, OCSPStaple *staple)
 {
-  ink_hrtime start, end;
-  OCSP_RESPONSE *resp = nullptr;
-  OCSP_REQ_CTX *ctx;
-  int rv;
-
-  start = Thread::get_hrtime();
-  end   = ink_hrtime_add(start, ink_hrtime_from_sec(req_timeout));
-
-  ctx = OCSP_sendreq_new(b, path, nullptr, -1);
-  OCSP_REQ_CTX_add1_header(ctx, "Host", host);
-  OCSP_REQ_CTX_set1_req(ctx, req);
-
-  do {
-    rv = OCSP_sendreq_nbio(&resp, ctx);
-    ink_hrtime_sleep(HRTIME_MSECONDS(1));
-  } while ((rv == -1) && BIO_should_retry(b) && (Thread::get_hrtime() < end));
-
-  OCSP_REQ_CTX_free(ctx);
+  time_t now         = time(nullptr);
+  time_t expire_time = now + SSLConfigParams::ssl_ocsp_cache_timeout;
+  unsigned char *p   = nullptr;
+  int resp_derlen;
+
+  // The responder may want it back sooner than the cache timeout.
+  stapling_check_response(staple, rsp, now, expire_time);
+  if (expire_time <= now) {
+    Error("stapling_cache_response: OCSP response already expired for %s", staple->certname.c_str());
+    return false;
+  }
 
-  if (rv) {
-    return resp;
+  resp_derlen = i2d_OCSP_RESPONSE(rsp, &p);
+  if (resp_derlen <= 0) {
+    Error("stapling_cache_response: cannot decode OCSP response for %s", staple->certname.c_str());
+    return false;
+  }
+  if (resp_derlen > MAX_STAPLING_DER) {
+    Error("stapling_cache_response: OCSP response too big (%d bytes) for %s", resp_derlen, staple->certname.c_str());
+    OPENSSL_free(p);
+    return false;
   }
 
-  return nullptr;
+  ink_mutex_acquire(&staple->mutex);
+  staple->resp_der.assign(p, p + resp_derlen);
+  staple->expire_time  = expire_time;
+  staple->refresh_time = stapling_refresh_time(now, expire_time);
+  ink_mutex_release(&staple->mutex);
+  OPENSSL_free(p);
+
+  Debug("ssl_ocsp", "stapling_cache_response: success to cache response");
+  return true;
 }
 
-static OCSP_RESPONSE *
-process_responder(OCSP_REQUEST *req, char *host, char *path, char *port, int req_timeout)
+namespace
 {
-  BIO *cbio           = nullptr;
-  OCSP_RESPONSE *resp = nullptr;
-  cbio                = BIO_new_connect(host);
-  if (!cbio) {
-    goto end;
-  }
-  if (port) {
-    BIO_set_conn_port(cbio, port);
-  }
-
-  BIO_set_nbio(cbio, 1);
-  if (BIO_do_connect(cbio) <= 0 && !BIO_should_retry(cbio)) {
-    Debug("ssl_ocsp", "process_responder: failed to connect to OCSP response server. host=%s port=%s path=%s", host, port, path);
-    goto end;
+// A query to a responder, driven by OCSP_sendreq_nbio() until it is done or times out.
+struct OCSPQuery {
+  ~OCSPQuery()
+  {
+    if (ctx) {
+      OCSP_REQ_CTX_free(ctx);
+    }
+    if (req) {
+      OCSP_REQUEST_free(req);
+    }
+    if (bio) {
+      BIO_free_all(bio);
+    }
   }
-  resp = query_responder(cbio, host, path, req, req_timeout);
 
-end:
-  if (cbio) {
-    BIO_free_all(cbio);
-  }
-  return resp;
-}
+  OCSPStaplePtr staple;
+  BIO *bio            = nullptr;
+  OCSP_REQUEST *req   = nullptr;
+  OCSP_REQ_CTX *ctx   = nullptr;
+  ink_hrtime deadline = 0;
+};
 
-static bool
-stapling_refresh_response(certinfo *cinf, OCSP_RESPONSE **prsp)
+OCSPQuery *
+query_responder(const OCSPStaplePtr &staple)
 {
-  bool rv           = true;
-  OCSP_REQUEST *req = nullptr;
-  OCSP_CERTID *id   = nullptr;
-  char *host, *path, *port;
-  int ssl_flag    = 0;
-  int req_timeout = -1;
+  OCSPQuery *query = new OCSPQuery();
+  OCSP_CERTID *id  = nullptr;
+  char *host = nullptr, *port = nullptr, *path = nullptr;
+  int ssl_flag = 0;
 
-  Debug("ssl_ocsp", "stapling_refresh_response: querying responder");
-  *prsp = nullptr;
+  Debug("ssl_ocsp", "query_responder: querying responder for %s", staple->certname.c_str());
+  query->staple = staple;
 
-  if (!OCSP_parse_url(cinf->uri, &host, &port, &path, &ssl_flag)) {
+  if (!OCSP_parse_url(staple->uri, &host, &port, &path, &ssl_flag)) {
     goto err;
   }
 
-  req = OCSP_REQUEST_new();
-  if (!req) {
+  query->req = OCSP_REQUEST_new();
+  if (!query->req) {
     goto err;
   }
-  id = OCSP_CERTID_dup(cinf->cid);
-  if (!id) {
+  id = OCSP_CERTID_dup(staple->cid);
+  if (!id || !OCSP_request_add0_id(query->req, id)) {
+    OCSP_CERTID_free(id);
     goto err;
   }
-  if (!OCSP_request_add0_id(req, id)) {
+
+  query->bio = BIO_new_connect(host);
+  if (!query->bio) {
     goto err;
   }
-
-  req_timeout = SSLConfigParams::ssl_ocsp_request_timeout;
-  *prsp       = process_responder(req, host, path, port, req_timeout);
-
-  if (*prsp == nullptr) {
-    goto done;
+  if (port) {
+    BIO_set_conn_port(query->bio, port);
+  }
+  BIO_set_nbio(query->bio, 1);
+  if (BIO_do_connect(query->bio) <= 0 && !BIO_should_retry(query->bio)) {
+    Debug("ssl_ocsp", "query_responder: failed to connect to OCSP response server. host=%s port=%s path=%s", host, port, path);
+    goto err;
   }
 
-  if (OCSP_response_status(*prsp) == OCSP_RESPONSE_STATUS_SUCCESSFUL) {
-    Debug("ssl_ocsp", "stapling_refresh_response: query response received");
-    stapling_check_response(cinf, *prsp);
-  } else {
-    // TODO: We should log the actual openssl error
-    Error("stapling_refresh_response: responder error");
+  query->ctx = OCSP_sendreq_new(query->bio, path, nullptr, -1);
+  if (!query->ctx) {
+    goto err;
   }
+  OCSP_REQ_CTX_add1_header(query->ctx, "Host", host);
+  OCSP_REQ_CTX_set1_req(query->ctx, query->req);
+  query->deadline = Thread::get_hrtime() + HRTIME_SECONDS(SSLConfigParams::ssl_ocsp_request_timeout);
 
-  if (!stapling_cache_response(*prsp, cinf)) {
-    Error("stapling_refresh_response: can not cache response");
+  OPENSSL_free(host);
+  OPENSSL_free(port);
+  OPENSSL_free(path);
+  return query;
+
+err:
+  OPENSSL_free(host);
+  OPENSSL_free(port);
+  OPENSSL_free(path);
+  delete query;
+  return nullptr;
+}
+
+// Refreshes the responses on the ET_OCSP thread. Every update period, the
+// staples that are due are queued, then at most
+// proxy.config.ssl.ocsp.max_concurrent_requests queries are in flight, polled
+// without blocking the thread.
+class OCSPScheduler : public Continuation
+{
+public:
+  OCSPScheduler() : Continuation(new_ProxyMutex()) { SET_HANDLER(&OCSPScheduler::mainEvent); }
+
+  int mainEvent(int event, Event *e);
+
+  // Queue the staples of @a due, then poll the queries in flight and start new ones. Returns the
+  // number of queries in flight.
+  size_t refresh(const std::vector<OCSPStaplePtr> &due);
+
+private:
+  void poll();
+  void finish(OCSPStaple *staple, OCSP_RESPONSE *resp);
+
+  std::deque<OCSPStaplePtr> queue;
+  std::vector<OCSPQuery *> active;
+  Event *poll_event = nullptr;
+  bool dirty        = false;
+};
+
+int
+OCSPScheduler::mainEvent(int /* event ATS_UNUSED */, Event *e)
+{
+  std::vector<OCSPStaplePtr> due;
+
+  if (e == poll_event) {
+    poll_event = nullptr;
   } else {
-    Debug("ssl_ocsp", "stapling_refresh_response: successful refresh OCSP response");
+    SSL_SET_COUNT_DYN_STAT(ssl_ocsp_stale_responses_stat, staple_cache.due(time(nullptr), due));
   }
 
-done:
-  if (req) {
-    OCSP_REQUEST_free(req);
+  if (refresh(due) > 0) {
+    if (poll_event == nullptr) {
+      poll_event = this_ethread()->schedule_in(this, OCSP_POLL_INTERVAL);
+    }
+  } else if (dirty && SSLConfigParams::ssl_ocsp_cache_filename) {
+    staple_cache.save(SSLConfigParams::ssl_ocsp_cache_filename);
+    dirty = false;
   }
-  if (*prsp) {
-    OCSP_RESPONSE_free(*prsp);
+
+  return EVENT_CONT;
+}
+
+size_t
+OCSPScheduler::refresh(const std::vector<OCSPStaplePtr> &due)
+{
+  queue.insert(queue.end(), due.begin(), due.end());
+
+  poll();
+  while (active.size() < static_cast<size_t>(SSLConfigParams::ssl_ocsp_max_concurrent_requests) && !queue.empty()) {
+    OCSPQuery *query = query_responder(queue.front());
+    if (query) {
+      active.push_back(query);
+    } else {
+      finish(queue.front().get(), nullptr);
+    }
+    queue.pop_front();
   }
-  return rv;
+  SSL_SET_COUNT_DYN_STAT(ssl_ocsp_refresh_queue_stat, queue.size() + active.size());
 
-err:
-  rv = false;
-  Error("stapling_refresh_response: failed to refresh OCSP response");
-  goto done;
+  return active.size();
 }
 
 void
-ocsp_update()
+OCSPScheduler::poll()
 {
-  SSL_CTX *ctx;
-  certinfo *cinf      = nullptr;
-  OCSP_RESPONSE *resp = nullptr;
-  time_t current_time;
+  ink_hrtime now = Thread::get_hrtime();
 
-  SSLCertificateConfig::scoped_config certLookup;
-  const unsigned ctxCount = certLookup->count();
-
-  for (unsigned i = 0; i < ctxCount; i++) {
-    SSLCertContext *cc = certLookup->get(i);
-    if (cc && cc->ctx) {
-      ctx  = cc->ctx;
-      cinf = stapling_get_cert_info(ctx);
-      if (cinf) {
-        ink_mutex_acquire(&cinf->stapling_mutex);
-        current_time = time(nullptr);
-        if (cinf->resp_derlen == 0 || cinf->is_expire || cinf->expire_time < current_time) {
-          ink_mutex_release(&cinf->stapling_mutex);
-          if (stapling_refresh_response(cinf, &resp)) {
-            Debug("Successfully refreshed OCSP for %s certificate. url=%s", cinf->certname, cinf->uri);
-            SSL_INCREMENT_DYN_STAT(ssl_ocsp_refreshed_cert_stat);
-          } else {
-            Error("Failed to refresh OCSP for %s certificate. url=%s", cinf->certname, cinf->uri);
-            SSL_INCREMENT_DYN_STAT(ssl_ocsp_refresh_cert_failure_stat);
-          }
-        } else {
-          ink_mutex_release(&cinf->stapling_mutex);
-        }
-      }
+  for (auto spot = active.begin(); spot != active.end();) {
+    OCSPQuery *query    = *spot;
+    OCSP_RESPONSE *resp = nullptr;
+    int rv              = OCSP_sendreq_nbio(&resp, query->ctx);
+
+    if (rv == -1 && BIO_should_retry(query->bio) && now < query->deadline) {
+      ++spot;
+      continue;
+    }
+    if (rv != 1) {
+      Debug("ssl_ocsp", "poll: no response from %s for %s", query->staple->uri, query->staple->certname.c_str());
     }
+    finish(query->staple.get(), rv == 1 ? resp : nullptr);
+    if (resp) {
+      OCSP_RESPONSE_free(resp);
+    }
+    delete query;
+    spot = active.erase(spot);
   }
 }
 
+void
+OCSPScheduler::finish(OCSPStaple *staple, OCSP_RESPONSE *resp)
+{
+  bool refreshed = false;
+
+  if (resp && OCSP_response_status(resp) != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+    // TODO: We should log the actual openssl error
+    Error("stapling_refresh_response: responder error");
+  } else if (resp) {
+    Debug("ssl_ocsp", "stapling_refresh_response: query response received");
+    refreshed = stapling_cache_response(resp, staple);
+  }
+
+  ink_mutex_acquire(&staple->mutex);
+  if (refreshed) {
+    Debug("ssl_ocsp", "Successfully refreshed OCSP for %s certificate. url=%s", staple->certname.c_str(), staple->uri);
+    SSL_INCREMENT_DYN_STAT(ssl_ocsp_refreshed_cert_stat);
+    dirty = true;
+  } else {
+    Error("Failed to refresh OCSP for %s certificate. url=%s", staple->certname.c_str(), staple->uri);
+    SSL_INCREMENT_DYN_STAT(ssl_ocsp_refresh_cert_failure_stat);
+    // Try again with the next update.
+    staple->refresh_time = time(nullptr) + SSLConfigParams::ssl_ocsp_update_period;
+  }
+  staple->queued = false;
+  ink_mutex_release(&staple->mutex);
+}
+
+} // namespace
+
+void
+ocsp_start(EventType type)
+{
+  OCSPScheduler *scheduler = new OCSPScheduler();
+
+  // Right away for the certificates without saved responses, then periodically.
+  eventProcessor.schedule_imm(scheduler, type);
+  eventProcessor.schedule_every(scheduler, HRTIME_SECONDS(SSLConfigParams::ssl_ocsp_update_period), type);
+}
+
 // RFC 6066 Section-8: Certificate Status Request
 int
 ssl_callback_ocsp_stapling(SSL *ssl)
 {
-  certinfo *cinf = nullptr;
+  OCSPStaple *staple = nullptr;
   time_t current_time;
 
   // Assume SSL_get_SSL_CTX() is the same as reaching into the ssl structure
   // Using the official call, to avoid leaking internal openssl knowledge
   // originally was, cinf = stapling_get_cert_info(ssl->ctx);
-  cinf = stapling_get_cert_info(SSL_get_SSL_CTX(ssl));
-  if (cinf == nullptr) {
+  staple = stapling_get_staple(SSL_get_SSL_CTX(ssl));
+  if (staple == nullptr) {
     Error("ssl_callback_ocsp_stapling: failed to get certificate information");
     return SSL_TLSEXT_ERR_NOACK;
   }
 
-  ink_mutex_acquire(&cinf->stapling_mutex);
+  ink_mutex_acquire(&staple->mutex);
   current_time = time(nullptr);
-  if (cinf->resp_derlen == 0 || cinf->is_expire || cinf->expire_time < current_time) {
-    ink_mutex_release(&cinf->stapling_mutex);
-    Debug("ssl_ocsp", "ssl_callback_ocsp_stapling: failed to get certificate status for %s", cinf->certname);
+  if (staple->resp_der.empty() || staple->expire_time < current_time) {
+    ink_mutex_release(&staple->mutex);
+    Debug("ssl_ocsp", "ssl_callback_ocsp_stapling: failed to get certificate status for %s", staple->certname.c_str());
     return SSL_TLSEXT_ERR_NOACK;
   } else {
-    unsigned char *p = (unsigned char *)OPENSSL_malloc(cinf->resp_derlen);
-    unsigned int len = cinf->resp_derlen;
-    memcpy(p, cinf->resp_der, cinf->resp_derlen);
-    ink_mutex_release(&cinf->stapling_mutex);
+    unsigned char *p = (unsigned char *)OPENSSL_malloc(staple->resp_der.size());
+    unsigned int len = staple->resp_der.size();
+    memcpy(p, staple->resp_der.data(), len);
+    ink_mutex_release(&staple->mutex);
     SSL_set_tlsext_status_ocsp_resp(ssl, p, len);
-    Debug("ssl_ocsp", "ssl_callback_ocsp_stapling: successfully got certificate status for %s", cinf->certname);
+    Debug("ssl_ocsp", "ssl_callback_ocsp_stapling: successfully got certificate status for %s", staple->certname.c_str());
     return SSL_TLSEXT_ERR_OK;
   }
 }
 
+REGRESSION_TEST(OCSPStapleCache)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  char path[] = "/tmp/ocsp_staple_cache.XXXXXX";
+  int tmp     = mkstemp(path);
+  close(tmp);
+
+  time_t now = time(nullptr);
+  std::string a(SHA_DIGEST_LENGTH, 'a'), b(SHA_DIGEST_LENGTH, 'b');
+
+  for (int i = 0; i < 100; ++i) {
+    time_t refresh = stapling_refresh_time(now, now + 3600);
+    box.check(refresh >= now + 1800 && refresh < now + 2700, "refresh in %ld seconds of a response expiring in 3600",
+              static_cast<long>(refresh - now));
+  }
+
+  {
+    OCSPStapleCache cache;
+    OCSPStaplePtr sa = cache.get(a);
+    OCSPStaplePtr sb = cache.get(b);
+    std::vector<OCSPStaplePtr> due;
+
+    box.check(cache.get(a) == sa, "the certificate contexts share their staple");
+
+    sa->resp_der.assign(100, 'x');
+    sa->expire_time  = now + 3600;
+    sa->refresh_time = now + 1800;
+    sa->cid          = OCSP_CERTID_new();
+    sa->uri          = OPENSSL_strdup("http://127.0.0.1/");
+    sb->resp_der.assign(50, 'y');
+    sb->expire_time = now - 1;
+    sb->cid         = OCSP_CERTID_new();
+    sb->uri         = OPENSSL_strdup("http://127.0.0.1/");
+
+    box.check(cache.due(now, due) == 1, "the expired response is stale");
+    box.check(due.size() == 1 && due[0] == sb && sb->queued, "the expired response is due");
+    due.clear();
+    box.check(cache.due(now, due) == 1 && due.empty(), "a queued response is not queued again");
+
+    box.check(cache.save(path), "responses saved to %s", path);
+
+    sa.reset();
+    sb.reset();
+    due.clear();
+    box.check(cache.due(now, due) == 0 && due.empty(), "unused responses are not refreshed");
+  }
+
+  {
+    OCSPStapleCache cache;
+
+    box.check(cache.load(path, now), "responses loaded from %s", path);
+    OCSPStaplePtr sa = cache.get(a);
+    OCSPStaplePtr sb = cache.get(b);
+    box.check(sa->resp_der.size() == 100 && sa->expire_time == now + 3600 && sa->refresh_time == now + 1800,
+              "the valid response is loaded");
+    box.check(sb->resp_der.empty(), "the expired response is not loaded");
+  }
+
+  unlink(path);
+}
+
+// A responder on a local port that answers the first query it gets, or only reads it.
+struct OCSPTestResponder {
+  OCSPTestResponder(OCSP_CERTID *id, const std::vector<unsigned char> &response, bool answer)
+    : cid(id), der(response), reply(answer)
+  {
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd                   = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, 1) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) != 0) {
+      return;
+    }
+    uri    = "http://127.0.0.1:" + std::to_string(ntohs(addr.sin_port)) + "/";
+    thread = std::thread([this]() { serve(); });
+  }
+
+  ~OCSPTestResponder()
+  {
+    if (thread.joinable()) {
+      thread.join();
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  void
+  serve()
+  {
+    int conn = accept(fd, nullptr, nullptr);
+    std::string request;
+    char buf[4096];
+    ssize_t n;
+
+    // Read the headers and the body of the query, or until the client goes away.
+    while ((n = read(conn, buf, sizeof(buf))) > 0) {
+      request.append(buf, n);
+      size_t body = request.find("\r\n\r\n");
+      size_t cl   = request.find("Content-Length: ");
+      if (reply && body != std::string::npos && cl != std::string::npos &&
+          request.size() >= body + 4 + strtoul(request.c_str() + cl + 16, nullptr, 10)) {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(request.data()) + body + 4;
+        OCSP_REQUEST *req      = d2i_OCSP_REQUEST(nullptr, &p, request.size() - body - 4);
+
+        valid_query = req && OCSP_request_onereq_count(req) == 1 &&
+                      OCSP_id_cmp(OCSP_onereq_get0_id(OCSP_request_onereq_get0(req, 0)), cid) == 0;
+        OCSP_REQUEST_free(req);
+
+        std::string headers = "HTTP/1.0 200 OK\r\nContent-Type: application/ocsp-response\r\nContent-Length: " +
+                              std::to_string(der.size()) + "\r\n\r\n";
+        ATS_UNUSED_RETURN(write(conn, headers.data(), headers.size()));
+        ATS_UNUSED_RETURN(write(conn, der.data(), der.size()));
+        break;
+      }
+    }
+    close(conn);
+  }
+
+  OCSP_CERTID *cid;
+  std::vector<unsigned char> der;
+  bool reply;
+  bool valid_query = false;
+  int fd           = -1;
+  std::string uri;
+  std::thread thread;
+};
+
+REGRESSION_TEST(OCSPRefresh)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // A self signed certificate, it is its own issuer.
+  EVP_PKEY *pkey     = nullptr;
+  EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+  EVP_PKEY_keygen_init(kctx);
+  EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1);
+  EVP_PKEY_keygen(kctx, &pkey);
+  EVP_PKEY_CTX_free(kctx);
+
+  X509 *cert      = X509_new();
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("ocsp.test"), -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+  X509_set_pubkey(cert, pkey);
+  X509_sign(cert, pkey, EVP_sha256());
+
+  OCSP_CERTID *cid = OCSP_cert_to_id(nullptr, cert, cert);
+
+  // A good status for two hours.
+  OCSP_BASICRESP *bs = OCSP_BASICRESP_new();
+  ASN1_TIME *thisupd = X509_gmtime_adj(nullptr, 0);
+  ASN1_TIME *nextupd = X509_gmtime_adj(nullptr, 7200);
+  OCSP_basic_add1_status(bs, cid, V_OCSP_CERTSTATUS_GOOD, 0, nullptr, thisupd, nextupd);
+  OCSP_basic_sign(bs, cert, pkey, EVP_sha256(), nullptr, 0);
+  OCSP_RESPONSE *rsp = OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL, bs);
+  unsigned char *p   = nullptr;
+  int len            = i2d_OCSP_RESPONSE(rsp, &p);
+  std::vector<unsigned char> der(p, p + std::max(len, 0));
+  OPENSSL_free(p);
+  OCSP_RESPONSE_free(rsp);
+  OCSP_BASICRESP_free(bs);
+  ASN1_TIME_free(thisupd);
+  ASN1_TIME_free(nextupd);
+
+  box.check(len > 0, "unable to build the OCSP response");
+
+  // Run the queries of @a staple to completion, as the ET_OCSP thread would.
+  auto run = [&](OCSPScheduler &scheduler, const OCSPStaplePtr &staple) {
+    ink_hrtime give_up = Thread::get_hrtime_updated() + HRTIME_SECONDS(10);
+    size_t active      = scheduler.refresh({staple});
+    while (active > 0 && Thread::get_hrtime_updated() < give_up) {
+      usleep(ink_hrtime_to_usec(OCSP_POLL_INTERVAL));
+      active = scheduler.refresh({});
+    }
+    return active == 0;
+  };
+
+  int request_timeout = SSLConfigParams::ssl_ocsp_request_timeout;
+
+  SSLConfigParams::ssl_ocsp_request_timeout = 1;
+
+  // The responder answers, the response is cached.
+  {
+    OCSPTestResponder responder(cid, der, true);
+    OCSPScheduler scheduler;
+    OCSPStaplePtr staple = std::make_shared<OCSPStaple>();
+    time_t now           = time(nullptr);
+
+    staple->cid      = OCSP_CERTID_dup(cid);
+    staple->uri      = OPENSSL_strdup(responder.uri.c_str());
+    staple->certname = "ocsp.test";
+    staple->queued   = true;
+
+    box.check(run(scheduler, staple), "the query to the responder did not complete");
+    box.check(responder.valid_query, "the responder did not get a query for the certificate");
+    box.check(staple->resp_der == der, "the response was not cached");
+    box.check(staple->expire_time > now + 7000 && staple->expire_time <= now + 7300,
+              "the response expires in %ld seconds instead of its next update", static_cast<long>(staple->expire_time - now));
+    box.check(staple->refresh_time > now && staple->refresh_time < staple->expire_time, "the refresh is not before the expiry");
+    box.check(!staple->queued, "the staple is still queued");
+  }
+
+  // The responder does not answer, the query times out and the staple is retried with the next update.
+  {
+    OCSPTestResponder responder(cid, der, false);
+    OCSPScheduler scheduler;
+    OCSPStaplePtr staple = std::make_shared<OCSPStaple>();
+    time_t now           = time(nullptr);
+
+    staple->cid      = OCSP_CERTID_dup(cid);
+    staple->uri      = OPENSSL_strdup(responder.uri.c_str());
+    staple->certname = "ocsp.test";
+    staple->queued   = true;
+
+    box.check(run(scheduler, staple), "the query to a silent responder did not time out");
+    box.check(staple->resp_der.empty(), "a response was cached from a silent responder");
+    box.check(staple->refresh_time >= now + SSLConfigParams::ssl_ocsp_update_period, "the failed refresh is not retried later");
+    box.check(!staple->queued, "the staple is still queued");
+  }
+
+  SSLConfigParams::ssl_ocsp_request_timeout = request_timeout;
+
+  OCSP_CERTID_free(cid);
+  X509_free(cert);
+  EVP_PKEY_free(pkey);
+}
+
 #endif /* HAVE_OPENSSL_OCSP_STAPLING */
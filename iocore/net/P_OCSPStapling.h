@@ -22,9 +22,11 @@
 #pragma once
 
 #include <openssl/ssl.h>
+#include "I_EventSystem.h"
 
 #define HAVE_OPENSSL_OCSP_STAPLING 1
 void ssl_stapling_ex_init();
 bool ssl_stapling_init_cert(SSL_CTX *ctx, X509 *cert, const char *certname);
-void ocsp_update();
+// Refresh the responses on the @a type threads, see OCSPScheduler.
+void ocsp_start(EventType type);
 int ssl_callback_ocsp_stapling(SSL *);
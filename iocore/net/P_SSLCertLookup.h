@@ -26,8 +26,11 @@
 #include "ProxyConfig.h"
 #include "P_SSLUtils.h"
 
+#include <vector>
+
 struct SSLConfigParams;
 struct SSLContextStorage;
+struct SSLLazyContext;
 
 struct ssl_ticket_key_t {
   unsigned char key_name[16];
@@ -60,21 +63,33 @@ struct SSLCertContext {
     OPT_TUNNEL ///< Just tunnel, don't terminate.
   };
 
-  SSLCertContext() : ctx(nullptr), opt(OPT_NONE), keyblock(nullptr) {}
-  explicit SSLCertContext(SSL_CTX *c) : ctx(c), opt(OPT_NONE), keyblock(nullptr) {}
-  SSLCertContext(SSL_CTX *c, Option o) : ctx(c), opt(o), keyblock(nullptr) {}
-  SSLCertContext(SSL_CTX *c, Option o, ssl_ticket_key_block *kb) : ctx(c), opt(o), keyblock(kb) {}
+  SSLCertContext() : ctx(nullptr), opt(OPT_NONE), keyblock(nullptr), lazy(nullptr) {}
+  explicit SSLCertContext(SSL_CTX *c) : ctx(c), opt(OPT_NONE), keyblock(nullptr), lazy(nullptr) {}
+  SSLCertContext(SSL_CTX *c, Option o) : ctx(c), opt(o), keyblock(nullptr), lazy(nullptr) {}
+  SSLCertContext(SSL_CTX *c, Option o, ssl_ticket_key_block *kb) : ctx(c), opt(o), keyblock(kb), lazy(nullptr) {}
   void release();
 
   SSL_CTX *ctx;                   ///< openSSL context.
   Option opt;                     ///< Special handling option.
   ssl_ticket_key_block *keyblock; ///< session keys associated with this address
+  SSLLazyContext *lazy;           ///< context built on first use, @a ctx is @c nullptr then.
+};
+
+/** Builds the openSSL context of a certificate when it is first used.
+
+    @see SSLCertLookup::defer
+*/
+struct SSLContextBuilder {
+  virtual ~SSLContextBuilder() {}
+  /// @return A new context, @c nullptr on error.
+  virtual SSL_CTX *build() = 0;
 };
 
 struct SSLCertLookup : public ConfigInfo {
   SSLContextStorage *ssl_storage;
   SSL_CTX *ssl_default;
   bool is_valid;
+  unsigned lazy_limit; ///< Maximum number of built deferred contexts.
 
   int insert(const char *name, SSLCertContext const &cc);
   int insert(const IpEndpoint &address, SSLCertContext const &cc);
@@ -92,6 +107,21 @@ struct SSLCertLookup : public ConfigInfo {
   */
   SSLCertContext *find(const char *name) const;
 
+  /** Make a certificate context whose openSSL context is built by @a builder on its first use.
+      The lookup owns @a builder. The result is inserted like any other certificate context.
+  */
+  SSLCertContext defer(SSLContextBuilder *builder, SSLCertContext::Option opt);
+
+  /** Get the openSSL context of @a cc, building it if it is deferred.
+      At most @a lazy_limit deferred contexts are kept built, the least recently used are released past that.
+      @return A context the caller holds a reference on and must release with @c SSLReleaseContext,
+      @c nullptr if there is none or it failed to build.
+  */
+  SSL_CTX *acquireContext(const SSLCertContext *cc) const;
+
+  /// Append the deferred contexts that are currently built to @a contexts, each with a reference for the caller.
+  void lazyContexts(std::vector<SSL_CTX *> &contexts) const;
+
   // Return the last-resort default TLS context if there is no name or address match.
   SSL_CTX *
   defaultContext() const
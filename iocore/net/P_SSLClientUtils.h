@@ -22,12 +22,17 @@
 #pragma once
 
 #include "ts/ink_config.h"
+#include "ts/ink_mutex.h"
 #include "ts/Diags.h"
 #include "P_SSLUtils.h"
 #include "P_SSLConfig.h"
 
 #include <openssl/ssl.h>
 
+#include <list>
+#include <string>
+#include <unordered_map>
+
 // BoringSSL does not have this include file
 #ifndef OPENSSL_IS_BORINGSSL
 #include <openssl/opensslconf.h>
@@ -37,3 +42,51 @@
 SSL_CTX *SSLInitClientContext(const struct SSLConfigParams *param);
 
 int verify_callback(int preverify_ok, X509_STORE_CTX *ctx);
+
+/**
+  The TLS sessions of the origin servers.
+
+  The last session negotiated with an origin is kept under its server name,
+  address and verification mode, and offered on the next connection to it
+  so the server can resume it instead of doing a full handshake. A session
+  is only offered to a connection made with the client context it was
+  negotiated with. The cache is split in shards, each with its own lock and
+  least recently used list.
+*/
+class SSLOriginSessionCache
+{
+public:
+  explicit SSLOriginSessionCache(size_t capacity);
+  ~SSLOriginSessionCache();
+
+  /// Returns a new reference to the session of @a key, nullptr if it has none usable with @a ctx at @a now.
+  SSL_SESSION *get(const std::string &key, const SSL_CTX *ctx, time_t now);
+  /// Keep @a session for @a key, taking over its reference.
+  void put(const std::string &key, const SSL_CTX *ctx, SSL_SESSION *session);
+  void remove(const std::string &key);
+
+private:
+  static const unsigned SHARDS = 16;
+
+  struct Entry {
+    std::string key;
+    const SSL_CTX *ctx;
+    SSL_SESSION *session;
+  };
+
+  struct Shard {
+    ink_mutex mutex;
+    std::list<Entry> entries; // the most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  };
+
+  Shard &shard(const std::string &key);
+
+  Shard shards[SHARDS];
+  size_t shard_capacity;
+};
+
+extern SSLOriginSessionCache *origin_sess_cache;
+
+// Offer the client session @a ssl the cached session of the origin it connects to.
+void SSLOriginSessionResume(SSL *ssl);
@@ -36,6 +36,13 @@
 #include <openssl/rand.h>
 #include "P_SSLCertLookup.h"
 
+// Kernel TLS offload, OpenSSL 3.0 and later built with kTLS support.
+#if defined(SSL_OP_ENABLE_KTLS) && defined(BIO_get_ktls_send)
+#define TS_USE_KTLS 1
+#else
+#define TS_USE_KTLS 0
+#endif
+
 struct SSLCertLookup;
 struct ssl_ticket_key_block;
 /////////////////////////////////////////////////////////////
@@ -69,6 +76,7 @@ struct SSLConfigParams : public ConfigInfo {
   char *cipherSuite;
   char *client_cipherSuite;
   int configExitOnLoadError;
+  int lazy_context_limit;
   int clientCertLevel;
   int verify_depth;
   int ssl_session_cache; // SSL_SESSION_CACHE_MODE
@@ -88,12 +96,15 @@ struct SSLConfigParams : public ConfigInfo {
   long ssl_client_ctx_options;
 
   static int ssl_maxrecord;
+  static int ssl_write_batch_size;
   static bool ssl_allow_client_renegotiation;
 
   static bool ssl_ocsp_enabled;
   static int ssl_ocsp_cache_timeout;
   static int ssl_ocsp_request_timeout;
   static int ssl_ocsp_update_period;
+  static int ssl_ocsp_max_concurrent_requests;
+  static char *ssl_ocsp_cache_filename;
   static int ssl_handshake_timeout_in;
 
   static size_t session_cache_number_buckets;
@@ -114,6 +125,16 @@ struct SSLConfigParams : public ConfigInfo {
   static int async_handshake_enabled;
   static char *engine_conf_file;
 
+  static int ktls_enabled;
+  static int crypto_offload_threads;
+
+  static int server_max_early_data;
+  static int early_data_replay_window;
+  static int early_data_replay_cache_size;
+
+  static int origin_session_cache;
+  static int origin_session_cache_size;
+
   SSL_CTX *client_ctx;
 
   mutable HashMap<cchar *, class StringHashFns, SSL_CTX *> ctx_map;
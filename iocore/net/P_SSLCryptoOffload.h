@@ -0,0 +1,46 @@
+/** @file
+
+  Private key operations of the TLS handshakes on a dedicated thread group.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#pragma once
+
+#include <openssl/ssl.h>
+
+// The server handshakes run in OpenSSL async jobs, and the RSA and ECDSA
+// private keys get a method that hands their operations to the
+// ET_SSL_CRYPTO threads, then pauses the job. The thread signals the wait
+// fd of the job when it is done, which wakes the SSLNetVConnection up
+// through its signalep, as with an async engine.
+
+// Start the ET_SSL_CRYPTO threads, if proxy.config.ssl.crypto_offload.threads is set.
+void SSLCryptoOffloadInitialize(size_t stacksize);
+
+// True if the handshakes must run in async jobs for the offload.
+bool SSLCryptoOffloadEnabled();
+
+// Replace the private key of @a ctx by one whose operations are offloaded.
+// Keys of other types are left alone. Returns false on error.
+bool SSLCryptoOffloadKey(SSL_CTX *ctx);
+
+// Finish the handshake of @a ssl if it is paused on an offloaded operation, before it is freed.
+// The handshake fails, this releases the OpenSSL job and the operation.
+void SSLCryptoOffloadCancel(SSL *ssl);
@@ -0,0 +1,45 @@
+/** @file
+
+  TLS 1.3 early data and its replay protection.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#pragma once
+
+#include <openssl/ssl.h>
+
+#if defined(SSL_READ_EARLY_DATA_SUCCESS) && !defined(OPENSSL_IS_BORINGSSL)
+#define TS_HAS_TLS_EARLY_DATA 1
+#else
+#define TS_HAS_TLS_EARLY_DATA 0
+#endif
+
+// Early data is accepted on resumed sessions whose ClientHello was not seen
+// before. OpenSSL refuses ClientHellos whose ticket age is off by more than
+// 10 seconds, so a replay has to come within that time of the original, and
+// the ClientHello randoms are remembered for proxy.config.ssl.server.early_data.replay_window
+// seconds in bloom filters. The filters are sharded by the random, each shard
+// with its own lock, so the threads rarely contend for one.
+
+// Set up the replay filter, if proxy.config.ssl.server.max_early_data is set.
+void SSLEarlyDataInitialize();
+
+// Let the server session @a ssl accept early data. Returns false if it is disabled.
+bool SSLEarlyDataEnable(SSL *ssl);
@@ -41,6 +41,7 @@
 #include "P_EventSystem.h"
 #include "P_UnixNetVConnection.h"
 #include "P_UnixNet.h"
+#include "P_SSLUtils.h"
 
 // These are included here because older OpenSSL libraries don't have them.
 // Don't copy these defines, or use their values directly, they are merely
@@ -68,6 +69,7 @@
 
 class SSLNextProtocolSet;
 class SSLNextProtocolAccept;
+class RegressionTest;
 struct SSLCertLookup;
 
 typedef enum {
@@ -124,6 +126,28 @@ public:
     return sslSessionCacheHit;
   }
 
+  /// The kernel encrypts the data sent on this connection.
+  bool
+  getSSLKTLSSend() const
+  {
+    return sslKTLSSend;
+  }
+
+  /// Bytes of TLS 1.3 early data received on this connection.
+  int64_t
+  getSSLEarlyDataLength() const
+  {
+    return sslEarlyDataLength;
+  }
+
+  /// True while the client did not finish the handshake of a connection
+  /// that sent early data. The requests read until then may be replays.
+  bool
+  getSSLEarlyData() const
+  {
+    return sslEarlyDataLength > 0 && ssl && !SSL_is_init_finished(ssl);
+  }
+
   int sslServerHandShakeEvent(int &err);
   int sslClientHandShakeEvent(int &err);
   void net_read_io(NetHandler *nh, EThread *lthread) override;
@@ -190,6 +214,9 @@ public:
 
   int64_t read_raw_data();
 
+  /// Read application data, starting with the early data received during the handshake.
+  ssl_error_t read_app_data(void *buf, int64_t nbytes, int64_t &nread);
+
   void
   initialize_handshake_buffers()
   {
@@ -199,6 +226,19 @@ public:
     this->handShakeBioStored = 0;
   }
 
+  void
+  free_early_data_buffer()
+  {
+    if (this->earlyDataReader) {
+      this->earlyDataReader->dealloc();
+    }
+    if (this->earlyDataBuffer) {
+      free_MIOBuffer(this->earlyDataBuffer);
+    }
+    this->earlyDataReader = nullptr;
+    this->earlyDataBuffer = nullptr;
+  }
+
   void
   free_handshake_buffers()
   {
@@ -318,17 +358,41 @@ public:
   SSLNetVConnection &operator=(const SSLNetVConnection &) = delete;
 
 private:
+  friend void RegressionTest_SSLWriteBatch(RegressionTest *, int, int *);
+
   ts::string_view map_tls_protocol_to_tag(const char *proto_string) const;
   bool update_rbio(bool move_to_socket);
+  void check_ktls();
+  void adopt_ktls();
+  int64_t tls_record_size(int64_t l);
+  void trace_write(const char *data, int64_t len);
+  int64_t load_buffer_and_write_batch(int64_t towrite, MIOBufferAccessor &buf, int64_t &total_written, ssl_error_t &err);
+  ssl_error_t accept_early_data();
+  ssl_error_t read_early_data(void *buf, int64_t nbytes, int64_t &nread);
 
   bool sslHandShakeComplete        = false;
   bool sslClientRenegotiationAbort = false;
   bool sslSessionCacheHit          = false;
+  bool sslKTLSSend                 = false;
+  bool sslKTLSChecked              = false;
+  // With proxy.config.ssl.write_batch_size the records gather in sslWriteBatch. The first
+  // sslWriteUnflushed bytes of the write buffer are encrypted and still in there, and
+  // OpenSSL wants the next record of sslWriteRetry bytes written again, if it is set.
+  BIO *sslWriteBatch               = nullptr;
+  int64_t sslWriteUnflushed        = 0;
+  int64_t sslWriteRetry            = 0;
   MIOBuffer *handShakeBuffer       = nullptr;
   IOBufferReader *handShakeHolder  = nullptr;
   IOBufferReader *handShakeReader  = nullptr;
   int handShakeBioStored           = 0;
 
+  // The client sends TLS 1.3 early data until sslEarlyDataReading is cleared,
+  // what arrived with the handshake waits in earlyDataBuffer.
+  bool sslEarlyDataReading        = false;
+  int64_t sslEarlyDataLength      = 0;
+  MIOBuffer *earlyDataBuffer      = nullptr;
+  IOBufferReader *earlyDataReader = nullptr;
+
   bool transparentPassThrough = false;
 
   /// The current hook.
@@ -33,6 +33,12 @@
 #endif
 #include <openssl/ssl.h>
 
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(OPENSSL_IS_BORINGSSL)
+#define TS_HAS_SSL_WRITE_BATCH 1
+#else
+#define TS_HAS_SSL_WRITE_BATCH 0
+#endif
+
 struct SSLConfigParams;
 struct SSLCertLookup;
 class SSLNetVConnection;
@@ -95,6 +101,30 @@ enum SSL_Stats {
   ssl_ocsp_unknown_cert_stat,
   ssl_ocsp_refreshed_cert_stat,
   ssl_ocsp_refresh_cert_failure_stat,
+  ssl_ocsp_stale_responses_stat,
+  ssl_ocsp_refresh_queue_stat,
+
+  /* kernel TLS stats */
+  ssl_ktls_sessions_stat,
+  ssl_ktls_fallback_stat,
+
+  /* contexts built on their first handshake */
+  ssl_lazy_contexts_built_stat,
+
+  /* TLS 1.3 early data stats */
+  ssl_early_data_accepted_stat,
+  ssl_early_data_rejected_stat,
+  ssl_early_data_replayed_stat,
+  ssl_early_data_accepted_bytes_stat,
+
+  /* origin session resumption stats */
+  ssl_origin_session_cache_hit,
+  ssl_origin_session_cache_miss,
+  ssl_origin_session_reused,
+
+  /* batched record writes */
+  ssl_write_batch_records_stat,
+  ssl_write_batch_writes_stat,
 
   ssl_cipher_stats_start = 100,
   ssl_cipher_stats_end   = 300,
@@ -103,6 +133,7 @@ enum SSL_Stats {
 };
 
 extern RecRawStatBlock *ssl_rsb;
+extern RecHistogram *ssl_handshake_time_histogram;
 
 /* Stats should only be accessed using these macros */
 #define SSL_INCREMENT_DYN_STAT(x) RecIncrRawStat(ssl_rsb, nullptr, (int)x, 1)
@@ -135,10 +166,20 @@ void SSLInitializeStatistics();
 void SSLReleaseContext(SSL_CTX *ctx);
 
 // Wrapper functions to SSL I/O routines
-ssl_error_t SSLWriteBuffer(SSL *ssl, const void *buf, int64_t nbytes, int64_t &nwritten);
+ssl_error_t SSLWriteBuffer(SSL *ssl, const void *buf, int64_t nbytes, int64_t &nwritten, bool flush = true);
 ssl_error_t SSLReadBuffer(SSL *ssl, void *buf, int64_t nbytes, int64_t &nread);
 ssl_error_t SSLAccept(SSL *ssl);
+// Early data of a TLS 1.3 handshake. SSLReadEarlyData sets @a finish when the client
+// sent all of it, the handshake and the reads go on with SSLAccept and SSLReadBuffer.
+ssl_error_t SSLReadEarlyData(SSL *ssl, void *buf, int64_t nbytes, int64_t &nread, bool &finish);
+ssl_error_t SSLWriteEarlyData(SSL *ssl, const void *buf, int64_t nbytes, int64_t &nwritten);
 ssl_error_t SSLConnect(SSL *ssl);
+// Put a buffer of @a size bytes in front of the socket of @a ssl. The records of the
+// writes that do not flush gather in it and go out together when the returned BIO is
+// flushed or full. Returns nullptr if OpenSSL is too old for this. An SSL keeps the
+// buffer when it moves to another SSLNetVConnection, SSLWriteBatchGet returns it then.
+BIO *SSLWriteBatchEnable(SSL *ssl, int size);
+BIO *SSLWriteBatchGet(SSL *ssl);
 
 // Log an SSL error.
 #define SSLError(fmt, ...) SSLDiagnostic(MakeSourceLocation(), false, nullptr, fmt, ##__VA_ARGS__)
@@ -30,9 +30,11 @@
 #include "ts/I_Layout.h"
 #include "ts/MatcherUtils.h"
 #include "ts/Regex.h"
-#include "ts/Trie.h"
 #include "ts/TestBox.h"
 
+#include <algorithm>
+#include <string>
+
 // Check if the ticket_key callback #define is available, and if so, enable session tickets.
 #ifdef SSL_CTX_set_tlsext_ticket_key_cb
 
@@ -40,6 +42,10 @@
 
 #endif /* SSL_CTX_set_tlsext_ticket_key_cb */
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define SSL_CTX_up_ref(ctx) CRYPTO_add(&(ctx)->references, 1, CRYPTO_LOCK_SSL_CTX)
+#endif
+
 struct SSLAddressLookupKey {
   explicit SSLAddressLookupKey(const IpEndpoint &ip) : sep(0)
   {
@@ -84,6 +90,66 @@ private:
   unsigned char sep; // offset of address/port separator
 };
 
+/** A trie of the host names on their labels, from the last one.
+
+    "www.example.com" is the path "com", "example", "www" from the root. A node holds the context
+    index of the name that ends there, and the one of the wildcard matching a single label below it.
+    The edges of all the nodes live in one open addressing table keyed by the parent node and the
+    label, and the labels are packed in one string pool, so there is no allocation per name.
+*/
+class SSLNameTrie
+{
+public:
+  SSLNameTrie() : nodes(1), edges(1024), edge_count(0) {}
+
+  /// Get the index slot of the exact @a name, or of the wildcard below it. @a name must be in lower case.
+  int &slot(const char *name, bool wildcard);
+
+  /// Find the index of @a name, in any case. Exact names are preferred to wildcards.
+  /// @return The index, -1 if no name matches.
+  int lookup(const char *name) const;
+
+private:
+  struct Node {
+    Node() : exact(-1), wildcard(-1) {}
+    int exact;    ///< Index of the name ending at this node.
+    int wildcard; ///< Index of the wildcard of the labels below this node.
+  };
+
+  struct Edge {
+    uint32_t parent;
+    uint32_t child; ///< 0 for a free slot, the root is nobody's child.
+    uint32_t hash;
+    uint32_t label; ///< Offset in the pool.
+    uint16_t len;
+  };
+
+  static uint32_t hash(uint32_t parent, const char *label, size_t len);
+  uint32_t child(uint32_t parent, const char *label, size_t len) const;
+  uint32_t add(uint32_t parent, const char *label, size_t len);
+  void grow();
+
+  std::vector<Node> nodes;
+  std::vector<Edge> edges; ///< Power of 2 sized.
+  size_t edge_count;
+  std::string pool;
+};
+
+/// A context built on its first use, see SSLCertLookup::defer.
+struct SSLLazyContext {
+  explicit SSLLazyContext(SSLContextBuilder *b) : builder(b), ctx(nullptr), failed(false) {}
+  ~SSLLazyContext()
+  {
+    SSLReleaseContext(ctx);
+    delete builder;
+  }
+
+  SSLContextBuilder *builder;
+  SSL_CTX *ctx; ///< The built context, @c nullptr until it is used or after it is evicted.
+  bool failed;  ///< Don't retry a context that failed to build before the next reload.
+  LINK(SSLLazyContext, link);
+};
+
 struct SSLContextStorage {
 public:
   SSLContextStorage();
@@ -100,8 +166,6 @@ public:
   /// @return @a idx
   int insert(const char *name, int idx);
   SSLCertContext *lookup(const char *name) const;
-  void printWildDomains() const;
-  void freeWildDomains() const;
   unsigned
   count() const
   {
@@ -113,31 +177,22 @@ public:
     return &this->ctx_store[i];
   }
 
-private:
-  /** A struct that can be stored a @c Trie.
-      It contains the index of the real certificate and the
-      linkage required by @c Trie.
-  */
-  struct ContextRef {
-    ContextRef() : idx(-1) {}
-    explicit ContextRef(int n) : idx(n) {}
-    void
-    Print() const
-    {
-      Debug("ssl", "Item=%p SSL_CTX=#%d", this, idx);
-    }
-    int idx;                ///< Index in the context store.
-    LINK(ContextRef, link); ///< Require by @c Trie
-  };
+  SSLLazyContext *defer(SSLContextBuilder *builder);
+  /// Build @a lazy if needed and get a reference on its context, keeping at most @a limit built.
+  SSL_CTX *acquire(SSLLazyContext *lazy, unsigned limit);
+  void built(std::vector<SSL_CTX *> &contexts);
 
-  /// We can only match one layer with the wildcards
-  /// This table stores the wildcarded subdomain
-  mutable HashMap<cchar *, StringHashFns, int> wilddomains;
+private:
   /// Contexts stored by IP address or FQDN
-  InkHashTable *hostnames;
+  SSLNameTrie names;
   /// List for cleanup.
   /// Exactly one pointer to each SSL context is stored here.
   Vec<SSLCertContext> ctx_store;
+  /// Deferred contexts, and the built ones from the most recently used.
+  Vec<SSLLazyContext *> lazy_store;
+  Queue<SSLLazyContext> lru;
+  unsigned lru_length;
+  ink_mutex lru_mutex;
 
   /// Add a context to the clean up list.
   /// @return The index of the added context.
@@ -245,7 +300,7 @@ SSLCertContext::release()
   ctx = nullptr;
 }
 
-SSLCertLookup::SSLCertLookup() : ssl_storage(new SSLContextStorage()), ssl_default(nullptr), is_valid(true) {}
+SSLCertLookup::SSLCertLookup() : ssl_storage(new SSLContextStorage()), ssl_default(nullptr), is_valid(true), lazy_limit(0) {}
 
 SSLCertLookup::~SSLCertLookup()
 {
@@ -278,6 +333,32 @@ SSLCertLookup::find(const IpEndpoint &address) const
   return nullptr;
 }
 
+SSLCertContext
+SSLCertLookup::defer(SSLContextBuilder *builder, SSLCertContext::Option opt)
+{
+  SSLCertContext cc(nullptr, opt);
+  cc.lazy = this->ssl_storage->defer(builder);
+  return cc;
+}
+
+SSL_CTX *
+SSLCertLookup::acquireContext(const SSLCertContext *cc) const
+{
+  if (cc->lazy) {
+    return this->ssl_storage->acquire(cc->lazy, this->lazy_limit);
+  }
+  if (cc->ctx) {
+    SSL_CTX_up_ref(cc->ctx);
+  }
+  return cc->ctx;
+}
+
+void
+SSLCertLookup::lazyContexts(std::vector<SSL_CTX *> &contexts) const
+{
+  this->ssl_storage->built(contexts);
+}
+
 int
 SSLCertLookup::insert(const char *name, SSLCertContext const &cc)
 {
@@ -349,31 +430,167 @@ reverse_dns_name(const char *hostname, char (&reversed)[TS_MAX_HOST_NAME_LEN + 1
   return ptr;
 }
 
-SSLContextStorage::SSLContextStorage() : wilddomains(-1), hostnames(ink_hash_table_create(InkHashTableKeyType_String)) {}
+uint32_t
+SSLNameTrie::hash(uint32_t parent, const char *label, size_t len)
+{
+  // FNV-1a on the label in lower case, seeded by the parent.
+  uint32_t h = (2166136261U ^ parent) * 16777619U;
+  for (size_t i = 0; i < len; ++i) {
+    h = (h ^ static_cast<unsigned char>(ParseRules::ink_tolower(label[i]))) * 16777619U;
+  }
+  return h;
+}
+
+uint32_t
+SSLNameTrie::child(uint32_t parent, const char *label, size_t len) const
+{
+  uint32_t h  = hash(parent, label, len);
+  size_t mask = this->edges.size() - 1;
+
+  for (size_t i = h & mask;; i = (i + 1) & mask) {
+    const Edge &e = this->edges[i];
+    if (e.child == 0) {
+      return 0;
+    }
+    if (e.hash == h && e.parent == parent && e.len == len) {
+      const char *stored = this->pool.data() + e.label;
+      size_t n           = 0;
+      while (n < len && stored[n] == ParseRules::ink_tolower(label[n])) {
+        ++n;
+      }
+      if (n == len) {
+        return e.child;
+      }
+    }
+  }
+}
+
+uint32_t
+SSLNameTrie::add(uint32_t parent, const char *label, size_t len)
+{
+  uint32_t node = this->child(parent, label, len);
+  if (node) {
+    return node;
+  }
+
+  if ((this->edge_count + 1) * 4 > this->edges.size() * 3) {
+    this->grow();
+  }
+
+  uint32_t h  = hash(parent, label, len);
+  size_t mask = this->edges.size() - 1;
+  size_t i    = h & mask;
+  while (this->edges[i].child) {
+    i = (i + 1) & mask;
+  }
+
+  node = this->nodes.size();
+  this->nodes.emplace_back();
+  this->edges[i] = {parent, node, h, static_cast<uint32_t>(this->pool.size()), static_cast<uint16_t>(len)};
+  this->pool.append(label, len);
+  ++this->edge_count;
+  return node;
+}
+
+void
+SSLNameTrie::grow()
+{
+  std::vector<Edge> old(this->edges.size() * 2);
+  old.swap(this->edges);
+
+  size_t mask = this->edges.size() - 1;
+  for (const Edge &e : old) {
+    if (e.child) {
+      size_t i = e.hash & mask;
+      while (this->edges[i].child) {
+        i = (i + 1) & mask;
+      }
+      this->edges[i] = e;
+    }
+  }
+}
+
+int &
+SSLNameTrie::slot(const char *name, bool wildcard)
+{
+  uint32_t node   = 0;
+  const char *end = name + strlen(name);
+
+  // Walk the labels from the last one, each ends at @a end.
+  for (;;) {
+    const char *label = end;
+    while (label > name && label[-1] != '.') {
+      --label;
+    }
+    node = this->add(node, label, end - label);
+    if (label == name) {
+      break;
+    }
+    end = label - 1;
+  }
+
+  Node &n = this->nodes[node];
+  return wildcard ? n.wildcard : n.exact;
+}
+
+int
+SSLNameTrie::lookup(const char *name) const
+{
+  uint32_t node   = 0;
+  const char *end = name + strlen(name);
+
+  for (;;) {
+    const char *label = end;
+    while (label > name && label[-1] != '.') {
+      --label;
+    }
+    uint32_t next = this->child(node, label, end - label);
+
+    if (label == name) {
+      // This is the first label, so @a node is the parent domain that a wildcard would be on. A name
+      // without a dot has no parent domain.
+      if (next && this->nodes[next].exact >= 0) {
+        return this->nodes[next].exact;
+      }
+      return node ? this->nodes[node].wildcard : -1;
+    }
+    if (next == 0) {
+      return -1;
+    }
+    node = next;
+    end  = label - 1;
+  }
+}
 
-bool
-SSLCtxCompare(SSLCertContext const &cc1, SSLCertContext const &cc2)
+SSLContextStorage::SSLContextStorage() : lru_length(0)
 {
-  // Either they are both real ctx pointers and cc1 has the smaller pointer
-  // Or only cc2 has a non-null pointer
-  return cc1.ctx < cc2.ctx;
+  ink_mutex_init(&this->lru_mutex);
 }
 
 SSLContextStorage::~SSLContextStorage()
 {
-  // First sort the array so we can efficiently detect duplicates
-  // and avoid the double free
-  this->ctx_store.qsort(SSLCtxCompare);
-  SSL_CTX *last_ctx = nullptr;
+  // First sort the contexts so we can efficiently detect duplicates
+  // and avoid the double free. The deferred ones have none, and many
+  // equal keys would make the sort quadratic.
+  std::vector<SSLCertContext *> built;
   for (unsigned i = 0; i < this->ctx_store.length(); ++i) {
-    if (this->ctx_store[i].ctx != last_ctx) {
-      last_ctx = this->ctx_store[i].ctx;
-      this->ctx_store[i].release();
+    if (this->ctx_store[i].ctx) {
+      built.push_back(&this->ctx_store[i]);
+    }
+  }
+  std::sort(built.begin(), built.end(), [](SSLCertContext *cc1, SSLCertContext *cc2) { return cc1->ctx < cc2->ctx; });
+  SSL_CTX *last_ctx = nullptr;
+  for (auto cc : built) {
+    if (cc->ctx != last_ctx) {
+      last_ctx = cc->ctx;
+      cc->release();
     }
   }
 
-  ink_hash_table_destroy(this->hostnames);
-  freeWildDomains();
+  for (unsigned i = 0; i < this->lazy_store.length(); ++i) {
+    delete this->lazy_store[i];
+  }
+  ink_mutex_destroy(&this->lru_mutex);
 }
 
 int
@@ -398,8 +615,8 @@ SSLContextStorage::insert(const char *name, SSLCertContext const &cc)
 int
 SSLContextStorage::insert(const char *name, int idx)
 {
-  ats_wildcard_matcher wildcard;
-  InkHashTableValue value;
+  // Compiling the regex takes longer than indexing the name.
+  static const ats_wildcard_matcher wildcard;
   char lower_case_name[TS_MAX_HOST_NAME_LEN + 1];
   make_to_lower_case(name, lower_case_name, sizeof(lower_case_name));
   if (wildcard.match(lower_case_name)) {
@@ -411,74 +628,109 @@ SSLContextStorage::insert(const char *name, int idx)
       subdomain = nullptr;
     }
     if (subdomain) {
-      auto index = this->wilddomains.get(subdomain);
+      int &index = this->names.slot(subdomain, true);
       if (index != -1) {
         Debug("ssl", "previously indexed '%s' with SSL_CTX #%d, cannot index it with SSL_CTX #%d now", lower_case_name, index, idx);
         idx = -1;
       } else {
-        this->wilddomains.put(ats_strdup(subdomain), idx);
+        index = idx;
         Debug("ssl", "indexed '%s' with SSL_CTX %p [%d]", lower_case_name, this->ctx_store[idx].ctx, idx);
       }
     }
   } else {
-    if (ink_hash_table_lookup(this->hostnames, lower_case_name, &value) && reinterpret_cast<InkHashTableValue>(idx) != value) {
-      Debug("ssl", "previously indexed '%s' with SSL_CTX %p, cannot index it with SSL_CTX #%d now", lower_case_name, value, idx);
+    int &index = this->names.slot(lower_case_name, false);
+    if (index != -1 && index != idx) {
+      Debug("ssl", "previously indexed '%s' with SSL_CTX #%d, cannot index it with SSL_CTX #%d now", lower_case_name, index, idx);
       idx = -1;
     } else {
-      ink_hash_table_insert(this->hostnames, lower_case_name, reinterpret_cast<void *>(static_cast<intptr_t>(idx)));
+      index = idx;
       Debug("ssl", "indexed '%s' with SSL_CTX %p [%d]", lower_case_name, this->ctx_store[idx].ctx, idx);
     }
   }
   return idx;
 }
 
-void
-SSLContextStorage::printWildDomains() const
+SSLCertContext *
+SSLContextStorage::lookup(const char *name) const
 {
-  Vec<cchar *> keys;
-  this->wilddomains.get_keys(keys);
-  for (size_t i = 0; i < keys.length(); i++) {
-    Debug("ssl", "Stored wilddomain %s", keys.get(i));
-  }
+  int idx = this->names.lookup(name);
+  return idx >= 0 ? &this->ctx_store[idx] : nullptr;
 }
 
-void
-SSLContextStorage::freeWildDomains() const
+SSLLazyContext *
+SSLContextStorage::defer(SSLContextBuilder *builder)
 {
-  Vec<cchar *> keys;
-  this->wilddomains.get_keys(keys);
-  size_t n = keys.length();
-  for (size_t i = 0; i < n; i++) {
-    ats_free((char *)keys.get(i));
-  }
-  this->wilddomains.clear();
+  SSLLazyContext *lazy = new SSLLazyContext(builder);
+  this->lazy_store.add(lazy);
+  return lazy;
 }
 
-SSLCertContext *
-SSLContextStorage::lookup(const char *name) const
+SSL_CTX *
+SSLContextStorage::acquire(SSLLazyContext *lazy, unsigned limit)
 {
-  InkHashTableValue value;
-  // First look for an exact name match
-  if (ink_hash_table_lookup(const_cast<InkHashTable *>(this->hostnames), name, &value)) {
-    return &(this->ctx_store[reinterpret_cast<intptr_t>(value)]);
+  SSL_CTX *ctx = nullptr;
+
+  ink_mutex_acquire(&this->lru_mutex);
+  if (lazy->ctx) {
+    this->lru.remove(lazy);
+    this->lru.push(lazy);
+    ctx = lazy->ctx;
+    SSL_CTX_up_ref(ctx);
   }
-  // Try lower casing it
-  char lower_case_name[TS_MAX_HOST_NAME_LEN + 1];
-  make_to_lower_case(name, lower_case_name, sizeof(lower_case_name));
-  if (ink_hash_table_lookup(const_cast<InkHashTable *>(this->hostnames), lower_case_name, &value)) {
-    return &(this->ctx_store[reinterpret_cast<intptr_t>(value)]);
+  bool failed = lazy->failed;
+  ink_mutex_release(&this->lru_mutex);
+
+  if (ctx || failed) {
+    return ctx;
   }
 
-  // Then strip off the top domain name and look for a wildcard domain match
-  const char *subdomain = index(lower_case_name, '.');
-  if (subdomain) {
-    ++subdomain; // Move beyond the '.'
-    auto index = this->wilddomains.get(subdomain);
-    if (index >= 0) {
-      return &(this->ctx_store[index]);
-    }
+  // Build outside of the lock, so that the handshakes of the other certificates don't wait for it. If
+  // another thread builds the same context meanwhile, the first one to finish wins.
+  SSL_CTX *built = lazy->builder->build();
+  std::vector<SSL_CTX *> evicted;
+
+  ink_mutex_acquire(&this->lru_mutex);
+  if (lazy->ctx) {
+    ctx = lazy->ctx;
+    this->lru.remove(lazy);
+  } else if (built) {
+    ctx       = built;
+    built     = nullptr;
+    lazy->ctx = ctx;
+    ++this->lru_length;
+  } else {
+    lazy->failed = true;
   }
-  return nullptr;
+  if (ctx) {
+    this->lru.push(lazy);
+    SSL_CTX_up_ref(ctx);
+  }
+  while (this->lru_length > limit && this->lru.tail != lazy) {
+    SSLLazyContext *victim = this->lru.tail;
+    this->lru.remove(victim);
+    --this->lru_length;
+    evicted.push_back(victim->ctx);
+    victim->ctx = nullptr;
+  }
+  ink_mutex_release(&this->lru_mutex);
+
+  // The connections that use the evicted contexts hold their own references.
+  for (SSL_CTX *e : evicted) {
+    SSLReleaseContext(e);
+  }
+  SSLReleaseContext(built);
+  return ctx;
+}
+
+void
+SSLContextStorage::built(std::vector<SSL_CTX *> &contexts)
+{
+  ink_mutex_acquire(&this->lru_mutex);
+  for (SSLLazyContext *lazy = this->lru.head; lazy; lazy = lazy->link.next) {
+    SSL_CTX_up_ref(lazy->ctx);
+    contexts.push_back(lazy->ctx);
+  }
+  ink_mutex_release(&this->lru_mutex);
 }
 
 #if TS_HAS_TESTS
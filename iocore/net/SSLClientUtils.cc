@@ -25,6 +25,7 @@
 #include "ts/X509HostnameValidator.h"
 #include "P_Net.h"
 #include "P_SSLClientUtils.h"
+#include "ts/TestBox.h"
 
 #include <openssl/err.h>
 #include <openssl/pem.h>
@@ -35,6 +36,160 @@ using ink_ssl_method_t = const SSL_METHOD *;
 typedef SSL_METHOD *ink_ssl_method_t;
 #endif
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define SSL_SESSION_up_ref(session) CRYPTO_add(&(session)->references, 1, CRYPTO_LOCK_SSL_SESSION)
+#endif
+
+SSLOriginSessionCache *origin_sess_cache;
+
+static bool
+ssl_session_usable(SSL_SESSION *session, time_t now)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  if (!SSL_SESSION_is_resumable(session)) {
+    return false;
+  }
+#endif
+  return SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) > now;
+}
+
+SSLOriginSessionCache::SSLOriginSessionCache(size_t capacity) : shard_capacity(std::max<size_t>(capacity / SHARDS, 1))
+{
+  for (Shard &s : shards) {
+    ink_mutex_init(&s.mutex);
+  }
+}
+
+SSLOriginSessionCache::~SSLOriginSessionCache()
+{
+  for (Shard &s : shards) {
+    for (Entry &entry : s.entries) {
+      SSL_SESSION_free(entry.session);
+    }
+    ink_mutex_destroy(&s.mutex);
+  }
+}
+
+SSLOriginSessionCache::Shard &
+SSLOriginSessionCache::shard(const std::string &key)
+{
+  return shards[std::hash<std::string>()(key) % SHARDS];
+}
+
+SSL_SESSION *
+SSLOriginSessionCache::get(const std::string &key, const SSL_CTX *ctx, time_t now)
+{
+  Shard &s = shard(key);
+  ink_scoped_mutex_lock lock(s.mutex);
+
+  auto spot = s.index.find(key);
+  if (spot == s.index.end()) {
+    return nullptr;
+  }
+
+  auto entry = spot->second;
+  if (entry->ctx != ctx || !ssl_session_usable(entry->session, now)) {
+    SSL_SESSION_free(entry->session);
+    s.entries.erase(entry);
+    s.index.erase(spot);
+    return nullptr;
+  }
+
+  s.entries.splice(s.entries.begin(), s.entries, entry);
+  SSL_SESSION_up_ref(entry->session);
+  return entry->session;
+}
+
+void
+SSLOriginSessionCache::put(const std::string &key, const SSL_CTX *ctx, SSL_SESSION *session)
+{
+  Shard &s = shard(key);
+  ink_scoped_mutex_lock lock(s.mutex);
+
+  auto spot = s.index.find(key);
+  if (spot != s.index.end()) {
+    auto entry = spot->second;
+    SSL_SESSION_free(entry->session);
+    entry->ctx     = ctx;
+    entry->session = session;
+    s.entries.splice(s.entries.begin(), s.entries, entry);
+    return;
+  }
+
+  s.entries.push_front(Entry{key, ctx, session});
+  s.index.emplace(key, s.entries.begin());
+  if (s.entries.size() > shard_capacity) {
+    Entry &last = s.entries.back();
+    s.index.erase(last.key);
+    SSL_SESSION_free(last.session);
+    s.entries.pop_back();
+  }
+}
+
+void
+SSLOriginSessionCache::remove(const std::string &key)
+{
+  Shard &s = shard(key);
+  ink_scoped_mutex_lock lock(s.mutex);
+
+  auto spot = s.index.find(key);
+  if (spot != s.index.end()) {
+    SSL_SESSION_free(spot->second->session);
+    s.entries.erase(spot->second);
+    s.index.erase(spot);
+  }
+}
+
+static std::string
+ssl_origin_session_key(SSL *ssl)
+{
+  SSLNetVConnection *netvc = SSLNetVCAccess(ssl);
+  ip_port_text_buffer ipb;
+  std::string key;
+
+  if (netvc->options.sni_servername) {
+    key = netvc->options.sni_servername.get();
+  }
+  key += '/';
+  key += ats_ip_nptop(netvc->get_remote_addr(), ipb, sizeof(ipb));
+  key += '/';
+  key += std::to_string(SSL_get_verify_mode(ssl));
+  return key;
+}
+
+// OpenSSL calls this for every session the origin gives us, for TLS 1.3 after the handshake.
+static int
+ssl_new_origin_session(SSL *ssl, SSL_SESSION *session)
+{
+  if (SSLNetVCAccess(ssl) == nullptr) {
+    return 0;
+  }
+
+  std::string key = ssl_origin_session_key(ssl);
+  Debug("ssl", "caching the session of origin %s", key.c_str());
+  origin_sess_cache->put(key, SSL_get_SSL_CTX(ssl), session);
+  return 1;
+}
+
+void
+SSLOriginSessionResume(SSL *ssl)
+{
+  if (origin_sess_cache == nullptr) {
+    return;
+  }
+
+  std::string key      = ssl_origin_session_key(ssl);
+  SSL_SESSION *session = origin_sess_cache->get(key, SSL_get_SSL_CTX(ssl), time(nullptr));
+  Debug("ssl", "%s session for origin %s", session ? "offering the cached" : "no", key.c_str());
+  if (session) {
+    SSL_set_session(ssl, session);
+    SSL_SESSION_free(session);
+    SSL_INCREMENT_DYN_STAT(ssl_origin_session_cache_hit);
+  } else {
+    SSL_INCREMENT_DYN_STAT(ssl_origin_session_cache_miss);
+  }
+}
+
 int
 verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
 {
@@ -179,6 +334,16 @@ SSLInitClientContext(const SSLConfigParams *params)
     }
   }
 
+  if (origin_sess_cache) {
+    SSL_CTX_set_session_cache_mode(client_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(client_ctx, ssl_new_origin_session);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // Many origins close without a close_notify once the response is sent, OpenSSL 3 would
+    // take that for an error and no longer resume the session.
+    SSL_CTX_set_options(client_ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+  }
+
   if (SSLConfigParams::init_ssl_ctx_cb) {
     SSLConfigParams::init_ssl_ctx_cb(client_ctx, false);
   }
@@ -189,3 +354,68 @@ fail:
   SSLReleaseContext(client_ctx);
   ::exit(1);
 }
+
+REGRESSION_TEST(SSLOriginSessionCache)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  SSL_CTX *ctx       = SSL_CTX_new(SSLv23_client_method());
+  SSL_CTX *other_ctx = SSL_CTX_new(SSLv23_client_method());
+  time_t now         = time(nullptr);
+
+  auto session = [now](unsigned char id) {
+    unsigned char sid[32];
+    memset(sid, id, sizeof(sid));
+    SSL_SESSION *s = SSL_SESSION_new();
+    SSL_SESSION_set1_id(s, sid, sizeof(sid));
+    SSL_SESSION_set_time(s, now);
+    SSL_SESSION_set_timeout(s, 300);
+    return s;
+  };
+
+  {
+    SSLOriginSessionCache cache(1024);
+    SSL_SESSION *a = session('a');
+    cache.put("a/1.2.3.4:443/1", ctx, a);
+
+    SSL_SESSION *found = cache.get("a/1.2.3.4:443/1", ctx, now);
+    box.check(found == a, "the session is found");
+    SSL_SESSION_free(found);
+    box.check(cache.get("a/1.2.3.4:443/0", ctx, now) == nullptr, "the verification mode is part of the key");
+    box.check(cache.get("a/1.2.3.4:443/1", ctx, now + 301) == nullptr, "an expired session is not offered");
+    box.check(cache.get("a/1.2.3.4:443/1", ctx, now) == nullptr, "an expired session is dropped");
+
+    cache.put("b/1.2.3.4:443/1", ctx, session('b'));
+    box.check(cache.get("b/1.2.3.4:443/1", other_ctx, now) == nullptr, "a session is not offered to another context");
+
+    cache.put("c/1.2.3.4:443/1", ctx, session('c'));
+    SSL_SESSION *c = session('C');
+    cache.put("c/1.2.3.4:443/1", ctx, c);
+    found = cache.get("c/1.2.3.4:443/1", ctx, now);
+    box.check(found == c, "the last session of an origin replaces the previous one");
+    SSL_SESSION_free(found);
+  }
+
+  {
+    SSLOriginSessionCache cache(64);
+    for (int i = 0; i < 1000; ++i) {
+      cache.put("origin" + std::to_string(i), ctx, session('x'));
+    }
+    int kept = 0;
+    for (int i = 0; i < 1000; ++i) {
+      SSL_SESSION *found = cache.get("origin" + std::to_string(i), ctx, now);
+      if (found) {
+        ++kept;
+        SSL_SESSION_free(found);
+      }
+    }
+    box.check(kept == 64, "%d sessions kept in a cache of 64", kept);
+    SSL_SESSION *last = cache.get("origin999", ctx, now);
+    box.check(last != nullptr, "the most recent session is kept");
+    SSL_SESSION_free(last);
+  }
+
+  SSL_CTX_free(ctx);
+  SSL_CTX_free(other_ctx);
+}
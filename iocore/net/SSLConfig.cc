@@ -38,6 +38,7 @@
 #include "P_SSLConfig.h"
 #include "P_SSLUtils.h"
 #include "P_SSLCertLookup.h"
+#include "P_SSLClientUtils.h"
 #include "SSLSessionCache.h"
 #include <records/I_RecHttp.h>
 
@@ -45,11 +46,14 @@ int SSLConfig::configid                                     = 0;
 int SSLCertificateConfig::configid                          = 0;
 int SSLTicketKeyConfig::configid                            = 0;
 int SSLConfigParams::ssl_maxrecord                          = 0;
+int SSLConfigParams::ssl_write_batch_size                   = 0;
 bool SSLConfigParams::ssl_allow_client_renegotiation        = false;
 bool SSLConfigParams::ssl_ocsp_enabled                      = false;
 int SSLConfigParams::ssl_ocsp_cache_timeout                 = 3600;
 int SSLConfigParams::ssl_ocsp_request_timeout               = 10;
 int SSLConfigParams::ssl_ocsp_update_period                 = 60;
+int SSLConfigParams::ssl_ocsp_max_concurrent_requests       = 16;
+char *SSLConfigParams::ssl_ocsp_cache_filename              = nullptr;
 int SSLConfigParams::ssl_handshake_timeout_in               = 0;
 size_t SSLConfigParams::session_cache_number_buckets        = 1024;
 bool SSLConfigParams::session_cache_skip_on_lock_contention = false;
@@ -65,6 +69,13 @@ IpAddr *SSLConfigParams::ssl_wire_trace_ip        = nullptr;
 int SSLConfigParams::ssl_wire_trace_percentage    = 0;
 char *SSLConfigParams::ssl_wire_trace_server_name = nullptr;
 int SSLConfigParams::async_handshake_enabled      = 0;
+int SSLConfigParams::ktls_enabled                 = 0;
+int SSLConfigParams::crypto_offload_threads       = 0;
+int SSLConfigParams::server_max_early_data        = 0;
+int SSLConfigParams::early_data_replay_window     = 30;
+int SSLConfigParams::early_data_replay_cache_size = 262144;
+int SSLConfigParams::origin_session_cache         = 1;
+int SSLConfigParams::origin_session_cache_size    = 10240;
 char *SSLConfigParams::engine_conf_file           = nullptr;
 
 static ConfigUpdateHandler<SSLCertificateConfig> *sslCertUpdate;
@@ -105,6 +116,7 @@ SSLConfigParams::reset()
   ssl_session_cache_timeout            = 0;
   ssl_session_cache_auto_clear         = 1;
   configExitOnLoadError                = 1;
+  lazy_context_limit                   = 0;
 }
 
 void
@@ -265,6 +277,11 @@ SSLConfigParams::initialize()
 
   configFilePath = ats_stringdup(RecConfigReadConfigPath("proxy.config.ssl.server.multicert.filename"));
   REC_ReadConfigInteger(configExitOnLoadError, "proxy.config.ssl.server.multicert.exit_on_load_fail");
+  REC_ReadConfigInt32(lazy_context_limit, "proxy.config.ssl.server.multicert.lazy_contexts");
+
+  REC_ReadConfigInt32(server_max_early_data, "proxy.config.ssl.server.max_early_data");
+  REC_ReadConfigInt32(early_data_replay_window, "proxy.config.ssl.server.early_data.replay_window");
+  REC_ReadConfigInt32(early_data_replay_cache_size, "proxy.config.ssl.server.early_data.replay_cache_size");
 
   REC_ReadConfigStringAlloc(ssl_server_private_key_path, "proxy.config.ssl.server.private_key.path");
   set_paths_helper(ssl_server_private_key_path, nullptr, &serverKeyPathOnly, nullptr);
@@ -288,26 +305,67 @@ SSLConfigParams::initialize()
   SSLConfigParams::session_cache_skip_on_lock_contention = ssl_session_cache_skip_on_contention;
   SSLConfigParams::session_cache_number_buckets          = ssl_session_cache_num_buckets;
 
-  if (ssl_session_cache == SSL_SESSION_CACHE_MODE_SERVER_ATS_IMPL) {
-    session_cache = new SSLSessionCache();
+  // The settings of the cache need a restart, the sessions are kept over a reload.
+  if (ssl_session_cache == SSL_SESSION_CACHE_MODE_SERVER_ATS_IMPL && session_cache == nullptr) {
+    ats_scoped_str filename(REC_ConfigReadString("proxy.config.ssl.session_cache.filename"));
+    if (filename && *filename) {
+      ats_scoped_str rundir(RecConfigReadRuntimeDir());
+      std::string path = Layout::relative_to(rundir.get(), filename.get());
+      session_cache    = new SSLSessionCache(path.c_str());
+    } else {
+      session_cache = new SSLSessionCache();
+    }
   }
 
   // SSL record size
   REC_EstablishStaticConfigInt32(ssl_maxrecord, "proxy.config.ssl.max_record_size");
+  REC_EstablishStaticConfigInt32(ssl_write_batch_size, "proxy.config.ssl.write_batch_size");
+#if !TS_HAS_SSL_WRITE_BATCH
+  if (ssl_write_batch_size > 0) {
+    Warning("proxy.config.ssl.write_batch_size is set, but needs OpenSSL 1.1.1 or later");
+  }
+#endif
 
   // SSL OCSP Stapling configurations
   REC_ReadConfigInt32(ssl_ocsp_enabled, "proxy.config.ssl.ocsp.enabled");
   REC_EstablishStaticConfigInt32(ssl_ocsp_cache_timeout, "proxy.config.ssl.ocsp.cache_timeout");
   REC_EstablishStaticConfigInt32(ssl_ocsp_request_timeout, "proxy.config.ssl.ocsp.request_timeout");
   REC_EstablishStaticConfigInt32(ssl_ocsp_update_period, "proxy.config.ssl.ocsp.update_period");
+  REC_ReadConfigInt32(ssl_ocsp_max_concurrent_requests, "proxy.config.ssl.ocsp.max_concurrent_requests");
+  // Read once, the ET_OCSP thread uses it.
+  if (ssl_ocsp_cache_filename == nullptr) {
+    ats_scoped_str filename(REC_ConfigReadString("proxy.config.ssl.ocsp.cache_filename"));
+    if (filename && *filename) {
+      ats_scoped_str rundir(RecConfigReadRuntimeDir());
+      ssl_ocsp_cache_filename = ats_stringdup(Layout::relative_to(rundir.get(), filename.get()));
+    }
+  }
 
+  REC_ReadConfigInt32(ssl_handshake_timeout_in, "proxy.config.ssl.handshake_timeout_in");
   REC_ReadConfigInt32(async_handshake_enabled, "proxy.config.ssl.async.handshake.enabled");
+  REC_ReadConfigInt32(ktls_enabled, "proxy.config.ssl.ktls.enabled");
+  REC_ReadConfigInt32(crypto_offload_threads, "proxy.config.ssl.crypto_offload.threads");
+#if !TS_USE_KTLS
+  if (ktls_enabled) {
+    Warning("proxy.config.ssl.ktls.enabled is set, but OpenSSL was not built with kernel TLS support");
+    ktls_enabled = 0;
+  }
+#endif
   REC_ReadConfigStringAlloc(engine_conf_file, "proxy.config.ssl.engine.conf_file");
 
   // ++++++++++++++++++++++++ Client part ++++++++++++++++++++
   client_verify_depth = 7;
   REC_EstablishStaticConfigByte(clientVerify, "proxy.config.ssl.client.verify.server");
 
+  // Read once, the client contexts of every reload share the cache.
+  if (origin_sess_cache == nullptr) {
+    REC_ReadConfigInt32(origin_session_cache, "proxy.config.ssl.origin_session_cache");
+    REC_ReadConfigInt32(origin_session_cache_size, "proxy.config.ssl.origin_session_cache.size");
+    if (origin_session_cache) {
+      origin_sess_cache = new SSLOriginSessionCache(origin_session_cache_size);
+    }
+  }
+
   ssl_client_cert_filename = nullptr;
   ssl_client_cert_path     = nullptr;
   REC_ReadConfigStringAlloc(ssl_client_cert_filename, "proxy.config.ssl.client.cert.filename");
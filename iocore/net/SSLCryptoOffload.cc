@@ -0,0 +1,616 @@
+/** @file
+
+  Private key operations of the TLS handshakes on a dedicated thread group.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "P_SSLCryptoOffload.h"
+#include "P_Net.h"
+#include "P_SSLConfig.h"
+#include "P_SSLUtils.h"
+#include "ts/TestBox.h"
+
+#if TS_USE_TLS_ASYNC
+
+#include <openssl/async.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <atomic>
+
+namespace
+{
+EventType ET_SSL_CRYPTO;
+bool offload_enabled = false;
+
+RSA_METHOD *offload_rsa_method;
+EC_KEY_METHOD *offload_ec_method;
+
+using ec_sign_fn = int (*)(int type, const unsigned char *dgst, int dlen, unsigned char *sig, unsigned int *siglen,
+                           const BIGNUM *kinv, const BIGNUM *r, EC_KEY *ec);
+ec_sign_fn default_ec_sign;
+
+std::atomic<int> queue_depth{0};
+RecHistogram *queue_depth_histogram;
+RecHistogram *latency_histogram;
+
+// Key of the wait fd in the ASYNC_WAIT_CTX of the jobs.
+const char wait_fd_key = 0;
+
+// Set while SSLCryptoOffloadCancel resumes a job, whose operation then stops waiting.
+thread_local bool cancelling = false;
+
+// The wait fd of a job. The operations in flight hold a reference, so it is
+// not closed, and its number reused, before they signal it.
+struct SignalFd {
+  int fd;
+  std::atomic<int> refcount;
+
+  void
+  release()
+  {
+    if (--refcount == 0) {
+      close(fd);
+      delete this;
+    }
+  }
+};
+
+void
+signal_fd_cleanup(ASYNC_WAIT_CTX * /* ctx ATS_UNUSED */, const void * /* key ATS_UNUSED */, OSSL_ASYNC_FD /* fd ATS_UNUSED */,
+                  void *data)
+{
+  static_cast<SignalFd *>(data)->release();
+}
+
+enum CryptoOp {
+  CRYPTO_RSA_PRIV_ENC,
+  CRYPTO_RSA_PRIV_DEC,
+  CRYPTO_ECDSA_SIGN,
+};
+
+int
+rsa_default(CryptoOp op, int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding)
+{
+  if (op == CRYPTO_RSA_PRIV_ENC) {
+    return RSA_meth_get_priv_enc(RSA_PKCS1_OpenSSL())(flen, from, to, rsa, padding);
+  }
+  return RSA_meth_get_priv_dec(RSA_PKCS1_OpenSSL())(flen, from, to, rsa, padding);
+}
+
+// Large enough for RSA keys of OPENSSL_RSA_MAX_MODULUS_BITS.
+const int CRYPTO_BUFFER_SIZE = 2048;
+
+// An operation, shared by the job waiting for it and the ET_SSL_CRYPTO
+// thread performing it. The buffers are copies, the job may be gone when
+// the operation completes if its connection was closed.
+struct CryptoTask : public Continuation {
+  CryptoOp op;
+  RSA *rsa    = nullptr;
+  EC_KEY *ec  = nullptr;
+  int padding = 0; // RSA padding, or ECDSA type
+  unsigned char in[CRYPTO_BUFFER_SIZE];
+  int in_len = 0;
+  unsigned char out[CRYPTO_BUFFER_SIZE];
+  int out_len = 0;
+  int result  = -1;
+
+  ink_hrtime queued   = 0;
+  SignalFd *signal    = nullptr;
+  std::atomic<bool> done{false};
+  std::atomic<int> refcount{2};
+
+  explicit CryptoTask(CryptoOp o) : Continuation(new_ProxyMutex()), op(o) { SET_HANDLER(&CryptoTask::perform); }
+
+  int
+  perform(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
+  {
+    if (op == CRYPTO_ECDSA_SIGN) {
+      unsigned int siglen = 0;
+      result              = default_ec_sign(padding, in, in_len, out, &siglen, nullptr, nullptr, ec);
+      out_len             = siglen;
+    } else {
+      result = rsa_default(op, in_len, in, out, rsa, padding);
+    }
+    // The job cannot see the errors of this thread.
+    ERR_clear_error();
+
+    latency_histogram->record(ink_hrtime_to_usec(Thread::get_hrtime_updated() - queued));
+    --queue_depth;
+
+    done.store(true, std::memory_order_release);
+    uint64_t one = 1;
+    ATS_UNUSED_RETURN(write(signal->fd, &one, sizeof(one)));
+    release();
+
+    return EVENT_DONE;
+  }
+
+  void
+  release()
+  {
+    if (--refcount == 0) {
+      RSA_free(rsa);
+      EC_KEY_free(ec);
+      if (signal) {
+        signal->release();
+      }
+      mutex = nullptr;
+      delete this;
+    }
+  }
+};
+
+// Hand @a task to the ET_SSL_CRYPTO threads and pause @a job until it is done,
+// or until the job is cancelled. Returns false if it could not be offloaded.
+bool
+offload(CryptoTask *task, ASYNC_JOB *job)
+{
+  ASYNC_WAIT_CTX *waitctx = ASYNC_get_wait_ctx(job);
+  OSSL_ASYNC_FD fd;
+  void *data = nullptr;
+  SignalFd *signal;
+
+  if (ASYNC_WAIT_CTX_get_fd(waitctx, &wait_fd_key, &fd, &data)) {
+    signal = static_cast<SignalFd *>(data);
+  } else {
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    signal = new SignalFd{fd, {1}};
+    if (!ASYNC_WAIT_CTX_set_wait_fd(waitctx, &wait_fd_key, fd, signal, signal_fd_cleanup)) {
+      signal->release();
+      return false;
+    }
+  }
+
+  ++signal->refcount;
+  task->signal = signal;
+  task->queued = Thread::get_hrtime_updated();
+  queue_depth_histogram->record(++queue_depth);
+  eventProcessor.schedule_imm(task, ET_SSL_CRYPTO);
+
+  // The connection resumes the job on any event, wait for ours.
+  do {
+    ASYNC_pause_job();
+  } while (!task->done.load(std::memory_order_acquire) && !cancelling);
+
+  if (!task->done.load(std::memory_order_acquire)) {
+    // The ET_SSL_CRYPTO thread still signals the fd, and releases its reference.
+    return true;
+  }
+
+  uint64_t count;
+  ATS_UNUSED_RETURN(read(fd, &count, sizeof(count)));
+  return true;
+}
+
+int
+offload_rsa(CryptoOp op, int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding)
+{
+  ASYNC_JOB *job = ASYNC_get_current_job();
+
+  if (job == nullptr || flen > CRYPTO_BUFFER_SIZE || RSA_size(rsa) > CRYPTO_BUFFER_SIZE) {
+    return rsa_default(op, flen, from, to, rsa, padding);
+  }
+
+  CryptoTask *task = new CryptoTask(op);
+  RSA_up_ref(rsa);
+  task->rsa     = rsa;
+  task->padding = padding;
+  task->in_len  = flen;
+  memcpy(task->in, from, flen);
+
+  if (!offload(task, job)) {
+    task->refcount = 1;
+    task->release();
+    return rsa_default(op, flen, from, to, rsa, padding);
+  }
+
+  int result = task->done ? task->result : -1;
+  if (result > 0) {
+    memcpy(to, task->out, result);
+  }
+  task->release();
+  return result;
+}
+
+int
+offload_rsa_priv_enc(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding)
+{
+  return offload_rsa(CRYPTO_RSA_PRIV_ENC, flen, from, to, rsa, padding);
+}
+
+int
+offload_rsa_priv_dec(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding)
+{
+  return offload_rsa(CRYPTO_RSA_PRIV_DEC, flen, from, to, rsa, padding);
+}
+
+int
+offload_ec_sign(int type, const unsigned char *dgst, int dlen, unsigned char *sig, unsigned int *siglen, const BIGNUM *kinv,
+                const BIGNUM *r, EC_KEY *ec)
+{
+  ASYNC_JOB *job = ASYNC_get_current_job();
+
+  if (job == nullptr || kinv != nullptr || r != nullptr || dlen > CRYPTO_BUFFER_SIZE || ECDSA_size(ec) > CRYPTO_BUFFER_SIZE) {
+    return default_ec_sign(type, dgst, dlen, sig, siglen, kinv, r, ec);
+  }
+
+  CryptoTask *task = new CryptoTask(CRYPTO_ECDSA_SIGN);
+  EC_KEY_up_ref(ec);
+  task->ec      = ec;
+  task->padding = type;
+  task->in_len  = dlen;
+  memcpy(task->in, dgst, dlen);
+
+  if (!offload(task, job)) {
+    task->refcount = 1;
+    task->release();
+    return default_ec_sign(type, dgst, dlen, sig, siglen, kinv, r, ec);
+  }
+
+  int result = task->done ? task->result : 0;
+  if (result > 0) {
+    memcpy(sig, task->out, task->out_len);
+    *siglen = task->out_len;
+  }
+  task->release();
+  return result;
+}
+
+} // namespace
+
+void
+SSLCryptoOffloadInitialize(size_t stacksize)
+{
+  if (SSLConfigParams::crypto_offload_threads <= 0) {
+    return;
+  }
+
+  offload_rsa_method = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+  RSA_meth_set1_name(offload_rsa_method, "ATS crypto offload");
+  RSA_meth_set_priv_enc(offload_rsa_method, offload_rsa_priv_enc);
+  RSA_meth_set_priv_dec(offload_rsa_method, offload_rsa_priv_dec);
+
+  int (*sign_setup)(EC_KEY *, BN_CTX *, BIGNUM **, BIGNUM **)                                 = nullptr;
+  ECDSA_SIG *(*sign_sig)(const unsigned char *, int, const BIGNUM *, const BIGNUM *, EC_KEY *) = nullptr;
+  offload_ec_method = EC_KEY_METHOD_new(EC_KEY_OpenSSL());
+  EC_KEY_METHOD_get_sign(EC_KEY_OpenSSL(), &default_ec_sign, &sign_setup, &sign_sig);
+  EC_KEY_METHOD_set_sign(offload_ec_method, offload_ec_sign, sign_setup, sign_sig);
+
+  queue_depth_histogram = RecAllocateHistogram("proxy.process.ssl.crypto_offload.queue_depth");
+  latency_histogram     = RecAllocateHistogram("proxy.process.ssl.crypto_offload.latency");
+
+  ET_SSL_CRYPTO   = eventProcessor.spawn_event_threads("ET_SSL_CRYPTO", SSLConfigParams::crypto_offload_threads, stacksize);
+  offload_enabled = true;
+  Note("offloading TLS private key operations to %d threads", SSLConfigParams::crypto_offload_threads);
+}
+
+bool
+SSLCryptoOffloadEnabled()
+{
+  return offload_enabled;
+}
+
+bool
+SSLCryptoOffloadKey(SSL_CTX *ctx)
+{
+  if (!offload_enabled) {
+    return true;
+  }
+
+  EVP_PKEY *pkey    = SSL_CTX_get0_privatekey(ctx);
+  EVP_PKEY *wrapped = nullptr;
+
+  switch (pkey ? EVP_PKEY_base_id(pkey) : EVP_PKEY_NONE) {
+  case EVP_PKEY_RSA: {
+    // Work on a copy, the legacy key of a provider key is cached in it.
+    RSA *rsa = RSAPrivateKey_dup(EVP_PKEY_get0_RSA(pkey));
+    if (rsa == nullptr || !RSA_set_method(rsa, offload_rsa_method)) {
+      RSA_free(rsa);
+      return false;
+    }
+    wrapped = EVP_PKEY_new();
+    EVP_PKEY_assign_RSA(wrapped, rsa);
+    break;
+  }
+  case EVP_PKEY_EC: {
+    EC_KEY *ec = EC_KEY_dup(EVP_PKEY_get0_EC_KEY(pkey));
+    if (ec == nullptr || !EC_KEY_set_method(ec, offload_ec_method)) {
+      EC_KEY_free(ec);
+      return false;
+    }
+    wrapped = EVP_PKEY_new();
+    EVP_PKEY_assign_EC_KEY(wrapped, ec);
+    break;
+  }
+  default:
+    // Not offloaded, these are fast enough.
+    return true;
+  }
+
+  bool ok = SSL_CTX_use_PrivateKey(ctx, wrapped);
+  EVP_PKEY_free(wrapped);
+  return ok;
+}
+
+void
+SSLCryptoOffloadCancel(SSL *ssl)
+{
+  if (!offload_enabled || !SSL_waiting_for_async(ssl)) {
+    return;
+  }
+
+  // The socket may be closed already, the failing handshake must not use it.
+  BIO *bio = BIO_new(BIO_s_null());
+  SSL_set_bio(ssl, bio, bio);
+
+  // Resume the job so that it fails the handshake and finishes, else the job and the task leak.
+  cancelling = true;
+  for (int i = 0; i < 4 && SSL_waiting_for_async(ssl); ++i) {
+    SSL_do_handshake(ssl);
+  }
+  cancelling = false;
+  ERR_clear_error();
+}
+
+#else /* TS_USE_TLS_ASYNC */
+
+void
+SSLCryptoOffloadInitialize(size_t /* stacksize ATS_UNUSED */)
+{
+  if (SSLConfigParams::crypto_offload_threads > 0) {
+    Warning("proxy.config.ssl.crypto_offload.threads is set, but OpenSSL does not support async jobs");
+  }
+}
+
+bool
+SSLCryptoOffloadEnabled()
+{
+  return false;
+}
+
+bool
+SSLCryptoOffloadKey(SSL_CTX * /* ctx ATS_UNUSED */)
+{
+  return true;
+}
+
+void
+SSLCryptoOffloadCancel(SSL * /* ssl ATS_UNUSED */)
+{
+}
+
+#endif /* TS_USE_TLS_ASYNC */
+
+#if TS_USE_TLS_ASYNC
+namespace
+{
+// Start the ET_SSL_CRYPTO threads for the tests, the SSL processor may not have.
+// Returns whether the offload was enabled before.
+bool
+crypto_offload_test_enable()
+{
+  bool enabled = offload_enabled;
+
+  if (offload_rsa_method == nullptr) {
+    int threads                             = SSLConfigParams::crypto_offload_threads;
+    SSLConfigParams::crypto_offload_threads = 1;
+    SSLCryptoOffloadInitialize(1 << 20);
+    SSLConfigParams::crypto_offload_threads = threads;
+  }
+  offload_enabled = true;
+  return enabled;
+}
+
+// A self signed RSA certificate, with the key offloaded.
+bool
+crypto_offload_test_certify(SSL_CTX *ctx)
+{
+  EVP_PKEY *pkey     = nullptr;
+  EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+  X509 *x509         = X509_new();
+
+  bool ok = kctx && x509 && EVP_PKEY_keygen_init(kctx) > 0 && EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) > 0 &&
+            EVP_PKEY_keygen(kctx, &pkey) > 0 && X509_set_version(x509, 2) && ASN1_INTEGER_set(X509_get_serialNumber(x509), 1) &&
+            X509_gmtime_adj(X509_get_notBefore(x509), 0) && X509_gmtime_adj(X509_get_notAfter(x509), 3600) &&
+            X509_set_pubkey(x509, pkey) &&
+            X509_NAME_add_entry_by_txt(X509_get_subject_name(x509), "CN", MBSTRING_ASC,
+                                       reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0) &&
+            X509_set_issuer_name(x509, X509_get_subject_name(x509)) && X509_sign(x509, pkey, EVP_sha256()) > 0 &&
+            SSL_CTX_use_certificate(ctx, x509) > 0 && SSL_CTX_use_PrivateKey(ctx, pkey) > 0 && SSLCryptoOffloadKey(ctx);
+
+  X509_free(x509);
+  EVP_PKEY_free(pkey);
+  EVP_PKEY_CTX_free(kctx);
+  return ok;
+}
+
+// A server SSL in async mode and a client SSL over a non blocking socketpair.
+struct CryptoOffloadTestPair {
+  int fds[2]  = {NO_FD, NO_FD};
+  SSL *server = nullptr;
+  SSL *client = nullptr;
+
+  bool
+  open(SSL_CTX *server_ctx, SSL_CTX *client_ctx)
+  {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      return false;
+    }
+    server = SSL_new(server_ctx);
+    client = SSL_new(client_ctx);
+    SSL_set_fd(server, fds[0]);
+    SSL_set_fd(client, fds[1]);
+    SSL_set_accept_state(server);
+    SSL_set_connect_state(client);
+    SSL_set_mode(server, SSL_MODE_ASYNC);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    return true;
+  }
+
+  // The wait fd of the job the server handshake is paused in, or NO_FD.
+  int
+  wait_fd()
+  {
+    OSSL_ASYNC_FD fd;
+    size_t numfds = 0;
+
+    if (!SSL_get_all_async_fds(server, nullptr, &numfds) || numfds != 1 || !SSL_get_all_async_fds(server, &fd, &numfds)) {
+      return NO_FD;
+    }
+    return fd;
+  }
+
+  // Drive both sides of the handshake, until it is done, or until the server pauses if @a stop_on_pause.
+  // Returns how many times the server paused on an offloaded operation, or -1 if the handshake failed.
+  int
+  handshake(bool stop_on_pause)
+  {
+    int paused = 0, server_done = 0, client_done = 0;
+
+    for (int i = 0; i < 1000 && (server_done <= 0 || client_done <= 0); ++i) {
+      client_done = client_done > 0 ? client_done : SSL_do_handshake(client);
+      if (server_done > 0) {
+        continue;
+      }
+      server_done = SSL_do_handshake(server);
+      if (server_done <= 0 && SSL_get_error(server, server_done) == SSL_ERROR_WANT_ASYNC) {
+        ++paused;
+        if (stop_on_pause) {
+          return paused;
+        }
+        // Wait for the ET_SSL_CRYPTO thread, as the signalep of the VC would.
+        struct pollfd pfd = {wait_fd(), POLLIN, 0};
+        poll(&pfd, 1, 1000);
+      }
+    }
+    return server_done > 0 && client_done > 0 ? paused : -1;
+  }
+
+  ~CryptoOffloadTestPair()
+  {
+    SSL_free(server);
+    SSL_free(client);
+    for (int fd : fds) {
+      if (fd != NO_FD) {
+        close(fd);
+      }
+    }
+  }
+};
+
+} // namespace
+#endif
+
+// Handshake with a server whose RSA key operations run on the ET_SSL_CRYPTO threads.
+REGRESSION_TEST(SSLCryptoOffloadHandshake)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+#if TS_USE_TLS_ASYNC
+  bool enabled        = crypto_offload_test_enable();
+  SSL_CTX *server_ctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+
+  if (box.check(server_ctx && client_ctx && crypto_offload_test_certify(server_ctx), "contexts")) {
+    for (int version : {TLS1_2_VERSION, TLS1_3_VERSION}) {
+      CryptoOffloadTestPair pair;
+
+      SSL_CTX_set_max_proto_version(client_ctx, version);
+      if (!box.check(pair.open(server_ctx, client_ctx), "socketpair")) {
+        break;
+      }
+      int paused = pair.handshake(false);
+      box.check(paused >= 0, "TLS version %x handshake failed", version);
+      box.check(paused > 0, "TLS version %x handshake did not wait for the offload", version);
+      box.check(SSL_version(pair.server) == version, "negotiated TLS version %x, not %x", SSL_version(pair.server), version);
+    }
+  }
+
+  SSL_CTX_free(server_ctx);
+  SSL_CTX_free(client_ctx);
+  offload_enabled = enabled;
+#else
+  rprintf(t, "the crypto offload needs OpenSSL async jobs\n");
+#endif
+}
+
+// Close an SSLNetVConnection whose handshake is paused on an offloaded operation. The job must
+// finish, and its operation and wait fd be released, whether the operation is done or not.
+REGRESSION_TEST(SSLCryptoOffloadCancel)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+#if TS_USE_TLS_ASYNC
+  bool enabled        = crypto_offload_test_enable();
+  SSL_CTX *server_ctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+
+  if (box.check(server_ctx && client_ctx && crypto_offload_test_certify(server_ctx), "contexts")) {
+    for (int wait : {0, 1}) {
+      CryptoOffloadTestPair pair;
+
+      if (!box.check(pair.open(server_ctx, client_ctx), "socketpair") ||
+          !box.check(pair.handshake(true) == 1 && SSL_waiting_for_async(pair.server), "the handshake did not pause")) {
+        break;
+      }
+      int fd = pair.wait_fd();
+      box.check(fd != NO_FD, "no wait fd");
+      if (wait) {
+        // The operation is done, but the job has not seen it.
+        struct pollfd pfd = {fd, POLLIN, 0};
+        box.check(poll(&pfd, 1, 1000) == 1, "the operation did not complete");
+      }
+
+      SSLNetVConnection *vc = static_cast<SSLNetVConnection *>(sslNetProcessor.allocate_vc(this_ethread()));
+      vc->mutex             = new_ProxyMutex();
+      SCOPED_MUTEX_LOCK(lock, vc->mutex, this_ethread());
+      vc->ssl     = pair.server;
+      pair.server = nullptr;
+      vc->free(this_ethread());
+
+      // The last of the SSL, the job and the operation to let go of the wait fd closes it.
+      bool closed = false;
+      for (int i = 0; i < 1000 && !(closed = fcntl(fd, F_GETFD) < 0 && errno == EBADF); ++i) {
+        usleep(1000);
+      }
+      box.check(closed, "the wait fd %d is still open %s the operation completed", fd, wait ? "after" : "before");
+    }
+  }
+
+  SSL_CTX_free(server_ctx);
+  SSL_CTX_free(client_ctx);
+  offload_enabled = enabled;
+#else
+  rprintf(t, "the crypto offload needs OpenSSL async jobs\n");
+#endif
+}
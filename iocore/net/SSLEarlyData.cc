@@ -0,0 +1,258 @@
+/** @file
+
+  TLS 1.3 early data and its replay protection.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "P_SSLEarlyData.h"
+#include "P_SSLConfig.h"
+#include "P_SSLUtils.h"
+#include "ts/ink_mutex.h"
+#include "ts/TestBox.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+/**
+  Bloom filters of the ClientHello randoms seen in the last window.
+
+  Each shard has two generations of bits. The older one is cleared and
+  becomes the current one when the window is over, so a random is known
+  for one to two windows. A false positive only costs the client a round
+  trip, its early data is refused and it sends the requests again after
+  the handshake.
+*/
+class SSLReplayFilter
+{
+public:
+  SSLReplayFilter(size_t capacity, int seconds);
+  ~SSLReplayFilter();
+
+  /// Remember @a random, returns true if it was already seen.
+  bool seen(const unsigned char *random, size_t len, time_t now);
+
+private:
+  static const unsigned SHARD_BITS = 6;
+  static const unsigned HASHES     = 8;
+
+  struct Shard {
+    ink_mutex mutex;
+    time_t rotated = 0;
+    std::vector<uint64_t> current;
+    std::vector<uint64_t> previous;
+  };
+
+  uint64_t hash(const unsigned char *random, size_t len, uint64_t seed) const;
+
+  Shard shards[1 << SHARD_BITS];
+  size_t shard_mask;
+  time_t window;
+  uint64_t seeds[2];
+};
+
+SSLReplayFilter::SSLReplayFilter(size_t capacity, int seconds) : window(seconds)
+{
+  // 16 bits for each random, about 0.05% of false positives at capacity.
+  size_t bits = 4096;
+  while (bits < capacity * 16 >> SHARD_BITS) {
+    bits <<= 1;
+  }
+  shard_mask = bits - 1;
+
+  for (Shard &shard : shards) {
+    ink_mutex_init(&shard.mutex);
+    shard.current.resize(bits / 64);
+    shard.previous.resize(bits / 64);
+  }
+
+  // The clients pick the randoms, keep them from aiming at the same bits.
+  std::random_device rd;
+  for (uint64_t &seed : seeds) {
+    seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+  }
+}
+
+SSLReplayFilter::~SSLReplayFilter()
+{
+  for (Shard &shard : shards) {
+    ink_mutex_destroy(&shard.mutex);
+  }
+}
+
+uint64_t
+SSLReplayFilter::hash(const unsigned char *random, size_t len, uint64_t seed) const
+{
+  uint64_t h = seed;
+
+  for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    memcpy(&word, random + i, std::min(sizeof(word), len - i));
+    h ^= word;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+  }
+  return h;
+}
+
+bool
+SSLReplayFilter::seen(const unsigned char *random, size_t len, time_t now)
+{
+  uint64_t h1  = hash(random, len, seeds[0]);
+  uint64_t h2  = hash(random, len, seeds[1]) | 1;
+  Shard &shard = shards[h2 >> (64 - SHARD_BITS)];
+
+  ink_scoped_mutex_lock lock(shard.mutex);
+
+  if (now - shard.rotated >= window) {
+    if (now - shard.rotated >= 2 * window) {
+      std::fill(shard.previous.begin(), shard.previous.end(), 0);
+    } else {
+      shard.previous.swap(shard.current);
+    }
+    std::fill(shard.current.begin(), shard.current.end(), 0);
+    shard.rotated = now;
+  }
+
+  bool in_current  = true;
+  bool in_previous = true;
+  for (unsigned i = 0; i < HASHES; ++i) {
+    size_t bit    = (h1 + i * h2) & shard_mask;
+    uint64_t mask = 1ULL << (bit % 64);
+
+    in_current  = in_current && (shard.current[bit / 64] & mask);
+    in_previous = in_previous && (shard.previous[bit / 64] & mask);
+    shard.current[bit / 64] |= mask;
+  }
+
+  return in_current || in_previous;
+}
+
+} // namespace
+
+#if TS_HAS_TLS_EARLY_DATA
+
+namespace
+{
+SSLReplayFilter *replay_filter;
+
+int
+ssl_allow_early_data(SSL *ssl, void * /* arg ATS_UNUSED */)
+{
+  unsigned char random[SSL3_RANDOM_SIZE];
+  size_t len = SSL_get_client_random(ssl, random, sizeof(random));
+
+  if (replay_filter->seen(random, len, time(nullptr))) {
+    SSL_INCREMENT_DYN_STAT(ssl_early_data_replayed_stat);
+    Debug("ssl_early_data", "refusing the early data of a ClientHello seen before");
+    return 0;
+  }
+  return 1;
+}
+
+} // namespace
+
+void
+SSLEarlyDataInitialize()
+{
+  if (SSLConfigParams::server_max_early_data <= 0) {
+    return;
+  }
+
+  replay_filter = new SSLReplayFilter(SSLConfigParams::early_data_replay_cache_size, SSLConfigParams::early_data_replay_window);
+  Note("accepting up to %d bytes of TLS early data", SSLConfigParams::server_max_early_data);
+}
+
+bool
+SSLEarlyDataEnable(SSL *ssl)
+{
+  if (replay_filter == nullptr) {
+    return false;
+  }
+
+  // The replay filter stands for the one of OpenSSL, which needs stateful
+  // tickets and so its internal session cache.
+  SSL_set_options(ssl, SSL_OP_NO_ANTI_REPLAY);
+  SSL_set_max_early_data(ssl, SSLConfigParams::server_max_early_data);
+  SSL_set_recv_max_early_data(ssl, SSLConfigParams::server_max_early_data);
+  SSL_set_allow_early_data_cb(ssl, ssl_allow_early_data, nullptr);
+  return true;
+}
+
+#else /* TS_HAS_TLS_EARLY_DATA */
+
+void
+SSLEarlyDataInitialize()
+{
+  if (SSLConfigParams::server_max_early_data > 0) {
+    Warning("proxy.config.ssl.server.max_early_data is set, but OpenSSL does not support TLS 1.3 early data");
+  }
+}
+
+bool
+SSLEarlyDataEnable(SSL * /* ssl ATS_UNUSED */)
+{
+  return false;
+}
+
+#endif /* TS_HAS_TLS_EARLY_DATA */
+
+REGRESSION_TEST(SSLEarlyDataReplay)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  SSLReplayFilter filter(1024, 30);
+  unsigned char a[32], b[32];
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+
+  box.check(!filter.seen(a, sizeof(a), 1000), "a is new");
+  box.check(filter.seen(a, sizeof(a), 1001), "a is a replay");
+  box.check(!filter.seen(b, sizeof(b), 1001), "b is new");
+  box.check(filter.seen(b, sizeof(b), 1035), "b is remembered in the previous generation");
+  box.check(!filter.seen(a, sizeof(a), 1100), "a is forgotten after two windows");
+
+  std::mt19937_64 rng(42);
+  unsigned char random[32];
+  auto fill = [&]() {
+    for (size_t i = 0; i < sizeof(random); i += 8) {
+      uint64_t r = rng();
+      memcpy(random + i, &r, 8);
+    }
+  };
+
+  for (int i = 0; i < 1024; ++i) {
+    fill();
+    filter.seen(random, sizeof(random), 1100);
+  }
+  int false_positives = 0;
+  for (int i = 0; i < 10000; ++i) {
+    fill();
+    false_positives += filter.seen(random, sizeof(random), 1100);
+  }
+  box.check(false_positives < 100, "%d false positives in 10000 at capacity", false_positives);
+}
@@ -26,6 +26,8 @@
 #include "I_RecHttp.h"
 #include "P_SSLUtils.h"
 #include "P_OCSPStapling.h"
+#include "P_SSLCryptoOffload.h"
+#include "P_SSLEarlyData.h"
 #include "P_SSLSNI.h"
 
 //
@@ -35,19 +37,6 @@
 SSLNetProcessor ssl_NetProcessor;
 NetProcessor &sslNetProcessor = ssl_NetProcessor;
 SNIActionPerformer sni_action_performer;
-#ifdef HAVE_OPENSSL_OCSP_STAPLING
-struct OCSPContinuation : public Continuation {
-  int
-  mainEvent(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
-  {
-    ocsp_update();
-
-    return EVENT_CONT;
-  }
-
-  OCSPContinuation() : Continuation(new_ProxyMutex()) { SET_HANDLER(&OCSPContinuation::mainEvent); }
-};
-#endif /* HAVE_OPENSSL_OCSP_STAPLING */
 
 void
 SSLNetProcessor::cleanup()
@@ -62,6 +51,9 @@ SSLNetProcessor::start(int, size_t stacksize)
   SSLConfig::startup();
   SSLPostConfigInitialize();
   SNIConfig::startup();
+  // Before loading the certificates, their keys use the offload methods.
+  SSLCryptoOffloadInitialize(stacksize);
+  SSLEarlyDataInitialize();
 
   if (!SSLCertificateConfig::startup()) {
     return -1;
@@ -77,7 +69,7 @@ SSLNetProcessor::start(int, size_t stacksize)
 #ifdef HAVE_OPENSSL_OCSP_STAPLING
   if (SSLConfigParams::ssl_ocsp_enabled) {
     EventType ET_OCSP = eventProcessor.spawn_event_threads("ET_OCSP", 1, stacksize);
-    eventProcessor.schedule_every(new OCSPContinuation(), HRTIME_SECONDS(SSLConfigParams::ssl_ocsp_update_period), ET_OCSP);
+    ocsp_start(ET_OCSP);
   }
 #endif /* HAVE_OPENSSL_OCSP_STAPLING */
 
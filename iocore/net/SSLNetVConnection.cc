@@ -32,6 +32,8 @@
 #include "Log.h"
 #include "P_SSLClientUtils.h"
 #include "P_SSLSNI.h"
+#include "P_SSLCryptoOffload.h"
+#include "P_SSLEarlyData.h"
 #include "HttpTunnel.h"
 
 #include <climits>
@@ -64,6 +66,7 @@ void SSL_set0_rbio(SSL *ssl, BIO *rbio);
 #define SSL_HANDSHAKE_WANT_CONNECT 9
 #define SSL_WRITE_WOULD_BLOCK 10
 #define SSL_WAIT_FOR_HOOK 11
+#define SSL_HANDSHAKE_WANT_ASYNC 12
 
 ClassAllocator<SSLNetVConnection> sslNetVCAllocator("sslNetVCAllocator");
 
@@ -167,7 +170,9 @@ make_ssl_connection(SSL_CTX *ctx, SSLNetVConnection *netvc)
     } else {
       netvc->initialize_handshake_buffers();
       BIO *rbio = BIO_new(BIO_s_mem());
-      BIO *wbio = BIO_new_fd(netvc->get_socket(), BIO_NOCLOSE);
+      // kTLS needs a socket BIO to install the keys
+      BIO *wbio = SSLConfigParams::ktls_enabled ? BIO_new_socket(netvc->get_socket(), BIO_NOCLOSE) :
+                                                  BIO_new_fd(netvc->get_socket(), BIO_NOCLOSE);
       BIO_set_mem_eof_return(wbio, -1);
       SSL_set_bio(ssl, rbio, wbio);
     }
@@ -231,7 +236,7 @@ ssl_read_from_net(SSLNetVConnection *sslvc, EThread *lthread, int64_t &ret)
     Debug("ssl", "[SSL_NetVConnection::ssl_read_from_net] b->write_avail()=%" PRId64, amount_to_read);
     char *current_block = buf.writer()->end();
     ink_release_assert(current_block != nullptr);
-    sslErr = SSLReadBuffer(sslvc->ssl, current_block, amount_to_read, nread);
+    sslErr = sslvc->read_app_data(current_block, amount_to_read, nread);
 
     Debug("ssl", "[SSL_NetVConnection::ssl_read_from_net] nread=%d", (int)nread);
     if (!sslvc->origin_trace) {
@@ -435,7 +440,8 @@ SSLNetVConnection::update_rbio(bool move_to_socket)
       retval = true;
       // Handshake buffer is empty but we have read something, move to the socket rbio
     } else if (move_to_socket && this->handShakeHolder->is_read_avail_more_than(0)) {
-      BIO *rbio = BIO_new_fd(this->get_socket(), BIO_NOCLOSE);
+      BIO *rbio = SSLConfigParams::ktls_enabled ? BIO_new_socket(this->get_socket(), BIO_NOCLOSE) :
+                                                  BIO_new_fd(this->get_socket(), BIO_NOCLOSE);
       BIO_set_mem_eof_return(rbio, -1);
       SSL_set0_rbio(this->ssl, rbio);
       free_handshake_buffers();
@@ -444,6 +450,133 @@ SSLNetVConnection::update_rbio(bool move_to_socket)
   return retval;
 }
 
+// Find out if OpenSSL moved the sending side of the connection to the kernel
+// when the handshake completed. It does not if the kernel lacks the tls
+// module or does not support the negotiated cipher. This is done once per
+// connection, for the contexts that enable kTLS.
+void
+SSLNetVConnection::check_ktls()
+{
+#if TS_USE_KTLS
+  if (sslKTLSChecked || this->ssl == nullptr || !(SSL_get_options(this->ssl) & SSL_OP_ENABLE_KTLS)) {
+    return;
+  }
+  sslKTLSChecked = true;
+
+  BIO *wbio = SSL_get_wbio(this->ssl);
+  if (wbio && BIO_get_ktls_send(wbio)) {
+    sslKTLSSend = true;
+    SSL_INCREMENT_DYN_STAT(ssl_ktls_sessions_stat);
+    SSLVCDebug(this, "kernel TLS send enabled, cipher %s", SSL_get_cipher_name(this->ssl));
+  } else {
+    SSL_INCREMENT_DYN_STAT(ssl_ktls_fallback_stat);
+    SSLVCDebug(this, "kernel TLS not available for %s %s", SSL_get_version(this->ssl), SSL_get_cipher_name(this->ssl));
+  }
+#endif
+}
+
+// Pick up the kTLS state of an SSL that comes from another SSLNetVConnection.
+void
+SSLNetVConnection::adopt_ktls()
+{
+#if TS_USE_KTLS
+  BIO *wbio      = SSL_get_wbio(this->ssl);
+  sslKTLSSend    = wbio && BIO_get_ktls_send(wbio);
+  sslKTLSChecked = SSL_is_init_finished(this->ssl);
+#endif
+}
+
+ssl_error_t
+SSLNetVConnection::read_app_data(void *buf, int64_t nbytes, int64_t &nread)
+{
+  if (this->earlyDataReader) {
+    nread = this->earlyDataReader->read(buf, nbytes);
+    if (!this->earlyDataReader->is_read_avail_more_than(0)) {
+      free_early_data_buffer();
+    }
+    if (nread > 0) {
+      return SSL_ERROR_NONE;
+    }
+  }
+
+#if TS_HAS_TLS_EARLY_DATA
+  if (sslEarlyDataReading) {
+    ssl_error_t ssl_error = read_early_data(buf, nbytes, nread);
+    if (ssl_error != SSL_ERROR_NONE || sslEarlyDataReading) {
+      return ssl_error;
+    }
+  }
+#endif
+
+  ssl_error_t ssl_error = SSLReadBuffer(this->ssl, buf, nbytes, nread);
+  // The client Finished of a handshake with early data comes with the reads.
+  if (!sslKTLSChecked && sslHandShakeComplete && SSL_is_init_finished(this->ssl)) {
+    check_ktls();
+  }
+  return ssl_error;
+}
+
+#if TS_HAS_TLS_EARLY_DATA
+ssl_error_t
+SSLNetVConnection::read_early_data(void *buf, int64_t nbytes, int64_t &nread)
+{
+  bool finish           = false;
+  ssl_error_t ssl_error = SSLReadEarlyData(this->ssl, buf, nbytes, nread, finish);
+
+  if (finish) {
+    sslEarlyDataReading = false;
+    SSLVCDebug(this, "early data done, %" PRId64 " bytes", sslEarlyDataLength);
+  } else if (nread > 0) {
+    sslEarlyDataLength += nread;
+    SSL_INCREMENT_DYN_STAT_EX(ssl_early_data_accepted_bytes_stat, nread);
+  }
+  return ssl_error;
+}
+
+// The handshake of a connection that may send early data. As soon as some
+// arrived, the handshake is done as far as the session is concerned: the
+// requests can go on without waiting a round trip for the client Finished,
+// which the reads process when it comes.
+ssl_error_t
+SSLNetVConnection::accept_early_data()
+{
+  for (;;) {
+    ssl_error_t ssl_error;
+
+    if (sslEarlyDataReading) {
+      char buf[SSL3_RT_MAX_PLAIN_LENGTH];
+      int64_t nread = 0;
+
+      ssl_error = read_early_data(buf, sizeof(buf), nread);
+      if (ssl_error == SSL_ERROR_NONE) {
+        if (nread > 0) {
+          if (this->earlyDataBuffer == nullptr) {
+            this->earlyDataBuffer = new_MIOBuffer(BUFFER_SIZE_INDEX_16K);
+            this->earlyDataReader = this->earlyDataBuffer->alloc_reader();
+          }
+          this->earlyDataBuffer->write(buf, nread);
+        }
+        continue;
+      }
+    } else {
+      ssl_error = SSLAccept(this->ssl);
+      if (ssl_error == SSL_ERROR_NONE) {
+        return ssl_error;
+      }
+    }
+
+    if (ssl_error != SSL_ERROR_WANT_READ || !this->earlyDataReader || !this->earlyDataReader->is_read_avail_more_than(0)) {
+      return ssl_error;
+    }
+    // Go on with the rest of the handshake buffer, or with the socket.
+    if (this->handShakeReader && update_rbio(true)) {
+      continue;
+    }
+    return SSL_ERROR_NONE;
+  }
+}
+#endif
+
 // changed by YTS Team, yamsat
 void
 SSLNetVConnection::net_read_io(NetHandler *nh, EThread *lthread)
@@ -539,7 +672,7 @@ SSLNetVConnection::net_read_io(NetHandler *nh, EThread *lthread)
     if (ret == EVENT_ERROR) {
       this->read.triggered = 0;
       readSignalError(nh, err);
-    } else if (ret == SSL_HANDSHAKE_WANT_READ || ret == SSL_HANDSHAKE_WANT_ACCEPT) {
+    } else if (ret == SSL_HANDSHAKE_WANT_READ || ret == SSL_HANDSHAKE_WANT_ACCEPT || ret == SSL_HANDSHAKE_WANT_ASYNC) {
       if (SSLConfigParams::ssl_handshake_timeout_in > 0) {
         double handshake_time = ((double)(Thread::get_hrtime() - sslHandshakeBeginTime) / 1000000000);
         Debug("ssl", "ssl handshake for vc %p, took %.3f seconds, configured handshake_timer: %d", this, handshake_time,
@@ -552,8 +685,11 @@ SSLNetVConnection::net_read_io(NetHandler *nh, EThread *lthread)
           return;
         }
       }
-      // move over to the socket if we haven't already
-      if (this->handShakeBuffer) {
+      if (ret == SSL_HANDSHAKE_WANT_ASYNC) {
+        // wait for the async job, signalep triggers the read when it can resume
+        read.triggered = 0;
+      } else if (this->handShakeBuffer) {
+        // move over to the socket if we haven't already
         read.triggered = update_rbio(true);
       } else {
         read.triggered = 0;
@@ -668,14 +804,152 @@ SSLNetVConnection::net_read_io(NetHandler *nh, EThread *lthread)
   }
 }
 
+// Cut the next record to the configured or dynamic TLS record size.
+int64_t
+SSLNetVConnection::tls_record_size(int64_t l)
+{
+  // TS-2365: If the SSL max record size is set and we have
+  // more data than that, break this into smaller write
+  // operations.
+  if (SSLConfigParams::ssl_maxrecord > 0 && l > SSLConfigParams::ssl_maxrecord) {
+    l = SSLConfigParams::ssl_maxrecord;
+  } else if (SSLConfigParams::ssl_maxrecord == -1) {
+    uint32_t dynamic_tls_record_size;
+    if (sslTotalBytesSent < SSL_DEF_TLS_RECORD_BYTE_THRESHOLD) {
+      dynamic_tls_record_size = SSL_DEF_TLS_RECORD_SIZE;
+      SSL_INCREMENT_DYN_STAT(ssl_total_dyn_def_tls_record_count);
+    } else {
+      dynamic_tls_record_size = SSL_MAX_TLS_RECORD_SIZE;
+      SSL_INCREMENT_DYN_STAT(ssl_total_dyn_max_tls_record_count);
+    }
+    if (l > dynamic_tls_record_size) {
+      l = dynamic_tls_record_size;
+    }
+  }
+  return l;
+}
+
+void
+SSLNetVConnection::trace_write(const char *data, int64_t len)
+{
+  if (!origin_trace) {
+    TraceOut((0 < len && getSSLTrace()), get_remote_addr(), get_remote_port(), "WIRE TRACE\tbytes=%d\n%.*s", (int)len, (int)len,
+             data);
+  } else {
+    char origin_trace_ip[INET6_ADDRSTRLEN];
+    ats_ip_ntop(origin_trace_addr, origin_trace_ip, sizeof(origin_trace_ip));
+    TraceOut((0 < len && getSSLTrace()), get_remote_addr(), get_remote_port(), "CLIENT %s:%d\ttbytes=%d\n%.*s", origin_trace_ip,
+             origin_trace_port, (int)len, (int)len, data);
+  }
+}
+
+// Write the records into sslWriteBatch and flush it once, the buffer writes to the socket
+// whenever it fills up in between. The small blocks of the write buffer are gathered into
+// whole records. The plain text stays in the write buffer until its records are flushed, so
+// that the VIO does not complete with them still in user space.
+int64_t
+SSLNetVConnection::load_buffer_and_write_batch(int64_t towrite, MIOBufferAccessor &buf, int64_t &total_written, ssl_error_t &err)
+{
+  IOBufferReader *reader = buf.reader();
+
+  if (sslWriteUnflushed > 0) {
+    if (BIO_flush(sslWriteBatch) <= 0) {
+      err = BIO_should_retry(sslWriteBatch) ? SSL_ERROR_WANT_WRITE : SSL_ERROR_SYSCALL;
+      return 0;
+    }
+    ink_assert(sslWriteUnflushed <= towrite);
+    total_written += sslWriteUnflushed;
+    reader->consume(sslWriteUnflushed);
+    sslWriteUnflushed = 0;
+  }
+
+  char record[SSL_MAX_TLS_RECORD_SIZE];
+  IOBufferBlock *block = reader->get_current_block();
+  int64_t offset       = reader->start_offset;
+  int64_t batched      = 0;
+  int64_t records      = 0;
+
+  while (total_written + batched < towrite) {
+    // OpenSSL wants the record it could not write in full again, with the same data.
+    int64_t l = sslWriteRetry ? sslWriteRetry : tls_record_size(towrite - total_written - batched);
+
+    while (block->read_avail() == offset) {
+      block  = block->next.get();
+      offset = 0;
+    }
+
+    const char *data = block->start() + offset;
+    int64_t avail    = block->read_avail() - offset;
+    if (avail >= l || avail >= static_cast<int64_t>(sizeof(record))) {
+      l = std::min(l, avail);
+    } else {
+      // Gather the record from the following blocks.
+      IOBufferBlock *b = block;
+      int64_t o        = offset;
+      int64_t n        = 0;
+      l                = std::min(l, static_cast<int64_t>(sizeof(record)));
+      while (n < l && b) {
+        int64_t c = std::min(l - n, b->read_avail() - o);
+        memcpy(record + n, b->start() + o, c);
+        n += c;
+        b = b->next.get();
+        o = 0;
+      }
+      data = record;
+      l    = n;
+    }
+
+    int64_t num_written = 0;
+    err                 = SSLWriteBuffer(ssl, data, l, num_written, false);
+    if (num_written <= 0) {
+      sslWriteRetry = (SSL_ERROR_WANT_WRITE == err || SSL_ERROR_WANT_READ == err) ? l : 0;
+      break;
+    }
+    sslWriteRetry = 0;
+    trace_write(data, num_written);
+
+    batched += num_written;
+    ++records;
+    for (int64_t skip = num_written; skip > 0;) {
+      int64_t c = std::min(skip, block->read_avail() - offset);
+      skip -= c;
+      offset += c;
+      if (skip > 0) {
+        block  = block->next.get();
+        offset = 0;
+      }
+    }
+  }
+
+  if (batched > 0) {
+    SSL_INCREMENT_DYN_STAT_EX(ssl_write_batch_records_stat, records);
+    NET_INCREMENT_DYN_STAT(net_calls_to_write_stat);
+    if (BIO_flush(sslWriteBatch) > 0) {
+      total_written += batched;
+      reader->consume(batched);
+    } else if (BIO_should_retry(sslWriteBatch)) {
+      sslWriteUnflushed = batched;
+      if (SSL_ERROR_NONE == err) {
+        err = SSL_ERROR_WANT_WRITE;
+      }
+    } else {
+      err = SSL_ERROR_SYSCALL;
+    }
+  }
+
+  Debug("ssl", "SSLNetVConnection::loadBufferAndCallWrite, %" PRId64 " records of %" PRId64 " bytes, unflushed=%" PRId64
+               ", total=%" PRId64,
+        records, batched, sslWriteUnflushed, total_written);
+  return total_written;
+}
+
 int64_t
 SSLNetVConnection::load_buffer_and_write(int64_t towrite, MIOBufferAccessor &buf, int64_t &total_written, int &needs)
 {
   int64_t try_to_write;
-  int64_t num_really_written       = 0;
-  int64_t l                        = 0;
-  uint32_t dynamic_tls_record_size = 0;
-  ssl_error_t err                  = SSL_ERROR_NONE;
+  int64_t num_really_written = 0;
+  int64_t l                  = 0;
+  ssl_error_t err            = SSL_ERROR_NONE;
 
   // Dynamic TLS record sizing
   ink_hrtime now = 0;
@@ -691,72 +965,66 @@ SSLNetVConnection::load_buffer_and_write(int64_t towrite, MIOBufferAccessor &buf
           sslLastWriteTime, msec_since_last_write);
   }
 
-  if (HttpProxyPort::TRANSPORT_BLIND_TUNNEL == this->attributes) {
+  // Blind tunnels carry the raw bytes, and with kTLS the kernel builds the records.
+  if (HttpProxyPort::TRANSPORT_BLIND_TUNNEL == this->attributes || sslKTLSSend) {
     return this->super::load_buffer_and_write(towrite, buf, total_written, needs);
   }
 
+  if (sslWriteBatch == nullptr && SSLConfigParams::ssl_write_batch_size > 0
+#if TS_HAS_TLS_EARLY_DATA
+      && !sslEarlyDataReading
+#endif
+  ) {
+    sslWriteBatch = SSLWriteBatchEnable(ssl, SSLConfigParams::ssl_write_batch_size);
+  }
+
   bool trace = getSSLTrace();
 
-  do {
-    // What is remaining left in the next block?
-    l                   = buf.reader()->block_read_avail();
-    char *current_block = buf.reader()->start();
-
-    // check if to amount to write exceeds that in this buffer
-    int64_t wavail = towrite - total_written;
-
-    if (l > wavail) {
-      l = wavail;
-    }
-
-    // TS-2365: If the SSL max record size is set and we have
-    // more data than that, break this into smaller write
-    // operations.
-    if (SSLConfigParams::ssl_maxrecord > 0 && l > SSLConfigParams::ssl_maxrecord) {
-      l = SSLConfigParams::ssl_maxrecord;
-    } else if (SSLConfigParams::ssl_maxrecord == -1) {
-      if (sslTotalBytesSent < SSL_DEF_TLS_RECORD_BYTE_THRESHOLD) {
-        dynamic_tls_record_size = SSL_DEF_TLS_RECORD_SIZE;
-        SSL_INCREMENT_DYN_STAT(ssl_total_dyn_def_tls_record_count);
-      } else {
-        dynamic_tls_record_size = SSL_MAX_TLS_RECORD_SIZE;
-        SSL_INCREMENT_DYN_STAT(ssl_total_dyn_max_tls_record_count);
-      }
-      if (l > dynamic_tls_record_size) {
-        l = dynamic_tls_record_size;
+  if (sslWriteBatch) {
+    num_really_written = load_buffer_and_write_batch(towrite, buf, total_written, err);
+  } else {
+    do {
+      // What is remaining left in the next block?
+      l                   = buf.reader()->block_read_avail();
+      char *current_block = buf.reader()->start();
+
+      // check if to amount to write exceeds that in this buffer
+      int64_t wavail = towrite - total_written;
+
+      if (l > wavail) {
+        l = wavail;
       }
-    }
 
-    if (!l) {
-      break;
-    }
+      l = tls_record_size(l);
+      if (!l) {
+        break;
+      }
 
-    try_to_write       = l;
-    num_really_written = 0;
-    Debug("ssl", "SSLNetVConnection::loadBufferAndCallWrite, before SSLWriteBuffer, l=%" PRId64 ", towrite=%" PRId64 ", b=%p", l,
-          towrite, current_block);
-    err = SSLWriteBuffer(ssl, current_block, l, num_really_written);
+      try_to_write       = l;
+      num_really_written = 0;
+      Debug("ssl", "SSLNetVConnection::loadBufferAndCallWrite, before SSLWriteBuffer, l=%" PRId64 ", towrite=%" PRId64 ", b=%p", l,
+            towrite, current_block);
+#if TS_HAS_TLS_EARLY_DATA
+      // Until the client finishes the handshake, the responses go out as 0.5-RTT data.
+      if (sslEarlyDataReading) {
+        err = SSLWriteEarlyData(ssl, current_block, l, num_really_written);
+      } else
+#endif
+        err = SSLWriteBuffer(ssl, current_block, l, num_really_written);
 
-    if (!origin_trace) {
-      TraceOut((0 < num_really_written && trace), get_remote_addr(), get_remote_port(), "WIRE TRACE\tbytes=%d\n%.*s",
-               (int)num_really_written, (int)num_really_written, current_block);
-    } else {
-      char origin_trace_ip[INET6_ADDRSTRLEN];
-      ats_ip_ntop(origin_trace_addr, origin_trace_ip, sizeof(origin_trace_ip));
-      TraceOut((0 < num_really_written && trace), get_remote_addr(), get_remote_port(), "CLIENT %s:%d\ttbytes=%d\n%.*s",
-               origin_trace_ip, origin_trace_port, (int)num_really_written, (int)num_really_written, current_block);
-    }
+      trace_write(current_block, num_really_written);
 
-    // We wrote all that we thought we should
-    if (num_really_written > 0) {
-      total_written += num_really_written;
-      buf.reader()->consume(num_really_written);
-    }
+      // We wrote all that we thought we should
+      if (num_really_written > 0) {
+        total_written += num_really_written;
+        buf.reader()->consume(num_really_written);
+      }
 
-    Debug("ssl", "SSLNetVConnection::loadBufferAndCallWrite,Number of bytes written=%" PRId64 " , total=%" PRId64 "",
-          num_really_written, total_written);
-    NET_INCREMENT_DYN_STAT(net_calls_to_write_stat);
-  } while (num_really_written == try_to_write && total_written < towrite);
+      Debug("ssl", "SSLNetVConnection::loadBufferAndCallWrite,Number of bytes written=%" PRId64 " , total=%" PRId64 "",
+            num_really_written, total_written);
+      NET_INCREMENT_DYN_STAT(net_calls_to_write_stat);
+    } while (num_really_written == try_to_write && total_written < towrite);
+  }
 
   if (total_written > 0) {
     sslLastWriteTime = now;
@@ -852,6 +1120,11 @@ SSLNetVConnection::do_io_close(int lerrno)
       // Send the close-notify
       int ret = SSL_shutdown(ssl);
       Debug("ssl-shutdown", "SSL_shutdown %s", (ret) ? "success" : "failed");
+    } else if (x == 0 && get_context() == NET_VCONNECTION_OUT) {
+      // The origin closed first with a FIN, this is a clean close and its session can still be
+      // resumed. SSL_free drops the sessions of the connections that did not send a close-notify,
+      // as it should after a reset or another error.
+      SSL_set_shutdown(ssl, new_shutdown_mode | SSL_SENT_SHUTDOWN);
     }
   }
   // Go on and do the unix socket cleanups
@@ -862,6 +1135,7 @@ void
 SSLNetVConnection::clear()
 {
   if (ssl != nullptr) {
+    SSLCryptoOffloadCancel(ssl);
     SSL_free(ssl);
     ssl = nullptr;
   }
@@ -872,6 +1146,14 @@ SSLNetVConnection::clear()
   sslTotalBytesSent           = 0;
   sslClientRenegotiationAbort = false;
   sslSessionCacheHit          = false;
+  sslKTLSSend                 = false;
+  sslKTLSChecked              = false;
+  sslWriteBatch               = nullptr;
+  sslWriteUnflushed           = 0;
+  sslWriteRetry               = 0;
+  sslEarlyDataReading         = false;
+  sslEarlyDataLength          = 0;
+  free_early_data_buffer();
 
   curHook              = nullptr;
   hookOpRequested      = SSL_HOOK_OP_DEFAULT;
@@ -964,6 +1246,9 @@ SSLNetVConnection::sslStartHandShake(int event, int &err)
       // to negotiate a SSL session, but it's enough to trampoline us into the SNI callback where we
       // can select the right server certificate.
       this->ssl = make_ssl_connection(lookup->defaultContext(), this);
+      if (this->ssl != nullptr) {
+        sslEarlyDataReading = SSLEarlyDataEnable(this->ssl);
+      }
     }
 
     if (this->ssl == nullptr) {
@@ -1024,6 +1309,7 @@ SSLNetVConnection::sslStartHandShake(int event, int &err)
           SSL_INCREMENT_DYN_STAT(ssl_sni_name_set_failure);
         }
       }
+      SSLOriginSessionResume(this->ssl);
     }
 
     return sslClientHandShakeEvent(err);
@@ -1113,11 +1399,17 @@ SSLNetVConnection::sslServerHandShakeEvent(int &err)
   }
 
 #if TS_USE_TLS_ASYNC
-  if (SSLConfigParams::async_handshake_enabled) {
+  if (SSLConfigParams::async_handshake_enabled || SSLCryptoOffloadEnabled()) {
     SSL_set_mode(ssl, SSL_MODE_ASYNC);
   }
 #endif
-  ssl_error_t ssl_error = SSLAccept(ssl);
+  ssl_error_t ssl_error;
+#if TS_HAS_TLS_EARLY_DATA
+  if (sslEarlyDataReading || this->earlyDataReader) {
+    ssl_error = accept_early_data();
+  } else
+#endif
+    ssl_error = SSLAccept(ssl);
 #if TS_USE_TLS_ASYNC
   if (ssl_error == SSL_ERROR_WANT_ASYNC && this->signalep.type == 0) {
     size_t numfds;
@@ -1132,7 +1424,7 @@ SSLNetVConnection::sslServerHandShakeEvent(int &err)
 #endif
     if (ssl_error == SSL_ERROR_NONE || ssl_error == SSL_ERROR_SSL) {
 #if TS_USE_TLS_ASYNC
-    if (SSLConfigParams::async_handshake_enabled) {
+    if (SSLConfigParams::async_handshake_enabled || SSLCryptoOffloadEnabled()) {
       // Clean up the epoll entry for signalling
       SSL_clear_mode(ssl, SSL_MODE_ASYNC);
       this->signalep.stop();
@@ -1169,6 +1461,20 @@ SSLNetVConnection::sslServerHandShakeEvent(int &err)
     }
 
     sslHandShakeComplete = true;
+#if TS_HAS_TLS_EARLY_DATA
+    switch (SSL_get_early_data_status(ssl)) {
+    case SSL_EARLY_DATA_ACCEPTED:
+      SSL_INCREMENT_DYN_STAT(ssl_early_data_accepted_stat);
+      break;
+    case SSL_EARLY_DATA_REJECTED:
+      SSL_INCREMENT_DYN_STAT(ssl_early_data_rejected_stat);
+      break;
+    }
+#endif
+    // Not yet if the client has to finish the handshake after its early data, read_app_data() does then.
+    if (SSL_is_init_finished(ssl)) {
+      check_ktls();
+    }
 
     TraceIn(trace, get_remote_addr(), get_remote_port(), "SSL server handshake completed successfully");
     // do we want to include cert info in trace?
@@ -1179,6 +1485,7 @@ SSLNetVConnection::sslServerHandShakeEvent(int &err)
 
       Debug("ssl", "ssl handshake time:%" PRId64, ssl_handshake_time);
       SSL_INCREMENT_DYN_STAT_EX(ssl_total_handshake_time_stat, ssl_handshake_time);
+      ssl_handshake_time_histogram->record(ink_hrtime_to_usec(ssl_handshake_time));
       SSL_INCREMENT_DYN_STAT(ssl_total_success_handshake_count_in_stat);
     }
 
@@ -1261,7 +1568,7 @@ SSLNetVConnection::sslServerHandShakeEvent(int &err)
 #if TS_USE_TLS_ASYNC
   case SSL_ERROR_WANT_ASYNC:
     TraceIn(trace, get_remote_addr(), get_remote_port(), "SSL server handshake ERROR_WANT_ASYNC");
-    return EVENT_CONT;
+    return SSL_HANDSHAKE_WANT_ASYNC;
 #endif
 
   case SSL_ERROR_WANT_ACCEPT:
@@ -1319,11 +1626,15 @@ SSLNetVConnection::sslClientHandShakeEvent(int &err)
     }
 
     SSL_INCREMENT_DYN_STAT(ssl_total_success_handshake_count_out_stat);
+    if (SSL_session_reused(ssl)) {
+      SSL_INCREMENT_DYN_STAT(ssl_origin_session_reused);
+    }
 
     TraceIn(trace, get_remote_addr(), get_remote_port(), "SSL client handshake completed successfully");
     // do we want to include cert info in trace?
 
     sslHandShakeComplete = true;
+    check_ktls();
     return EVENT_DONE;
 
   case SSL_ERROR_WANT_WRITE:
@@ -1696,6 +2007,8 @@ SSLNetVConnection::populate(Connection &con, Continuation *c, void *arg)
   // Maybe bring over the stats?
 
   this->sslHandShakeComplete = true;
+  this->sslWriteBatch        = SSLWriteBatchGet(this->ssl);
+  adopt_ktls();
   SSLNetVCAttach(this->ssl, this);
   return EVENT_DONE;
 }
@@ -21,100 +21,285 @@
 
 #include "P_SSLConfig.h"
 #include "SSLSessionCache.h"
+#include "ts/TestBox.h"
+
 #include <cstring>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+namespace
+{
+// Number of times a reader looks again at a slot being written before it gives up.
+const int SSL_SESSION_CACHE_READ_RETRIES = 4;
+
+// Number of times removeSession tries to claim a slot being written. A process sharing
+// the file that died while writing leaves the slot claimed until the file is opened alone,
+// readers skip such a slot too.
+const int SSL_SESSION_CACHE_REMOVE_RETRIES = 2;
+
+// With proxy.config.ssl.session_cache.skip_cache_on_bucket_contention, a slot being written
+// is skipped at once.
+int
+contention_retries(int retries)
+{
+  return SSLConfigParams::session_cache_skip_on_lock_contention ? 1 : retries;
+}
 
-#define SSLSESSIONCACHE_STRINGIFY0(x) #x
-#define SSLSESSIONCACHE_STRINGIFY(x) SSLSESSIONCACHE_STRINGIFY0(x)
-#define SSLSESSIONCACHE_LINENO SSLSESSIONCACHE_STRINGIFY(__LINE__)
+// Offset of the first slot in the mapping.
+const size_t SSL_SESSION_SLOTS_OFFSET = INK_ALIGN(sizeof(SSLSessionCacheHeader), alignof(SSLSessionSlot));
+
+bool
+claim_slot(SSLSessionSlot *slot, uint64_t &seq)
+{
+  seq = slot->sequence.load(std::memory_order_acquire);
+  return (seq & 1) == 0 && slot->sequence.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire);
+}
+
+void
+release_slot(SSLSessionSlot *slot, uint64_t seq)
+{
+  slot->sequence.store(seq + 2, std::memory_order_release);
+}
 
-#ifdef DEBUG
-#define PRINT_BUCKET(x) this->print(x " at " __FILE__ ":" SSLSESSIONCACHE_LINENO);
-#else
-#define PRINT_BUCKET(x)
-#endif
+void
+count_contention()
+{
+  if (ssl_rsb) {
+    SSL_INCREMENT_DYN_STAT(ssl_session_cache_lock_contention);
+  }
+}
 
-using ts::detail::RBNode;
+} // namespace
 
 /* Session Cache */
-SSLSessionCache::SSLSessionCache() : session_bucket(nullptr), nbuckets(SSLConfigParams::session_cache_number_buckets)
+SSLSessionCache::SSLSessionCache(const char *path)
+  : nbuckets(SSLConfigParams::session_cache_number_buckets),
+    bucket_size(std::max(SSLConfigParams::session_cache_max_bucket_size, static_cast<size_t>(SSL_SESSION_CACHE_WAYS)))
 {
-  Debug("ssl.session_cache", "Created new ssl session cache %p with %zu buckets each with size max size %zu", this, nbuckets,
-        SSLConfigParams::session_cache_max_bucket_size);
+  size_t size = INK_ALIGN(SSL_SESSION_SLOTS_OFFSET + nbuckets * bucket_size * sizeof(SSLSessionSlot), ats_pagesize());
+
+  if (path == nullptr || !mapFile(path, size)) {
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ink_release_assert(addr != MAP_FAILED);
+    map_size = size;
+    header   = static_cast<SSLSessionCacheHeader *>(addr);
+  }
+  slots = reinterpret_cast<SSLSessionSlot *>(reinterpret_cast<char *>(header) + SSL_SESSION_SLOTS_OFFSET);
 
-  session_bucket = new SSLSessionBucket[nbuckets];
+  Debug("ssl.session_cache", "Created new ssl session cache %p with %zu buckets each with size max size %zu%s%s", this, nbuckets,
+        bucket_size, fd >= 0 ? " in " : "", fd >= 0 ? path : "");
 }
 
 SSLSessionCache::~SSLSessionCache()
 {
-  delete[] session_bucket;
+  munmap(header, map_size);
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+// Map the slots from the file @a path, creating it if needed. The first
+// process to open the file gets it for itself for a moment, to initialize
+// it or to release the slots of a writer that died while it had one.
+bool
+SSLSessionCache::mapFile(const char *path, size_t size)
+{
+  fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    Warning("unable to open the SSL session cache %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  bool alone = flock(fd, LOCK_EX | LOCK_NB) == 0;
+  if (!alone) {
+    flock(fd, LOCK_SH);
+  }
+
+  struct stat st;
+  void *addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size) {
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+
+  const SSLSessionCacheHeader expected = {SSLSessionCacheHeader::SESSION_CACHE_MAGIC,
+                                          SSLSessionCacheHeader::SESSION_CACHE_VERSION,
+                                          static_cast<uint32_t>(nbuckets),
+                                          static_cast<uint32_t>(bucket_size),
+                                          static_cast<uint32_t>(sizeof(SSLSessionSlot)),
+                                          0};
+
+  if (addr == MAP_FAILED || memcmp(addr, &expected, sizeof(expected)) != 0) {
+    if (addr != MAP_FAILED) {
+      munmap(addr, size);
+      addr = MAP_FAILED;
+    }
+    // Start over with empty slots, unless another process uses the file.
+    if (alone && ftruncate(fd, 0) == 0 && ftruncate(fd, size) == 0) {
+      addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (addr == MAP_FAILED) {
+      Warning("unable to map the SSL session cache %s%s", path, alone ? "" : ", another process uses it with another size");
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    *static_cast<SSLSessionCacheHeader *>(addr) = expected;
+  } else if (alone) {
+    // A writer died while it had these slots.
+    SSLSessionSlot *file_slots = reinterpret_cast<SSLSessionSlot *>(static_cast<char *>(addr) + SSL_SESSION_SLOTS_OFFSET);
+    size_t count               = 0;
+    for (size_t i = 0; i < nbuckets * bucket_size; ++i) {
+      uint64_t seq = file_slots[i].sequence.load(std::memory_order_relaxed);
+      if (seq & 1) {
+        file_slots[i].data_len = 0;
+        file_slots[i].sequence.store(seq + 1, std::memory_order_relaxed);
+      } else if (file_slots[i].data_len) {
+        ++count;
+      }
+    }
+    Note("loaded %zu SSL sessions from %s", count, path);
+  }
+
+  if (alone) {
+    flock(fd, LOCK_SH);
+  }
+  header   = static_cast<SSLSessionCacheHeader *>(addr);
+  map_size = size;
+  return true;
+}
+
+// Return the bucket of @a sid, and in @a first the position of its first way.
+SSLSessionSlot *
+SSLSessionCache::findSlots(const SSLSessionID &sid, size_t &first) const
+{
+  uint64_t hash = sid.hash();
+
+  first = (hash / nbuckets) % bucket_size;
+  return &slots[(hash % nbuckets) * bucket_size];
+}
+
+// Copy the ASN1 data of @a sid to @a data. Returns its length, 0 if it is not in the cache.
+int
+SSLSessionCache::readSession(const SSLSessionID &sid, unsigned char *data) const
+{
+  size_t first;
+  SSLSessionSlot *bucket = findSlots(sid, first);
+  uint64_t hash          = sid.hash();
+  int retries            = contention_retries(SSL_SESSION_CACHE_READ_RETRIES);
+
+  for (unsigned way = 0; way < SSL_SESSION_CACHE_WAYS; ++way) {
+    SSLSessionSlot *slot = &bucket[(first + way) % bucket_size];
+
+    for (int retry = 0; retry < retries; ++retry) {
+      uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+      if (seq & 1) {
+        continue;
+      }
+      if (slot->hash != hash || slot->data_len == 0 || slot->id_len != sid.len || memcmp(slot->id, sid.bytes, sid.len) != 0) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) == seq) {
+          break; // not this one
+        }
+        continue;
+      }
+
+      uint32_t len = std::min(slot->data_len, static_cast<uint32_t>(SSL_MAX_SESSION_SIZE));
+      memcpy(data, slot->data, len);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot->sequence.load(std::memory_order_relaxed) == seq) {
+        return len;
+      }
+    }
+  }
+
+  return 0;
 }
 
 int
 SSLSessionCache::getSessionBuffer(const SSLSessionID &sid, char *buffer, int &len) const
 {
-  uint64_t hash            = sid.hash();
-  uint64_t target_bucket   = hash % nbuckets;
-  SSLSessionBucket *bucket = &session_bucket[target_bucket];
+  unsigned char data[SSL_MAX_SESSION_SIZE];
+  int true_len = readSession(sid, data);
 
-  return bucket->getSessionBuffer(sid, buffer, len);
+  if (true_len && buffer) {
+    if (true_len < len) {
+      len = true_len;
+    }
+    memcpy(buffer, data, len);
+  }
+  return true_len;
 }
 
 bool
 SSLSessionCache::getSession(const SSLSessionID &sid, SSL_SESSION **sess) const
 {
-  uint64_t hash            = sid.hash();
-  uint64_t target_bucket   = hash % nbuckets;
-  SSLSessionBucket *bucket = &session_bucket[target_bucket];
+  unsigned char data[SSL_MAX_SESSION_SIZE];
+  int len = readSession(sid, data);
 
   if (is_debug_tag_set("ssl.session_cache")) {
     char buf[sid.len * 2 + 1];
     sid.toString(buf, sizeof(buf));
-    Debug("ssl.session_cache.get", "SessionCache looking in bucket %" PRId64 " (%p) for session '%s' (hash: %" PRIX64 ").",
-          target_bucket, bucket, buf, hash);
+    Debug("ssl.session_cache.get", "SessionCache looking for session '%s' (hash: %" PRIX64 "): %s.", buf, sid.hash(),
+          len ? "found" : "not found");
+  }
+
+  if (len == 0) {
+    return false;
   }
 
-  return bucket->getSession(sid, sess);
+  const unsigned char *loc = data;
+  *sess                    = d2i_SSL_SESSION(nullptr, &loc, len);
+  return true;
 }
 
 void
 SSLSessionCache::removeSession(const SSLSessionID &sid)
 {
-  uint64_t hash            = sid.hash();
-  uint64_t target_bucket   = hash % nbuckets;
-  SSLSessionBucket *bucket = &session_bucket[target_bucket];
+  size_t first;
+  SSLSessionSlot *bucket = findSlots(sid, first);
+  uint64_t hash          = sid.hash();
 
   if (is_debug_tag_set("ssl.session_cache")) {
     char buf[sid.len * 2 + 1];
     sid.toString(buf, sizeof(buf));
-    Debug("ssl.session_cache.remove", "SessionCache using bucket %" PRId64 " (%p): Removing session '%s' (hash: %" PRIX64 ").",
-          target_bucket, bucket, buf, hash);
+    Debug("ssl.session_cache.remove", "SessionCache removing session '%s' (hash: %" PRIX64 ").", buf, hash);
   }
 
   if (ssl_rsb) {
     SSL_INCREMENT_DYN_STAT(ssl_session_cache_eviction);
   }
-  bucket->removeSession(sid);
-}
 
-void
-SSLSessionCache::insertSession(const SSLSessionID &sid, SSL_SESSION *sess)
-{
-  uint64_t hash            = sid.hash();
-  uint64_t target_bucket   = hash % nbuckets;
-  SSLSessionBucket *bucket = &session_bucket[target_bucket];
+  int retries = contention_retries(SSL_SESSION_CACHE_REMOVE_RETRIES);
 
-  if (is_debug_tag_set("ssl.session_cache")) {
-    char buf[sid.len * 2 + 1];
-    sid.toString(buf, sizeof(buf));
-    Debug("ssl.session_cache.insert", "SessionCache using bucket %" PRId64 " (%p): Inserting session '%s' (hash: %" PRIX64 ").",
-          target_bucket, bucket, buf, hash);
-  }
+  for (unsigned way = 0; way < SSL_SESSION_CACHE_WAYS; ++way) {
+    SSLSessionSlot *slot = &bucket[(first + way) % bucket_size];
+    uint64_t seq;
 
-  bucket->insertSession(sid, sess);
+    if (slot->hash != hash) {
+      continue;
+    }
+    // The writer of a slot only copies a few hundred bytes, give it a chance to finish.
+    int retry = 0;
+    while (!claim_slot(slot, seq) && ++retry < retries) {
+      sched_yield();
+    }
+    if (retry) {
+      count_contention();
+    }
+    if (retry == retries) {
+      // The slot is still claimed, so readers skip it.
+      Debug("ssl.session_cache.remove", "SessionCache slot of hash %" PRIX64 " is being written, skipping it", hash);
+      continue;
+    }
+    if (slot->data_len && slot->id_len == sid.len && memcmp(slot->id, sid.bytes, sid.len) == 0) {
+      slot->data_len = 0;
+    }
+    release_slot(slot, seq);
+  }
 }
 
 void
-SSLSessionBucket::insertSession(const SSLSessionID &id, SSL_SESSION *sess)
+SSLSessionCache::insertSession(const SSLSessionID &sid, SSL_SESSION *sess)
 {
   size_t len = i2d_SSL_SESSION(sess, nullptr); // make sure we're not going to need more than SSL_MAX_SESSION_SIZE bytes
   /* do not cache a session that's too big. */
@@ -123,182 +308,157 @@ SSLSessionBucket::insertSession(const SSLSessionID &id, SSL_SESSION *sess)
     return;
   }
 
-  if (is_debug_tag_set("ssl.session_cache")) {
-    char buf[id.len * 2 + 1];
-    id.toString(buf, sizeof(buf));
-    Debug("ssl.session_cache", "Inserting session '%s' to bucket %p.", buf, this);
-  }
-
-  MUTEX_TRY_LOCK(lock, mutex, this_ethread());
-  if (!lock.is_locked()) {
-    if (ssl_rsb) {
-      SSL_INCREMENT_DYN_STAT(ssl_session_cache_lock_contention);
-    }
-    if (SSLConfigParams::session_cache_skip_on_lock_contention) {
-      return;
-    }
-    lock.acquire(this_ethread());
-  }
+  size_t first;
+  SSLSessionSlot *bucket = findSlots(sid, first);
+  uint64_t hash          = sid.hash();
 
-  PRINT_BUCKET("insertSession before")
-  if (queue.size >= static_cast<int>(SSLConfigParams::session_cache_max_bucket_size)) {
-    removeOldestSession();
+  if (is_debug_tag_set("ssl.session_cache")) {
+    char buf[sid.len * 2 + 1];
+    sid.toString(buf, sizeof(buf));
+    Debug("ssl.session_cache.insert", "SessionCache inserting session '%s' (hash: %" PRIX64 ").", buf, hash);
   }
 
-  // Don't insert if it is already there
-  SSLSession *node = queue.tail;
-  while (node) {
-    if (node->session_id == id) {
+  // Don't insert if it is already there, else take an empty way or the oldest.
+  SSLSessionSlot *ways[SSL_SESSION_CACHE_WAYS];
+  for (unsigned way = 0; way < SSL_SESSION_CACHE_WAYS; ++way) {
+    SSLSessionSlot *slot = &bucket[(first + way) % bucket_size];
+    if (slot->hash == hash && slot->data_len && slot->id_len == sid.len && memcmp(slot->id, sid.bytes, sid.len) == 0) {
       return;
     }
-    node = node->link.prev;
+    ways[way] = slot;
   }
+  std::stable_sort(ways, ways + SSL_SESSION_CACHE_WAYS, [](const SSLSessionSlot *a, const SSLSessionSlot *b) {
+    return (a->data_len ? a->inserted : INT64_MIN) < (b->data_len ? b->inserted : INT64_MIN);
+  });
 
-  Ptr<IOBufferData> buf;
-  buf = new_IOBufferData(buffer_size_to_index(len, MAX_BUFFER_SIZE_INDEX), MEMALIGNED);
-  ink_release_assert(static_cast<size_t>(buf->block_size()) >= len);
-  unsigned char *loc = reinterpret_cast<unsigned char *>(buf->data());
-  i2d_SSL_SESSION(sess, &loc);
-
-  ats_scoped_obj<SSLSession> ssl_session(new SSLSession(id, buf, len));
-
-  /* do the actual insert */
-  queue.enqueue(ssl_session.release());
-
-  PRINT_BUCKET("insertSession after")
-}
+  for (SSLSessionSlot *slot : ways) {
+    uint64_t seq;
 
-int
-SSLSessionBucket::getSessionBuffer(const SSLSessionID &id, char *buffer, int &len)
-{
-  int true_len = 0;
-  MUTEX_TRY_LOCK(lock, mutex, this_ethread());
-  if (!lock.is_locked()) {
-    if (ssl_rsb) {
-      SSL_INCREMENT_DYN_STAT(ssl_session_cache_lock_contention);
+    if (!claim_slot(slot, seq)) {
+      continue;
     }
-    if (SSLConfigParams::session_cache_skip_on_lock_contention) {
-      return true_len;
+    if (slot->data_len && ssl_rsb) {
+      SSL_INCREMENT_DYN_STAT(ssl_session_cache_eviction);
     }
 
-    lock.acquire(this_ethread());
+    unsigned char *loc = slot->data;
+    slot->hash         = hash;
+    slot->inserted     = time(nullptr);
+    slot->id_len       = sid.len;
+    memcpy(slot->id, sid.bytes, sid.len);
+    slot->data_len = i2d_SSL_SESSION(sess, &loc);
+    release_slot(slot, seq);
+    return;
   }
 
-  // We work backwards because that's the most likely place we'll find our session...
-  SSLSession *node = queue.tail;
-  while (node) {
-    if (node->session_id == id) {
-      true_len = node->len_asn1_data;
-      if (buffer) {
-        const unsigned char *loc = reinterpret_cast<const unsigned char *>(node->asn1_data->data());
-        if (true_len < len) {
-          len = true_len;
-        }
-        memcpy(buffer, loc, len);
-        return true_len;
-      }
-    }
-    node = node->link.prev;
-  }
-  return 0;
+  // Every way is being written by someone else.
+  count_contention();
 }
 
-bool
-SSLSessionBucket::getSession(const SSLSessionID &id, SSL_SESSION **sess)
+REGRESSION_TEST(SSLSessionCache)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
 {
-  char buf[id.len * 2 + 1];
-  buf[0] = '\0'; // just to be safe.
-  if (is_debug_tag_set("ssl.session_cache")) {
-    id.toString(buf, sizeof(buf));
-  }
-
-  Debug("ssl.session_cache", "Looking for session with id '%s' in bucket %p", buf, this);
-
-  MUTEX_TRY_LOCK(lock, mutex, this_ethread());
-  if (!lock.is_locked()) {
-    if (ssl_rsb) {
-      SSL_INCREMENT_DYN_STAT(ssl_session_cache_lock_contention);
-    }
-    if (SSLConfigParams::session_cache_skip_on_lock_contention) {
-      return false;
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  char path[] = "/tmp/ssl_session_cache.XXXXXX";
+  int tmp     = mkstemp(path);
+  close(tmp);
+  unlink(path);
+
+  SSL_CTX *ctx = SSL_CTX_new(SSLv23_server_method());
+  SSL *ssl     = SSL_new(ctx);
+  unsigned char key[48];
+  memset(key, 0x5a, sizeof(key));
+
+  auto make_session = [&](unsigned char n) {
+    unsigned char id[32];
+    memset(id, n, sizeof(id));
+    SSL_SESSION *sess = SSL_SESSION_new();
+    SSL_SESSION_set1_id(sess, id, sizeof(id));
+    SSL_SESSION_set1_master_key(sess, key, sizeof(key));
+    SSL_SESSION_set_protocol_version(sess, TLS1_2_VERSION);
+    SSL_SESSION_set_cipher(sess, sk_SSL_CIPHER_value(SSL_get_ciphers(ssl), 0));
+    return std::make_pair(SSLSessionID(id, sizeof(id)), sess);
+  };
+
+  {
+    SSLSessionCache cache(path);
+    SSL_SESSION *found = nullptr;
+
+    for (unsigned n = 1; n <= 20; ++n) {
+      auto s = make_session(n);
+      cache.insertSession(s.first, s.second);
+      SSL_SESSION_free(s.second);
     }
 
-    lock.acquire(this_ethread());
-  }
-
-  PRINT_BUCKET("getSession")
-
-  // We work backwards because that's the most likely place we'll find our session...
-  SSLSession *node = queue.tail;
-  while (node) {
-    if (node->session_id == id) {
-      const unsigned char *loc = reinterpret_cast<const unsigned char *>(node->asn1_data->data());
-      *sess                    = d2i_SSL_SESSION(nullptr, &loc, node->len_asn1_data);
-
-      return true;
+    auto s = make_session(3);
+    box.check(cache.getSession(s.first, &found) && found != nullptr, "inserted session not found");
+    if (found) {
+      unsigned int len;
+      const unsigned char *id = SSL_SESSION_get_id(found, &len);
+      box.check(len == 32 && id[0] == 3, "wrong session found");
+      SSL_SESSION_free(found);
     }
-    node = node->link.prev;
-  }
 
-  Debug("ssl.session_cache", "Session with id '%s' not found in bucket %p.", buf, this);
-  return false;
-}
+    char buffer[SSL_MAX_SESSION_SIZE];
+    int len = sizeof(buffer);
+    box.check(cache.getSessionBuffer(s.first, buffer, len) > 0 && len > 0, "session buffer not found");
 
-void inline SSLSessionBucket::print(const char *ref_str) const
-{
-  /* NOTE: This method assumes you're already holding the bucket lock */
-  if (!is_debug_tag_set("ssl.session_cache.bucket")) {
-    return;
+    cache.removeSession(s.first);
+    found = nullptr;
+    box.check(!cache.getSession(s.first, &found), "removed session found");
+    SSL_SESSION_free(s.second);
   }
 
-  fprintf(stderr, "-------------- BUCKET %p (%s) ----------------\n", this, ref_str);
-  fprintf(stderr, "Current Size: %d, Max Size: %zd\n", queue.size, SSLConfigParams::session_cache_max_bucket_size);
-  fprintf(stderr, "Queue: \n");
-
-  SSLSession *node = queue.head;
-  while (node) {
-    char s_buf[2 * node->session_id.len + 1];
-    node->session_id.toString(s_buf, sizeof(s_buf));
-    fprintf(stderr, "  %s\n", s_buf);
-    node = node->link.next;
+  // The sessions survive in the file.
+  {
+    SSLSessionCache cache(path);
+    SSL_SESSION *found = nullptr;
+    auto s             = make_session(7);
+    box.check(cache.getSession(s.first, &found) && found != nullptr, "session not found after reopening the cache");
+    SSL_SESSION_free(found);
+    SSL_SESSION_free(s.second);
+
+    s = make_session(3);
+    box.check(!cache.getSession(s.first, &found), "removed session found after reopening the cache");
+    SSL_SESSION_free(s.second);
   }
-}
 
-void inline SSLSessionBucket::removeOldestSession()
-{
-  // Caller must hold the bucket lock.
-  ink_assert(this_ethread() == mutex->thread_holding);
-
-  PRINT_BUCKET("removeOldestSession before")
-  while (queue.head && queue.size >= static_cast<int>(SSLConfigParams::session_cache_max_bucket_size)) {
-    SSLSession *old_head = queue.pop();
-    if (is_debug_tag_set("ssl.session_cache")) {
-      char buf[old_head->session_id.len * 2 + 1];
-      old_head->session_id.toString(buf, sizeof(buf));
-      Debug("ssl.session_cache", "Removing session '%s' from bucket %p because the bucket has size %d and max %zd", buf, this,
-            (queue.size + 1), SSLConfigParams::session_cache_max_bucket_size);
+  // A process sharing the file that died while writing leaves its slots claimed.
+  {
+    SSLSessionCache cache(path);
+    int fd = open(path, O_RDWR);
+    struct stat st;
+    fstat(fd, &st);
+    char *addr = static_cast<char *>(mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    close(fd);
+
+    const SSLSessionCacheHeader *file_header = reinterpret_cast<SSLSessionCacheHeader *>(addr);
+    SSLSessionSlot *file_slots               = reinterpret_cast<SSLSessionSlot *>(addr + SSL_SESSION_SLOTS_OFFSET);
+    for (size_t i = 0; i < file_header->nbuckets * file_header->bucket_size; ++i) {
+      file_slots[i].sequence.fetch_add(1);
     }
-    delete old_head;
-  }
-  PRINT_BUCKET("removeOldestSession after")
-}
 
-void
-SSLSessionBucket::removeSession(const SSLSessionID &id)
-{
-  SCOPED_MUTEX_LOCK(lock, mutex, this_ethread()); // We can't bail on contention here because this session MUST be removed.
-  SSLSession *node = queue.head;
-  while (node) {
-    if (node->session_id == id) {
-      queue.remove(node);
-      delete node;
-      return;
-    }
-    node = node->link.next;
+    SSL_SESSION *found = nullptr;
+    auto s             = make_session(7);
+    box.check(!cache.getSession(s.first, &found), "session found in a claimed slot");
+    cache.removeSession(s.first);
+    SSL_SESSION_free(s.second);
+    munmap(addr, st.st_size);
   }
-}
 
-/* Session Bucket */
-SSLSessionBucket::SSLSessionBucket() : mutex(new_ProxyMutex()) {}
+  // Opened alone, the claimed slots are released and emptied.
+  {
+    SSLSessionCache cache(path);
+    SSL_SESSION *found = nullptr;
+    auto s             = make_session(7);
+    cache.insertSession(s.first, s.second);
+    box.check(cache.getSession(s.first, &found) && found != nullptr, "session not inserted after the slots were released");
+    SSL_SESSION_free(found);
+    SSL_SESSION_free(s.second);
+  }
 
-SSLSessionBucket::~SSLSessionBucket() {}
+  SSL_free(ssl);
+  SSL_CTX_free(ctx);
+  unlink(path);
+}
@@ -33,6 +33,8 @@
 #include "ts/apidefs.h"
 #include <openssl/ssl.h>
 
+#include <atomic>
+
 #define SSL_MAX_SESSION_SIZE 256
 
 struct SSLSessionID : public TSSslSessionID {
@@ -112,40 +114,39 @@ struct SSLSessionID : public TSSslSessionID {
   }
 };
 
-class SSLSession
-{
-public:
-  SSLSessionID session_id;
-  Ptr<IOBufferData> asn1_data; /* this is the ASN1 representation of the SSL_CTX */
-  size_t len_asn1_data;
-
-  SSLSession(const SSLSessionID &id, Ptr<IOBufferData> ssl_asn1_data, size_t len_asn1)
-    : session_id(id), asn1_data(ssl_asn1_data), len_asn1_data(len_asn1)
-  {
-  }
-
-  LINK(SSLSession, link);
+// A session in the cache: a fixed size slot, shared between the threads and
+// possibly other processes mapping the same file. The sequence number is a
+// seqlock, odd while a writer owns the slot. Readers copy the slot and retry
+// if it changed meanwhile, writers take the slot with a compare and swap and
+// go elsewhere if it is taken, so no one ever waits for a lock.
+struct alignas(64) SSLSessionSlot {
+  std::atomic<uint64_t> sequence;
+  uint64_t hash;     // of the session id, to skip the other slots quickly
+  int64_t inserted;  // wall clock time of the insertion, in seconds
+  uint32_t id_len;
+  uint32_t data_len; // 0 if the slot is empty
+  char id[TS_SSL_MAX_SSL_SESSION_ID_LENGTH];
+  unsigned char data[SSL_MAX_SESSION_SIZE]; // ASN1 representation of the SSL_SESSION
 };
 
-class SSLSessionBucket
-{
-public:
-  SSLSessionBucket();
-  ~SSLSessionBucket();
-  void insertSession(const SSLSessionID &, SSL_SESSION *ctx);
-  bool getSession(const SSLSessionID &, SSL_SESSION **ctx);
-  int getSessionBuffer(const SSLSessionID &, char *buffer, int &len);
-  void removeSession(const SSLSessionID &);
-
-private:
-  /* these method must be used while hold the lock */
-  void print(const char *) const;
-  void removeOldestSession();
+struct SSLSessionCacheHeader {
+  static const uint32_t SESSION_CACHE_MAGIC   = 0x5353434d; // "SSCM"
+  static const uint32_t SESSION_CACHE_VERSION = 1;
 
-  Ptr<ProxyMutex> mutex;
-  CountQueue<SSLSession> queue;
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nbuckets;
+  uint32_t bucket_size;
+  uint32_t slot_size;
+  uint32_t reserved;
 };
 
+// The cache is split in buckets of session_cache_max_bucket_size slots. A
+// session goes in one of the SSL_SESSION_CACHE_WAYS slots following the
+// position its hash gives in its bucket, replacing the oldest if all are
+// used. The slots are in anonymous memory, or in the file named by
+// proxy.config.ssl.session_cache.filename so that they survive restarts
+// and can be shared with a standby process.
 class SSLSessionCache
 {
 public:
@@ -153,10 +154,20 @@ public:
   int getSessionBuffer(const SSLSessionID &sid, char *buffer, int &len) const;
   void insertSession(const SSLSessionID &sid, SSL_SESSION *sess);
   void removeSession(const SSLSessionID &sid);
-  SSLSessionCache();
+  SSLSessionCache(const char *path = nullptr);
   ~SSLSessionCache();
 
+  static const unsigned SSL_SESSION_CACHE_WAYS = 8;
+
 private:
-  SSLSessionBucket *session_bucket;
+  bool mapFile(const char *path, size_t size);
+  SSLSessionSlot *findSlots(const SSLSessionID &sid, size_t &first) const;
+  int readSession(const SSLSessionID &sid, unsigned char *data) const;
+
+  SSLSessionCacheHeader *header = nullptr;
+  SSLSessionSlot *slots         = nullptr;
+  size_t map_size               = 0;
+  int fd                        = -1;
   size_t nbuckets;
+  size_t bucket_size;
 };
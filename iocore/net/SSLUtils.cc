@@ -27,9 +27,12 @@
 #include "ts/ink_cap.h"
 #include "ts/ink_mutex.h"
 #include "P_OCSPStapling.h"
+#include "P_SSLCryptoOffload.h"
+#include "P_SSLEarlyData.h"
 #include "SSLSessionCache.h"
 #include "InkAPIInternal.h"
 #include "SSLDynlock.h"
+#include "ts/TestBox.h"
 
 #include <string>
 #include <openssl/err.h>
@@ -44,7 +47,9 @@
 #include <openssl/conf.h>
 #include <unistd.h>
 #include <termios.h>
+#include <thread>
 #include <vector>
+#include <sys/socket.h>
 #include "P_SNIActionPerformer.h"
 
 #if HAVE_OPENSSL_EVP_H
@@ -139,7 +144,8 @@ static int ssl_vc_index = -1;
 static ink_mutex *mutex_buf      = nullptr;
 static bool open_ssl_initialized = false;
 
-RecRawStatBlock *ssl_rsb = nullptr;
+RecRawStatBlock *ssl_rsb                    = nullptr;
+RecHistogram *ssl_handshake_time_histogram = nullptr;
 HashMap<cchar *, class StringHashFns, intptr_t> cipher_map;
 
 /* Using pthread thread ID and mutex functions directly, instead of
@@ -337,8 +343,8 @@ set_context_cert(SSL *ssl)
     netvc->setSSLTrace(trace);
   }
 
-  // catch the client renegotiation early on
-  if (SSLConfigParams::ssl_allow_client_renegotiation == false && netvc->getSSLHandShakeComplete()) {
+  // catch the client renegotiation early on, the kernel cannot change the keys of a kTLS session
+  if ((SSLConfigParams::ssl_allow_client_renegotiation == false || netvc->getSSLKTLSSend()) && netvc->getSSLHandShakeComplete()) {
     Debug("ssl", "set_context_cert trying to renegotiate from the client");
     retval = 0; // Error
     goto done;
@@ -349,15 +355,16 @@ set_context_cert(SSL *ssl)
   // already made a best effort to find the best match.
   if (likely(servername)) {
     cc = lookup->find((char *)servername);
-    if (cc && cc->ctx) {
-      ctx = cc->ctx;
-    }
     if (cc && SSLCertContext::OPT_TUNNEL == cc->opt && netvc->get_is_transparent()) {
       netvc->attributes = HttpProxyPort::TRANSPORT_BLIND_TUNNEL;
       netvc->setSSLHandShakeComplete(true);
       retval = -1;
       goto done;
     }
+    // This builds the context if it was deferred.
+    if (cc) {
+      ctx = lookup->acquireContext(cc);
+    }
   }
 
   // If there's no match on the server name, try to match on the peer address.
@@ -368,8 +375,8 @@ set_context_cert(SSL *ssl)
     if (0 == safe_getsockname(netvc->get_socket(), &ip.sa, &namelen)) {
       cc = lookup->find(ip);
     }
-    if (cc && cc->ctx) {
-      ctx = cc->ctx;
+    if (cc) {
+      ctx = lookup->acquireContext(cc);
     }
   }
 
@@ -379,6 +386,8 @@ set_context_cert(SSL *ssl)
     // Reset the ticket callback if needed
     SSL_CTX_set_tlsext_ticket_key_cb(ctx, ssl_callback_session_ticket);
 #endif
+    // The connection holds its own reference now.
+    SSLReleaseContext(ctx);
   } else {
     found = false;
   }
@@ -588,7 +597,11 @@ ssl_context_enable_ecdh(SSL_CTX *ctx)
 {
 #if TS_USE_TLS_ECKEY
 
-#if defined(SSL_CTRL_SET_ECDH_AUTO)
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+// The curves are picked automatically. Setting one would also be the only
+// TLS 1.3 group, and the clients sending another key share would need a
+// HelloRetryRequest, which refuses their early data.
+#elif defined(SSL_CTRL_SET_ECDH_AUTO)
   SSL_CTX_set_ecdh_auto(ctx, 1);
 #elif defined(HAVE_EC_KEY_NEW_BY_CURVE_NAME) && defined(NID_X9_62_prime256v1)
   EC_KEY *ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
@@ -816,6 +829,7 @@ SSLRecRawStatSyncCount(const char *name, RecDataT data_type, RecData *data, RecR
   int64_t timeouts = 0;
 
   if (certLookup) {
+    std::vector<SSL_CTX *> lazy;
     const unsigned ctxCount = certLookup->count();
     for (size_t i = 0; i < ctxCount; i++) {
       SSLCertContext *cc = certLookup->get(i);
@@ -826,6 +840,15 @@ SSLRecRawStatSyncCount(const char *name, RecDataT data_type, RecData *data, RecR
         timeouts += SSL_CTX_sess_timeouts(cc->ctx);
       }
     }
+    // The deferred contexts count while they are built.
+    certLookup->lazyContexts(lazy);
+    for (auto ctx : lazy) {
+      sessions += SSL_CTX_sess_accept_good(ctx);
+      hits += SSL_CTX_sess_hits(ctx);
+      misses += SSL_CTX_sess_misses(ctx);
+      timeouts += SSL_CTX_sess_timeouts(ctx);
+      SSLReleaseContext(ctx);
+    }
   }
 
   SSL_SET_COUNT_DYN_STAT(ssl_user_agent_sessions_stat, sessions);
@@ -965,6 +988,7 @@ SSLInitializeStatistics()
   // Allocate SSL statistics block.
   ssl_rsb = RecAllocateRawStatBlock((int)Ssl_Stat_Count);
   ink_assert(ssl_rsb != nullptr);
+  ssl_handshake_time_histogram = RecAllocateHistogram("proxy.process.ssl.latency.handshake");
 
   // SSL client errors.
   RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.user_agent_other_errors", RECD_COUNTER, RECP_PERSISTENT,
@@ -1084,6 +1108,44 @@ SSLInitializeStatistics()
                      (int)ssl_ocsp_refreshed_cert_stat, RecRawStatSyncCount);
   RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.ssl_ocsp_refresh_cert_failure", RECD_INT, RECP_PERSISTENT,
                      (int)ssl_ocsp_refresh_cert_failure_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.ocsp_stale_responses", RECD_INT, RECP_NON_PERSISTENT,
+                     (int)ssl_ocsp_stale_responses_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.ocsp_refresh_queue", RECD_INT, RECP_NON_PERSISTENT,
+                     (int)ssl_ocsp_refresh_queue_stat, RecRawStatSyncCount);
+
+  /* kernel TLS stats */
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.ktls_sessions", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_ktls_sessions_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.ktls_fallback", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_ktls_fallback_stat, RecRawStatSyncCount);
+
+  /* lazy context stats */
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.lazy_contexts_built", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_lazy_contexts_built_stat, RecRawStatSyncCount);
+
+  /* early data stats */
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.early_data_accepted", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_early_data_accepted_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.early_data_rejected", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_early_data_rejected_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.early_data_replayed", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_early_data_replayed_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.early_data_accepted_bytes", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_early_data_accepted_bytes_stat, RecRawStatSyncSum);
+
+  /* origin session cache stats */
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.origin_session_cache_hit", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_origin_session_cache_hit, RecRawStatSyncCount);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.origin_session_cache_miss", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_origin_session_cache_miss, RecRawStatSyncCount);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.origin_session_reused", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_origin_session_reused, RecRawStatSyncCount);
+
+  /* batched record write stats */
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.write_batch_records", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_write_batch_records_stat, RecRawStatSyncSum);
+  RecRegisterRawStat(ssl_rsb, RECT_PROCESS, "proxy.process.ssl.write_batch_writes", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)ssl_write_batch_writes_stat, RecRawStatSyncCount);
 
   // Get and register the SSL cipher stats. Note that we are using the default SSL context to obtain
   // the cipher list. This means that the set of ciphers is fixed by the build configuration and not
@@ -1351,6 +1413,11 @@ SSLPrivateKeyHandler(SSL_CTX *ctx, const SSLConfigParams *params, const ats_scop
     return false;
   }
 
+  if (!SSLCryptoOffloadKey(ctx)) {
+    SSLError("failed to offload the operations of the server private key");
+    return false;
+  }
+
   return true;
 }
 
@@ -1486,7 +1553,7 @@ ssl_callback_info(const SSL *ssl, int where, int ret)
   SSLNetVConnection *netvc = SSLNetVCAccess(ssl);
 
   if ((where & SSL_CB_ACCEPT_LOOP) && netvc->getSSLHandShakeComplete() == true &&
-      SSLConfigParams::ssl_allow_client_renegotiation == false) {
+      (SSLConfigParams::ssl_allow_client_renegotiation == false || netvc->getSSLKTLSSend())) {
     int state = SSL_get_state(ssl);
 
 // TODO: ifdef can be removed in the future
@@ -1611,6 +1678,13 @@ SSLInitServerContext(const SSLConfigParams *params, const ssl_user_config *sslMu
   SSL_CTX_set_options(ctx, SSL_OP_SAFARI_ECDHE_ECDSA_BUG);
 #endif
 
+#if TS_USE_KTLS
+  // OpenSSL installs the keys in the kernel when the handshake completes, if the kernel supports the cipher.
+  if (SSLConfigParams::ktls_enabled) {
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+  }
+#endif
+
   if (sslMultCertSettings) {
     if (sslMultCertSettings->dialog) {
       passphrase_cb_userdata ud(params, sslMultCertSettings->dialog, sslMultCertSettings->first_cert, sslMultCertSettings->key);
@@ -1875,20 +1949,51 @@ SSLCreateServerContext(const SSLConfigParams *params)
   return ctx;
 }
 
-static SSL_CTX *
-ssl_store_ssl_context(const SSLConfigParams *params, SSLCertLookup *lookup, const ssl_user_config *sslMultCertSettings)
+// Set up the session tickets and the OCSP stapling of the context of an ssl_multicert.config line.
+// @return The session ticket key block if the session tickets are enabled.
+static ssl_ticket_key_block *
+ssl_context_enable_features(SSL_CTX *ctx, const ssl_user_config *sslMultCertSettings, const std::vector<X509 *> &cert_list)
 {
-  std::vector<X509 *> cert_list;
-  SSL_CTX *ctx                   = SSLInitServerContext(params, sslMultCertSettings, cert_list);
   ssl_ticket_key_block *keyblock = nullptr;
-  bool inserted                  = false;
+  const char *certname           = sslMultCertSettings->cert.get();
 
-  if (!ctx || !sslMultCertSettings) {
-    lookup->is_valid = false;
-    return nullptr;
+  // Load the session ticket key if session tickets are not disabled
+  if (sslMultCertSettings->session_ticket_enabled != 0) {
+    keyblock = ssl_context_enable_tickets(ctx, nullptr);
   }
 
-  const char *certname = sslMultCertSettings->cert.get();
+#if defined(SSL_OP_NO_TICKET)
+  // Session tickets are enabled by default. Disable if explicitly requested.
+  if (sslMultCertSettings->session_ticket_enabled == 0) {
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    Debug("ssl", "ssl session ticket is disabled");
+  }
+#endif
+
+#ifdef HAVE_OPENSSL_OCSP_STAPLING
+  if (SSLConfigParams::ssl_ocsp_enabled) {
+    Debug("ssl", "ssl ocsp stapling is enabled");
+    SSL_CTX_set_tlsext_status_cb(ctx, ssl_callback_ocsp_stapling);
+    for (auto cert : cert_list) {
+      if (!ssl_stapling_init_cert(ctx, cert, certname)) {
+        Warning("fail to configure SSL_CTX for OCSP Stapling info for certificate at %s", (const char *)certname);
+      }
+    }
+  } else {
+    Debug("ssl", "ssl ocsp stapling is disabled");
+  }
+#else
+  if (SSLConfigParams::ssl_ocsp_enabled) {
+    Warning("fail to enable ssl ocsp stapling, this openssl version does not support it");
+  }
+#endif /* HAVE_OPENSSL_OCSP_STAPLING */
+
+  return keyblock;
+}
+
+static void
+ssl_check_certificates(SSLCertLookup *lookup, const std::vector<X509 *> &cert_list, const char *certname)
+{
   for (auto cert : cert_list) {
     if (0 > SSLCheckServerCertNow(cert, certname)) {
       /* At this point, we know cert is bad, and we've already printed a
@@ -1897,12 +2002,26 @@ ssl_store_ssl_context(const SSLConfigParams *params, SSLCertLookup *lookup, cons
       lookup->is_valid = false;
     }
   }
+}
 
-  // Load the session ticket key if session tickets are not disabled
-  if (sslMultCertSettings->session_ticket_enabled != 0) {
-    keyblock = ssl_context_enable_tickets(ctx, nullptr);
+static SSL_CTX *
+ssl_store_ssl_context(const SSLConfigParams *params, SSLCertLookup *lookup, const ssl_user_config *sslMultCertSettings)
+{
+  std::vector<X509 *> cert_list;
+  SSL_CTX *ctx                   = SSLInitServerContext(params, sslMultCertSettings, cert_list);
+  ssl_ticket_key_block *keyblock = nullptr;
+  bool inserted                  = false;
+
+  if (!ctx || !sslMultCertSettings) {
+    lookup->is_valid = false;
+    return nullptr;
   }
 
+  const char *certname = sslMultCertSettings->cert.get();
+  ssl_check_certificates(lookup, cert_list, certname);
+
+  keyblock = ssl_context_enable_features(ctx, sslMultCertSettings, cert_list);
+
   // Index this certificate by the specified IP(v6) address. If the address is "*", make it the default context.
   if (sslMultCertSettings->addr) {
     if (strcmp(sslMultCertSettings->addr, "*") == 0) {
@@ -1933,32 +2052,6 @@ ssl_store_ssl_context(const SSLConfigParams *params, SSLCertLookup *lookup, cons
 #endif
   }
 
-#if defined(SSL_OP_NO_TICKET)
-  // Session tickets are enabled by default. Disable if explicitly requested.
-  if (sslMultCertSettings->session_ticket_enabled == 0) {
-    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
-    Debug("ssl", "ssl session ticket is disabled");
-  }
-#endif
-
-#ifdef HAVE_OPENSSL_OCSP_STAPLING
-  if (SSLConfigParams::ssl_ocsp_enabled) {
-    Debug("ssl", "ssl ocsp stapling is enabled");
-    SSL_CTX_set_tlsext_status_cb(ctx, ssl_callback_ocsp_stapling);
-    for (auto cert : cert_list) {
-      if (!ssl_stapling_init_cert(ctx, cert, certname)) {
-        Warning("fail to configure SSL_CTX for OCSP Stapling info for certificate at %s", (const char *)certname);
-      }
-    }
-  } else {
-    Debug("ssl", "ssl ocsp stapling is disabled");
-  }
-#else
-  if (SSLConfigParams::ssl_ocsp_enabled) {
-    Warning("fail to enable ssl ocsp stapling, this openssl version does not support it");
-  }
-#endif /* HAVE_OPENSSL_OCSP_STAPLING */
-
   // Insert additional mappings. Note that this maps multiple keys to the same value, so when
   // this code is updated to reconfigure the SSL certificates, it will need some sort of
   // refcounting or alternate way of avoiding double frees.
@@ -1987,6 +2080,103 @@ ssl_store_ssl_context(const SSLConfigParams *params, SSLCertLookup *lookup, cons
   return ctx;
 }
 
+// Builds the context of an ssl_multicert.config line when a handshake first asks for one of its names.
+struct ssl_lazy_context_builder : public SSLContextBuilder {
+  explicit ssl_lazy_context_builder(const ssl_user_config *settings)
+  {
+    config.session_ticket_enabled = settings->session_ticket_enabled;
+    config.cert                   = ats_strdup(settings->cert);
+    config.first_cert             = ats_strdup(settings->first_cert);
+    config.ca                     = ats_strdup(settings->ca);
+    config.key                    = ats_strdup(settings->key);
+    config.servername             = ats_strdup(settings->servername);
+    config.opt                    = settings->opt;
+  }
+
+  SSL_CTX *
+  build() override
+  {
+    SSLConfig::scoped_config params;
+    std::vector<X509 *> cert_list;
+    SSL_CTX *ctx = SSLInitServerContext(params, &config, cert_list);
+
+    if (ctx) {
+      ticket_block_free(ssl_context_enable_features(ctx, &config, cert_list));
+      if (SSLConfigParams::init_ssl_ctx_cb) {
+        SSLConfigParams::init_ssl_ctx_cb(ctx, true);
+      }
+      SSL_INCREMENT_DYN_STAT(ssl_lazy_contexts_built_stat);
+      Debug("ssl", "built SSL context %p for %s", ctx, (const char *)config.cert);
+    } else {
+      Error("failed to build the SSL context for %s", (const char *)config.cert);
+    }
+
+    for (auto &i : cert_list) {
+      X509_free(i);
+    }
+    return ctx;
+  }
+
+  ssl_user_config config;
+};
+
+// The contexts of the lines that are only matched by name can wait for their first handshake. Those with
+// a pass phrase dialog cannot, it would run in the handshake.
+static bool
+ssl_context_is_lazy(const SSLConfigParams *params, const ssl_user_config *sslMultCertSettings)
+{
+  return params->lazy_context_limit > 0 && sslMultCertSettings->cert && !sslMultCertSettings->addr &&
+         !sslMultCertSettings->dialog;
+}
+
+// Index the names of the certificates of an ssl_multicert.config line, leaving the context to be built
+// on the first handshake that matches one of them.
+static bool
+ssl_defer_ssl_context(const SSLConfigParams *params, SSLCertLookup *lookup, const ssl_user_config *sslMultCertSettings)
+{
+  std::vector<X509 *> cert_list;
+  const char *certname = sslMultCertSettings->cert.get();
+  bool loaded          = true;
+  bool inserted        = false;
+
+  SimpleTokenizer cert_tok(certname, SSL_CERT_SEPARATE_DELIM);
+  for (const char *name = cert_tok.getNext(); name; name = cert_tok.getNext()) {
+    ats_scoped_str completeServerCertPath(Layout::relative_to(params->serverCertPathOnly, name));
+    scoped_BIO bio(BIO_new_file(completeServerCertPath, "r"));
+    X509 *cert = nullptr;
+    if (bio) {
+      cert = PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr);
+    }
+    if (!cert) {
+      SSLError("failed to load certificate from %s", (const char *)completeServerCertPath);
+      lookup->is_valid = false;
+      loaded           = false;
+      break;
+    }
+    cert_list.push_back(cert);
+    if (SSLConfigParams::load_ssl_file_cb) {
+      SSLConfigParams::load_ssl_file_cb(completeServerCertPath, CONFIG_FLAG_UNVERSIONED);
+    }
+  }
+
+  if (loaded) {
+    ssl_check_certificates(lookup, cert_list, certname);
+
+    SSLCertContext cc = lookup->defer(new ssl_lazy_context_builder(sslMultCertSettings), sslMultCertSettings->opt);
+    Debug("ssl", "importing SNI names from %s, deferring its SSL context", certname);
+    for (auto cert : cert_list) {
+      if (ssl_index_certificate(lookup, cc, cert, certname)) {
+        inserted = true;
+      }
+    }
+  }
+
+  for (auto &i : cert_list) {
+    X509_free(i);
+  }
+  return inserted;
+}
+
 static bool
 ssl_extract_certificate(const matcher_line *line_info, ssl_user_config &sslMultCertSettings)
 {
@@ -2062,6 +2252,7 @@ SSLParseCertificateConfiguration(const SSLConfigParams *params, SSLCertLookup *l
   const matcher_tags sslCertTags = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, false};
 
   Note("loading SSL certificate configuration from %s", params->configFilePath);
+  lookup->lazy_limit = params->lazy_context_limit;
 
   //  TunnelMap.clear();
 
@@ -2102,7 +2293,11 @@ SSLParseCertificateConfiguration(const SSLConfigParams *params, SSLCertLookup *l
         if (ssl_extract_certificate(&line_info, sslMultiCertSettings)) {
           // There must be a certificate specified unless the tunnel action is set
           if (sslMultiCertSettings.cert || sslMultiCertSettings.opt != SSLCertContext::OPT_TUNNEL) {
-            ssl_store_ssl_context(params, lookup, &sslMultiCertSettings);
+            if (ssl_context_is_lazy(params, &sslMultiCertSettings)) {
+              ssl_defer_ssl_context(params, lookup, &sslMultiCertSettings);
+            } else {
+              ssl_store_ssl_context(params, lookup, &sslMultiCertSettings);
+            }
           } else {
             Warning("No ssl_cert_name specified and no tunnel action set");
           }
@@ -2236,7 +2431,7 @@ SSLNetVCAccess(const SSL *ssl)
 }
 
 ssl_error_t
-SSLWriteBuffer(SSL *ssl, const void *buf, int64_t nbytes, int64_t &nwritten)
+SSLWriteBuffer(SSL *ssl, const void *buf, int64_t nbytes, int64_t &nwritten, bool flush)
 {
   nwritten = 0;
 
@@ -2247,7 +2442,7 @@ SSLWriteBuffer(SSL *ssl, const void *buf, int64_t nbytes, int64_t &nwritten)
   int ret = SSL_write(ssl, buf, (int)nbytes);
   if (ret > 0) {
     nwritten = ret;
-    BIO *bio = SSL_get_wbio(ssl);
+    BIO *bio = flush ? SSL_get_wbio(ssl) : nullptr;
     if (bio != nullptr) {
       (void)BIO_flush(bio);
     }
@@ -2307,6 +2502,56 @@ SSLAccept(SSL *ssl)
   return ssl_error;
 }
 
+#if TS_HAS_TLS_EARLY_DATA
+ssl_error_t
+SSLReadEarlyData(SSL *ssl, void *buf, int64_t nbytes, int64_t &nread, bool &finish)
+{
+  size_t readbytes = 0;
+
+  ERR_clear_error();
+  int ret = SSL_read_early_data(ssl, buf, nbytes, &readbytes);
+  nread   = readbytes;
+  finish  = ret == SSL_READ_EARLY_DATA_FINISH;
+  if (ret != SSL_READ_EARLY_DATA_ERROR) {
+    return SSL_ERROR_NONE;
+  }
+  int ssl_error = SSL_get_error(ssl, ret);
+  if (ssl_error == SSL_ERROR_SSL && is_debug_tag_set("ssl.error.read")) {
+    char buf[512];
+    unsigned long e = ERR_peek_last_error();
+    ERR_error_string_n(e, buf, sizeof(buf));
+    Debug("ssl.error.read", "SSL read early data returned %d, ssl_error=%d, ERR_get_error=%ld (%s)", ret, ssl_error, e, buf);
+  }
+
+  return ssl_error;
+}
+
+ssl_error_t
+SSLWriteEarlyData(SSL *ssl, const void *buf, int64_t nbytes, int64_t &nwritten)
+{
+  size_t written = 0;
+
+  nwritten = 0;
+  if (unlikely(nbytes == 0)) {
+    return SSL_ERROR_NONE;
+  }
+  ERR_clear_error();
+  int ret = SSL_write_early_data(ssl, buf, nbytes, &written);
+  if (ret > 0) {
+    nwritten = written;
+    return SSL_ERROR_NONE;
+  }
+  int ssl_error = SSL_get_error(ssl, ret);
+  if (ssl_error == SSL_ERROR_SSL && is_debug_tag_set("ssl.error.write")) {
+    char buf[512];
+    unsigned long e = ERR_peek_last_error();
+    ERR_error_string_n(e, buf, sizeof(buf));
+    Debug("ssl.error.write", "SSL write early data returned %d, ssl_error=%d, ERR_get_error=%ld (%s)", ret, ssl_error, e, buf);
+  }
+  return ssl_error;
+}
+#endif /* TS_HAS_TLS_EARLY_DATA */
+
 ssl_error_t
 SSLConnect(SSL *ssl)
 {
@@ -2325,3 +2570,380 @@ SSLConnect(SSL *ssl)
 
   return ssl_error;
 }
+
+#if TS_HAS_SSL_WRITE_BATCH
+// Counts the writes to the socket under a batch buffer.
+static long
+ssl_write_batch_callback(BIO * /* bio ATS_UNUSED */, int oper, const char * /* argp ATS_UNUSED */, size_t /* len ATS_UNUSED */,
+                         int /* argi ATS_UNUSED */, long /* argl ATS_UNUSED */, int ret, size_t * /* processed ATS_UNUSED */)
+{
+  if (oper == (BIO_CB_WRITE | BIO_CB_RETURN) && ret > 0) {
+    SSL_INCREMENT_DYN_STAT(ssl_write_batch_writes_stat);
+  }
+  return ret;
+}
+#endif
+
+BIO *
+SSLWriteBatchGet(SSL *ssl)
+{
+  BIO *wbio = SSL_get_wbio(ssl);
+
+  return wbio && BIO_method_type(wbio) == BIO_TYPE_BUFFER ? wbio : nullptr;
+}
+
+BIO *
+SSLWriteBatchEnable(SSL *ssl, int size)
+{
+#if TS_HAS_SSL_WRITE_BATCH
+  if (BIO *batch = SSLWriteBatchGet(ssl)) {
+    return batch;
+  }
+
+  BIO *socket = SSL_get_wbio(ssl);
+  BIO *batch  = BIO_new(BIO_f_buffer());
+
+  if (socket == nullptr || batch == nullptr || BIO_set_write_buffer_size(batch, size) <= 0) {
+    BIO_free(batch);
+    return nullptr;
+  }
+
+  // SSL_set0_wbio releases the socket, the chain holds on to it.
+  BIO_up_ref(socket);
+  SSL_set0_wbio(ssl, BIO_push(batch, socket));
+  BIO_set_callback_ex(socket, ssl_write_batch_callback);
+  // A record written again after SSL_ERROR_WANT_WRITE may be gathered at another address.
+  SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  return batch;
+#else
+  (void)ssl;
+  (void)size;
+  return nullptr;
+#endif
+}
+
+#if TS_HAS_SSL_WRITE_BATCH
+namespace
+{
+long ssl_write_batch_test_writes;
+
+long
+ssl_write_batch_test_callback(BIO * /* bio ATS_UNUSED */, int oper, const char * /* argp ATS_UNUSED */,
+                              size_t /* len ATS_UNUSED */, int /* argi ATS_UNUSED */, long /* argl ATS_UNUSED */, int ret,
+                              size_t * /* processed ATS_UNUSED */)
+{
+  if (oper == (BIO_CB_WRITE | BIO_CB_RETURN) && ret > 0) {
+    ++ssl_write_batch_test_writes;
+  }
+  return ret;
+}
+
+// A self signed Ed25519 certificate for the benchmark server.
+bool
+ssl_write_batch_test_certify(SSL_CTX *ctx)
+{
+  EVP_PKEY *pkey     = nullptr;
+  EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
+  X509 *x509         = X509_new();
+
+  bool ok = kctx && x509 && EVP_PKEY_keygen_init(kctx) > 0 && EVP_PKEY_keygen(kctx, &pkey) > 0 && X509_set_version(x509, 2) &&
+            ASN1_INTEGER_set(X509_get_serialNumber(x509), 1) && X509_gmtime_adj(X509_get_notBefore(x509), 0) &&
+            X509_gmtime_adj(X509_get_notAfter(x509), 3600) && X509_set_pubkey(x509, pkey) &&
+            X509_NAME_add_entry_by_txt(X509_get_subject_name(x509), "CN", MBSTRING_ASC,
+                                       reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0) &&
+            X509_set_issuer_name(x509, X509_get_subject_name(x509)) && X509_sign(x509, pkey, nullptr) > 0 &&
+            SSL_CTX_use_certificate(ctx, x509) > 0 && SSL_CTX_use_PrivateKey(ctx, pkey) > 0;
+
+  X509_free(x509);
+  EVP_PKEY_free(pkey);
+  EVP_PKEY_CTX_free(kctx);
+  return ok;
+}
+
+// A server and a client SSL over a non blocking socketpair, with the handshake done.
+struct SSLWriteBatchTestPair {
+  int fds[2]  = {NO_FD, NO_FD};
+  SSL *server = nullptr;
+  SSL *client = nullptr;
+
+  bool
+  connect(SSL_CTX *server_ctx, SSL_CTX *client_ctx)
+  {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      return false;
+    }
+    server = SSL_new(server_ctx);
+    client = SSL_new(client_ctx);
+    SSL_set_fd(server, fds[0]);
+    SSL_set_fd(client, fds[1]);
+    SSL_set_accept_state(server);
+    SSL_set_connect_state(client);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    // Each side waits for the other, drive both from here.
+    int server_done = 0, client_done = 0;
+    for (int i = 0; i < 1000 && (server_done <= 0 || client_done <= 0); ++i) {
+      client_done = client_done > 0 ? client_done : SSL_do_handshake(client);
+      server_done = server_done > 0 ? server_done : SSL_do_handshake(server);
+    }
+    return server_done > 0 && client_done > 0;
+  }
+
+  ~SSLWriteBatchTestPair()
+  {
+    SSL_free(server);
+    SSL_free(client);
+    for (int fd : fds) {
+      if (fd != NO_FD) {
+        close(fd);
+      }
+    }
+  }
+};
+
+char
+ssl_write_batch_test_byte(int64_t offset)
+{
+  return static_cast<char>(offset % 251);
+}
+
+// Append @a len bytes of the test data, from @a offset on, to @a mbuf in blocks of @a block_size bytes.
+void
+ssl_write_batch_test_fill(MIOBuffer *mbuf, int64_t offset, int64_t len, int64_t block_size)
+{
+  while (len > 0) {
+    int64_t n        = std::min(len, block_size);
+    IOBufferBlock *b = new_IOBufferBlock();
+    b->alloc(iobuffer_size_to_index(n, BUFFER_SIZE_INDEX_32K));
+    for (int64_t i = 0; i < n; ++i) {
+      b->end()[i] = ssl_write_batch_test_byte(offset + i);
+    }
+    b->fill(n);
+    mbuf->append_block(b);
+    offset += n;
+    len -= n;
+  }
+}
+
+} // namespace
+#endif
+
+// Write a fragmented buffer through the write batch of an SSLNetVConnection, into socket
+// buffers much smaller than it. The flushes and the records hit EAGAIN, and the writes that
+// follow finish them.
+REGRESSION_TEST(SSLWriteBatch)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+#if TS_HAS_SSL_WRITE_BATCH
+  static const int64_t TOTAL = 1 << 20;
+  static const int BLOCK     = 1000;
+  static const int BATCH     = 64 * 1024;
+
+  // The writes count in the SSL stats, which are missing if the SSL processor did not start.
+  if (ssl_rsb == nullptr) {
+    SSLInitializeStatistics();
+  }
+
+  SSL_CTX *server_ctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+  {
+    SSLWriteBatchTestPair pair;
+
+    if (!box.check(server_ctx && client_ctx && ssl_write_batch_test_certify(server_ctx), "contexts") ||
+        !box.check(pair.connect(server_ctx, client_ctx), "handshake")) {
+      SSL_CTX_free(server_ctx);
+      SSL_CTX_free(client_ctx);
+      return;
+    }
+
+    int size = 16 * 1024;
+    setsockopt(pair.fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(pair.fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    SSLNetVConnection *vc = static_cast<SSLNetVConnection *>(sslNetProcessor.allocate_vc(this_ethread()));
+    vc->mutex             = new_ProxyMutex();
+    SCOPED_MUTEX_LOCK(lock, vc->mutex, this_ethread());
+    vc->ssl           = pair.server;
+    vc->sslWriteBatch = SSLWriteBatchEnable(pair.server, BATCH);
+    box.check(vc->sslWriteBatch != nullptr, "no write batch");
+    box.check(SSLWriteBatchEnable(pair.server, BATCH) == vc->sslWriteBatch && SSLWriteBatchGet(pair.server) == vc->sslWriteBatch,
+              "the write batch of the SSL is not reused");
+
+    MIOBuffer *mbuf        = new_empty_MIOBuffer();
+    IOBufferReader *reader = mbuf->alloc_reader();
+    MIOBufferAccessor buf;
+    buf.reader_for(reader);
+    ssl_write_batch_test_fill(mbuf, 0, TOTAL, BLOCK);
+
+    std::string received;
+    int64_t written = 0;
+    bool unflushed  = false, retried = false;
+    for (int i = 0; i < 100000 && static_cast<int64_t>(received.size()) < TOTAL; ++i) {
+      int64_t total   = 0;
+      ssl_error_t err = SSL_ERROR_NONE;
+
+      if (reader->read_avail() > 0) {
+        vc->load_buffer_and_write_batch(reader->read_avail(), buf, total, err);
+        written += total;
+        unflushed |= vc->sslWriteUnflushed > 0;
+        retried |= vc->sslWriteRetry > 0;
+        if (!box.check(err == SSL_ERROR_NONE || err == SSL_ERROR_WANT_WRITE, "write error %d", err)) {
+          break;
+        }
+      }
+
+      // The client takes what the socket has.
+      char data[SSL3_RT_MAX_PLAIN_LENGTH];
+      int n;
+      while ((n = SSL_read(pair.client, data, sizeof(data))) > 0) {
+        received.append(data, n);
+      }
+    }
+
+    box.check(written == TOTAL && reader->read_avail() == 0, "wrote %" PRId64 " of %" PRId64 " bytes", written, TOTAL);
+    box.check(unflushed, "no flush was left unfinished");
+    box.check(retried, "no record was written again");
+    if (box.check(static_cast<int64_t>(received.size()) == TOTAL, "received %zu of %" PRId64 " bytes", received.size(), TOTAL)) {
+      for (int64_t i = 0; i < TOTAL; ++i) {
+        if (received[i] != ssl_write_batch_test_byte(i)) {
+          box.check(false, "received a wrong byte at %" PRId64, i);
+          break;
+        }
+      }
+    }
+
+    free_MIOBuffer(mbuf);
+    // The pair frees the SSL.
+    vc->ssl           = nullptr;
+    vc->sslWriteBatch = nullptr;
+    vc->free(this_ethread());
+  }
+  SSL_CTX_free(server_ctx);
+  SSL_CTX_free(client_ctx);
+#else
+  rprintf(t, "write batching needs OpenSSL 1.1.1\n");
+#endif
+}
+
+// Compare the CPU cost of writing a response in small blocks, the blocks a fragmented write
+// buffer has, one record per block, in whole records, and gathered in whole records that the
+// write batch sends together.
+REGRESSION_TEST(SSLWriteBatchBenchmark)(RegressionTest *t, int level, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // This is a benchmark, only run it when asked for (traffic_server -R 3 -r SSLWriteBatchBenchmark).
+  if (REGRESSION_TEST_EXTENDED > level) {
+    return;
+  }
+
+#if TS_HAS_SSL_WRITE_BATCH
+  static const int64_t TOTAL = 256 << 20;
+  static const int64_t CHUNK = 4 << 20;
+  static const int BATCH     = 64 * 1024;
+  static const struct {
+    const char *name;
+    int block;
+    bool batch;
+  } modes[] = {
+    {"per block", 1400, false},
+    {"whole records", SSL_MAX_TLS_RECORD_SIZE, false},
+    {"batched", 1400, true},
+  };
+
+  SSL_CTX *server_ctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+  if (!box.check(server_ctx && client_ctx && ssl_write_batch_test_certify(server_ctx), "contexts")) {
+    SSL_CTX_free(server_ctx);
+    SSL_CTX_free(client_ctx);
+    return;
+  }
+
+  if (ssl_rsb == nullptr) {
+    SSLInitializeStatistics();
+  }
+
+  int batch_size = SSLConfigParams::ssl_write_batch_size;
+  for (const auto &mode : modes) {
+    SSLWriteBatchTestPair pair;
+    if (!box.check(pair.connect(server_ctx, client_ctx), "handshake")) {
+      break;
+    }
+    fcntl(pair.fds[0], F_SETFL, 0);
+    fcntl(pair.fds[1], F_SETFL, 0);
+
+    // The client only takes the records off the socket.
+    int64_t received = 0;
+    std::thread drain([&]() {
+      char data[256 * 1024];
+      ssize_t n;
+      while ((n = read(pair.fds[1], data, sizeof(data))) > 0) {
+        received += n;
+      }
+    });
+
+    // The VC picks up the batch of the SSL, with the callback that counts the writes.
+    SSLConfigParams::ssl_write_batch_size = mode.batch ? BATCH : 0;
+    BIO *batch_bio                        = mode.batch ? SSLWriteBatchEnable(pair.server, BATCH) : nullptr;
+    BIO_set_callback_ex(batch_bio ? BIO_next(batch_bio) : SSL_get_wbio(pair.server), ssl_write_batch_test_callback);
+    ssl_write_batch_test_writes = 0;
+
+    SSLNetVConnection *vc = static_cast<SSLNetVConnection *>(sslNetProcessor.allocate_vc(this_ethread()));
+    vc->mutex             = new_ProxyMutex();
+    SCOPED_MUTEX_LOCK(lock, vc->mutex, this_ethread());
+    vc->ssl                = pair.server;
+    MIOBuffer *mbuf        = new_empty_MIOBuffer();
+    IOBufferReader *reader = mbuf->alloc_reader();
+    MIOBufferAccessor buf;
+    buf.reader_for(reader);
+
+    int64_t sent       = 0;
+    double cpu         = 0;
+    ink_hrtime elapsed = 0;
+    while (sent < TOTAL) {
+      ssl_write_batch_test_fill(mbuf, sent, CHUNK, mode.block);
+
+      timespec cpu_start, cpu_end;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+      ink_hrtime start = ink_get_hrtime_internal();
+      while (reader->read_avail() > 0) {
+        int64_t total = 0;
+        int needs     = 0;
+        if (vc->load_buffer_and_write(reader->read_avail(), buf, total, needs) <= 0 && total == 0) {
+          break;
+        }
+        sent += total;
+      }
+      elapsed += ink_get_hrtime_internal() - start;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+      cpu += (cpu_end.tv_sec - cpu_start.tv_sec) + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e9;
+
+      if (!box.check(reader->read_avail() == 0, "%s: write failed", mode.name)) {
+        break;
+      }
+    }
+
+    shutdown(pair.fds[0], SHUT_WR);
+    drain.join();
+
+    box.check(received > sent, "%" PRId64 " bytes of records for %" PRId64 " bytes", received, sent);
+    rprintf(t, "%s: %" PRId64 " bytes in %ld writes, %.0f bytes per write, %.2f CPU seconds per GB, %.0f MB/s\n", mode.name, sent,
+            ssl_write_batch_test_writes, static_cast<double>(received) / ssl_write_batch_test_writes, cpu * 1e9 / sent,
+            static_cast<double>(sent) / (1 << 20) / (static_cast<double>(elapsed) / HRTIME_SECOND));
+
+    free_MIOBuffer(mbuf);
+    vc->ssl = nullptr;
+    vc->free(this_ethread());
+  }
+  SSLConfigParams::ssl_write_batch_size = batch_size;
+
+  SSL_CTX_free(server_ctx);
+  SSL_CTX_free(client_ctx);
+#else
+  rprintf(t, "write batching needs OpenSSL 1.1.1\n");
+#endif
+}
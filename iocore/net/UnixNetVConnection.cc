@@ -79,7 +79,9 @@ static inline int
 read_signal_and_update(int event, UnixNetVConnection *vc)
 {
   vc->recursion++;
-  if (vc->read.vio._cont) {
+  if (vc->read.vio._cont && EventProfiler::is_enabled()) {
+    EventProfiler::handle_event(vc->read.vio._cont, event, &vc->read.vio);
+  } else if (vc->read.vio._cont) {
     vc->read.vio._cont->handleEvent(event, &vc->read.vio);
   } else {
     switch (event) {
@@ -110,7 +112,9 @@ static inline int
 write_signal_and_update(int event, UnixNetVConnection *vc)
 {
   vc->recursion++;
-  if (vc->write.vio._cont) {
+  if (vc->write.vio._cont && EventProfiler::is_enabled()) {
+    EventProfiler::handle_event(vc->write.vio._cont, event, &vc->write.vio);
+  } else if (vc->write.vio._cont) {
     vc->write.vio._cont->handleEvent(event, &vc->write.vio);
   } else {
     switch (event) {
@@ -390,6 +394,9 @@ write_to_net_io(NetHandler *nh, UnixNetVConnection *vc, EThread *thread)
       vc->read.triggered = 0;
       nh->read_ready_list.remove(vc);
       read_reschedule(nh, vc);
+    } else if (ret == SSL_HANDSHAKE_WANT_ASYNC) {
+      // the read side resumes the handshake when the async job is signalled
+      nh->write_ready_list.remove(vc);
     } else if (ret == SSL_HANDSHAKE_WANT_CONNECT || ret == SSL_HANDSHAKE_WANT_WRITE) {
       vc->write.triggered = 0;
       nh->write_ready_list.remove(vc);
@@ -23,7 +23,10 @@
 
 #include "P_SSLCertLookup.h"
 #include "ts/TestBox.h"
+#include <algorithm>
 #include <fstream>
+#include <string>
+#include <vector>
 
 static IpEndpoint
 make_endpoint(const char *address)
@@ -97,6 +100,150 @@ REGRESSION_TEST(SSLCertificateLookup)(RegressionTest *t, int /* atype ATS_UNUSED
   box.check(lookup.find("Mixed.CASE.Com")->ctx == foo, "mixed case lookup 1 for Mixed.Case.Com");
   box.check(lookup.find("Mixed.Case.Com")->ctx == foo, "mixed case lookup 2 for Mixed.Case.Com");
   box.check(lookup.find("mixed.case.com")->ctx == foo, "lower case lookup for Mixed.Case.Com");
+
+  // Names without a parent domain don't match wildcards.
+  box.check(lookup.find("com") == nullptr, "com won't match *.com");
+  box.check(lookup.find("") == nullptr, "the empty name has no match");
+}
+
+// Counts the contexts it builds, or fails to build them.
+struct TestContextBuilder : public SSLContextBuilder {
+  TestContextBuilder(int &n, bool ok) : builds(n), succeed(ok) {}
+  SSL_CTX *
+  build() override
+  {
+    ++builds;
+    return succeed ? SSL_CTX_new(SSLv23_server_method()) : nullptr;
+  }
+
+  int &builds;
+  bool succeed;
+};
+
+REGRESSION_TEST(SSLLazyContextLookup)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  SSLCertLookup lookup;
+  int builds[4] = {0, 0, 0, 0};
+  std::vector<SSL_CTX *> built;
+
+  box = REGRESSION_TEST_PASSED;
+
+  lookup.lazy_limit  = 2;
+  SSLCertContext a   = lookup.defer(new TestContextBuilder(builds[0], true), SSLCertContext::OPT_NONE);
+  SSLCertContext b   = lookup.defer(new TestContextBuilder(builds[1], true), SSLCertContext::OPT_NONE);
+  SSLCertContext c   = lookup.defer(new TestContextBuilder(builds[2], true), SSLCertContext::OPT_NONE);
+  SSLCertContext bad = lookup.defer(new TestContextBuilder(builds[3], false), SSLCertContext::OPT_NONE);
+
+  box.check(lookup.insert("a.example.com", a) >= 0, "insert deferred context");
+  box.check(lookup.insert("alias.example.com", a) >= 0, "insert deferred context alias");
+  box.check(lookup.insert("*.b.example.com", b) >= 0, "insert deferred wildcard context");
+  box.check(lookup.insert("c.example.com", c) >= 0, "insert deferred context");
+  box.check(lookup.insert("bad.example.com", bad) >= 0, "insert deferred context");
+  box.check(builds[0] + builds[1] + builds[2] + builds[3] == 0, "contexts are not built when inserted");
+
+  SSL_CTX *ctx_a = lookup.acquireContext(lookup.find("a.example.com"));
+  box.check(ctx_a != nullptr && builds[0] == 1, "context built on first use");
+  SSL_CTX *ctx_alias = lookup.acquireContext(lookup.find("ALIAS.example.com"));
+  box.check(ctx_alias == ctx_a && builds[0] == 1, "context shared by the names of a certificate");
+  SSL_CTX *ctx_b = lookup.acquireContext(lookup.find("www.b.example.com"));
+  box.check(ctx_b != nullptr && ctx_b != ctx_a && builds[1] == 1, "wildcard context built on first use");
+
+  // That is one context too many, the least recently used goes.
+  SSL_CTX *ctx_c = lookup.acquireContext(lookup.find("c.example.com"));
+  box.check(ctx_c != nullptr && builds[2] == 1, "context built on first use");
+  lookup.lazyContexts(built);
+  box.check(built.size() == 2 && built[0] == ctx_c && built[1] == ctx_b, "least recently used context evicted");
+  for (auto ctx : built) {
+    SSLReleaseContext(ctx);
+  }
+
+  SSL_CTX *ctx_a2 = lookup.acquireContext(lookup.find("a.example.com"));
+  box.check(ctx_a2 != nullptr && builds[0] == 2, "evicted context rebuilt");
+
+  box.check(lookup.acquireContext(lookup.find("bad.example.com")) == nullptr, "failed context");
+  box.check(lookup.acquireContext(lookup.find("bad.example.com")) == nullptr && builds[3] == 1, "failed context not retried");
+
+  // The evicted contexts lived on while we held them.
+  for (auto ctx : {ctx_a, ctx_alias, ctx_b, ctx_c, ctx_a2}) {
+    SSLReleaseContext(ctx);
+  }
+}
+
+REGRESSION_TEST(SSLCertLookupBenchmark)(RegressionTest *t, int level, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // This is a benchmark, only run it when asked for (test_certlookup --benchmark).
+  if (REGRESSION_TEST_EXTENDED > level) {
+    return;
+  }
+
+  // A multi-tenant configuration: a certificate per tenant, each for its name and its subdomains.
+  static const int TENANTS = 150000;
+  static const int ROUNDS  = 3;
+  SSLCertLookup lookup;
+  std::vector<std::string> hosts;
+  int builds = 0;
+
+  lookup.lazy_limit = 1000;
+  for (int i = 0; i < TENANTS; ++i) {
+    hosts.push_back("tenant" + std::to_string(i) + ".site" + std::to_string(i % 997) + ".example.com");
+  }
+
+  ink_hrtime start = ink_get_hrtime_internal();
+  for (const auto &host : hosts) {
+    SSLCertContext cc = lookup.defer(new TestContextBuilder(builds, true), SSLCertContext::OPT_NONE);
+    lookup.insert(host.c_str(), cc);
+    lookup.insert(("*." + host).c_str(), cc);
+  }
+  double load = static_cast<double>(ink_get_hrtime_internal() - start) / HRTIME_MSECOND;
+  rprintf(t, "indexed %d certificates with %d names in %.1f ms\n", TENANTS, 2 * TENANTS, load);
+
+  // Exact names, wildcard matches and misses.
+  std::vector<std::string> exact(hosts), wild, miss;
+  for (const auto &host : hosts) {
+    wild.push_back("WWW." + host);
+    miss.push_back("a.b." + host);
+  }
+  std::reverse(exact.begin(), exact.end());
+
+  struct {
+    const char *what;
+    const std::vector<std::string> &names;
+    bool match;
+  } sets[] = {{"exact", exact, true}, {"wildcard", wild, true}, {"miss", miss, false}};
+
+  for (const auto &set : sets) {
+    int found   = 0;
+    double best = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+      found = 0;
+      start = ink_get_hrtime_internal();
+      for (const auto &name : set.names) {
+        found += lookup.find(name.c_str()) != nullptr;
+      }
+      double nsec = static_cast<double>(ink_get_hrtime_internal() - start) / set.names.size();
+      best        = (0 == round || nsec < best) ? nsec : best;
+    }
+    box.check(found == (set.match ? TENANTS : 0), "%d %s lookups found", found, set.what);
+    rprintf(t, "%s lookups, best %.1f ns per lookup\n", set.what, best);
+  }
+
+  // Handshakes cycling over more tenants than the limit, then over fewer.
+  for (int working_set : {2000, 500}) {
+    int before = builds;
+    start      = ink_get_hrtime_internal();
+    for (int i = 0; i < 10 * working_set; ++i) {
+      SSL_CTX *ctx = lookup.acquireContext(lookup.find(hosts[i % working_set].c_str()));
+      box.check(ctx != nullptr, "context for %s", hosts[i % working_set].c_str());
+      SSLReleaseContext(ctx);
+    }
+    double nsec = static_cast<double>(ink_get_hrtime_internal() - start) / (10 * working_set);
+    rprintf(t, "%d tenants over %u contexts, %d builds, %.1f ns per context\n", working_set, lookup.lazy_limit, builds - before,
+            nsec);
+  }
 }
 
 REGRESSION_TEST(SSLAddressLookup)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
@@ -220,15 +367,18 @@ main(int argc, const char **argv)
   SSL_library_init();
   ink_freelists_snap_baseline();
 
-  if (argc > 1) {
+  if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+    RegressionTest::run("SSLCertLookupBenchmark", REGRESSION_TEST_EXTENDED);
+  } else if (argc > 1) {
     SSLCertLookup lookup;
-    unsigned count = 0;
+    unsigned count   = 0;
+    ink_hrtime start = ink_get_hrtime_internal();
 
     for (int i = 1; i < argc; ++i) {
       count += load_hostnames_csv(argv[i], lookup);
     }
 
-    printf("loaded %u host names\n", count);
+    printf("loaded %u host names in %.1f ms\n", count, static_cast<double>(ink_get_hrtime_internal() - start) / HRTIME_MSECOND);
 
   } else {
     // Standard regression tests.
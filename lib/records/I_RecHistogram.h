@@ -0,0 +1,149 @@
+/** @file
+
+  Per-thread log-linear histogram stats.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#pragma once
+
+#include "ts/ink_platform.h"
+#include "ts/List.h"
+
+#include <atomic>
+
+//-------------------------------------------------------------------------
+// RecHistogram
+//
+// A histogram of non-negative integer values, typically latencies, with
+// HDR style log-linear buckets: each power of two is split into
+// 2^precision sub-buckets, so every value is kept to within 1/2^precision
+// of itself (6.25% for the default precision of 4) over the whole range.
+//
+// Every thread records into buckets of its own, allocated on its first
+// record() and aligned to a cache line, so recording is two uncontended
+// relaxed increments. A histogram can be given fewer slots than MAX_SLOTS,
+// then the threads share them; that saves memory for histograms that are
+// numerous or seldom recorded. The raw stat sync merges the threads and publishes
+//
+//   <name>.count   number of values recorded since startup
+//   <name>.sum     sum of these values
+//   <name>.p50, <name>.p90, <name>.p99, <name>.p999, <name>.max
+//                  percentiles of the values recorded during the last
+//                  sync interval, 0 if there were none
+//
+// as plain integer stats, so they are available everywhere records are.
+//-------------------------------------------------------------------------
+class RecHistogram
+{
+public:
+  static const int MAX_SLOTS         = 256; // threads beyond this share slots
+  static const int RANGE_BITS        = 36;  // larger values are counted in the last bucket
+  static const int DEFAULT_PRECISION = 4;
+
+  /// @a slots is a power of two, up to MAX_SLOTS.
+  RecHistogram(const char *name, int precision = DEFAULT_PRECISION, int slots = MAX_SLOTS);
+  ~RecHistogram();
+
+  void
+  record(int64_t value)
+  {
+    std::atomic<int64_t> *slot = _thread_slot();
+
+    slot[0].fetch_add(value, std::memory_order_relaxed);
+    slot[1 + bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  int
+  bucket_count() const
+  {
+    return m_bucket_count;
+  }
+
+  int
+  bucket_index(int64_t value) const
+  {
+    if (value < (1 << m_precision)) {
+      return value < 0 ? 0 : static_cast<int>(value);
+    }
+
+    int msb   = 63 - __builtin_clzll(value);
+    int index = ((msb - m_precision + 1) << m_precision) + static_cast<int>((value >> (msb - m_precision)) - (1 << m_precision));
+    return index < m_bucket_count ? index : m_bucket_count - 1;
+  }
+
+  int64_t bucket_lowest(int index) const;
+  int64_t bucket_highest(int index) const;
+
+  /// Sum the buckets of all threads into @a counts, which holds bucket_count() values. Returns the sum of the values.
+  int64_t merge(int64_t *counts) const;
+
+  /// Highest value of the bucket holding the @a fraction percentile of @a counts, or 0 if there are no values.
+  int64_t percentile(const int64_t *counts, double fraction) const;
+
+  const char *
+  name() const
+  {
+    return m_name;
+  }
+
+  LINK(RecHistogram, link);
+
+private:
+  std::atomic<int64_t> *
+  _thread_slot()
+  {
+    static std::atomic<unsigned> next_thread_slot{0};
+    static thread_local unsigned thread_slot = next_thread_slot++ % MAX_SLOTS;
+
+    unsigned index             = thread_slot & m_slot_mask;
+    std::atomic<int64_t> *slot = m_slots[index].load(std::memory_order_acquire);
+    return likely(slot != nullptr) ? slot : _install_slot(index);
+  }
+
+  std::atomic<int64_t> *_install_slot(unsigned index);
+
+  char *m_name;
+  int m_precision;
+  int m_bucket_count;
+  unsigned m_slot_mask;
+
+  // Per thread: the sum of the values, then the bucket counts.
+  std::atomic<std::atomic<int64_t> *> m_slots[MAX_SLOTS];
+
+  // Merged counts at the last sync, to compute the interval percentiles.
+  int64_t *m_last_counts;
+
+  friend void RecExecHistogramSyncs();
+
+  // noncopyable
+  RecHistogram(const RecHistogram &) = delete;
+  RecHistogram &operator=(const RecHistogram &) = delete;
+};
+
+//-------------------------------------------------------------------------
+// Histogram Registration
+//-------------------------------------------------------------------------
+
+// Return the histogram named @a name, creating it and its stats if needed.
+RecHistogram *RecAllocateHistogram(const char *name, int precision = RecHistogram::DEFAULT_PRECISION,
+                                   int slots = RecHistogram::MAX_SLOTS);
+
+// Merge the threads of all histograms and update their stats.
+void RecExecHistogramSyncs();
@@ -24,6 +24,8 @@
 #pragma once
 
 #include "I_RecCore.h"
+#include "I_RecHistogram.h"
+#include "I_RecSnapshot.h"
 #include "I_EventSystem.h"
 
 //-------------------------------------------------------------------------
@@ -0,0 +1,148 @@
+/** @file
+
+  Shared memory snapshot of the stats.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#pragma once
+
+#include "ts/ink_platform.h"
+#include "I_RecDefs.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+//-------------------------------------------------------------------------
+// Stats snapshot
+//
+// traffic_server writes the value of every stat to a memory mapped file
+// after each raw stat sync, so tools can read the stats without going
+// through traffic_manager, and without taking any lock in traffic_server.
+//
+// The file is a RecSnapshotHeader followed by 'capacity' entries and a
+// string area holding the names and the string values. The header's
+// sequence number is a seqlock: it is odd while the snapshot is being
+// written, and changes with every write. Readers copy the snapshot and
+// retry if the sequence number was odd or changed during the copy.
+//
+// The writer creates a new file and renames it over the old one when it
+// starts, so readers compare the inode to find out they need to reopen.
+//-------------------------------------------------------------------------
+struct RecSnapshotHeader {
+  static const uint32_t SNAPSHOT_MAGIC   = 0x53535354; // "TSSS"
+  static const uint32_t SNAPSHOT_VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  std::atomic<uint64_t> sequence;
+  int64_t timestamp; // wall clock time of the snapshot, in microseconds
+  uint32_t pid;      // of the writer
+  uint32_t count;    // number of entries
+  uint32_t capacity; // maximum number of entries
+  uint32_t strings_size;
+  uint32_t strings_capacity;
+  uint32_t reserved;
+};
+
+struct RecSnapshotEntry {
+  uint32_t name; // offset in the string area
+  uint8_t rec_type;
+  uint8_t data_type;
+  uint16_t reserved;
+  union {
+    int64_t rec_int;     // RECD_INT, RECD_COUNTER
+    double rec_float;    // RECD_FLOAT
+    uint32_t rec_string; // RECD_STRING, offset in the string area
+  } value;
+};
+
+// A stat read from a snapshot.
+struct RecSnapshotRecord {
+  std::string name;
+  RecT rec_type;
+  RecDataT data_type;
+  int64_t rec_int;
+  double rec_float;
+  std::string rec_string;
+
+  // The value formatted the way traffic_ctl shows it.
+  std::string value() const;
+};
+
+//-------------------------------------------------------------------------
+// RecSnapshotWriter
+//-------------------------------------------------------------------------
+class RecSnapshotWriter
+{
+public:
+  RecSnapshotWriter() {}
+  ~RecSnapshotWriter();
+
+  /// Create the snapshot file @a path, replacing an existing one.
+  bool open(const char *path, uint32_t capacity = 0);
+
+  /// Write the current value of all stats.
+  void publish();
+
+private:
+  RecSnapshotHeader *m_header = nullptr;
+  size_t m_size               = 0;
+  bool m_overflow_warned      = false;
+
+  // noncopyable
+  RecSnapshotWriter(const RecSnapshotWriter &) = delete;
+  RecSnapshotWriter &operator=(const RecSnapshotWriter &) = delete;
+};
+
+//-------------------------------------------------------------------------
+// RecSnapshotReader
+//-------------------------------------------------------------------------
+class RecSnapshotReader
+{
+public:
+  RecSnapshotReader() {}
+  ~RecSnapshotReader();
+
+  /// Read the snapshot file @a path, reopening it if it was replaced.
+  /// Returns false if there is no readable snapshot, or if its writer is gone.
+  bool read(const char *path, std::vector<RecSnapshotRecord> &records, int64_t *timestamp = nullptr);
+
+private:
+  bool _open(const char *path);
+  void _close();
+
+  const RecSnapshotHeader *m_header = nullptr;
+  size_t m_size                     = 0;
+  ino_t m_inode                     = 0;
+  std::vector<char> m_copy;
+
+  // noncopyable
+  RecSnapshotReader(const RecSnapshotReader &) = delete;
+  RecSnapshotReader &operator=(const RecSnapshotReader &) = delete;
+};
+
+// Path of the snapshot, from proxy.config.stats.snapshot_filename.
+// Empty if the snapshot is disabled.
+std::string RecSnapshotPath();
+
+// Open the snapshot of traffic_server, and write it.
+void RecSnapshotInit();
+void RecExecSnapshot();
@@ -0,0 +1,312 @@
+/** @file
+
+  Per-thread log-linear histogram stats.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "P_RecCore.h"
+#include "P_RecProcess.h"
+#include "I_RecHistogram.h"
+
+#include <vector>
+
+namespace
+{
+// Suffixes of the stats of a histogram, in the order they are published.
+const char *const histogram_stat_suffix[] = {"count", "sum", "p50", "p90", "p99", "p999", "max"};
+const double histogram_percentiles[]      = {0.50, 0.90, 0.99, 0.999};
+
+ink_mutex histogram_mutex = PTHREAD_MUTEX_INITIALIZER;
+Queue<RecHistogram> histogram_list;
+} // namespace
+
+//-------------------------------------------------------------------------
+// RecHistogram
+//-------------------------------------------------------------------------
+RecHistogram::RecHistogram(const char *name, int precision, int slots)
+  : m_name(ats_strdup(name)),
+    m_precision(precision),
+    m_bucket_count((RANGE_BITS - precision + 1) << precision),
+    m_slot_mask(slots - 1)
+{
+  ink_release_assert(precision >= 1 && precision <= 8);
+  ink_release_assert(slots >= 1 && slots <= MAX_SLOTS && (slots & (slots - 1)) == 0);
+
+  for (auto &slot : m_slots) {
+    slot = nullptr;
+  }
+  m_last_counts = static_cast<int64_t *>(ats_malloc(m_bucket_count * sizeof(int64_t)));
+  memset(m_last_counts, 0, m_bucket_count * sizeof(int64_t));
+}
+
+RecHistogram::~RecHistogram()
+{
+  for (auto &slot : m_slots) {
+    ats_memalign_free(slot.load());
+  }
+  ats_free(m_last_counts);
+  ats_free(m_name);
+}
+
+std::atomic<int64_t> *
+RecHistogram::_install_slot(unsigned index)
+{
+  size_t size                    = (1 + m_bucket_count) * sizeof(std::atomic<int64_t>);
+  std::atomic<int64_t> *slot     = static_cast<std::atomic<int64_t> *>(ats_memalign(64, size));
+  std::atomic<int64_t> *expected = nullptr;
+
+  for (int i = 0; i <= m_bucket_count; ++i) {
+    new (&slot[i]) std::atomic<int64_t>(0);
+  }
+
+  // Threads that share the slot race to install it, the loser uses the winner's.
+  if (!m_slots[index].compare_exchange_strong(expected, slot)) {
+    ats_memalign_free(slot);
+    return expected;
+  }
+  return slot;
+}
+
+int64_t
+RecHistogram::bucket_lowest(int index) const
+{
+  int group = index >> m_precision;
+  int64_t r = index & ((1 << m_precision) - 1);
+
+  return group == 0 ? r : ((1LL << m_precision) + r) << (group - 1);
+}
+
+int64_t
+RecHistogram::bucket_highest(int index) const
+{
+  int group = index >> m_precision;
+
+  return group == 0 ? bucket_lowest(index) : bucket_lowest(index) + (1LL << (group - 1)) - 1;
+}
+
+int64_t
+RecHistogram::merge(int64_t *counts) const
+{
+  int64_t sum = 0;
+
+  memset(counts, 0, m_bucket_count * sizeof(int64_t));
+  for (auto &s : m_slots) {
+    std::atomic<int64_t> *slot = s.load(std::memory_order_acquire);
+    if (slot) {
+      sum += slot[0].load(std::memory_order_relaxed);
+      for (int i = 0; i < m_bucket_count; ++i) {
+        counts[i] += slot[1 + i].load(std::memory_order_relaxed);
+      }
+    }
+  }
+  return sum;
+}
+
+int64_t
+RecHistogram::percentile(const int64_t *counts, double fraction) const
+{
+  int64_t total = 0;
+
+  for (int i = 0; i < m_bucket_count; ++i) {
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  // The rank of the value, counting from 1.
+  int64_t rank = std::max<int64_t>(1, static_cast<int64_t>(fraction * total + 0.5));
+  for (int i = 0; i < m_bucket_count; ++i) {
+    rank -= counts[i];
+    if (rank <= 0) {
+      return bucket_highest(i);
+    }
+  }
+  return bucket_highest(m_bucket_count - 1);
+}
+
+//-------------------------------------------------------------------------
+// RecAllocateHistogram
+//-------------------------------------------------------------------------
+RecHistogram *
+RecAllocateHistogram(const char *name, int precision, int slots)
+{
+  ink_scoped_mutex_lock lock(histogram_mutex);
+
+  for (RecHistogram *h = histogram_list.head; h; h = h->link.next) {
+    if (strcmp(h->name(), name) == 0) {
+      return h;
+    }
+  }
+
+  for (const char *suffix : histogram_stat_suffix) {
+    char stat_name[1024];
+
+    snprintf(stat_name, sizeof(stat_name), "%s.%s", name, suffix);
+    if (RecRegisterStatInt(RECT_PROCESS, stat_name, static_cast<RecInt>(0), RECP_NON_PERSISTENT) != REC_ERR_OKAY) {
+      Warning("failed to register histogram stat %s", stat_name);
+      return nullptr;
+    }
+  }
+
+  RecHistogram *h = new RecHistogram(name, precision, slots);
+  histogram_list.enqueue(h);
+  return h;
+}
+
+//-------------------------------------------------------------------------
+// RecExecHistogramSyncs
+//-------------------------------------------------------------------------
+void
+RecExecHistogramSyncs()
+{
+  ink_scoped_mutex_lock lock(histogram_mutex);
+  std::vector<int64_t> counts;
+  std::vector<int64_t> interval;
+
+  for (RecHistogram *h = histogram_list.head; h; h = h->link.next) {
+    int n = h->bucket_count();
+    RecInt values[countof(histogram_stat_suffix)];
+
+    counts.resize(n);
+    interval.resize(n);
+
+    values[1] = h->merge(counts.data());
+    values[0] = 0;
+    for (int i = 0; i < n; ++i) {
+      values[0] += counts[i];
+      interval[i]         = counts[i] - h->m_last_counts[i];
+      h->m_last_counts[i] = counts[i];
+    }
+
+    for (unsigned i = 0; i < countof(histogram_percentiles); ++i) {
+      values[2 + i] = h->percentile(interval.data(), histogram_percentiles[i]);
+    }
+    values[countof(histogram_stat_suffix) - 1] = h->percentile(interval.data(), 1.0);
+
+    for (unsigned i = 0; i < countof(histogram_stat_suffix); ++i) {
+      char stat_name[1024];
+
+      snprintf(stat_name, sizeof(stat_name), "%s.%s", h->name(), histogram_stat_suffix[i]);
+      RecSetRecordInt(stat_name, values[i], REC_SOURCE_DEFAULT);
+    }
+  }
+}
+
+#if TS_HAS_TESTS
+#include "ts/TestBox.h"
+
+struct RecHistogramTestArgs {
+  RecHistogram *histogram;
+  int64_t first;
+  int64_t last;
+};
+
+static void *
+rec_histogram_test_thread(void *data)
+{
+  RecHistogramTestArgs *args = static_cast<RecHistogramTestArgs *>(data);
+
+  for (int64_t v = args->first; v <= args->last; ++v) {
+    args->histogram->record(v);
+  }
+  return nullptr;
+}
+
+REGRESSION_TEST(RecHistogram)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  RecHistogram h("proxy.process.test.histogram");
+  int errors = 0;
+
+  // Buckets are contiguous and no wider than 1/16 of their values.
+  for (int i = 0; i < h.bucket_count() - 1; ++i) {
+    if (h.bucket_highest(i) + 1 != h.bucket_lowest(i + 1)) {
+      ++errors;
+    }
+    if (h.bucket_highest(i) - h.bucket_lowest(i) > h.bucket_lowest(i) / 16) {
+      ++errors;
+    }
+  }
+  box.check(errors == 0, "%d buckets are not contiguous or too wide", errors);
+
+  errors = 0;
+  for (int64_t v = 0; v < (1 << 20); v += 7) {
+    int index = h.bucket_index(v);
+    if (v < h.bucket_lowest(index) || v > h.bucket_highest(index)) {
+      ++errors;
+    }
+  }
+  box.check(errors == 0, "%d values are in the wrong bucket", errors);
+  box.check(h.bucket_index(-5) == 0, "negative values must go to the first bucket");
+  box.check(h.bucket_index(INT64_MAX) == h.bucket_count() - 1, "large values must go to the last bucket");
+
+  // 1 .. 40000, recorded by 4 threads.
+  RecHistogramTestArgs args[4];
+  ink_thread threads[4];
+  for (int i = 0; i < 4; ++i) {
+    args[i] = {&h, i * 10000 + 1, (i + 1) * 10000};
+    ink_thread_create(&threads[i], rec_histogram_test_thread, &args[i], 0, 0, nullptr);
+  }
+  for (auto &tid : threads) {
+    ink_thread_join(tid);
+  }
+
+  std::vector<int64_t> counts(h.bucket_count());
+  int64_t total = 0;
+  int64_t sum   = h.merge(counts.data());
+  for (int64_t c : counts) {
+    total += c;
+  }
+  box.check(total == 40000, "counted %" PRId64 " of 40000 values", total);
+  box.check(sum == 40000LL * 40001 / 2, "wrong sum %" PRId64, sum);
+
+  for (double p : {0.5, 0.9, 0.99, 0.999}) {
+    int64_t expected = static_cast<int64_t>(p * 40000);
+    int64_t value    = h.percentile(counts.data(), p);
+    box.check(value >= expected && value <= expected + expected / 16, "p%g is %" PRId64 ", expected %" PRId64, p * 100, value,
+              expected);
+  }
+  box.check(h.percentile(counts.data(), 1.0) >= 40000, "max is below the largest value");
+
+  // Coarser buckets, in two slots shared by the 4 threads.
+  RecHistogram shared("proxy.process.test.shared_histogram", 2, 2);
+  for (int i = 0; i < 4; ++i) {
+    args[i].histogram = &shared;
+    ink_thread_create(&threads[i], rec_histogram_test_thread, &args[i], 0, 0, nullptr);
+  }
+  for (auto &tid : threads) {
+    ink_thread_join(tid);
+  }
+
+  counts.resize(shared.bucket_count());
+  total = 0;
+  sum   = shared.merge(counts.data());
+  for (int64_t c : counts) {
+    total += c;
+  }
+  box.check(total == 40000, "counted %" PRId64 " of 40000 values in shared slots", total);
+  box.check(sum == 40000LL * 40001 / 2, "wrong sum %" PRId64 " in shared slots", sum);
+  int64_t median = shared.percentile(counts.data(), 0.5);
+  box.check(median >= 20000 && median <= 20000 + 20000 / 4, "coarse p50 is %" PRId64 ", expected 20000", median);
+}
+#endif
@@ -144,6 +144,8 @@ struct raw_stat_sync_cont : public Continuation {
   exec_callbacks(int /* event */, Event * /* e */)
   {
     RecExecRawStatSyncCbs();
+    RecExecHistogramSyncs();
+    RecExecSnapshot();
     Debug("statsproc", "raw_stat_sync_cont() processed");
 
     return EVENT_CONT;
@@ -293,6 +295,8 @@ RecProcessStart()
     return REC_ERR_OKAY;
   }
 
+  RecSnapshotInit();
+
   Debug("statsproc", "Starting sync continuations:");
   raw_stat_sync_cont *rssc = new raw_stat_sync_cont(new_ProxyMutex());
   Debug("statsproc", "raw-stat syncer");
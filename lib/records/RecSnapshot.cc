@@ -0,0 +1,502 @@
+/** @file
+
+  Shared memory snapshot of the stats.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "P_RecCore.h"
+#include "P_RecUtils.h"
+#include "I_RecSnapshot.h"
+#include "ts/I_Layout.h"
+#include "ts/ink_hrtime.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+namespace
+{
+// Average space reserved for the name and the value of a stat.
+const uint32_t STRING_SPACE_PER_ENTRY = 128;
+
+// Readers give up after this many copies raced with the writer.
+const int MAX_READ_ATTEMPTS = 64;
+
+RecSnapshotWriter *snapshot_writer;
+
+inline RecSnapshotEntry *
+snapshot_entries(const RecSnapshotHeader *header)
+{
+  return reinterpret_cast<RecSnapshotEntry *>(const_cast<RecSnapshotHeader *>(header) + 1);
+}
+
+inline char *
+snapshot_strings(const RecSnapshotHeader *header)
+{
+  return reinterpret_cast<char *>(snapshot_entries(header) + header->capacity);
+}
+
+struct SnapshotFill {
+  RecSnapshotHeader *header;
+  RecSnapshotEntry *entries;
+  char *strings;
+  uint32_t count;
+  uint32_t strings_size;
+  bool overflow;
+};
+
+// Append @a str to the string area, returning its offset or -1 if there is no room.
+int64_t
+snapshot_add_string(SnapshotFill *fill, const char *str)
+{
+  size_t len = strlen(str) + 1;
+
+  if (fill->strings_size + len > fill->header->strings_capacity) {
+    fill->overflow = true;
+    return -1;
+  }
+  memcpy(fill->strings + fill->strings_size, str, len);
+  fill->strings_size += len;
+  return fill->strings_size - len;
+}
+
+void
+snapshot_record_callback(RecT rec_type, void *edata, int registered, const char *name, int data_type, RecData *datum)
+{
+  SnapshotFill *fill = static_cast<SnapshotFill *>(edata);
+
+  if (!registered || fill->count >= fill->header->capacity) {
+    fill->overflow = fill->overflow || registered;
+    return;
+  }
+
+  RecSnapshotEntry *entry = &fill->entries[fill->count];
+  uint32_t strings_size   = fill->strings_size;
+  int64_t offset          = snapshot_add_string(fill, name);
+
+  if (offset < 0) {
+    return;
+  }
+
+  entry->name      = offset;
+  entry->rec_type  = rec_type;
+  entry->data_type = data_type;
+  entry->reserved  = 0;
+
+  switch (data_type) {
+  case RECD_INT:
+    entry->value.rec_int = datum->rec_int;
+    break;
+  case RECD_COUNTER:
+    entry->value.rec_int = datum->rec_counter;
+    break;
+  case RECD_FLOAT:
+    entry->value.rec_float = datum->rec_float;
+    break;
+  case RECD_STRING:
+    offset = snapshot_add_string(fill, datum->rec_string ? datum->rec_string : "");
+    if (offset < 0) {
+      fill->strings_size = strings_size;
+      return;
+    }
+    entry->value.rec_string = offset;
+    break;
+  default:
+    fill->strings_size = strings_size;
+    return;
+  }
+
+  ++fill->count;
+}
+} // namespace
+
+//-------------------------------------------------------------------------
+// RecSnapshotRecord
+//-------------------------------------------------------------------------
+std::string
+RecSnapshotRecord::value() const
+{
+  char buf[64];
+
+  switch (data_type) {
+  case RECD_INT:
+  case RECD_COUNTER:
+    snprintf(buf, sizeof(buf), "%" PRId64, rec_int);
+    return buf;
+  case RECD_FLOAT:
+    snprintf(buf, sizeof(buf), "%f", rec_float);
+    return buf;
+  case RECD_STRING:
+    return rec_string.empty() ? "\"\"" : rec_string;
+  default:
+    return "(invalid)";
+  }
+}
+
+//-------------------------------------------------------------------------
+// RecSnapshotWriter
+//-------------------------------------------------------------------------
+RecSnapshotWriter::~RecSnapshotWriter()
+{
+  if (m_header) {
+    munmap(m_header, m_size);
+  }
+}
+
+bool
+RecSnapshotWriter::open(const char *path, uint32_t capacity)
+{
+  if (capacity == 0) {
+    capacity = REC_MAX_RECORDS;
+  }
+
+  uint32_t strings_capacity = capacity * STRING_SPACE_PER_ENTRY;
+  size_t size               = sizeof(RecSnapshotHeader) + capacity * sizeof(RecSnapshotEntry) + strings_capacity;
+  std::string tmp_path      = std::string(path) + ".XXXXXX";
+
+  // Build the new file aside, so readers never see it half initialized.
+  int fd = mkstemp(&tmp_path[0]);
+  if (fd < 0) {
+    Warning("unable to create stats snapshot %s: %s", tmp_path.c_str(), strerror(errno));
+    return false;
+  }
+
+  void *addr = MAP_FAILED;
+  if (fchmod(fd, 0644) == 0 && ftruncate(fd, size) == 0) {
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (addr == MAP_FAILED) {
+    Warning("unable to map stats snapshot %s: %s", tmp_path.c_str(), strerror(errno));
+    close(fd);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  close(fd);
+
+  RecSnapshotHeader *header = new (addr) RecSnapshotHeader;
+  header->magic             = RecSnapshotHeader::SNAPSHOT_MAGIC;
+  header->version           = RecSnapshotHeader::SNAPSHOT_VERSION;
+  header->sequence          = 0;
+  header->timestamp         = 0;
+  header->pid               = getpid();
+  header->count             = 0;
+  header->capacity          = capacity;
+  header->strings_size      = 0;
+  header->strings_capacity  = strings_capacity;
+  header->reserved          = 0;
+
+  if (rename(tmp_path.c_str(), path) != 0) {
+    Warning("unable to rename stats snapshot %s to %s: %s", tmp_path.c_str(), path, strerror(errno));
+    munmap(addr, size);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  if (m_header) {
+    munmap(m_header, m_size);
+  }
+  m_header = header;
+  m_size   = size;
+  return true;
+}
+
+void
+RecSnapshotWriter::publish()
+{
+  if (m_header == nullptr) {
+    return;
+  }
+
+  SnapshotFill fill = {m_header, snapshot_entries(m_header), snapshot_strings(m_header), 0, 0, false};
+  uint64_t sequence = m_header->sequence.load(std::memory_order_relaxed);
+
+  m_header->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  RecDumpRecords(static_cast<RecT>(RECT_PROCESS | RECT_NODE | RECT_PLUGIN), snapshot_record_callback, &fill);
+  m_header->count        = fill.count;
+  m_header->strings_size = fill.strings_size;
+  m_header->timestamp    = ink_hrtime_to_usec(ink_get_hrtime_internal());
+
+  m_header->sequence.store(sequence + 2, std::memory_order_release);
+
+  if (fill.overflow && !m_overflow_warned) {
+    Warning("the stats snapshot is full, only %u stats are published", fill.count);
+    m_overflow_warned = true;
+  }
+}
+
+//-------------------------------------------------------------------------
+// RecSnapshotReader
+//-------------------------------------------------------------------------
+RecSnapshotReader::~RecSnapshotReader()
+{
+  _close();
+}
+
+void
+RecSnapshotReader::_close()
+{
+  if (m_header) {
+    munmap(const_cast<RecSnapshotHeader *>(m_header), m_size);
+    m_header = nullptr;
+  }
+  m_size  = 0;
+  m_inode = 0;
+}
+
+bool
+RecSnapshotReader::_open(const char *path)
+{
+  struct stat st;
+  int fd = ::open(path, O_RDONLY);
+
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RecSnapshotHeader)) {
+    close(fd);
+    return false;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  const RecSnapshotHeader *header = static_cast<const RecSnapshotHeader *>(addr);
+  if (header->magic != RecSnapshotHeader::SNAPSHOT_MAGIC || header->version != RecSnapshotHeader::SNAPSHOT_VERSION ||
+      sizeof(RecSnapshotHeader) + header->capacity * sizeof(RecSnapshotEntry) + header->strings_capacity >
+        static_cast<size_t>(st.st_size)) {
+    munmap(addr, st.st_size);
+    return false;
+  }
+
+  m_header = header;
+  m_size   = st.st_size;
+  m_inode  = st.st_ino;
+  return true;
+}
+
+bool
+RecSnapshotReader::read(const char *path, std::vector<RecSnapshotRecord> &records, int64_t *timestamp)
+{
+  struct stat st;
+
+  // The writer replaces the file when it restarts.
+  if (stat(path, &st) != 0) {
+    _close();
+    return false;
+  }
+  if (m_header == nullptr || st.st_ino != m_inode) {
+    _close();
+    if (!_open(path)) {
+      return false;
+    }
+  }
+
+  // A traffic_server that died leaves its last snapshot behind, do not report it as current.
+  if (kill(m_header->pid, 0) != 0 && errno == ESRCH) {
+    return false;
+  }
+
+  const RecSnapshotEntry *entries = snapshot_entries(m_header);
+  const char *strings             = snapshot_strings(m_header);
+
+  for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+    uint64_t sequence = m_header->sequence.load(std::memory_order_acquire);
+
+    if (sequence & 1) {
+      sched_yield();
+      continue;
+    }
+
+    uint32_t count        = std::min(m_header->count, m_header->capacity);
+    uint32_t strings_size = std::min(m_header->strings_size, m_header->strings_capacity);
+    int64_t time          = m_header->timestamp;
+    size_t entries_size   = count * sizeof(RecSnapshotEntry);
+
+    m_copy.resize(entries_size + strings_size + 1);
+    memcpy(m_copy.data(), entries, entries_size);
+    memcpy(m_copy.data() + entries_size, strings, strings_size);
+    m_copy[entries_size + strings_size] = '\0';
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_header->sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+
+    const RecSnapshotEntry *copy = reinterpret_cast<const RecSnapshotEntry *>(m_copy.data());
+    const char *copy_strings     = m_copy.data() + entries_size;
+
+    records.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      RecSnapshotRecord &record = records[i];
+
+      record.name      = copy_strings + std::min(copy[i].name, strings_size);
+      record.rec_type  = static_cast<RecT>(copy[i].rec_type);
+      record.data_type = static_cast<RecDataT>(copy[i].data_type);
+      record.rec_int   = 0;
+      record.rec_float = 0;
+      record.rec_string.clear();
+
+      switch (record.data_type) {
+      case RECD_INT:
+      case RECD_COUNTER:
+        record.rec_int = copy[i].value.rec_int;
+        break;
+      case RECD_FLOAT:
+        record.rec_float = copy[i].value.rec_float;
+        break;
+      case RECD_STRING:
+        record.rec_string = copy_strings + std::min(copy[i].value.rec_string, strings_size);
+        break;
+      default:
+        break;
+      }
+    }
+
+    if (timestamp) {
+      *timestamp = time;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+//-------------------------------------------------------------------------
+// RecSnapshotPath
+//-------------------------------------------------------------------------
+std::string
+RecSnapshotPath()
+{
+  ats_scoped_str filename;
+
+  if (RecGetRecordString_Xmalloc("proxy.config.stats.snapshot_filename", (RecString *)&filename) != REC_ERR_OKAY || !filename ||
+      *filename == '\0') {
+    return std::string();
+  }
+  ats_scoped_str rundir(RecConfigReadRuntimeDir());
+
+  return Layout::relative_to(rundir.get(), filename.get());
+}
+
+//-------------------------------------------------------------------------
+// RecSnapshotInit / RecExecSnapshot
+//-------------------------------------------------------------------------
+void
+RecSnapshotInit()
+{
+  std::string path = RecSnapshotPath();
+
+  if (path.empty() || snapshot_writer) {
+    return;
+  }
+
+  snapshot_writer = new RecSnapshotWriter;
+  if (!snapshot_writer->open(path.c_str())) {
+    delete snapshot_writer;
+    snapshot_writer = nullptr;
+  }
+}
+
+void
+RecExecSnapshot()
+{
+  if (snapshot_writer) {
+    snapshot_writer->publish();
+  }
+}
+
+#if TS_HAS_TESTS
+#include "ts/TestBox.h"
+
+REGRESSION_TEST(RecSnapshot)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  char path[] = "/tmp/snapshot_test.XXXXXX";
+  int fd      = mkstemp(path);
+  close(fd);
+
+  RecRegisterStatInt(RECT_PROCESS, "proxy.process.test.snapshot.int", static_cast<RecInt>(0), RECP_NON_PERSISTENT);
+  RecRegisterStatFloat(RECT_PROCESS, "proxy.process.test.snapshot.float", static_cast<RecFloat>(0), RECP_NON_PERSISTENT);
+  RecRegisterStatString(RECT_PROCESS, "proxy.process.test.snapshot.string", (RecString) "", RECP_NON_PERSISTENT);
+  RecSetRecordInt("proxy.process.test.snapshot.int", 42, REC_SOURCE_DEFAULT);
+  RecSetRecordFloat("proxy.process.test.snapshot.float", 0.5, REC_SOURCE_DEFAULT);
+  RecSetRecordString("proxy.process.test.snapshot.string", (RecString) "forty two", REC_SOURCE_DEFAULT);
+
+  RecSnapshotWriter writer;
+  RecSnapshotReader reader;
+  std::vector<RecSnapshotRecord> records;
+
+  box.check(writer.open(path), "unable to create %s", path);
+  box.check(reader.read(path, records), "unable to read an empty snapshot");
+  box.check(records.empty(), "the snapshot should be empty before the first publish");
+
+  writer.publish();
+  box.check(reader.read(path, records), "unable to read the snapshot");
+
+  int found = 0;
+  for (const auto &r : records) {
+    if (r.name == "proxy.process.test.snapshot.int") {
+      box.check(r.data_type == RECD_INT && r.rec_int == 42, "wrong int value %s", r.value().c_str());
+      ++found;
+    } else if (r.name == "proxy.process.test.snapshot.float") {
+      box.check(r.data_type == RECD_FLOAT && r.rec_float == 0.5, "wrong float value %s", r.value().c_str());
+      ++found;
+    } else if (r.name == "proxy.process.test.snapshot.string") {
+      box.check(r.data_type == RECD_STRING && r.rec_string == "forty two", "wrong string value %s", r.value().c_str());
+      ++found;
+    } else if (r.name.compare(0, 13, "proxy.config.") == 0) {
+      box.check(false, "config %s is not a stat", r.name.c_str());
+    }
+  }
+  box.check(found == 3, "found %d of the 3 test stats", found);
+
+  // A new writer replaces the file, the reader follows it.
+  RecSetRecordInt("proxy.process.test.snapshot.int", 43, REC_SOURCE_DEFAULT);
+  RecSnapshotWriter writer2;
+  box.check(writer2.open(path, 4), "unable to recreate %s", path);
+  writer2.publish();
+  box.check(reader.read(path, records), "unable to read the new snapshot");
+  box.check(records.size() <= 4, "the snapshot holds %zu stats, more than its capacity", records.size());
+
+  // The snapshot of a writer that is gone is stale.
+  pid_t child = fork();
+  if (child == 0) {
+    _exit(0);
+  }
+  waitpid(child, nullptr, 0);
+
+  uint32_t dead_pid = child;
+  fd                = ::open(path, O_WRONLY);
+  box.check(fd >= 0 && pwrite(fd, &dead_pid, sizeof(dead_pid), offsetof(RecSnapshotHeader, pid)) == sizeof(dead_pid),
+            "unable to set the writer pid of %s", path);
+  close(fd);
+  box.check(!reader.read(path, records), "read the snapshot of a dead writer");
+
+  unlink(path);
+  box.check(!reader.read(path, records), "read a removed snapshot");
+}
+#endif
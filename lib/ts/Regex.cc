@@ -26,6 +26,10 @@
 #include "ts/ink_memory.h"
 #include "ts/Regex.h"
 
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
+
 #ifdef PCRE_CONFIG_JIT
 struct RegexThreadKey {
   RegexThreadKey() { ink_thread_key_create(&this->key, (void (*)(void *)) & pcre_jit_stack_free); }
@@ -247,3 +251,314 @@ DFA::match(const char *str, int length) const
 
   return -1;
 }
+
+bool
+RegexPrefilter::literals(const char *pattern, std::vector<std::vector<std::string>> &alternatives)
+{
+  std::string run;
+  std::vector<std::string> runs;
+  bool after_literal = false; // The last atom was a literal character.
+
+  auto end_run = [&]() {
+    if (run.size() >= MIN_LITERAL) {
+      runs.push_back(run);
+    }
+    run.clear();
+  };
+  auto end_alternative = [&]() {
+    end_run();
+    if (runs.empty()) {
+      return false;
+    }
+    alternatives.emplace_back();
+    alternatives.back().swap(runs);
+    return true;
+  };
+
+  alternatives.clear();
+  for (const char *p = pattern; *p;) {
+    switch (*p) {
+    case '\\':
+      if (p[1] == '\0') {
+        return false;
+      } else if (!isalnum(static_cast<unsigned char>(p[1]))) {
+        run += p[1];
+        after_literal = true;
+      } else if (strchr("dDwWsShHvVbBRXnrtfeaAzZGK", p[1])) {
+        end_run();
+        after_literal = false;
+      } else {
+        // Escapes with arguments, references and quoting are not worth following.
+        return false;
+      }
+      p += 2;
+      continue;
+
+    case '[':
+      // Skip the class, a leading ] is a member.
+      p += (p[1] == '^') ? 2 : 1;
+      p += (*p == ']') ? 1 : 0;
+      while (*p && *p != ']') {
+        if (*p == '\\' && p[1]) {
+          p += 2;
+        } else if (*p == '[' && p[1] == ':') {
+          const char *end = strstr(p, ":]");
+          if (end == nullptr) {
+            return false;
+          }
+          p = end + 2;
+        } else {
+          ++p;
+        }
+      }
+      if (*p != ']') {
+        return false;
+      }
+      end_run();
+      after_literal = false;
+      ++p;
+      continue;
+
+    case '(': {
+      // Groups may be optional, skip them. The extended syntax changes the meaning of the characters.
+      if (p[1] == '?') {
+        for (const char *option = p + 2; isalpha(static_cast<unsigned char>(*option)) || *option == '-'; ++option) {
+          if (*option == 'x') {
+            return false;
+          }
+        }
+      }
+      int depth = 0;
+      do {
+        if (*p == '\\' && p[1]) {
+          ++p;
+        } else if (*p == '[') {
+          // A class in the group, find its end.
+          p += (p[1] == '^') ? 2 : 1;
+          p += (*p == ']') ? 1 : 0;
+          while (*p && *p != ']') {
+            p += (*p == '\\' && p[1]) ? 2 : 1;
+          }
+        } else if (*p == '(') {
+          ++depth;
+        } else if (*p == ')') {
+          --depth;
+        }
+        if (*p) {
+          ++p;
+        }
+      } while (*p && depth > 0);
+      if (depth > 0) {
+        return false;
+      }
+      end_run();
+      after_literal = false;
+      continue;
+    }
+
+    case ')':
+      return false;
+
+    case '|':
+      if (!end_alternative()) {
+        return false;
+      }
+      after_literal = false;
+      ++p;
+      continue;
+
+    case '*':
+    case '?':
+      // The last character is optional.
+      if (after_literal) {
+        run.pop_back();
+      }
+      end_run();
+      after_literal = false;
+      ++p;
+      continue;
+
+    case '+':
+      end_run();
+      after_literal = false;
+      ++p;
+      continue;
+
+    case '{': {
+      char *end;
+      long min = strtol(p + 1, &end, 10);
+      if (end == p + 1 || (*end != '}' && *end != ',')) {
+        return false;
+      }
+      if (*end == ',') {
+        strtol(end + 1, &end, 10);
+      }
+      if (*end != '}') {
+        return false;
+      }
+      if (after_literal && min == 0) {
+        run.pop_back();
+      }
+      end_run();
+      after_literal = false;
+      p = end + 1;
+      continue;
+    }
+
+    case '.':
+    case '^':
+    case '$':
+      end_run();
+      after_literal = false;
+      ++p;
+      continue;
+
+    default:
+      run += *p;
+      after_literal = true;
+      ++p;
+      continue;
+    }
+  }
+
+  return end_alternative();
+}
+
+void
+RegexPrefilter::add(const char *pattern)
+{
+  _alternatives.emplace_back();
+  if (literals(pattern, _alternatives.back())) {
+    for (auto &runs : _alternatives.back()) {
+      for (auto &literal : runs) {
+        std::transform(literal.begin(), literal.end(), literal.begin(), ::tolower);
+      }
+    }
+  } else {
+    _alternatives.back().clear();
+    _always.push_back(_count);
+  }
+  ++_count;
+}
+
+void
+RegexPrefilter::build()
+{
+  // Count the patterns of each literal, a literal most of them share, like a domain, would make them all candidates.
+  std::unordered_map<std::string, int> shared;
+  for (const auto &alternatives : _alternatives) {
+    std::vector<const std::string *> seen;
+    for (const auto &runs : alternatives) {
+      for (const auto &literal : runs) {
+        if (std::find_if(seen.begin(), seen.end(), [&](const std::string *s) { return *s == literal; }) == seen.end()) {
+          seen.push_back(&literal);
+          ++shared[literal];
+        }
+      }
+    }
+  }
+
+  // Each alternative is found by its least shared literal, the longest one of those.
+  std::unordered_map<std::string, int> index;
+  std::vector<std::string> literals;
+  _patterns.clear();
+  for (size_t pattern = 0; pattern < _alternatives.size(); ++pattern) {
+    for (const auto &runs : _alternatives[pattern]) {
+      const std::string *best = &runs.front();
+      for (const auto &literal : runs) {
+        if (shared[literal] < shared[*best] || (shared[literal] == shared[*best] && literal.size() > best->size())) {
+          best = &literal;
+        }
+      }
+      auto found = index.emplace(*best, literals.size());
+      if (found.second) {
+        literals.push_back(*best);
+        _patterns.emplace_back();
+      }
+      auto &to = _patterns[found.first->second];
+      if (to.empty() || to.back() != static_cast<int>(pattern)) {
+        to.push_back(pattern);
+      }
+    }
+  }
+  _alternatives.clear();
+  _alternatives.shrink_to_fit();
+
+  // The characters of the literals, in either case, get a class. The others all go to the root.
+  memset(_class, 0, sizeof(_class));
+  _width = 1;
+  for (const auto &literal : literals) {
+    for (unsigned char c : literal) {
+      if (_class[c] == 0) {
+        _class[c] = _class[toupper(c)] = _width++;
+      }
+    }
+  }
+
+  // The trie of the literals.
+  _delta.assign(_width, -1);
+  _output.assign(1, -1);
+  for (size_t i = 0; i < literals.size(); ++i) {
+    int32_t state = 0;
+    for (unsigned char c : literals[i]) {
+      int32_t &next = _delta[state * _width + _class[c]];
+      if (next < 0) {
+        next = _output.size();
+        _output.push_back(-1);
+        _delta.resize(_delta.size() + _width, -1);
+      }
+      state = _delta[state * _width + _class[c]];
+    }
+    _output[state] = i;
+  }
+
+  // Turn it into an automaton, breadth first so that the failure states are done first.
+  std::vector<int32_t> failure(_output.size(), 0);
+  std::vector<int32_t> queue;
+  _dictionary.assign(_output.size(), -1);
+  for (int c = 0; c < _width; ++c) {
+    int32_t &next = _delta[c];
+    if (next < 0) {
+      next = 0;
+    } else {
+      queue.push_back(next);
+    }
+  }
+  for (size_t head = 0; head < queue.size(); ++head) {
+    int32_t state = queue[head];
+    for (int c = 0; c < _width; ++c) {
+      int32_t &next = _delta[state * _width + c];
+      int32_t fail  = _delta[failure[state] * _width + c];
+      if (next < 0) {
+        next = fail;
+      } else {
+        failure[next]     = fail;
+        _dictionary[next] = _output[fail] >= 0 ? fail : _dictionary[fail];
+        queue.push_back(next);
+      }
+    }
+  }
+}
+
+void
+RegexPrefilter::candidates(const char *str, int length, std::vector<int> &candidates) const
+{
+  std::vector<int> hits;
+
+  if (!_patterns.empty()) {
+    int32_t state = 0;
+    for (int i = 0; i < length; ++i) {
+      state = _delta[state * _width + _class[static_cast<unsigned char>(str[i])]];
+      for (int32_t s = _output[state] >= 0 ? state : _dictionary[state]; s >= 0; s = _dictionary[s]) {
+        const auto &patterns = _patterns[_output[s]];
+        hits.insert(hits.end(), patterns.begin(), patterns.end());
+      }
+    }
+    std::sort(hits.begin(), hits.end());
+    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+  }
+
+  candidates.clear();
+  candidates.reserve(hits.size() + _always.size());
+  std::merge(hits.begin(), hits.end(), _always.begin(), _always.end(), std::back_inserter(candidates));
+}
@@ -25,6 +25,10 @@
 
 #include "ts/ink_config.h"
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #ifdef HAVE_PCRE_PCRE_H
 #include <pcre/pcre.h>
 #else
@@ -78,3 +82,47 @@ private:
 
   dfa_pattern *_my_patterns;
 };
+
+/**
+  Finds the patterns of a set a string may match, in one pass over the string.
+
+  Every match of a pattern contains the literals of one of its top level
+  alternatives. The least common literal of each alternative goes into an
+  Aho-Corasick automaton, a string can only match the patterns whose
+  literals it contains, and those without literals. These are the candidates, the caller runs their regular
+  expressions in order. The literals are matched regardless of case, so the
+  candidates are right for case insensitive patterns too.
+*/
+class RegexPrefilter
+{
+public:
+  /// Add the next pattern, its index is the number of patterns added before.
+  void add(const char *pattern);
+  /// Build the automaton, after the last add().
+  void build();
+
+  /// Set @a candidates to the indexes of the patterns @a str may match, in ascending order.
+  void candidates(const char *str, int length, std::vector<int> &candidates) const;
+
+  int
+  size() const
+  {
+    return _count;
+  }
+
+  /// Get the literals every match of each top level alternative of @a pattern contains. False if one has none.
+  static bool literals(const char *pattern, std::vector<std::vector<std::string>> &alternatives);
+
+private:
+  static const size_t MIN_LITERAL = 3;
+
+  int _count = 0;
+  std::vector<int> _always;                                          // Patterns without literals.
+  std::vector<std::vector<std::vector<std::string>>> _alternatives; // Literals of each pattern, until build().
+  std::vector<std::vector<int>> _patterns;                           // Of each literal.
+  uint8_t _class[256] = {0};                                         // Characters of the literals, 0 for the others.
+  int _width          = 1;                                           // Number of classes.
+  std::vector<int32_t> _delta;                                       // Next state, by state and class.
+  std::vector<int32_t> _output;                                      // Literal ending at a state, or -1.
+  std::vector<int32_t> _dictionary;                                  // Next state on the failure path with a literal, or -1.
+};
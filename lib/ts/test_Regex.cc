@@ -24,6 +24,8 @@
 #include "ts/Regex.h"
 #include "ts/TestBox.h"
 
+#include <algorithm>
+
 typedef struct {
   char subject[100];
   bool match;
@@ -55,3 +57,86 @@ REGRESSION_TEST(Regex_basic)(RegressionTest *t, int /* atype ATS_UNUSED */, int
     }
   }
 }
+
+REGRESSION_TEST(RegexPrefilter_literals)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus, REGRESSION_TEST_PASSED);
+
+  static const struct {
+    const char *pattern;
+    const char *literals; // Separated by spaces, the alternatives by " | ", nullptr if none.
+  } tests[] = {
+    {"^www\\.example\\.com$", "www.example.com"},
+    {"^(.*)\\.example\\.com$", ".example.com"},
+    {"tenant[0-9]+\\.cdn\\.net", "tenant .cdn.net"},
+    {"abc?def", "def"},
+    {"abcd*ef", "abc"},
+    {"abcx{0,3}de", "abc"},
+    {"abcx{2}de", "abcx"},
+    {"host\\d+\\.a\\.org", "host .a.org"},
+    {"foo\\.com|bar\\.org", "foo.com | bar.org"},
+    {"foo\\.com|b", nullptr},
+    {"(?i)Example\\.COM", "Example.COM"},
+    {"(?x) e x a m p l e", nullptr},
+    {"\\x41bcdef", nullptr},
+    {"[a-z]{3}", nullptr},
+    {".*", nullptr},
+  };
+
+  for (const auto &test : tests) {
+    std::vector<std::vector<std::string>> alternatives;
+    std::string joined;
+
+    if (RegexPrefilter::literals(test.pattern, alternatives)) {
+      for (const auto &literals : alternatives) {
+        joined += joined.empty() ? "" : " | ";
+        for (const auto &literal : literals) {
+          joined += (&literal == &literals.front() ? "" : " ") + literal;
+        }
+      }
+      box.check(test.literals && joined == test.literals, "%s has literals \"%s\"", test.pattern, joined.c_str());
+    } else {
+      box.check(test.literals == nullptr, "%s has no literals", test.pattern);
+    }
+  }
+}
+
+REGRESSION_TEST(RegexPrefilter_candidates)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus, REGRESSION_TEST_PASSED);
+
+  static const char *patterns[] = {
+    "^www\\.example\\.com$", "^(.*)\\.example\\.com$", "^img[0-9]+\\.cdn\\.example\\.net$", ".*", "^api\\.(foo|bar)\\.org$",
+    "^shop\\.example\\.com$", "ample\\.co",            "(?i)^MiXeD\\.case\\.test$",
+  };
+  static const char *subjects[] = {
+    "www.example.com", "a.example.com", "img12.cdn.example.net", "api.foo.org", "shop.example.com",
+    "nothing.test",    "EXAMPLE.COM",   "mixed.case.test",       "",            "sample.com",
+  };
+
+  RegexPrefilter prefilter;
+  std::vector<Regex> regexes(countof(patterns));
+  for (unsigned i = 0; i < countof(patterns); ++i) {
+    regexes[i].compile(patterns[i]);
+    prefilter.add(patterns[i]);
+  }
+  prefilter.build();
+
+  // Every pattern that matches must be a candidate.
+  for (auto subject : subjects) {
+    std::vector<int> candidates;
+    prefilter.candidates(subject, strlen(subject), candidates);
+    box.check(std::is_sorted(candidates.begin(), candidates.end()), "%s: candidates are in order", subject);
+    for (unsigned i = 0; i < countof(patterns); ++i) {
+      if (regexes[i].exec(subject)) {
+        box.check(std::find(candidates.begin(), candidates.end(), i) != candidates.end(), "%s: %s is a candidate", subject,
+                  patterns[i]);
+      }
+    }
+    rprintf(t, "%s: %zu candidates\n", subject, candidates.size());
+  }
+
+  std::vector<int> candidates;
+  prefilter.candidates("nothing.test", 12, candidates);
+  box.check(candidates == std::vector<int>{3}, "only the pattern without literals for a miss");
+}
@@ -0,0 +1,387 @@
+/** @file
+
+  OpenMetrics rendering of the stats.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <ts/ts.h>
+
+#include "ts/ink_defs.h"
+#include "openmetrics.h"
+
+enum metric_type {
+  METRIC_UNKNOWN,
+  METRIC_COUNTER,
+  METRIC_SUMMARY,
+};
+
+static const char *const metric_type_name[] = {"unknown", "counter", "summary"};
+
+/* A part of the record name that is turned into a label: the name component
+   following 'prefix', up to 'suffix'. */
+typedef struct {
+  const char *prefix;
+  const char *suffix;
+  const char *label;
+  bool status; /* the value must look like an HTTP status, 200 or 2xx */
+  bool rest;   /* the value is the rest of the name, dots included */
+} label_rule;
+
+static const label_rule label_rules[] = {
+  {"proxy.process.http.", "_responses", "code", true, false},
+  {"proxy.process.http.latency.origin.", "", "origin", false, false},
+  {"proxy.process.log.object.", "", "object", false, false},
+  {"proxy.process.cache.volume_", "", "volume", false, false},
+  {"proxy.process.ssl.cipher.user_agent.", "", "cipher", false, true},
+};
+
+/* Histogram stats, see I_RecHistogram.h. */
+static const char *const quantile_suffix[] = {"p50", "p90", "p99", "p999", "max"};
+static const char *const quantile_value[]  = {"0.5", "0.9", "0.99", "0.999", "1"};
+
+typedef struct {
+  char *name;         /* of the record */
+  char *family;       /* dotted name, sanitized when rendered */
+  char labels[256];   /* rendered label pairs, without the braces */
+  const char *suffix; /* of the sample name */
+  char value[32];
+  enum metric_type type;
+  int order;
+} sample;
+
+typedef struct {
+  sample *samples;
+  int count;
+  int capacity;
+} sample_list;
+
+typedef struct {
+  char *data;
+  int64_t len;
+  int64_t capacity;
+} text_buffer;
+
+static void
+text_append(text_buffer *text, const char *fmt, ...)
+{
+  for (;;) {
+    va_list ap;
+    int64_t room = text->capacity - text->len;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(text->data + text->len, room, fmt, ap);
+    va_end(ap);
+
+    if (n < room) {
+      text->len += n;
+      return;
+    }
+    text->capacity = 2 * text->capacity + n;
+    text->data     = TSrealloc(text->data, text->capacity);
+  }
+}
+
+/* Append label="value" to @a labels, escaping the value. */
+static void
+add_label(char *labels, size_t size, const char *label, const char *value, size_t value_len)
+{
+  size_t len = strlen(labels);
+  size_t i;
+
+  len += snprintf(labels + len, len < size ? size - len : 0, "%s%s=\"", len ? "," : "", label);
+  for (i = 0; i < value_len && len + 3 < size; ++i) {
+    char c = value[i];
+    if (c == '\\' || c == '"') {
+      labels[len++] = '\\';
+      labels[len++] = c;
+    } else if (c == '\n') {
+      labels[len++] = '\\';
+      labels[len++] = 'n';
+    } else {
+      labels[len++] = c;
+    }
+  }
+  if (len + 1 < size) {
+    labels[len++] = '"';
+    labels[len]   = '\0';
+  }
+}
+
+static bool
+is_status(const char *s, size_t len)
+{
+  return len == 3 && s[0] >= '1' && s[0] <= '5' &&
+         ((s[1] >= '0' && s[1] <= '9' && s[2] >= '0' && s[2] <= '9') || (s[1] == 'x' && s[2] == 'x'));
+}
+
+/* Move the parts of @a name matched by the label rules to labels. Returns the TSmalloc'ed family name. */
+static char *
+extract_labels(const char *name, char *labels, size_t size)
+{
+  unsigned i;
+
+  for (i = 0; i < countof(label_rules); ++i) {
+    const label_rule *rule = &label_rules[i];
+    size_t prefix_len      = strlen(rule->prefix);
+    size_t suffix_len      = strlen(rule->suffix);
+    const char *value      = name + prefix_len;
+    const char *end;
+    size_t value_len;
+
+    if (strncmp(name, rule->prefix, prefix_len) != 0) {
+      continue;
+    }
+
+    end = rule->rest ? NULL : strchr(value, '.');
+    if (end == NULL) {
+      end = value + strlen(value);
+    }
+    value_len = end - value;
+    if (value_len <= suffix_len || memcmp(end - suffix_len, rule->suffix, suffix_len) != 0) {
+      continue;
+    }
+    value_len -= suffix_len;
+    if (rule->status && !is_status(value, value_len)) {
+      continue;
+    }
+
+    add_label(labels, size, rule->label, value, value_len);
+
+    /* The family is the prefix, without its trailing separator, then the suffix and the rest of the name. */
+    {
+      size_t family_len = prefix_len - 1;
+      const char *rest  = suffix_len ? rule->suffix + 1 : "";
+      char *family      = TSmalloc(family_len + 1 + strlen(rest) + strlen(end) + 1);
+
+      memcpy(family, rule->prefix, family_len);
+      family[family_len] = '\0';
+      if (*rest) {
+        strcat(family, ".");
+        strcat(family, rest);
+      }
+      strcat(family, end);
+      return family;
+    }
+  }
+
+  return TSstrdup(name);
+}
+
+static void
+collect_stat(TSRecordType rec_type ATS_UNUSED, void *edata, int registered ATS_UNUSED, const char *name,
+             TSRecordDataType data_type, TSRecordData *datum)
+{
+  sample_list *list = edata;
+  sample *s;
+  char *dot;
+  unsigned i;
+
+  if (data_type != TS_RECORDDATATYPE_INT && data_type != TS_RECORDDATATYPE_COUNTER && data_type != TS_RECORDDATATYPE_FLOAT) {
+    return;
+  }
+
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? 2 * list->capacity : 1024;
+    list->samples  = TSrealloc(list->samples, list->capacity * sizeof(sample));
+  }
+  s = &list->samples[list->count];
+
+  s->labels[0] = '\0';
+  s->name      = TSstrdup(name);
+  s->family    = extract_labels(name, s->labels, sizeof(s->labels));
+  s->suffix    = "";
+  s->type      = METRIC_UNKNOWN;
+  s->order     = list->count;
+
+  switch (data_type) {
+  case TS_RECORDDATATYPE_COUNTER:
+    snprintf(s->value, sizeof(s->value), "%" PRId64, datum->rec_counter);
+    s->type   = METRIC_COUNTER;
+    s->suffix = "_total";
+    break;
+  case TS_RECORDDATATYPE_INT:
+    snprintf(s->value, sizeof(s->value), "%" PRId64, datum->rec_int);
+    break;
+  default:
+    snprintf(s->value, sizeof(s->value), "%.17g", datum->rec_float);
+    break;
+  }
+
+  /* Histogram quantiles. */
+  dot = strrchr(s->family, '.');
+  if (dot) {
+    for (i = 0; i < countof(quantile_suffix); ++i) {
+      if (strcmp(dot + 1, quantile_suffix[i]) == 0) {
+        *dot = '\0';
+        add_label(s->labels, sizeof(s->labels), "quantile", quantile_value[i], strlen(quantile_value[i]));
+        s->type   = METRIC_SUMMARY;
+        s->suffix = "";
+        break;
+      }
+    }
+  }
+
+  ++list->count;
+}
+
+static int
+compare_family(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int
+compare_sample(const void *a, const void *b)
+{
+  const sample *sa = a;
+  const sample *sb = b;
+  int c            = strcmp(sa->family, sb->family);
+
+  return c ? c : sa->order - sb->order;
+}
+
+/* The count and sum of a histogram join the summary of its quantiles. */
+static void
+join_summaries(sample_list *list)
+{
+  char **summaries = TSmalloc((list->count + 1) * sizeof(char *));
+  int n            = 0;
+  int i;
+
+  for (i = 0; i < list->count; ++i) {
+    if (list->samples[i].type == METRIC_SUMMARY) {
+      summaries[n++] = list->samples[i].family;
+    }
+  }
+  qsort(summaries, n, sizeof(char *), compare_family);
+
+  for (i = 0; i < list->count && n > 0; ++i) {
+    sample *s  = &list->samples[i];
+    char *dot  = strrchr(s->family, '.');
+    char *base = s->family;
+
+    if (dot == NULL || (strcmp(dot, ".count") != 0 && strcmp(dot, ".sum") != 0)) {
+      continue;
+    }
+    *dot = '\0';
+    if (bsearch(&base, summaries, n, sizeof(char *), compare_family)) {
+      s->type   = METRIC_SUMMARY;
+      s->suffix = strcmp(dot + 1, "count") == 0 ? "_count" : "_sum";
+    } else {
+      *dot = '.';
+    }
+  }
+
+  TSfree(summaries);
+}
+
+/* Metric names are [a-zA-Z_:][a-zA-Z0-9_:]*. */
+static void
+sanitize(char *name)
+{
+  for (; *name; ++name) {
+    char c = *name;
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == ':')) {
+      *name = '_';
+    }
+  }
+}
+
+/* Whether @a s is rendered as the same metric as a sample of its family
+   before it, @a first, or has another type than them: different records can
+   get the same metric name once sanitized. */
+static bool
+is_duplicate(const sample *first, const sample *s)
+{
+  const sample *p;
+
+  if (s->type != first->type) {
+    return true;
+  }
+  for (p = first; p < s; ++p) {
+    if (strcmp(p->suffix, s->suffix) == 0 && strcmp(p->labels, s->labels) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+char *
+openmetrics_render(int64_t *len)
+{
+  /* The duplicates are logged when their number changes, not at each render. */
+  static int last_duplicates = 0;
+
+  sample_list list    = {NULL, 0, 0};
+  text_buffer text    = {NULL, 0, 0};
+  const sample *first = NULL;
+  int duplicates      = 0;
+  int i;
+
+  TSRecordDump((TSRecordType)(TS_RECORDTYPE_PLUGIN | TS_RECORDTYPE_NODE | TS_RECORDTYPE_PROCESS), collect_stat, &list);
+  join_summaries(&list);
+  for (i = 0; i < list.count; ++i) {
+    sanitize(list.samples[i].family);
+  }
+  qsort(list.samples, list.count, sizeof(sample), compare_sample);
+
+  text.capacity = 64 * (list.count + 16);
+  text.data     = TSmalloc(text.capacity);
+
+  for (i = 0; i < list.count; ++i) {
+    const sample *s = &list.samples[i];
+
+    if (first == NULL || strcmp(first->family, s->family) != 0) {
+      text_append(&text, "# TYPE %s %s\n", s->family, metric_type_name[s->type]);
+      first = s;
+    } else if (is_duplicate(first, s)) {
+      if (++duplicates > last_duplicates) {
+        TSError("[stats_over_http] %s is skipped, its metric %s is already given by %s", s->name, s->family, first->name);
+      }
+      continue;
+    }
+    if (s->labels[0]) {
+      text_append(&text, "%s%s{%s} %s\n", s->family, s->suffix, s->labels, s->value);
+    } else {
+      text_append(&text, "%s%s %s\n", s->family, s->suffix, s->value);
+    }
+  }
+
+  text_append(&text, "# TYPE trafficserver_build info\n");
+  text_append(&text, "trafficserver_build_info{version=\"%s\"} 1\n", TSTrafficServerVersionGet());
+  text_append(&text, "# EOF\n");
+
+  for (i = 0; i < list.count; ++i) {
+    TSfree(list.samples[i].name);
+    TSfree(list.samples[i].family);
+  }
+  last_duplicates = duplicates;
+  TSfree(list.samples);
+
+  *len = text.len;
+  return text.data;
+}
@@ -0,0 +1,45 @@
+/** @file
+
+  OpenMetrics rendering of the stats.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define OPENMETRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* Render all stats in the OpenMetrics text format. Returns a TSmalloc'ed
+   string, of length *len.
+
+   Record names are turned into metric names by replacing the dots with
+   underscores, after some parts are moved to labels:
+
+     proxy.process.http.200_responses              -> proxy_process_http_responses{code="200"}
+     proxy.process.cache.volume_1.bytes_used       -> proxy_process_cache_volume_bytes_used{volume="1"}
+     proxy.process.log.object.<name>.<stat>        -> proxy_process_log_object_<stat>{object="<name>"}
+     proxy.process.ssl.cipher.user_agent.<cipher>  -> proxy_process_ssl_cipher_user_agent{cipher="<cipher>"}
+     proxy.process.http.latency.origin.<host>.<x>  -> proxy_process_http_latency_origin_<x>{origin="<host>"}
+
+   and the stats of a histogram, <name>.count, .sum, .p50, .p90, .p99, .p999
+   and .max, form a summary with quantile labels.
+ */
+char *openmetrics_render(int64_t *len);
@@ -30,11 +30,14 @@
 #include <ctype.h>
 #include <limits.h>
 #include <ts/ts.h>
+#include <ts/experimental.h>
 #include <string.h>
 #include <inttypes.h>
 #include <getopt.h>
+#include <zlib.h>
 
 #include "ts/ink_defs.h"
+#include "openmetrics.h"
 
 #define PLUGIN_NAME "stats_over_http"
 
@@ -45,6 +48,32 @@ static int url_path_len;
 static bool integer_counters = false;
 static bool wrap_counters    = false;
 
+/* The OpenMetrics output is rendered on the first request after
+   render_interval milliseconds, the default raw stat sync interval, and shared
+   by all the requests until then. */
+static int render_interval = 5000;
+
+typedef struct rendered_metrics_t {
+  int refcount;
+  TSIOBuffer buffer;
+  TSIOBufferReader reader;
+  int64_t length;
+  TSIOBuffer gz_buffer;
+  TSIOBufferReader gz_reader;
+  int64_t gz_length;
+  char etag[24];
+  TSHRTime rendered_at;
+} rendered_metrics;
+
+static rendered_metrics *current_metrics;
+static bool metrics_rendering; /* a request is rendering a newer output */
+static TSMutex metrics_mutex;
+
+typedef enum {
+  FORMAT_JSON,
+  FORMAT_OPENMETRICS,
+} output_format;
+
 typedef struct stats_state_t {
   TSVConn net_vc;
   TSVIO read_vio;
@@ -56,8 +85,157 @@ typedef struct stats_state_t {
 
   int output_bytes;
   int body_written;
+
+  output_format format;
+  bool gzip;
+  char *if_none_match;
+  rendered_metrics *metrics;
 } stats_state;
 
+static void
+metrics_release(rendered_metrics *metrics)
+{
+  if (metrics && __atomic_sub_fetch(&metrics->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+    TSIOBufferDestroy(metrics->buffer);
+    if (metrics->gz_buffer) {
+      TSIOBufferDestroy(metrics->gz_buffer);
+    }
+    TSfree(metrics);
+  }
+}
+
+/* Add a gzip compressed copy of @a text to @a metrics. */
+static void
+metrics_compress(rendered_metrics *metrics, const char *text, int64_t len)
+{
+  z_stream zstrm;
+  uLong bound;
+  char *gz;
+
+  memset(&zstrm, 0, sizeof(zstrm));
+  if (deflateInit2(&zstrm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31 /* gzip */, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return;
+  }
+
+  bound           = deflateBound(&zstrm, len);
+  gz              = TSmalloc(bound);
+  zstrm.next_in   = (Bytef *)text;
+  zstrm.avail_in  = len;
+  zstrm.next_out  = (Bytef *)gz;
+  zstrm.avail_out = bound;
+  if (deflate(&zstrm, Z_FINISH) == Z_STREAM_END) {
+    metrics->gz_buffer = TSIOBufferCreate();
+    metrics->gz_reader = TSIOBufferReaderAlloc(metrics->gz_buffer);
+    metrics->gz_length = zstrm.total_out;
+    TSIOBufferWrite(metrics->gz_buffer, gz, metrics->gz_length);
+  }
+  deflateEnd(&zstrm);
+  TSfree(gz);
+}
+
+/* Render the OpenMetrics output and make it the current one. */
+static void
+metrics_render(void)
+{
+  rendered_metrics *metrics = TSmalloc(sizeof(*metrics));
+  rendered_metrics *old;
+  uint64_t hash = 14695981039346656037ULL;
+  char *text;
+  int64_t i;
+
+  memset(metrics, 0, sizeof(*metrics));
+  metrics->refcount    = 1;
+  metrics->rendered_at = TShrtime();
+  text                 = openmetrics_render(&metrics->length);
+  metrics->buffer   = TSIOBufferCreate();
+  metrics->reader   = TSIOBufferReaderAlloc(metrics->buffer);
+  TSIOBufferWrite(metrics->buffer, text, metrics->length);
+  metrics_compress(metrics, text, metrics->length);
+
+  /* FNV-1a of the text */
+  for (i = 0; i < metrics->length; ++i) {
+    hash = (hash ^ (unsigned char)text[i]) * 1099511628211ULL;
+  }
+  snprintf(metrics->etag, sizeof(metrics->etag), "\"%016" PRIx64 "\"", hash);
+  TSfree(text);
+
+  TSMutexLock(metrics_mutex);
+  old               = current_metrics;
+  current_metrics   = metrics;
+  metrics_rendering = false;
+  TSMutexUnlock(metrics_mutex);
+
+  metrics_release(old);
+}
+
+/* Return a reference to the current OpenMetrics output. The first request
+   after the render interval renders a new one, the requests meanwhile get the
+   previous one, so nothing is rendered while no one asks. */
+static rendered_metrics *
+metrics_acquire(void)
+{
+  rendered_metrics *metrics;
+  bool render = false;
+
+  TSMutexLock(metrics_mutex);
+  metrics = current_metrics;
+  if (metrics == NULL || (!metrics_rendering && TShrtime() - metrics->rendered_at >= render_interval * TS_HRTIME_MSECOND)) {
+    metrics_rendering = true;
+    render            = true;
+  }
+  if (metrics && !render) {
+    __atomic_add_fetch(&metrics->refcount, 1, __ATOMIC_ACQ_REL);
+  }
+  TSMutexUnlock(metrics_mutex);
+
+  if (render) {
+    metrics_render();
+    return metrics_acquire();
+  }
+  return metrics;
+}
+
+/* Whether the If-None-Match list @a list, of @a len bytes, matches @a etag,
+   with the weak comparison of RFC 7232. */
+static bool
+etag_list_matches(const char *list, int len, const char *etag)
+{
+  const char *end = list + len;
+  size_t etag_len = strlen(etag);
+
+  while (list < end) {
+    const char *item;
+    const char *item_end;
+
+    while (list < end && (*list == ' ' || *list == '\t' || *list == ',')) {
+      ++list;
+    }
+    item = list;
+    if (end - item >= 2 && item[0] == 'W' && item[1] == '/') {
+      item += 2;
+    }
+    /* The entity tags are quoted and can contain commas. */
+    if (item < end && *item == '"') {
+      const char *quote = memchr(item + 1, '"', end - item - 1);
+      item_end          = quote ? quote + 1 : end;
+    } else {
+      item_end = item;
+      while (item_end < end && *item_end != ',' && *item_end != ' ' && *item_end != '\t') {
+        ++item_end;
+      }
+    }
+
+    if ((item_end - item == 1 && *item == '*') || ((size_t)(item_end - item) == etag_len && memcmp(item, etag, etag_len) == 0)) {
+      return true;
+    }
+    list = item_end;
+    while (list < end && *list != ',') {
+      ++list;
+    }
+  }
+  return false;
+}
+
 static void
 stats_cleanup(TSCont contp, stats_state *my_state)
 {
@@ -71,6 +249,8 @@ stats_cleanup(TSCont contp, stats_state *my_state)
     my_state->resp_buffer = NULL;
   }
   TSVConnClose(my_state->net_vc);
+  TSfree(my_state->if_none_match);
+  metrics_release(my_state->metrics);
   TSfree(my_state);
   TSContDestroy(contp);
 }
@@ -96,9 +276,39 @@ stats_add_data_to_resp_buffer(const char *s, stats_state *my_state)
 
 static const char RESP_HEADER[] = "HTTP/1.0 200 Ok\r\nContent-Type: text/javascript\r\nCache-Control: no-cache\r\n\r\n";
 
+/* The cached OpenMetrics output is shared with the response by reference, the
+   header is the only part that is written for each request. */
+static int
+stats_add_openmetrics_resp(stats_state *my_state)
+{
+  rendered_metrics *metrics = my_state->metrics = metrics_acquire();
+  bool gzip                 = my_state->gzip && metrics->gz_buffer;
+  char header[512];
+
+  if (my_state->if_none_match && etag_list_matches(my_state->if_none_match, strlen(my_state->if_none_match), metrics->etag)) {
+    snprintf(header, sizeof(header), "HTTP/1.0 304 Not Modified\r\nETag: %s\r\nVary: Accept, Accept-Encoding\r\n"
+                                     "Cache-Control: no-cache\r\n\r\n",
+             metrics->etag);
+    my_state->body_written = 1;
+    return stats_add_data_to_resp_buffer(header, my_state);
+  }
+
+  snprintf(header, sizeof(header), "HTTP/1.0 200 Ok\r\nContent-Type: " OPENMETRICS_CONTENT_TYPE "\r\nContent-Length: %" PRId64
+                                   "\r\nETag: %s\r\n%sVary: Accept, Accept-Encoding\r\nCache-Control: no-cache\r\n\r\n",
+           gzip ? metrics->gz_length : metrics->length, metrics->etag, gzip ? "Content-Encoding: gzip\r\n" : "");
+
+  my_state->body_written = 1;
+  return stats_add_data_to_resp_buffer(header, my_state) +
+         TSIOBufferCopy(my_state->resp_buffer, gzip ? metrics->gz_reader : metrics->reader,
+                        gzip ? metrics->gz_length : metrics->length, 0);
+}
+
 static int
 stats_add_resp_header(stats_state *my_state)
 {
+  if (my_state->format == FORMAT_OPENMETRICS) {
+    return stats_add_openmetrics_resp(my_state);
+  }
   return stats_add_data_to_resp_buffer(RESP_HEADER, my_state);
 }
 
@@ -109,7 +319,8 @@ stats_process_read(TSCont contp, TSEvent event, stats_state *my_state)
   if (event == TS_EVENT_VCONN_READ_READY) {
     my_state->output_bytes = stats_add_resp_header(my_state);
     TSVConnShutdown(my_state->net_vc, 1, 0);
-    my_state->write_vio = TSVConnWrite(my_state->net_vc, contp, my_state->resp_reader, INT64_MAX);
+    my_state->write_vio = TSVConnWrite(my_state->net_vc, contp, my_state->resp_reader,
+                                       my_state->body_written ? my_state->output_bytes : INT64_MAX);
   } else if (event == TS_EVENT_ERROR) {
     TSError("[%s] stats_process_read: Received TS_EVENT_ERROR", PLUGIN_NAME);
   } else if (event == TS_EVENT_VCONN_EOS) {
@@ -231,6 +442,66 @@ stats_dostuff(TSCont contp, TSEvent event, void *edata)
   return 0;
 }
 
+/* Return whether the header @a name of the request contains @a token. */
+static bool
+stats_header_contains(TSMBuffer reqp, TSMLoc hdr_loc, const char *name, int name_len, const char *token)
+{
+  TSMLoc field = TSMimeHdrFieldFind(reqp, hdr_loc, name, name_len);
+  bool found   = false;
+
+  while (field && !found) {
+    int len           = 0;
+    const char *value = TSMimeHdrFieldValueStringGet(reqp, hdr_loc, field, -1, &len);
+    TSMLoc next       = TSMimeHdrFieldNextDup(reqp, hdr_loc, field);
+
+    found = value && memmem(value, len, token, strlen(token)) != NULL;
+    TSHandleMLocRelease(reqp, hdr_loc, field);
+    field = next;
+  }
+  if (field) {
+    TSHandleMLocRelease(reqp, hdr_loc, field);
+  }
+  return found;
+}
+
+static void
+stats_negotiate(TSMBuffer reqp, TSMLoc hdr_loc, TSMLoc url_loc, stats_state *my_state)
+{
+  int query_len     = 0;
+  const char *query = TSUrlHttpQueryGet(reqp, url_loc, &query_len);
+  TSMLoc field;
+
+  if (stats_header_contains(reqp, hdr_loc, TS_MIME_FIELD_ACCEPT, TS_MIME_LEN_ACCEPT, "application/openmetrics-text") ||
+      (query && memmem(query, query_len, "format=openmetrics", sizeof("format=openmetrics") - 1) != NULL)) {
+    my_state->format = FORMAT_OPENMETRICS;
+  }
+  my_state->gzip = stats_header_contains(reqp, hdr_loc, TS_MIME_FIELD_ACCEPT_ENCODING, TS_MIME_LEN_ACCEPT_ENCODING, "gzip");
+
+  /* The If-None-Match fields are joined in one list. */
+  field = TSMimeHdrFieldFind(reqp, hdr_loc, TS_MIME_FIELD_IF_NONE_MATCH, TS_MIME_LEN_IF_NONE_MATCH);
+  while (field) {
+    int len           = 0;
+    const char *value = TSMimeHdrFieldValueStringGet(reqp, hdr_loc, field, -1, &len);
+    TSMLoc next       = TSMimeHdrFieldNextDup(reqp, hdr_loc, field);
+
+    if (value) {
+      size_t old_len = my_state->if_none_match ? strlen(my_state->if_none_match) : 0;
+      char *list     = TSmalloc(old_len + len + 2);
+
+      if (old_len) {
+        memcpy(list, my_state->if_none_match, old_len);
+        list[old_len++] = ',';
+      }
+      memcpy(list + old_len, value, len);
+      list[old_len + len] = '\0';
+      TSfree(my_state->if_none_match);
+      my_state->if_none_match = list;
+    }
+    TSHandleMLocRelease(reqp, hdr_loc, field);
+    field = next;
+  }
+}
+
 static int
 stats_origin(TSCont contp ATS_UNUSED, TSEvent event ATS_UNUSED, void *edata)
 {
@@ -267,6 +538,7 @@ stats_origin(TSCont contp ATS_UNUSED, TSEvent event ATS_UNUSED, void *edata)
   icontp   = TSContCreate(stats_dostuff, TSMutexCreate());
   my_state = (stats_state *)TSmalloc(sizeof(*my_state));
   memset(my_state, 0, sizeof(*my_state));
+  stats_negotiate(reqp, hdr_loc, url_loc, my_state);
   TSContDataSet(icontp, my_state);
   TSHttpTxnIntercept(icontp, txnp);
   goto cleanup;
@@ -290,9 +562,10 @@ TSPluginInit(int argc, const char *argv[])
 {
   TSPluginRegistrationInfo info;
 
-  static const char usage[]             = PLUGIN_NAME ".so [--integer-counters] [PATH]";
+  static const char usage[] = PLUGIN_NAME ".so [--integer-counters] [--wrap-counters] [--render-interval MS] [PATH]";
   static const struct option longopts[] = {{(char *)("integer-counters"), no_argument, NULL, 'i'},
                                            {(char *)("wrap-counters"), no_argument, NULL, 'w'},
+                                           {(char *)("render-interval"), required_argument, NULL, 'r'},
                                            {NULL, 0, NULL, 0}};
 
   info.plugin_name   = PLUGIN_NAME;
@@ -304,13 +577,20 @@ TSPluginInit(int argc, const char *argv[])
   }
 
   for (;;) {
-    switch (getopt_long(argc, (char *const *)argv, "iw", longopts, NULL)) {
+    switch (getopt_long(argc, (char *const *)argv, "iwr:", longopts, NULL)) {
     case 'i':
       integer_counters = true;
       break;
     case 'w':
       wrap_counters = true;
       break;
+    case 'r':
+      render_interval = atoi(optarg);
+      if (render_interval <= 0) {
+        TSError("[%s] invalid render interval %s", PLUGIN_NAME, optarg);
+        render_interval = 5000;
+      }
+      break;
     case -1:
       goto init;
     default:
@@ -327,6 +607,8 @@ init:
   }
   url_path_len = strlen(url_path);
 
+  metrics_mutex = TSMutexCreate();
+
   /* Create a continuation with a mutex as there is a shared global structure
      containing the headers to add */
   TSHttpHookAdd(TS_HTTP_READ_REQUEST_HDR_HOOK, TSContCreate(stats_origin, NULL));
@@ -379,10 +379,18 @@ RegexMatcher<Data, MatchResult>::RegexMatcher(const char *name, const char *file
 template <class Data, class MatchResult> RegexMatcher<Data, MatchResult>::~RegexMatcher()
 {
   for (int i = 0; i < num_el; i++) {
+    if (re_extra[i]) {
+#ifdef PCRE_CONFIG_JIT
+      pcre_free_study(re_extra[i]);
+#else
+      pcre_free(re_extra[i]);
+#endif
+    }
     pcre_free(re_array[i]);
     ats_free(re_str[i]);
   }
   delete[] re_str;
+  ats_free(re_extra);
   ats_free(re_array);
 }
 
@@ -415,6 +423,9 @@ RegexMatcher<Data, MatchResult>::AllocateSpace(int num_entries)
   re_array = (pcre **)ats_malloc(sizeof(pcre *) * num_entries);
   memset(re_array, 0, sizeof(pcre *) * num_entries);
 
+  re_extra = (pcre_extra **)ats_malloc(sizeof(pcre_extra *) * num_entries);
+  memset(re_extra, 0, sizeof(pcre_extra *) * num_entries);
+
   data_array = new Data[num_entries];
 
   re_str = new char *[num_entries];
@@ -435,7 +446,8 @@ RegexMatcher<Data, MatchResult>::NewEntry(matcher_line *line_info)
   char *pattern;
   const char *errptr;
   int erroffset;
-  Result error = Result::ok();
+  int study_opts = 0;
+  Result error   = Result::ok();
 
   // Make sure space has been allocated
   ink_assert(num_el >= 0);
@@ -455,7 +467,11 @@ RegexMatcher<Data, MatchResult>::NewEntry(matcher_line *line_info)
     return Result::failure("%s regular expression error at line %d position %d : %s", matcher_name, line_info->line_num, erroffset,
                            errptr);
   }
-  re_str[num_el] = ats_strdup(pattern);
+#ifdef PCRE_CONFIG_JIT
+  study_opts |= PCRE_STUDY_JIT_COMPILE;
+#endif
+  re_extra[num_el] = pcre_study(re_array[num_el], study_opts, &errptr);
+  re_str[num_el]   = ats_strdup(pattern);
 
   // Remove our consumed label from the parsed line
   line_info->line[0][line_info->dest_entry] = nullptr;
@@ -469,27 +485,70 @@ RegexMatcher<Data, MatchResult>::NewEntry(matcher_line *line_info)
     // There was a problem so undo the effects this function
     ats_free(re_str[num_el]);
     re_str[num_el] = nullptr;
+    if (re_extra[num_el]) {
+#ifdef PCRE_CONFIG_JIT
+      pcre_free_study(re_extra[num_el]);
+#else
+      pcre_free(re_extra[num_el]);
+#endif
+      re_extra[num_el] = nullptr;
+    }
     pcre_free(re_array[num_el]);
     re_array[num_el] = nullptr;
   } else {
+    re_prefilter.add(pattern);
     num_el++;
   }
 
   return error;
 }
 
+//
+// void RegexMatcher<Data,MatchResult>::BuildPrefilter()
+//
+//   Called after the last NewEntry(), before any Match()
+//
+template <class Data, class MatchResult>
+void
+RegexMatcher<Data, MatchResult>::BuildPrefilter()
+{
+  re_prefilter.build();
+}
+
+//
+// int RegexMatcher<Data,MatchResult>::Exec(int i, const char* str, int length)
+//
+//   Runs regex i on str, returns what pcre_exec() does
+//
+template <class Data, class MatchResult>
+int
+RegexMatcher<Data, MatchResult>::Exec(int i, const char *str, int length)
+{
+  int r = pcre_exec(re_array[i], re_extra[i], str, length, 0, 0, nullptr, 0);
+
+#ifdef PCRE_CONFIG_JIT
+  // The JIT code has a small stack of its own, the interpreter uses the thread's.
+  if (r == PCRE_ERROR_JIT_STACKLIMIT) {
+    r = pcre_exec(re_array[i], nullptr, str, length, 0, 0, nullptr, 0);
+  }
+#endif
+  return r;
+}
+
 //
 // void RegexMatcher<Data,MatchResult>::Match(RequestData* rdata, MatchResult* result)
 //
-//   Coduncts a linear search through the regex array and
-//     updates arg result for each regex that matches arg URL
+//   Runs the regexs whose literals are in arg URL, in order, and
+//     updates arg result for each regex that matches it
 //
 template <class Data, class MatchResult>
 void
 RegexMatcher<Data, MatchResult>::Match(RequestData *rdata, MatchResult *result)
 {
   char *url_str;
+  int url_len;
   int r;
+  std::vector<int> candidates;
 
   // Check to see there is any work to before we copy the
   //   URL
@@ -509,8 +568,10 @@ RegexMatcher<Data, MatchResult>::Match(RequestData *rdata, MatchResult *result)
   // HttpRequestData::get_string(); therefore, no need to call again here.
   // unescapifyStr(url_str);
 
-  for (int i = 0; i < num_el; i++) {
-    r = pcre_exec(re_array[i], nullptr, url_str, strlen(url_str), 0, 0, nullptr, 0);
+  url_len = strlen(url_str);
+  re_prefilter.candidates(url_str, url_len, candidates);
+  for (int i : candidates) {
+    r = Exec(i, url_str, url_len);
     if (r > -1) {
       Debug("matcher", "%s Matched %s with regex at line %d", matcher_name, url_str, data_array[i].line_num);
       data_array[i].UpdateMatch(result, rdata);
@@ -534,15 +595,17 @@ HostRegexMatcher<Data, MatchResult>::HostRegexMatcher(const char *name, const ch
 //
 // void HostRegexMatcher<Data,MatchResult>::Match(RequestData* rdata, MatchResult* result)
 //
-//   Conducts a linear search through the regex array and
-//     updates arg result for each regex that matches arg host_regex
+//   Runs the regexs whose literals are in the host, in order, and
+//     updates arg result for each regex that matches it
 //
 template <class Data, class MatchResult>
 void
 HostRegexMatcher<Data, MatchResult>::Match(RequestData *rdata, MatchResult *result)
 {
   const char *url_str;
+  int url_len;
   int r;
+  std::vector<int> candidates;
 
   // Check to see there is any work to before we copy the
   //   URL
@@ -557,16 +620,18 @@ HostRegexMatcher<Data, MatchResult>::Match(RequestData *rdata, MatchResult *resu
   if (url_str == nullptr) {
     url_str = "";
   }
-  for (int i = 0; i < this->num_el; i++) {
-    r = pcre_exec(this->re_array[i], nullptr, url_str, strlen(url_str), 0, 0, nullptr, 0);
-    if (r != -1) {
+  url_len = strlen(url_str);
+  this->re_prefilter.candidates(url_str, url_len, candidates);
+  for (int i : candidates) {
+    r = this->Exec(i, url_str, url_len);
+    if (r > -1) {
       Debug("matcher", "%s Matched %s with regex at line %d", const_cast<char *>(this->matcher_name), url_str,
             this->data_array[i].line_num);
       this->data_array[i].UpdateMatch(result, rdata);
-    } else {
+    } else if (r < -1) {
       // An error has occured
       Warning("error matching regex at line %d", this->data_array[i].line_num);
-    }
+    } // else it's -1 which means no match was found.
   }
 }
 
@@ -930,6 +995,13 @@ ControlMatcher<Data, MatchResult>::BuildTableFromString(char *file_buf)
 
   ink_assert(second_pass == numEntries);
 
+  if (reMatch != nullptr) {
+    reMatch->BuildPrefilter();
+  }
+  if (hrMatch != nullptr) {
+    hrMatch->BuildPrefilter();
+  }
+
   if (is_debug_tag_set("matcher")) {
     Print();
   }
@@ -218,6 +218,7 @@ public:
   void Match(RequestData *rdata, MatchResult *result);
   void AllocateSpace(int num_entries);
   Result NewEntry(matcher_line *line_info);
+  void BuildPrefilter();
   void Print();
 
   using super::num_el;
@@ -227,8 +228,12 @@ public:
   using super::array_len;
 
 protected:
-  pcre **re_array = nullptr; // array of compiled regexs
-  char **re_str   = nullptr; // array of uncompiled regex strings
+  int Exec(int i, const char *str, int length);
+
+  pcre **re_array       = nullptr; // array of compiled regexs
+  pcre_extra **re_extra = nullptr; // array of studied regexs, JIT compiled if pcre can
+  char **re_str         = nullptr; // array of uncompiled regex strings
+  RegexPrefilter re_prefilter;     // literals of the regexs, to find the ones a string may match
 };
 
 template <class Data, class MatchResult> class HostRegexMatcher : public RegexMatcher<Data, MatchResult>
@@ -8157,6 +8157,9 @@ _conf_to_memberp(TSOverridableConfigKey conf, OverridableHttpConfigParams *overr
   case TS_CONFIG_HTTP_REQUEST_BUFFER_ENABLED:
     ret = _memberp_to_generic(&overridableHttpConfig->request_buffer_enabled, typep);
     break;
+  case TS_CONFIG_HTTP_EARLY_DATA_METHODS:
+    ret = _memberp_to_generic(&overridableHttpConfig->early_data_methods, typep);
+    break;
   case TS_CONFIG_HTTP_GLOBAL_USER_AGENT_HEADER:
     ret = _memberp_to_generic(&overridableHttpConfig->global_user_agent_header, typep);
     break;
@@ -8551,6 +8554,11 @@ TSHttpTxnConfigFind(const char *name, int length, TSOverridableConfigKey *conf,
         cnf = TS_CONFIG_HTTP_SLOW_LOG_THRESHOLD;
       }
       break;
+    case 's':
+      if (!strncmp(name, "proxy.config.http.early_data_methods", length)) {
+        cnf = TS_CONFIG_HTTP_EARLY_DATA_METHODS;
+      }
+      break;
     }
     break;
 
@@ -9261,13 +9269,15 @@ TSSslContextFindByName(const char *name)
   SSLCertLookup *lookup = SSLCertificateConfig::acquire();
   if (lookup != nullptr) {
     SSLCertContext *cc = lookup->find(name);
-    if (cc && cc->ctx) {
-      ret = reinterpret_cast<TSSslContext>(cc->ctx);
+    if (cc) {
+      // The caller holds a reference, a deferred context may be evicted and a reload frees the others.
+      ret = reinterpret_cast<TSSslContext>(lookup->acquireContext(cc));
     }
     SSLCertificateConfig::release(lookup);
   }
   return ret;
 }
+
 tsapi TSSslContext
 TSSslContextFindByAddr(struct sockaddr const *addr)
 {
@@ -9277,8 +9287,8 @@ TSSslContextFindByAddr(struct sockaddr const *addr)
     IpEndpoint ip;
     ip.assign(addr);
     SSLCertContext *cc = lookup->find(ip);
-    if (cc && cc->ctx) {
-      ret = reinterpret_cast<TSSslContext>(cc->ctx);
+    if (cc) {
+      ret = reinterpret_cast<TSSslContext>(lookup->acquireContext(cc));
     }
     SSLCertificateConfig::release(lookup);
   }
@@ -9304,6 +9314,12 @@ TSSslServerContextCreate(TSSslX509 cert, const char *certname)
   return ret;
 }
 
+tsapi void
+TSSslContextRelease(TSSslContext ctx)
+{
+  SSLReleaseContext(reinterpret_cast<SSL_CTX *>(ctx));
+}
+
 tsapi void
 TSSslContextDestroy(TSSslContext ctx)
 {
@@ -2082,6 +2082,33 @@ mgmt_storage_device_cmd_callback(void *data, char *arg, int len)
   return nullptr;
 }
 
+// traffic_ctl server profile
+static void
+event_profiler_message(const char *data, size_t len)
+{
+  std::string command(data, strnlen(data, len));
+  ats_scoped_str filename;
+
+  if (command == "start") {
+    EventProfiler::start();
+  } else if (command == "stop") {
+    EventProfiler::stop();
+  } else if (command == "reset") {
+    EventProfiler::reset();
+  } else if (command == "dump" || command == "dump summary") {
+    if (RecGetRecordString_Xmalloc("proxy.config.exec_thread.profile.filename", (RecString *)&filename) != REC_ERR_OKAY ||
+        !filename || *filename == '\0') {
+      Error("no file to dump the event profile to");
+      return;
+    }
+    ats_scoped_str rundir(RecConfigReadRuntimeDir());
+
+    EventProfiler::dump(Layout::relative_to(rundir.get(), filename.get()).c_str(), command == "dump summary");
+  } else {
+    Error("invalid event profiler command '%s'", command.c_str());
+  }
+}
+
 static void *
 mgmt_lifecycle_msg_callback(void *, char *data, int len)
 {
@@ -2094,6 +2121,8 @@ mgmt_lifecycle_msg_callback(void *, char *data, int len)
 
   if (mgmt_message_parse(data, len, fields, countof(fields), &op, &tag, &payload) == -1) {
     Error("Plugin message - RPC parsing error - message discarded.");
+  } else if (strcmp(tag, EVENT_PROFILER_MESSAGE_TAG) == 0) {
+    event_profiler_message(static_cast<const char *>(payload.ptr), payload.len);
   } else {
     msg.tag       = tag;
     msg.data      = payload.ptr;
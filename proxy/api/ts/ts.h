@@ -1232,9 +1232,11 @@ tsapi void TSVConnReenable(TSVConn sslvcp);
 tsapi TSReturnCode TSVConnTunnel(TSVConn sslp);
 /*  Return the SSL object associated with the connection */
 tsapi TSSslConnection TSVConnSSLConnectionGet(TSVConn sslp);
-/*  Fetch a SSL context from the global lookup table */
+/*  Fetch a SSL context from the global lookup table.
+    The caller holds a reference on the context and must release it with TSSslContextRelease */
 tsapi TSSslContext TSSslContextFindByName(const char *name);
 tsapi TSSslContext TSSslContextFindByAddr(struct sockaddr const *);
+tsapi void TSSslContextRelease(TSSslContext ctx);
 /*  Create a new SSL context based on the settings in records.config */
 tsapi TSSslContext TSSslServerContextCreate(TSSslX509 cert, const char *certname);
 tsapi void TSSslContextDestroy(TSSslContext ctx);
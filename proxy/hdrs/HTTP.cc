@@ -794,7 +794,7 @@ http_hdr_reason_lookup(unsigned status)
     HTTP_STATUS_ENTRY(422, Unprocessable Entity);            // [RFC4918]
     HTTP_STATUS_ENTRY(423, Locked);                          // [RFC4918]
     HTTP_STATUS_ENTRY(424, Failed Dependency);               // [RFC4918]
-    // 425 Reserved                                                   // [RFC2817]
+    HTTP_STATUS_ENTRY(425, Too Early);        // [RFC8470]
     HTTP_STATUS_ENTRY(426, Upgrade Required); // [RFC2817]
     // 427 Unassigned
     HTTP_STATUS_ENTRY(428, Precondition Required); // [RFC6585]
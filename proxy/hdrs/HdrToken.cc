@@ -22,7 +22,6 @@
  */
 
 #include "ts/ink_platform.h"
-#include "ts/HashFNV.h"
 #include "ts/Diags.h"
 #include "ts/ink_memory.h"
 #include <cstdio>
@@ -261,34 +260,57 @@ DFA *hdrtoken_strs_dfa = nullptr;
  *                                                                     *
  ***********************************************************************/
 
-#define HDRTOKEN_HASH_TABLE_SIZE 65536
-#define HDRTOKEN_HASH_TABLE_MASK HDRTOKEN_HASH_TABLE_SIZE - 1
+/*
+  The commonly tokenized strings are a fixed set, so at start up a multiplier is searched for that maps
+  every one of them to a distinct slot of a small table (a perfect hash). A lookup is then a hash of the
+  first and last 8 bytes of the name, one table load, and a case insensitive compare done 8 bytes at a
+  time against a pre-folded copy of the well known string.
+*/
+
+#define HDRTOKEN_HASH_TABLE_MIN_BITS 9
+#define HDRTOKEN_HASH_TABLE_MAX_BITS 12
+#define HDRTOKEN_HASH_MAX_WORDS 4 // Longest tokenized string, in 8 byte words.
+#define HDRTOKEN_HASH_CASE_FOLD 0x2020202020202020ULL
 
 struct HdrTokenHashBucket {
-  const char *wks;
-  uint32_t hash;
+  const char *wks;                           // nullptr if the slot is empty.
+  int length;                                // length of @a wks
+  uint64_t fold[HDRTOKEN_HASH_MAX_WORDS];    // @a wks with letters in lower case, zero padded.
+  uint64_t caseless[HDRTOKEN_HASH_MAX_WORDS]; // 0x20 for every byte of @a wks that is a letter.
 };
 
-HdrTokenHashBucket hdrtoken_hash_table[HDRTOKEN_HASH_TABLE_SIZE];
+static HdrTokenHashBucket *hdrtoken_hash_table = nullptr;
+static uint64_t hdrtoken_hash_multiplier       = 0;
+static unsigned int hdrtoken_hash_shift        = 0;
 
-/**
-  basic FNV hash
-**/
-#define TINY_MASK(x) (((uint32_t)1 << (x)) - 1)
+// Load up to 8 bytes, zero padded.
+static inline uint64_t
+hdrtoken_load_word(const char *string, int length)
+{
+  uint64_t word = 0;
+  memcpy(&word, string, length < 8 ? length : 8);
+  return word;
+}
 
-inline uint32_t
-hash_to_slot(uint32_t hash)
+static inline uint32_t
+hdrtoken_hash(const char *string, int length)
 {
-  return ((hash >> 15) ^ hash) & TINY_MASK(15);
+  uint64_t head = hdrtoken_load_word(string, length);
+  uint64_t tail = length > 8 ? hdrtoken_load_word(string + length - 8, 8) : 0;
+  uint64_t h    = ((head | HDRTOKEN_HASH_CASE_FOLD) * 0x9E3779B97F4A7C15ULL) ^ ((tail | HDRTOKEN_HASH_CASE_FOLD) + length);
+  return static_cast<uint32_t>((h * hdrtoken_hash_multiplier) >> hdrtoken_hash_shift);
 }
 
-inline uint32_t
-hdrtoken_hash(const unsigned char *string, unsigned int length)
+// Compare @a string to the well known string in @a bucket ignoring case, @a length must be the length of both.
+static inline bool
+hdrtoken_hash_bucket_match(const HdrTokenHashBucket *bucket, const char *string, int length)
 {
-  ATSHash32FNV1a fnv;
-  fnv.update(string, length, ATSHash::nocase());
-  fnv.final();
-  return fnv.get();
+  for (int i = 0; length > 0; ++i, string += 8, length -= 8) {
+    if ((hdrtoken_load_word(string, length) | bucket->caseless[i]) != bucket->fold[i]) {
+      return false;
+    }
+  }
+  return true;
 }
 
 /*-------------------------------------------------------------------------
@@ -368,34 +390,55 @@ static const char *_hdrtoken_commonly_tokenized_strs[] = {
 void
 hdrtoken_hash_init()
 {
-  uint32_t i;
-  int num_collisions;
-
-  memset(hdrtoken_hash_table, 0, sizeof(hdrtoken_hash_table));
-  num_collisions = 0;
+  const int n_strs = SIZEOF(_hdrtoken_commonly_tokenized_strs);
+  const char *wks[SIZEOF(_hdrtoken_commonly_tokenized_strs)];
 
-  for (i = 0; i < (int)SIZEOF(_hdrtoken_commonly_tokenized_strs); i++) {
+  for (int i = 0; i < n_strs; i++) {
     // convert the common string to the well-known token
-    unsigned const char *wks;
     int wks_idx = hdrtoken_tokenize_dfa(_hdrtoken_commonly_tokenized_strs[i], (int)strlen(_hdrtoken_commonly_tokenized_strs[i]),
-                                        (const char **)&wks);
+                                        &wks[i]);
     ink_release_assert(wks_idx >= 0);
+    ink_release_assert(hdrtoken_str_lengths[wks_idx] <= HDRTOKEN_HASH_MAX_WORDS * 8);
+  }
 
-    uint32_t hash = hdrtoken_hash(wks, hdrtoken_str_lengths[wks_idx]);
-    uint32_t slot = hash_to_slot(hash);
-
-    if (hdrtoken_hash_table[slot].wks) {
-      printf("ERROR: hdrtoken_hash_table[%u] collision: '%s' replacing '%s'\n", slot, (const char *)wks,
-             hdrtoken_hash_table[slot].wks);
-      ++num_collisions;
+  // Search for a multiplier with no collisions, growing the table if none is found.
+  for (unsigned int bits = HDRTOKEN_HASH_TABLE_MIN_BITS; bits <= HDRTOKEN_HASH_TABLE_MAX_BITS; ++bits) {
+    size_t size = size_t(1) << bits;
+
+    hdrtoken_hash_table = static_cast<HdrTokenHashBucket *>(ats_realloc(hdrtoken_hash_table, size * sizeof(HdrTokenHashBucket)));
+    hdrtoken_hash_shift = 64 - bits;
+
+    for (uint64_t seed = 1; seed <= 4096; ++seed) {
+      bool collision_p = false;
+
+      memset(hdrtoken_hash_table, 0, size * sizeof(HdrTokenHashBucket));
+      hdrtoken_hash_multiplier = (seed * 0xC2B2AE3D27D4EB4FULL) | 1;
+
+      for (int i = 0; i < n_strs && !collision_p; i++) {
+        int length                 = hdrtoken_wks_to_length(wks[i]);
+        HdrTokenHashBucket *bucket = &hdrtoken_hash_table[hdrtoken_hash(wks[i], length)];
+
+        if (bucket->wks) {
+          collision_p = true;
+        } else {
+          bucket->wks    = wks[i];
+          bucket->length = length;
+          for (int j = 0; j < length; ++j) {
+            unsigned char c                                = wks[i][j];
+            reinterpret_cast<char *>(bucket->caseless)[j] = ParseRules::is_alpha(c) ? 0x20 : 0;
+            reinterpret_cast<char *>(bucket->fold)[j]     = ParseRules::is_alpha(c) ? (c | 0x20) : c;
+          }
+        }
+      }
+
+      if (!collision_p) {
+        Debug("hdr_token", "perfect hash for %d strings in %zu slots with seed %" PRIu64, n_strs, size, seed);
+        return;
+      }
     }
-    hdrtoken_hash_table[slot].wks  = (const char *)wks;
-    hdrtoken_hash_table[slot].hash = hash;
   }
 
-  if (num_collisions > 0) {
-    abort();
-  }
+  ink_fatal("hdrtoken_hash_init: could not find a perfect hash for the well known strings");
 }
 
 /***********************************************************************
@@ -559,11 +602,8 @@ hdrtoken_tokenize(const char *string, int string_len, const char **wks_string_ou
     return wks_idx;
   }
 
-  uint32_t hash = hdrtoken_hash((const unsigned char *)string, (unsigned int)string_len);
-  uint32_t slot = hash_to_slot(hash);
-
-  bucket = &(hdrtoken_hash_table[slot]);
-  if ((bucket->wks != nullptr) && (bucket->hash == hash) && (hdrtoken_wks_to_length(bucket->wks) == string_len)) {
+  bucket = &(hdrtoken_hash_table[hdrtoken_hash(string, string_len)]);
+  if ((bucket->wks != nullptr) && (bucket->length == string_len) && hdrtoken_hash_bucket_match(bucket, string, string_len)) {
     wks_idx = hdrtoken_wks_to_index(bucket->wks);
     if (wks_string_out) {
       *wks_string_out = bucket->wks;
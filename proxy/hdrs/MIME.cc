@@ -25,15 +25,21 @@
 #include "ts/ink_platform.h"
 #include "ts/ink_memory.h"
 #include "ts/TsBuffer.h"
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
+#include <memory>
 #include "MIME.h"
 #include "HdrHeap.h"
 #include "HdrToken.h"
 #include "HdrUtils.h"
 #include "HttpCompat.h"
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 /***********************************************************************
  *                                                                     *
  *                    C O M P I L E    O P T I O N S                   *
@@ -656,6 +662,8 @@ mime_init()
     init = 0;
 
     hdrtoken_init();
+    mime_scanner_select_simd(true);
+
     day_names_dfa = new DFA;
     day_names_dfa->compile(day_names, SIZEOF(day_names), RE_CASE_INSENSITIVE);
 
@@ -992,6 +1000,28 @@ mime_init_date_format_table()
   }
 }
 
+/*-------------------------------------------------------------------------
+  Field generations. Each thread hands out generation numbers from a chunk
+  reserved from a global counter, so a generation is not repeated by another
+  thread and stamping a header on attach/detach needs no atomic operation.
+  -------------------------------------------------------------------------*/
+
+static const uint32_t MIME_FIELDS_GEN_CHUNK = 1024;
+
+static std::atomic<uint32_t> mime_fields_gen_reserved{0};
+static thread_local uint32_t mime_fields_gen_next  = 0;
+static thread_local uint32_t mime_fields_gen_limit = 0;
+
+static inline void
+mime_hdr_fields_changed(MIMEHdrImpl *mh)
+{
+  if (mime_fields_gen_next == mime_fields_gen_limit) {
+    mime_fields_gen_next  = mime_fields_gen_reserved.fetch_add(MIME_FIELDS_GEN_CHUNK, std::memory_order_relaxed);
+    mime_fields_gen_limit = mime_fields_gen_next + MIME_FIELDS_GEN_CHUNK;
+  }
+  mh->m_fields_gen = ++mime_fields_gen_next;
+}
+
 MIMEHdrImpl *
 mime_hdr_create(HdrHeap *heap)
 {
@@ -1051,6 +1081,7 @@ mime_hdr_init(MIMEHdrImpl *mh)
 
   _mime_hdr_field_block_init(&(mh->m_first_fblock));
   mh->m_fblock_list_tail = &(mh->m_first_fblock);
+  mime_hdr_fields_changed(mh);
 
   MIME_HDR_SANITY_CHECK(mh);
 }
@@ -1117,6 +1148,7 @@ mime_hdr_copy_onto(MIMEHdrImpl *s_mh, HdrHeap *s_heap, MIMEHdrImpl *d_mh, HdrHea
 
   // copies useful part of enclosed first block too
   memcpy(d_mh, s_mh, bytes_below_top);
+  mime_hdr_fields_changed(d_mh);
 
   if (d_mh->m_first_fblock.m_next == nullptr) // common case: no other block
   {
@@ -1245,6 +1277,129 @@ _mime_hdr_field_list_search_by_wks(MIMEHdrImpl *mh, int wks_idx)
   return nullptr;
 }
 
+/*-------------------------------------------------------------------------
+  Field name index.
+
+  Names that are not well known strings get no help from the presence bits
+  or slot accelerators, so finding one is a walk over every slot. For
+  headers that have spilled past the first field block, each thread keeps a
+  few lazily built hash tables from field name to the first live field of
+  that name, keyed by header address and m_fields_gen. Attach and detach are
+  the only operations that change the set of live names and both assign a
+  new generation, so a table is never consulted after its header changed.
+  The table is built on the second lookup against an unchanged header, so a
+  header that is found in once (or mutated between every lookup, as during
+  parsing) costs no more than before. It lives outside MIMEHdrImpl because
+  the header is marshalled into the cache and its layout cannot change.
+  -------------------------------------------------------------------------*/
+
+static const int MIME_FIELD_INDEX_SLOTS      = 256; // must be a power of two
+static const int MIME_FIELD_INDEX_MAX_FIELDS = MIME_FIELD_INDEX_SLOTS / 2;
+static const int MIME_FIELD_INDEX_WAYS       = 4; // must be a power of two
+
+struct MIMEFieldIndex {
+  const MIMEHdrImpl *m_mh;
+  uint32_t m_gen;
+  enum { PENDING, BUILT, TOO_BIG } m_state;
+  struct {
+    MIMEField *field;
+    uint32_t hash;
+  } m_slots[MIME_FIELD_INDEX_SLOTS];
+};
+
+static bool mime_field_index_enabled = true;
+static thread_local std::unique_ptr<MIMEFieldIndex[]> mime_field_index_cache;
+
+void
+mime_hdr_field_index_enable(bool enable)
+{
+  mime_field_index_enabled = enable;
+}
+
+static inline uint32_t
+mime_field_index_hash(const char *name, int len)
+{
+  // FNV-1a over the name with ASCII letters folded to lower case. Other
+  // characters may collide with their 0x20 neighbours; lookups compare names.
+  uint32_t hash = 2166136261U;
+  for (int i = 0; i < len; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(name[i] | 0x20)) * 16777619U;
+  }
+  return hash;
+}
+
+static MIMEField *
+mime_field_index_search(const MIMEFieldIndex *index, const char *name, int len, uint32_t hash)
+{
+  for (uint32_t i = hash;; ++i) {
+    const auto &slot = index->m_slots[i & (MIME_FIELD_INDEX_SLOTS - 1)];
+    if (slot.field == nullptr) {
+      return nullptr;
+    }
+    if (slot.hash == hash && slot.field->m_len_name == len && strncasecmp(slot.field->m_ptr_name, name, len) == 0) {
+      return slot.field;
+    }
+  }
+}
+
+static void
+mime_field_index_build(MIMEFieldIndex *index, MIMEHdrImpl *mh)
+{
+  int count = 0;
+
+  memset(index->m_slots, 0, sizeof(index->m_slots));
+  index->m_state = MIMEFieldIndex::BUILT;
+
+  // Slot order, so that the first field of a name wins as in the list walk.
+  for (MIMEFieldBlockImpl *fblock = &(mh->m_first_fblock); fblock != nullptr; fblock = fblock->m_next) {
+    for (uint32_t n = 0; n < fblock->m_freetop; ++n) {
+      MIMEField *field = &(fblock->m_field_slots[n]);
+      if (!field->is_live()) {
+        continue;
+      }
+      if (++count > MIME_FIELD_INDEX_MAX_FIELDS) {
+        index->m_state = MIMEFieldIndex::TOO_BIG;
+        return;
+      }
+
+      uint32_t hash = mime_field_index_hash(field->m_ptr_name, field->m_len_name);
+      if (mime_field_index_search(index, field->m_ptr_name, field->m_len_name, hash) == nullptr) {
+        uint32_t i = hash;
+        while (index->m_slots[i & (MIME_FIELD_INDEX_SLOTS - 1)].field != nullptr) {
+          ++i;
+        }
+        index->m_slots[i & (MIME_FIELD_INDEX_SLOTS - 1)].field = field;
+        index->m_slots[i & (MIME_FIELD_INDEX_SLOTS - 1)].hash  = hash;
+      }
+    }
+  }
+}
+
+/// Return the name index for @a mh, or @c nullptr if the caller should walk the field list.
+static MIMEFieldIndex *
+mime_field_index_get(MIMEHdrImpl *mh)
+{
+  if (!mime_field_index_cache) {
+    mime_field_index_cache.reset(new MIMEFieldIndex[MIME_FIELD_INDEX_WAYS]);
+    for (int i = 0; i < MIME_FIELD_INDEX_WAYS; ++i) {
+      mime_field_index_cache[i].m_mh = nullptr;
+    }
+  }
+
+  MIMEFieldIndex *index = &mime_field_index_cache[(reinterpret_cast<uintptr_t>(mh) >> 6) & (MIME_FIELD_INDEX_WAYS - 1)];
+
+  if (index->m_mh != mh || index->m_gen != mh->m_fields_gen) {
+    index->m_mh    = mh;
+    index->m_gen   = mh->m_fields_gen;
+    index->m_state = MIMEFieldIndex::PENDING;
+    return nullptr;
+  }
+  if (index->m_state == MIMEFieldIndex::PENDING) {
+    mime_field_index_build(index, mh);
+  }
+  return index->m_state == MIMEFieldIndex::BUILT ? index : nullptr;
+}
+
 MIMEField *
 _mime_hdr_field_list_search_by_string(MIMEHdrImpl *mh, const char *field_name_str, int field_name_len)
 {
@@ -1252,6 +1407,13 @@ _mime_hdr_field_list_search_by_string(MIMEHdrImpl *mh, const char *field_name_st
   MIMEField *field, *too_far_field;
 
   ink_assert(mh);
+  if (mime_field_index_enabled && mh->m_first_fblock.m_next != nullptr) {
+    MIMEFieldIndex *index = mime_field_index_get(mh);
+    if (index) {
+      return mime_field_index_search(index, field_name_str, field_name_len, mime_field_index_hash(field_name_str, field_name_len));
+    }
+  }
+
   for (fblock = &(mh->m_first_fblock); fblock != nullptr; fblock = fblock->m_next) {
     field = &(fblock->m_field_slots[0]);
 
@@ -1483,6 +1645,7 @@ mime_hdr_field_attach(MIMEHdrImpl *mh, MIMEField *field, int check_for_dups, MIM
   }
 
   field->m_readiness = MIME_FIELD_SLOT_READINESS_LIVE;
+  mime_hdr_fields_changed(mh);
 
   ////////////////////////////////////////////////////////////////////
   // now, attach the new field --- if there are dups, make sure the //
@@ -1612,6 +1775,7 @@ mime_hdr_field_detach(MIMEHdrImpl *mh, MIMEField *field, bool detach_all_dups)
   // Field is now detached and alone
   field->m_readiness = MIME_FIELD_SLOT_READINESS_DETACHED;
   field->m_next_dup  = nullptr;
+  mime_hdr_fields_changed(mh);
 
   // Because we changed the values through detaching,update the cooked cache
   if (field->is_cooked()) {
@@ -2372,6 +2536,79 @@ mime_scanner_append(MIMEScanner *scanner, const char *data, int data_size)
   scanner->m_line_length += data_size;
 }
 
+/* Delimiter scanning for the field scanner.
+
+   A field line is scanned for its terminating LF and for NUL, which is never valid in a header. Doing both
+   in one pass over the bytes matters for large (cookie heavy) fields. On x86_64 SSE2 is always available,
+   AVX2 is selected at run time by @c mime_init if the CPU supports it.
+*/
+typedef const char *(*MIMEScanLfNulFunc)(const char *s, const char *e);
+
+/// Find the first LF or NUL in [ @a s, @a e ), returning @a e if there is neither.
+static const char *
+mime_scan_lf_nul_scalar(const char *s, const char *e)
+{
+  const char *lf  = static_cast<const char *>(memchr(s, ParseRules::CHAR_LF, e - s));
+  const char *nul = static_cast<const char *>(memchr(s, '\0', (lf ? lf : e) - s));
+  return nul ? nul : (lf ? lf : e);
+}
+
+#if defined(__x86_64__)
+static const char *
+mime_scan_lf_nul_sse2(const char *s, const char *e)
+{
+  const __m128i lf  = _mm_set1_epi8(ParseRules::CHAR_LF);
+  const __m128i nul = _mm_setzero_si128();
+
+  for (; e - s >= 16; s += 16) {
+    __m128i v     = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+    unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, nul)));
+    if (mask) {
+      return s + __builtin_ctz(mask);
+    }
+  }
+  for (; s < e && *s != ParseRules::CHAR_LF && *s != '\0'; ++s) {
+  }
+  return s;
+}
+
+__attribute__((target("avx2"))) static const char *
+mime_scan_lf_nul_avx2(const char *s, const char *e)
+{
+  const __m256i lf  = _mm256_set1_epi8(ParseRules::CHAR_LF);
+  const __m256i nul = _mm256_setzero_si256();
+
+  for (; e - s >= 32; s += 32) {
+    __m256i v     = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+    unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, nul)));
+    if (mask) {
+      return s + __builtin_ctz(mask);
+    }
+  }
+  return mime_scan_lf_nul_sse2(s, e);
+}
+
+static MIMEScanLfNulFunc mime_scan_lf_nul = &mime_scan_lf_nul_sse2;
+#else
+static MIMEScanLfNulFunc mime_scan_lf_nul = &mime_scan_lf_nul_scalar;
+#endif
+
+void
+mime_scanner_select_simd(bool enable)
+{
+#if defined(__x86_64__)
+  if (!enable) {
+    mime_scan_lf_nul = &mime_scan_lf_nul_scalar;
+  } else if (__builtin_cpu_supports("avx2")) {
+    mime_scan_lf_nul = &mime_scan_lf_nul_avx2;
+  } else {
+    mime_scan_lf_nul = &mime_scan_lf_nul_sse2;
+  }
+#else
+  (void)enable;
+#endif
+}
+
 ParseResult
 mime_scanner_get(MIMEScanner *S, const char **raw_input_s, const char *raw_input_e, const char **output_s, const char **output_e,
                  bool *output_shares_raw_input,
@@ -2380,6 +2617,7 @@ mime_scanner_get(MIMEScanner *S, const char **raw_input_s, const char *raw_input
 {
   const char *raw_input_c, *lf_ptr;
   ParseResult zret = PARSE_RESULT_CONT;
+  bool saw_nul     = false;
   // Need this for handling dangling CR.
   static const char RAW_CR = ParseRules::CHAR_CR;
 
@@ -2425,8 +2663,13 @@ mime_scanner_get(MIMEScanner *S, const char **raw_input_s, const char *raw_input
       }
       break;
     case MIME_PARSE_INSIDE:
-      lf_ptr = static_cast<const char *>(memchr(raw_input_c, ParseRules::CHAR_LF, runway));
-      if (lf_ptr) {
+      lf_ptr = mime_scan_lf_nul(raw_input_c, raw_input_e);
+      // A NUL makes the header invalid, but keep scanning so the input consumed is the same as without one.
+      while (lf_ptr < raw_input_e && '\0' == *lf_ptr) {
+        saw_nul = true;
+        lf_ptr  = mime_scan_lf_nul(lf_ptr + 1, raw_input_e);
+      }
+      if (lf_ptr < raw_input_e) {
         raw_input_c = lf_ptr + 1;
         if (MIME_SCANNER_TYPE_LINE == raw_input_scan_type) {
           zret       = PARSE_RESULT_OK;
@@ -2517,7 +2760,7 @@ mime_scanner_get(MIMEScanner *S, const char **raw_input_s, const char *raw_input
   }
 
   // Make sure there are no '\0' in the input scanned so far
-  if (zret != PARSE_RESULT_ERROR && memchr(*raw_input_s, '\0', raw_input_c - *raw_input_s) != nullptr) {
+  if (zret != PARSE_RESULT_ERROR && saw_nul) {
     zret = PARSE_RESULT_ERROR;
   }
 
@@ -3769,6 +4012,7 @@ MIMEHdrImpl::unmarshal(intptr_t offset)
 {
   HDR_UNMARSHAL_PTR(m_fblock_list_tail, MIMEFieldBlockImpl, offset);
   m_first_fblock.unmarshal(offset);
+  mime_hdr_fields_changed(this);
 }
 
 void
@@ -246,7 +246,10 @@ struct MIMECooked {
  ***********************************************************************/
 
 struct MIMEHdrImpl : public HdrHeapObjImpl {
-  // HdrHeapObjImpl is 4 bytes, so this will result in 4 bytes padding
+  // HdrHeapObjImpl is 4 bytes, so this occupies what would otherwise be padding
+  // and the marshalled layout is unchanged. It changes whenever a field is attached
+  // or detached and is only meaningful in memory (it is reassigned on unmarshal).
+  uint32_t m_fields_gen;
   uint64_t m_presence_bits;
   uint32_t m_slot_accelerators[4];
 
@@ -693,6 +696,10 @@ void mime_field_value_append(HdrHeap *heap, MIMEHdrImpl *mh, MIMEField *field, c
 void mime_scanner_init(MIMEScanner *scanner);
 void mime_scanner_clear(MIMEScanner *scanner);
 void mime_scanner_append(MIMEScanner *scanner, const char *data, int data_size);
+/// Select the vectorized (if @a enable and supported by the CPU) or scalar delimiter scan for the scanner.
+void mime_scanner_select_simd(bool enable);
+/// Enable or disable the per thread name index used to find fields in headers with many fields.
+void mime_hdr_field_index_enable(bool enable);
 ParseResult mime_scanner_get(MIMEScanner *S, const char **raw_input_s, const char *raw_input_e, const char **output_s,
                              const char **output_e, bool *output_shares_raw_input, bool raw_input_eof, int raw_input_scan_type);
 
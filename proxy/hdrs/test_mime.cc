@@ -21,9 +21,12 @@
   limitations under the License.
  */
 
+#include <string>
+#include <vector>
 #include <ts/TestBox.h>
 #include "I_EventSystem.h"
 #include "MIME.h"
+#include "HdrToken.h"
 
 REGRESSION_TEST(MIME)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
 {
@@ -52,6 +55,318 @@ REGRESSION_TEST(MIME)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatu
   hdr.destroy();
 }
 
+// Parse @a text (a copy, the scanner unfolds in place) and return the result and the number of fields.
+static ParseResult
+parse_mime_text(std::string text, bool simd, int *n_fields, int *value_len = nullptr)
+{
+  MIMEHdr hdr;
+  MIMEParser parser;
+  const char *start = text.data();
+
+  mime_scanner_select_simd(simd);
+  mime_parser_init(&parser);
+  hdr.create(nullptr);
+  ParseResult result = static_cast<ParseResult>(hdr.parse(&parser, &start, text.data() + text.size(), false, true));
+  *n_fields          = hdr.fields_count();
+  if (value_len) {
+    MIMEField *cookie = hdr.field_find("Cookie", 6);
+    *value_len        = cookie ? cookie->m_len_value : -1;
+  }
+  hdr.destroy();
+  mime_parser_clear(&parser);
+  mime_scanner_select_simd(true);
+  return result;
+}
+
+REGRESSION_TEST(MIME_PARSER_SIMD)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  std::string cookie(300, 'c');
+  std::string text = "Host: example.com\r\nCookie: " + cookie + "\r\nX-Folded: one\r\n two\r\nAccept: */*\r\n\r\n";
+
+  // The vectorized and scalar scans must agree for every header length, so the delimiters are checked
+  // at each position relative to the vector width.
+  for (size_t pad = 0; pad < 64; ++pad) {
+    std::string padded = "X-Pad: " + std::string(pad, 'p') + "\r\n" + text;
+    int n_simd, n_scalar, len_simd, len_scalar;
+    ParseResult r_simd   = parse_mime_text(padded, true, &n_simd, &len_simd);
+    ParseResult r_scalar = parse_mime_text(padded, false, &n_scalar, &len_scalar);
+
+    box.check(r_simd == PARSE_RESULT_DONE, "Pad %zu: parse result is %d but should be %d", pad, r_simd, PARSE_RESULT_DONE);
+    box.check(r_simd == r_scalar, "Pad %zu: parse result %d differs from scalar %d", pad, r_simd, r_scalar);
+    box.check(n_simd == 5 && n_simd == n_scalar, "Pad %zu: found %d fields, scalar %d, expected 5", pad, n_simd, n_scalar);
+    box.check(len_simd == static_cast<int>(cookie.size()) && len_simd == len_scalar, "Pad %zu: Cookie length %d, scalar %d",
+              pad, len_simd, len_scalar);
+  }
+
+  // A NUL anywhere in a field must be an error.
+  for (size_t spot = 0; spot < 128; ++spot) {
+    std::string bad = "Cookie: " + std::string(200, 'c') + "\r\n\r\n";
+    bad[8 + spot]   = '\0';
+    int n_fields;
+    ParseResult r_simd   = parse_mime_text(bad, true, &n_fields);
+    ParseResult r_scalar = parse_mime_text(bad, false, &n_fields);
+
+    box.check(r_simd == PARSE_RESULT_ERROR, "NUL at %zu: parse result is %d but should be %d", spot, r_simd, PARSE_RESULT_ERROR);
+    box.check(r_scalar == PARSE_RESULT_ERROR, "NUL at %zu: scalar parse result is %d but should be %d", spot, r_scalar,
+              PARSE_RESULT_ERROR);
+  }
+}
+
+REGRESSION_TEST(MIME_PARSER_THROUGHPUT)(RegressionTest *t, int level, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // This is a benchmark, only run it when asked for (-R 3).
+  if (REGRESSION_TEST_EXTENDED > level) {
+    return;
+  }
+
+  std::string text = "Host: www.example.com\r\n"
+                     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/66.0 Safari/537.36\r\n"
+                     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+                     "Accept-Encoding: gzip, deflate, br\r\n"
+                     "Accept-Language: en-US,en;q=0.9\r\n";
+  for (int i = 0; i < 8; ++i) {
+    text += "Cookie: session" + std::to_string(i) + "=" + std::string(512, 'a' + i) + "\r\n";
+  }
+  text += "\r\n";
+
+  static const int ITERATIONS = 20000;
+  double mb                   = static_cast<double>(text.size()) * ITERATIONS / (1024 * 1024);
+  for (bool simd : {false, true}) {
+    MIMEScanner scanner;
+    const char *line_s, *line_e;
+    bool shares_input;
+    int n_fields;
+
+    // Scanning the lines only, which is what the delimiter search speeds up.
+    mime_scanner_select_simd(simd);
+    mime_scanner_init(&scanner);
+    ink_hrtime start = ink_get_hrtime_internal();
+    for (int i = 0; i < ITERATIONS; ++i) {
+      const char *s = text.data();
+      const char *e = s + text.size();
+      while (PARSE_RESULT_OK == mime_scanner_get(&scanner, &s, e, &line_s, &line_e, &shares_input, true, MIME_SCANNER_TYPE_FIELD)) {
+      }
+    }
+    double msec = static_cast<double>(ink_get_hrtime_internal() - start) / HRTIME_MSECOND;
+    mime_scanner_clear(&scanner);
+    rprintf(t, "%s scan: %d headers of %zu bytes in %.3f ms, %.1f MB/s\n", simd ? "SIMD" : "scalar", ITERATIONS, text.size(), msec,
+            mb * 1000.0 / msec);
+
+    // Full parse in to a MIMEHdr.
+    start = ink_get_hrtime_internal();
+    for (int i = 0; i < ITERATIONS; ++i) {
+      parse_mime_text(text, simd, &n_fields);
+    }
+    msec = static_cast<double>(ink_get_hrtime_internal() - start) / HRTIME_MSECOND;
+    rprintf(t, "%s parse: %d headers of %zu bytes in %.3f ms, %.1f MB/s\n", simd ? "SIMD" : "scalar", ITERATIONS, text.size(),
+            msec, mb * 1000.0 / msec);
+  }
+  mime_scanner_select_simd(true);
+}
+
+REGRESSION_TEST(HdrToken_tokenize)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  for (int idx = 0; idx < hdrtoken_num_wks; ++idx) {
+    // Copy the string so it is not recognized by address as a well known string.
+    std::string name(hdrtoken_index_to_wks(idx), hdrtoken_index_to_length(idx));
+    std::string upper(name), lower(name);
+    for (auto &c : upper) {
+      c = toupper(c);
+    }
+    for (auto &c : lower) {
+      c = tolower(c);
+    }
+
+    int wks_idx = hdrtoken_tokenize(name.data(), name.size());
+    box.check(wks_idx == idx, "'%s' tokenized to %d but should be %d", name.c_str(), wks_idx, idx);
+    wks_idx = hdrtoken_tokenize(upper.data(), upper.size());
+    box.check(wks_idx == idx, "'%s' tokenized to %d but should be %d", upper.c_str(), wks_idx, idx);
+    wks_idx = hdrtoken_tokenize(lower.data(), lower.size());
+    box.check(wks_idx == idx, "'%s' tokenized to %d but should be %d", lower.c_str(), wks_idx, idx);
+
+    // A one character change anywhere must not match this token.
+    for (size_t i = 0; i < name.size(); ++i) {
+      std::string changed(name);
+      changed[i] = (changed[i] == '-') ? '_' : '-';
+      wks_idx    = hdrtoken_tokenize(changed.data(), changed.size());
+      box.check(wks_idx != idx, "'%s' tokenized to '%s'", changed.c_str(), name.c_str());
+    }
+    wks_idx = hdrtoken_tokenize(name.data(), name.size() - 1);
+    box.check(wks_idx != idx, "'%.*s' tokenized to '%s'", static_cast<int>(name.size() - 1), name.data(), name.c_str());
+  }
+
+  // Non-letters must match exactly, '@' and '`' differ only in the case bit.
+  box.check(hdrtoken_tokenize("`Ats-Internal", 13) < 0, "'`Ats-Internal' should not be a well known string");
+  box.check(hdrtoken_tokenize("X-Not-Well-Known", 16) < 0, "'X-Not-Well-Known' should not be a well known string");
+  box.check(hdrtoken_tokenize("Content-Length-And-Then-Some-More-Text", 38) < 0, "Long name should not be a well known string");
+}
+
+REGRESSION_TEST(HdrToken_tokenize_throughput)(RegressionTest *t, int level, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // This is a benchmark, only run it when asked for (-R 3).
+  if (REGRESSION_TEST_EXTENDED > level) {
+    return;
+  }
+
+  // Field names from typical browser requests and origin responses.
+  static const char *names[] = {"Host", "User-Agent", "Accept", "Accept-Language", "Accept-Encoding", "Referer", "Cookie",
+                                "Connection", "Cache-Control", "If-None-Match", "If-Modified-Since", "X-Forwarded-For",
+                                "Content-Type", "Content-Length", "Date", "Server", "Last-Modified", "ETag", "Vary", "Set-Cookie",
+                                "Age", "Via", "Strict-Transport-Security", "Transfer-Encoding", "Expires"};
+  std::string copies[countof(names)];
+  for (unsigned i = 0; i < countof(names); ++i) {
+    copies[i] = names[i];
+  }
+
+  // Report the best of several rounds, the lookups are short enough for scheduling noise to matter.
+  static const int ROUNDS     = 5;
+  static const int ITERATIONS = 40000;
+  int found                   = 0;
+  double best                 = 0;
+  for (int round = 0; round < ROUNDS; ++round) {
+    found            = 0;
+    ink_hrtime start = ink_get_hrtime_internal();
+    for (int i = 0; i < ITERATIONS; ++i) {
+      for (const auto &name : copies) {
+        found += hdrtoken_tokenize(name.data(), name.size()) >= 0;
+      }
+    }
+    double nsec = static_cast<double>(ink_get_hrtime_internal() - start) / (ITERATIONS * countof(names));
+    best        = (0 == round || nsec < best) ? nsec : best;
+  }
+  box.check(found == static_cast<int>(ITERATIONS * countof(names)), "Only %d of the names were found", found);
+  rprintf(t, "%d lookups per round, best %.1f ns per lookup\n", static_cast<int>(ITERATIONS * countof(names)), best);
+}
+
+// Build a header with @a n_fields fields that are not well known strings, plus a few that are.
+static void
+build_wide_header(MIMEHdr &hdr, std::vector<std::string> &names, int n_fields)
+{
+  hdr.create(nullptr);
+  names.clear();
+  for (int i = 0; i < n_fields; ++i) {
+    names.push_back("X-Custom-Field-" + std::to_string(i));
+  }
+  names.push_back("Host");
+  names.push_back("Cookie");
+  for (const auto &name : names) {
+    MIMEField *field = hdr.field_create(name.data(), name.size());
+    hdr.field_attach(field);
+    hdr.field_value_set(field, name.data(), name.size());
+  }
+}
+
+// Find @a name with the name index (twice, so that it is built) and with the list walk, return whether they agree.
+static bool
+index_agrees(MIMEHdr &hdr, const std::string &name, MIMEField **found)
+{
+  mime_hdr_field_index_enable(false);
+  MIMEField *walked = hdr.field_find(name.data(), name.size());
+  mime_hdr_field_index_enable(true);
+  hdr.field_find(name.data(), name.size());
+  *found = hdr.field_find(name.data(), name.size());
+  return *found == walked;
+}
+
+REGRESSION_TEST(MIME_FIELD_INDEX)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  MIMEHdr hdr;
+  MIMEField *field;
+  std::vector<std::string> names;
+  build_wide_header(hdr, names, 60);
+
+  for (const auto &name : names) {
+    box.check(index_agrees(hdr, name, &field) && field != nullptr, "Field %s was not found", name.c_str());
+  }
+  std::string upper = "X-CUSTOM-FIELD-17";
+  box.check(index_agrees(hdr, upper, &field) && field != nullptr && field->m_len_name == static_cast<int>(upper.size()),
+            "Field lookup is not case insensitive");
+  for (const char *absent : {"X-Custom-Field-60", "X-Custom-Field-", "X-Custom-Field-170", "Y-Custom-Field-1"}) {
+    box.check(index_agrees(hdr, absent, &field) && field == nullptr, "Field %s was found but should not be", absent);
+  }
+
+  // Deleting a field must invalidate the index.
+  hdr.field_delete(names[5].data(), names[5].size());
+  box.check(index_agrees(hdr, names[5], &field) && field == nullptr, "Deleted field %s was found", names[5].c_str());
+
+  // Renaming a field (detach, rename, attach) must invalidate the index.
+  std::string renamed = "X-Renamed-Field";
+  MIMEField *old      = hdr.field_find(names[6].data(), names[6].size());
+  hdr.field_detach(old);
+  old->name_set(hdr.m_heap, hdr.m_mime, renamed.data(), renamed.size());
+  hdr.field_attach(old);
+  box.check(index_agrees(hdr, names[6], &field) && field == nullptr, "Renamed field %s was found", names[6].c_str());
+  box.check(index_agrees(hdr, renamed, &field) && field == old, "Renamed field %s was not found", renamed.c_str());
+
+  // With duplicates the first one in slot order is returned.
+  MIMEField *dup = hdr.field_create(names[10].data(), names[10].size());
+  hdr.field_attach(dup);
+  box.check(index_agrees(hdr, names[10], &field) && field != dup && field->m_next_dup == dup,
+            "Duplicate field %s did not find the first field", names[10].c_str());
+
+  hdr.destroy();
+}
+
+REGRESSION_TEST(MIME_FIELD_INDEX_THROUGHPUT)(RegressionTest *t, int level, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // This is a benchmark, only run it when asked for (-R 3).
+  if (REGRESSION_TEST_EXTENDED > level) {
+    return;
+  }
+
+  static const int ROUNDS     = 5;
+  static const int ITERATIONS = 20000;
+
+  for (int n_fields : {16, 50, 100}) {
+    MIMEHdr hdr;
+    std::vector<std::string> names;
+    build_wide_header(hdr, names, n_fields);
+    // Look up the custom fields, and as many that are absent.
+    std::vector<std::string> lookups(names.begin(), names.begin() + n_fields);
+    for (int i = 0; i < n_fields; ++i) {
+      lookups.push_back("X-Custom-Field-" + std::to_string(n_fields + i));
+    }
+
+    double best[2] = {0, 0};
+    for (int indexed = 0; indexed < 2; ++indexed) {
+      mime_hdr_field_index_enable(indexed);
+      for (int round = 0; round < ROUNDS; ++round) {
+        int found        = 0;
+        ink_hrtime start = ink_get_hrtime_internal();
+        for (int i = 0; i < ITERATIONS; ++i) {
+          for (const auto &name : lookups) {
+            found += hdr.field_find(name.data(), name.size()) != nullptr;
+          }
+        }
+        double nsec   = static_cast<double>(ink_get_hrtime_internal() - start) / (ITERATIONS * lookups.size());
+        best[indexed] = (0 == round || nsec < best[indexed]) ? nsec : best[indexed];
+        box.check(found == ITERATIONS * n_fields, "Found %d fields, expected %d", found, ITERATIONS * n_fields);
+      }
+    }
+    mime_hdr_field_index_enable(true);
+    rprintf(t, "%d fields: list walk %.1f ns, name index %.1f ns per lookup\n", static_cast<int>(names.size()), best[0], best[1]);
+    hdr.destroy();
+  }
+}
+
 int
 main(int argc, const char **argv)
 {
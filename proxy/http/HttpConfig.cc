@@ -24,6 +24,7 @@
 #include "ts/ink_config.h"
 #include <cctype>
 #include <cstring>
+#include <string>
 #include "HttpConfig.h"
 #include "HTTP.h"
 #include "ProcessManager.h"
@@ -31,6 +32,7 @@
 #include "P_Net.h"
 #include "P_RecUtils.h"
 #include <records/I_RecHttp.h>
+#include "ts/HashFNV.h"
 
 #define HttpEstablishStaticConfigStringAlloc(_ix, _n) \
   REC_EstablishStaticConfigStringAlloc(_ix, _n);      \
@@ -49,6 +51,153 @@
   REC_RegisterConfigUpdateFunc(_n, http_config_cb, NULL)
 
 RecRawStatBlock *http_rsb;
+RecHistogram *http_histograms[http_histogram_count];
+
+namespace
+{
+// The latency histograms of an origin server. Origins are added to an open
+// addressing table that is never shrunk, so lookups need no lock.
+struct OriginHistograms {
+  char *name;
+  int len;
+  uint32_t hash;
+  RecHistogram *histograms[http_origin_histogram_count];
+};
+
+const char *const origin_histogram_name[] = {"server_connect", "server_response", "ttfb", "total"};
+
+// The histograms of an origin are coarser than the global ones, within 25% instead of 6.25%, and the threads share 8
+// slots of them. That bounds an origin to about 36 KB, whatever the number of threads.
+const int origin_histogram_precision = 2;
+const int origin_histogram_slots     = 8;
+const int64_t origin_max_limit       = 1000;
+
+std::atomic<OriginHistograms *> *origin_table;
+unsigned origin_table_mask;
+int64_t origin_count;
+int64_t origin_max;
+ink_mutex origin_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void
+origin_table_init(int64_t max)
+{
+  origin_max = max;
+
+  // Keep the table at most half full.
+  unsigned size = 1;
+  while (size < 2 * origin_max) {
+    size <<= 1;
+  }
+  origin_table      = new std::atomic<OriginHistograms *>[size];
+  origin_table_mask = size - 1;
+  for (unsigned i = 0; i < size; ++i) {
+    origin_table[i] = nullptr;
+  }
+}
+
+void
+origin_histograms_init()
+{
+  int64_t max;
+
+  REC_ReadConfigInteger(max, "proxy.config.http.latency_histograms.max_origins");
+  if (max > origin_max_limit) {
+    Warning("proxy.config.http.latency_histograms.max_origins is %" PRId64 ", only %" PRId64 " origins are tracked", max,
+            origin_max_limit);
+    max = origin_max_limit;
+  }
+  if (max > 0) {
+    origin_table_init(max);
+  }
+}
+} // namespace
+
+RecHistogram *const *
+http_origin_histograms(const char *name, int len)
+{
+  // Host names are at most 255 bytes, longer ones are not tracked.
+  if (origin_table == nullptr || name == nullptr || len <= 0 || len > 255) {
+    return nullptr;
+  }
+
+  ATSHash32FNV1a fnv;
+  fnv.update(name, len);
+  fnv.final();
+  uint32_t hash = fnv.get();
+
+  for (unsigned i = hash & origin_table_mask;; i = (i + 1) & origin_table_mask) {
+    OriginHistograms *origin = origin_table[i].load(std::memory_order_acquire);
+
+    if (origin == nullptr) {
+      break;
+    }
+    if (origin->hash == hash && origin->len == len && memcmp(origin->name, name, len) == 0) {
+      return origin->histograms;
+    }
+  }
+
+  // Not found, add it unless the table is full. Another thread may have
+  // added it meanwhile, so probe again under the lock.
+  ink_scoped_mutex_lock lock(origin_mutex);
+  unsigned i;
+
+  for (i = hash & origin_table_mask;; i = (i + 1) & origin_table_mask) {
+    OriginHistograms *origin = origin_table[i].load(std::memory_order_relaxed);
+
+    if (origin == nullptr) {
+      break;
+    }
+    if (origin->hash == hash && origin->len == len && memcmp(origin->name, name, len) == 0) {
+      return origin->histograms;
+    }
+  }
+  if (origin_count >= origin_max) {
+    return nullptr;
+  }
+
+  OriginHistograms *origin = new OriginHistograms;
+  origin->name             = ats_strndup(name, len);
+  origin->len              = len;
+  origin->hash             = hash;
+
+  // Dots would split the host name over several record name components, they become underscores. The
+  // escapes start with a dash so that no two hosts get the same name: "-_" for an underscore, "--" for a
+  // dash and "-" and two hex digits for anything else that is not a letter or a digit.
+  char host[3 * 255 + 1];
+  char *h = host;
+  for (int j = 0; j < len; ++j) {
+    unsigned char c = origin->name[j];
+    if (ParseRules::is_alnum(c)) {
+      *h++ = c;
+    } else if (c == '.') {
+      *h++ = '_';
+    } else if (c == '_' || c == '-') {
+      *h++ = '-';
+      *h++ = c;
+    } else {
+      h += snprintf(h, 4, "-%02x", c);
+    }
+  }
+  *h = '\0';
+
+  for (int j = 0; j < http_origin_histogram_count; ++j) {
+    char histogram_name[1024];
+
+    snprintf(histogram_name, sizeof(histogram_name), "proxy.process.http.latency.origin.%s.%s", host, origin_histogram_name[j]);
+    origin->histograms[j] = RecAllocateHistogram(histogram_name, origin_histogram_precision, origin_histogram_slots);
+    if (origin->histograms[j] == nullptr) {
+      // Out of records, stop tracking more origins.
+      origin_max = origin_count;
+      ats_free(origin->name);
+      delete origin;
+      return nullptr;
+    }
+  }
+
+  ++origin_count;
+  origin_table[i].store(origin, std::memory_order_release);
+  return origin->histograms;
+}
 #define HTTP_CLEAR_DYN_STAT(x)          \
   do {                                  \
     RecSetRawStatSum(http_rsb, x, 0);   \
@@ -115,7 +264,8 @@ static const ConfigEnumPair<TSServerSessionSharingMatchType> SessionSharingMatch
 
 static const ConfigEnumPair<TSServerSessionSharingPoolType> SessionSharingPoolStrings[] = {
   {TS_SERVER_SESSION_SHARING_POOL_GLOBAL, "global"},
-  {TS_SERVER_SESSION_SHARING_POOL_THREAD, "thread"}};
+  {TS_SERVER_SESSION_SHARING_POOL_THREAD, "thread"},
+  {TS_SERVER_SESSION_SHARING_POOL_HYBRID, "hybrid"}};
 
 int HttpConfig::m_id = 0;
 HttpConfigParams HttpConfig::m_master;
@@ -846,6 +996,11 @@ register_stat_callbacks()
   RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.disallowed_post_100_continue", RECD_COUNTER, RECP_PERSISTENT,
                      (int)disallowed_post_100_continue, RecRawStatSyncCount);
 
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.early_data_requests", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)http_early_data_requests_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.early_data_too_early", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)http_early_data_too_early_stat, RecRawStatSyncCount);
+
   RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.total_x_redirect_count", RECD_COUNTER, RECP_PERSISTENT,
                      (int)http_total_x_redirect_stat, RecRawStatSyncCount);
 
@@ -857,6 +1012,22 @@ register_stat_callbacks()
                      (int)http_origin_connections_throttled_stat, RecRawStatSyncCount);
   RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.post_body_too_large", RECD_COUNTER, RECP_PERSISTENT,
                      (int)http_post_body_too_large, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.origin_session_reuse.attached", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)http_origin_session_attached_reuse_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.origin_session_reuse.pool_hit", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)http_origin_session_pool_hit_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.origin_session_reuse.pool_remote_hit", RECD_COUNTER,
+                     RECP_PERSISTENT, (int)http_origin_session_pool_remote_hit_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.origin_session_reuse.pool_miss", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)http_origin_session_pool_miss_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.origin_session_reuse.pool_lock_contention", RECD_COUNTER,
+                     RECP_PERSISTENT, (int)http_origin_session_pool_lock_contention_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.origin_session_reuse.prewarm_hit", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)http_origin_session_prewarm_hit_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.origin_prewarm.connections", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)http_origin_prewarm_connections_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.origin_prewarm.failures", RECD_COUNTER, RECP_PERSISTENT,
+                     (int)http_origin_prewarm_failures_stat, RecRawStatSyncCount);
   // milestones
   RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.milestone.ua_begin", RECD_COUNTER, RECP_PERSISTENT,
                      (int)http_ua_begin_time_stat, RecRawStatSyncSum);
@@ -898,6 +1069,18 @@ register_stat_callbacks()
                      (int)http_sm_start_time_stat, RecRawStatSyncSum);
   RecRegisterRawStat(http_rsb, RECT_PROCESS, "proxy.process.http.milestone.sm_finish", RECD_COUNTER, RECP_PERSISTENT,
                      (int)http_sm_finish_time_stat, RecRawStatSyncSum);
+
+  // latency histograms
+  http_histograms[http_ttfb_histogram]            = RecAllocateHistogram("proxy.process.http.latency.ttfb");
+  http_histograms[http_server_connect_histogram]  = RecAllocateHistogram("proxy.process.http.latency.server_connect");
+  http_histograms[http_cache_lookup_histogram]    = RecAllocateHistogram("proxy.process.http.latency.cache_lookup");
+  http_histograms[http_dns_lookup_histogram]      = RecAllocateHistogram("proxy.process.http.latency.dns_lookup");
+  http_histograms[http_server_response_histogram] = RecAllocateHistogram("proxy.process.http.latency.server_response");
+  http_histograms[http_total_histogram]           = RecAllocateHistogram("proxy.process.http.latency.total");
+  for (auto h : http_histograms) {
+    ink_release_assert(h != nullptr);
+  }
+  origin_histograms_init();
 }
 
 ////////////////////////////////////////////////////////////////
@@ -932,6 +1115,9 @@ HttpConfig::startup()
   HttpEstablishStaticConfigLongLong(c.oride.origin_max_connections, "proxy.config.http.origin_max_connections");
   HttpEstablishStaticConfigLongLong(c.oride.origin_max_connections_queue, "proxy.config.http.origin_max_connections_queue");
   HttpEstablishStaticConfigLongLong(c.origin_min_keep_alive_connections, "proxy.config.http.origin_min_keep_alive_connections");
+  HttpEstablishStaticConfigLongLong(c.origin_prewarm_connections, "proxy.config.http.origin_prewarm.connections");
+  HttpEstablishStaticConfigLongLong(c.origin_prewarm_max_origins, "proxy.config.http.origin_prewarm.max_origins");
+  HttpEstablishStaticConfigLongLong(c.origin_prewarm_interval, "proxy.config.http.origin_prewarm.interval");
   HttpEstablishStaticConfigByte(c.oride.attach_server_session_to_client, "proxy.config.http.attach_server_session_to_client");
 
   HttpEstablishStaticConfigByte(c.disable_ssl_parenting, "proxy.local.http.parent_proxy.disable_connect_tunneling");
@@ -1133,6 +1319,7 @@ HttpConfig::startup()
 
   HttpEstablishStaticConfigByte(c.oride.send_http11_requests, "proxy.config.http.send_http11_requests");
   HttpEstablishStaticConfigByte(c.oride.allow_multi_range, "proxy.config.http.allow_multi_range");
+  HttpEstablishStaticConfigByte(c.oride.early_data_methods, "proxy.config.http.early_data_methods");
 
   // HTTP Referer Filtering
   HttpEstablishStaticConfigByte(c.referer_filter_enabled, "proxy.config.http.referer_filter");
@@ -1224,6 +1411,9 @@ HttpConfig::reconfigure()
   }
   params->origin_min_keep_alive_connections     = m_master.origin_min_keep_alive_connections;
   params->oride.attach_server_session_to_client = m_master.oride.attach_server_session_to_client;
+  params->origin_prewarm_connections            = m_master.origin_prewarm_connections;
+  params->origin_prewarm_max_origins            = m_master.origin_prewarm_max_origins;
+  params->origin_prewarm_interval               = m_master.origin_prewarm_interval;
 
   if (params->oride.origin_max_connections && params->oride.origin_max_connections < params->origin_min_keep_alive_connections) {
     Warning("origin_max_connections < origin_min_keep_alive_connections, setting min=max , please correct your records.config");
@@ -1391,6 +1581,7 @@ HttpConfig::reconfigure()
   params->oride.cache_range_lookup     = INT_TO_BOOL(m_master.oride.cache_range_lookup);
   params->oride.cache_range_write      = INT_TO_BOOL(m_master.oride.cache_range_write);
   params->oride.allow_multi_range      = m_master.oride.allow_multi_range;
+  params->oride.early_data_methods     = m_master.oride.early_data_methods;
 
   params->connect_ports_string = ats_strdup(m_master.connect_ports_string);
   params->connect_ports        = parse_ports_list(params->connect_ports_string);
@@ -1557,3 +1748,59 @@ HttpConfig::parse_ports_list(char *ports_string)
   }
   return (ports_list);
 }
+
+#if TS_HAS_TESTS
+#include "ts/TestBox.h"
+
+REGRESSION_TEST(HttpOriginHistograms)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // The test needs an empty table, it leaves it full.
+  if (origin_table != nullptr) {
+    rprintf(t, "origin histograms are configured, not testing them\n");
+    return;
+  }
+  origin_table_init(5);
+
+  static const struct {
+    const char *host;
+    const char *record;
+  } origins[] = {
+    {"cdn-1.example.com", "cdn--1_example_com"},
+    {"a-b.example.com", "a--b_example_com"},
+    {"a_b.example.com", "a-_b_example_com"},
+    {"a.b.example.com", "a_b_example_com"},
+    {"[::1]:8080", "-5b-3a-3a1-5d-3a8080"},
+  };
+  RecHistogram *const *found[countof(origins)];
+  int coarse_buckets = (RecHistogram::RANGE_BITS - origin_histogram_precision + 1) << origin_histogram_precision;
+
+  for (unsigned i = 0; i < countof(origins); ++i) {
+    char name[256];
+    RecInt count;
+
+    found[i] = http_origin_histograms(origins[i].host, strlen(origins[i].host));
+    if (!box.check(found[i] != nullptr, "%s is not tracked", origins[i].host)) {
+      continue;
+    }
+    snprintf(name, sizeof(name), "proxy.process.http.latency.origin.%s.ttfb.count", origins[i].record);
+    box.check(RecGetRecordInt(name, &count) == REC_ERR_OKAY, "%s has no %s stat", origins[i].host, name);
+    box.check(found[i][http_origin_ttfb_histogram]->bucket_count() == coarse_buckets, "%s has %d buckets, expected %d",
+              origins[i].host, found[i][http_origin_ttfb_histogram]->bucket_count(), coarse_buckets);
+    for (unsigned j = 0; j < i; ++j) {
+      box.check(found[j] == nullptr || found[j][0] != found[i][0], "%s and %s share histograms", origins[j].host, origins[i].host);
+    }
+  }
+
+  const char *again = origins[0].host;
+  box.check(http_origin_histograms(again, strlen(again)) == found[0], "a second lookup of %s made new histograms", again);
+
+  const char *extra = "extra.example.com";
+  box.check(http_origin_histograms(extra, strlen(extra)) == nullptr, "more origins than the maximum are tracked");
+
+  std::string overlong(256, 'a');
+  box.check(http_origin_histograms(overlong.data(), overlong.size()) == nullptr, "a host name over 255 bytes is tracked");
+}
+#endif
@@ -238,6 +238,9 @@ enum {
   disallowed_post_100_continue,
   http_post_body_too_large,
 
+  http_early_data_requests_stat,
+  http_early_data_too_early_stat,
+
   http_total_x_redirect_stat,
 
   // Times
@@ -321,16 +324,56 @@ enum {
 
   http_origin_connections_throttled_stat,
 
+  // origin session reuse
+  http_origin_session_attached_reuse_stat,
+  http_origin_session_pool_hit_stat,
+  http_origin_session_pool_remote_hit_stat,
+  http_origin_session_pool_miss_stat,
+  http_origin_session_pool_lock_contention_stat,
+  http_origin_session_prewarm_hit_stat,
+  http_origin_prewarm_connections_stat,
+  http_origin_prewarm_failures_stat,
+
   http_stat_count
 };
 
 extern RecRawStatBlock *http_rsb;
 
+// Latency histograms of the main transaction phases, in microseconds
+enum {
+  http_ttfb_histogram,            // UA_BEGIN to UA_BEGIN_WRITE
+  http_server_connect_histogram,  // SERVER_CONNECT to SERVER_CONNECT_END
+  http_cache_lookup_histogram,    // CACHE_OPEN_READ_BEGIN to CACHE_OPEN_READ_END
+  http_dns_lookup_histogram,      // DNS_LOOKUP_BEGIN to DNS_LOOKUP_END
+  http_server_response_histogram, // SERVER_BEGIN_WRITE to SERVER_FIRST_READ
+  http_total_histogram,           // UA_BEGIN to UA_CLOSE
+
+  http_histogram_count
+};
+
+extern RecHistogram *http_histograms[http_histogram_count];
+
+// Latency histograms of a single origin server, see http_origin_histograms()
+enum {
+  http_origin_server_connect_histogram,
+  http_origin_server_response_histogram,
+  http_origin_ttfb_histogram,
+  http_origin_total_histogram,
+
+  http_origin_histogram_count
+};
+
+// Return the latency histograms of the origin server @a name, creating them
+// on first use. Returns nullptr if origin histograms are disabled or the
+// proxy.config.http.latency_histograms.max_origins origins are taken.
+RecHistogram *const *http_origin_histograms(const char *name, int len);
+
 /* Stats should only be accessed using these macros */
 #define HTTP_INCREMENT_DYN_STAT(x) RecIncrRawStat(http_rsb, this_ethread(), (int)x, 1)
 #define HTTP_DECREMENT_DYN_STAT(x) RecIncrRawStat(http_rsb, this_ethread(), (int)x, -1)
 #define HTTP_SUM_DYN_STAT(x, y) RecIncrRawStat(http_rsb, this_ethread(), (int)x, (int64_t)y)
 #define HTTP_SUM_GLOBAL_DYN_STAT(x, y) RecIncrGlobalRawStatSum(http_rsb, x, y)
+#define HTTP_RECORD_HISTOGRAM(x, y) http_histograms[x]->record((int64_t)y)
 
 #define HTTP_CLEAR_DYN_STAT(x)          \
   do {                                  \
@@ -435,6 +478,7 @@ struct OverridableHttpConfigParams {
       cache_range_lookup(1),
       cache_range_write(0),
       allow_multi_range(0),
+      early_data_methods(1),
       cache_enable_default_vary_headers(0),
       ignore_accept_mismatch(0),
       ignore_accept_language_mismatch(0),
@@ -589,6 +633,7 @@ struct OverridableHttpConfigParams {
   MgmtByte cache_range_lookup;
   MgmtByte cache_range_write;
   MgmtByte allow_multi_range;
+  MgmtByte early_data_methods;
 
   MgmtByte cache_enable_default_vary_headers;
 
@@ -787,6 +832,9 @@ public:
 
   MgmtInt server_max_connections            = 0;
   MgmtInt origin_min_keep_alive_connections = 0; // TODO: This one really ought to be overridable, but difficult right now.
+  MgmtInt origin_prewarm_connections        = 0;
+  MgmtInt origin_prewarm_max_origins        = 16;
+  MgmtInt origin_prewarm_interval           = 5;
   MgmtInt max_websocket_connections         = -1;
 
   char *proxy_request_via_string    = nullptr;
@@ -730,6 +730,11 @@ HttpSM::state_read_client_request_header(int event, void *data)
 
     ua_txn->set_session_active();
 
+    if (client_connection_is_ssl) {
+      SSLNetVConnection *ssl_vc = dynamic_cast<SSLNetVConnection *>(ua_txn->get_netvc());
+      t_state.early_data        = ssl_vc && ssl_vc->getSSLEarlyData();
+    }
+
     if (t_state.hdr_info.client_request.version_get() == HTTPVersion(1, 1) &&
         (t_state.hdr_info.client_request.method_get_wksidx() == HTTP_WKSIDX_POST ||
          t_state.hdr_info.client_request.method_get_wksidx() == HTTP_WKSIDX_PUT) &&
@@ -1720,6 +1725,7 @@ HttpSM::state_http_server_open(int event, void *data)
 
   switch (event) {
   case NET_EVENT_OPEN:
+    // Sessions in a hybrid pool can be moved to another thread, so they come from the global allocator.
     session = (TS_SERVER_SESSION_SHARING_POOL_THREAD == t_state.http_config_param->server_session_sharing_pool) ?
                 THREAD_ALLOC_INIT(httpServerSessionAllocator, mutex->thread_holding) :
                 httpServerSessionAllocator.alloc();
@@ -4782,6 +4788,16 @@ HttpSM::do_http_server_open(bool raw)
   if (raw == false && TS_SERVER_SESSION_SHARING_MATCH_NONE != t_state.txn_conf->server_session_sharing_match &&
       (t_state.txn_conf->keep_alive_post_out == 1 || t_state.hdr_info.request_content_length == 0) && !is_private() &&
       ua_txn != nullptr) {
+    // Count the requests to the HTTPS origins, the busiest get sessions opened ahead.
+    if (t_state.http_config_param->origin_prewarm_connections > 0 && t_state.current.request_to == HttpTransact::ORIGIN_SERVER &&
+        t_state.next_hop_scheme == URL_WKSIDX_HTTPS) {
+      int len          = 0;
+      const char *host = t_state.hdr_info.server_request.host_get(&len);
+      httpSessionManager.note_origin(t_state.current.server->name, ts::string_view(host, host ? len : 0),
+                                     &t_state.current.server->dst_addr.sa,
+                                     HRTIME_SECONDS(t_state.http_config_param->origin_prewarm_interval));
+    }
+
     HSMresult_t shared_result;
     shared_result = httpSessionManager.acquire_session(this,                                 // state machine
                                                        &t_state.current.server->dst_addr.sa, // ip + port
@@ -76,6 +76,7 @@ public:
       to_parent_proxy(false),
       server_trans_stat(0),
       private_session(false),
+      prewarmed(false),
       sharing_match(TS_SERVER_SESSION_SHARING_MATCH_BOTH),
       sharing_pool(TS_SERVER_SESSION_SHARING_POOL_GLOBAL),
       enable_origin_connection_limiting(false),
@@ -158,6 +159,9 @@ public:
   //  are sent over them
   bool private_session;
 
+  // Opened ahead of the requests by ServerSessionPrewarm and not used yet
+  bool prewarmed;
+
   // Copy of the owning SM's server session sharing settings
   TSServerSessionSharingMatchType sharing_match;
   TSServerSessionSharingPoolType sharing_pool;
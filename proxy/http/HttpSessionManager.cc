@@ -35,6 +35,11 @@
 #include "HttpServerSession.h"
 #include "HttpSM.h"
 #include "HttpDebugNames.h"
+#include "ts/HashFNV.h"
+#include "ts/TestBox.h"
+
+#include <algorithm>
+#include <thread>
 
 // Initialize a thread to handle HTTP session management
 void
@@ -45,6 +50,34 @@ initialize_thread_for_http_sessions(EThread *thread)
 
 HttpSessionManager httpSessionManager;
 
+/** Move the net connection of @a ss, just removed from @a pool, to @a ethread.
+
+    If the connection can not be moved the session is put back in to @a pool.
+
+    @return @c true if @a ss can be used on @a ethread.
+*/
+static bool
+migrate_session_to_thread(ServerSessionPool *pool, HttpServerSession *ss, HttpSM *sm, EThread *ethread)
+{
+  UnixNetVConnection *server_vc = dynamic_cast<UnixNetVConnection *>(ss->get_netvc());
+  if (server_vc) {
+    UnixNetVConnection *new_vc = server_vc->migrateToCurrentThread(sm, ethread);
+    if (new_vc->thread != ethread) {
+      // Failed to migrate, put it back to the session pool
+      pool->releaseSession(ss);
+      return false;
+    } else if (new_vc != server_vc) {
+      // The VC migrated, keep things from timing out on us
+      new_vc->set_inactivity_timeout(new_vc->get_inactivity_timeout());
+      ss->set_netvc(new_vc);
+    } else {
+      // The VC moved, keep things from timing out on us
+      server_vc->set_inactivity_timeout(server_vc->get_inactivity_timeout());
+    }
+  }
+  return true;
+}
+
 ServerSessionPool::ServerSessionPool() : Continuation(new_ProxyMutex()), m_ip_pool(1023), m_host_pool(1023)
 {
   SET_HANDLER(&ServerSessionPool::eventHandler);
@@ -245,10 +278,259 @@ ServerSessionPool::eventHandler(int event, void *data)
   return 0;
 }
 
+/// Opens one session to a pre-warmed origin, does its TLS handshake and releases it to the pool.
+struct ServerSessionPrewarmConnect : public Continuation {
+  explicit ServerSessionPrewarmConnect(ServerSessionPrewarm::OriginPtr o) : Continuation(new_ProxyMutex()), origin(std::move(o))
+  {
+    SET_HANDLER(&ServerSessionPrewarmConnect::startEvent);
+  }
+
+  int
+  startEvent(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+  {
+    HttpConfigParams *params = HttpConfig::acquire();
+    NetVCOptions opt;
+    opt.f_blocking_connect = false;
+    opt.set_sock_param(params->oride.sock_recv_buffer_size_out, params->oride.sock_send_buffer_size_out,
+                       params->oride.sock_option_flag_out, params->oride.sock_packet_mark_out, params->oride.sock_packet_tos_out);
+    opt.ip_family = origin->addr.family();
+    if (!origin->sni.empty()) {
+      opt.set_sni_servername(origin->sni.data(), origin->sni.size());
+    }
+    HttpConfig::release(params);
+
+    // The connect can call back before it returns, this is gone then.
+    SET_HANDLER(&ServerSessionPrewarmConnect::connectEvent);
+    sslNetProcessor.connect_re(this, &origin->addr.sa, &opt);
+    return EVENT_DONE;
+  }
+
+  int
+  connectEvent(int event, void *data)
+  {
+    if (NET_EVENT_OPEN != event) {
+      return done(false);
+    }
+
+    HttpConfigParams *params = HttpConfig::acquire();
+    NetVConnection *netvc    = static_cast<NetVConnection *>(data);
+    // As in HttpSM::state_http_server_open.
+    session = (TS_SERVER_SESSION_SHARING_POOL_THREAD == params->server_session_sharing_pool) ?
+                THREAD_ALLOC_INIT(httpServerSessionAllocator, this_ethread()) :
+                httpServerSessionAllocator.alloc();
+    session->sharing_pool  = static_cast<TSServerSessionSharingPoolType>(params->server_session_sharing_pool);
+    session->sharing_match = static_cast<TSServerSessionSharingMatchType>(params->oride.server_session_sharing_match);
+    session->prewarmed     = true;
+    // The pre-warmed sessions count against origin_max_connections, as those of the transactions do.
+    if (params->oride.origin_max_connections > 0 || params->origin_min_keep_alive_connections > 0) {
+      session->enable_origin_connection_limiting = true;
+    }
+    session->attach_hostname(origin->hostname.c_str());
+    session->new_connection(netvc);
+    netvc->set_inactivity_timeout(HRTIME_SECONDS(params->oride.keep_alive_no_activity_timeout_out));
+    HttpConfig::release(params);
+
+    // A zero length read completes with the handshake, the write side sends the ClientHello.
+    SET_HANDLER(&ServerSessionPrewarmConnect::handshakeEvent);
+    session->do_io_read(this, 0, session->read_buffer);
+    session->reenable(session->do_io_write(this, 0, nullptr));
+    return EVENT_DONE;
+  }
+
+  int
+  handshakeEvent(int event, void * /* data ATS_UNUSED */)
+  {
+    if (VC_EVENT_READ_COMPLETE != event) {
+      session->do_io_close();
+      return done(false);
+    }
+
+    Debug("http_ss", "[%" PRId64 "] [prewarm] session opened to %s", session->con_id, origin->hostname.c_str());
+    session->release();
+    return done(true);
+  }
+
+  int
+  done(bool success)
+  {
+    if (success) {
+      HTTP_INCREMENT_DYN_STAT(http_origin_prewarm_connections_stat);
+    } else {
+      HTTP_INCREMENT_DYN_STAT(http_origin_prewarm_failures_stat);
+      Debug("http_ss", "[prewarm] failed to open a session to %s", origin->hostname.c_str());
+    }
+    --origin->opening;
+    delete this;
+    return EVENT_DONE;
+  }
+
+  ServerSessionPrewarm::OriginPtr origin;
+  HttpServerSession *session = nullptr;
+};
+
+ServerSessionPrewarm::ServerSessionPrewarm() : Continuation(new_ProxyMutex())
+{
+  SET_HANDLER(&ServerSessionPrewarm::mainEvent);
+  ink_mutex_init(&m_lock);
+  m_slots = new CountSlot[COUNT_SLOTS];
+  for (unsigned i = 0; i < COUNT_SLOTS; ++i) {
+    ink_mutex_init(&m_slots[i].lock);
+  }
+}
+
+ServerSessionPrewarm::~ServerSessionPrewarm()
+{
+  for (unsigned i = 0; i < COUNT_SLOTS; ++i) {
+    ink_mutex_destroy(&m_slots[i].lock);
+  }
+  delete[] m_slots;
+  ink_mutex_destroy(&m_lock);
+}
+
+ServerSessionPrewarm::CountSlot *
+ServerSessionPrewarm::_thread_slot()
+{
+  static std::atomic<unsigned> next_thread_slot{0};
+  static thread_local unsigned thread_slot = next_thread_slot++;
+
+  return &m_slots[thread_slot % COUNT_SLOTS];
+}
+
+void
+ServerSessionPrewarm::note(const char *hostname, ts::string_view sni, sockaddr const *addr)
+{
+  size_t len = strlen(hostname);
+  ATSHash64FNV1a hash;
+
+  hash.update(hostname, len);
+  hash.update("/", 1);
+  hash.update(sni.data(), sni.size());
+  hash.update(ats_ip_addr8_cast(addr), ats_ip_addr_size(addr));
+  hash.update(&ats_ip_port_cast(addr), sizeof(in_port_t));
+  hash.final();
+
+  // Only the first request to an origin on a slot allocates, until the origin goes idle.
+  CountSlot *slot = _thread_slot();
+  ink_scoped_mutex_lock lock(slot->lock);
+  Noted &noted = slot->origins[hash.get()];
+  if (noted.hostname.empty()) {
+    noted.hostname.assign(hostname, len);
+    noted.sni.assign(sni.data(), sni.size());
+    noted.addr.assign(addr);
+  } else if (noted.hostname.size() != len || memcmp(noted.hostname.data(), hostname, len) != 0 ||
+             noted.sni != sni || !ats_ip_addr_port_eq(&noted.addr.sa, addr)) {
+    return; // another origin with the same hash, too rare to matter
+  }
+  ++noted.requests;
+}
+
+void
+ServerSessionPrewarm::start(ink_hrtime interval)
+{
+  if (!m_scheduled.load(std::memory_order_relaxed) && !m_scheduled.exchange(true)) {
+    eventProcessor.schedule_in(this, interval, ET_NET);
+  }
+}
+
+std::vector<ServerSessionPrewarm::OriginPtr>
+ServerSessionPrewarm::rank(size_t n)
+{
+  std::vector<OriginPtr> ranked;
+
+  {
+    ink_scoped_mutex_lock lock(m_lock);
+
+    for (unsigned i = 0; i < COUNT_SLOTS; ++i) {
+      ink_scoped_mutex_lock slot_lock(m_slots[i].lock);
+      auto &origins = m_slots[i].origins;
+
+      for (auto spot = origins.begin(); spot != origins.end();) {
+        Noted &noted = spot->second;
+        if (noted.requests == 0) {
+          spot = origins.erase(spot);
+          continue;
+        }
+
+        ip_port_text_buffer ipb;
+        std::string key   = noted.hostname + '/' + noted.sni + '/' + ats_ip_nptop(&noted.addr.sa, ipb, sizeof(ipb));
+        OriginPtr &origin = m_origins[key];
+        if (!origin) {
+          origin           = std::make_shared<Origin>();
+          origin->hostname = noted.hostname;
+          origin->sni      = noted.sni;
+          origin->addr     = noted.addr;
+          CryptoContext().hash_immediate(origin->hostname_hash, (unsigned char *)noted.hostname.data(), noted.hostname.size());
+        }
+        origin->requests += noted.requests;
+        noted.requests = 0;
+        ++spot;
+      }
+    }
+
+    for (auto spot = m_origins.begin(); spot != m_origins.end();) {
+      Origin &origin  = *spot->second;
+      origin.score    = origin.score / 2 + origin.requests;
+      origin.requests = 0;
+      if (origin.score == 0) {
+        spot = m_origins.erase(spot);
+      } else {
+        ranked.push_back(spot->second);
+        ++spot;
+      }
+    }
+  }
+
+  n = std::min(n, ranked.size());
+  std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(),
+                    [](const OriginPtr &lhs, const OriginPtr &rhs) { return lhs->score > rhs->score; });
+  ranked.resize(n);
+  return ranked;
+}
+
+int
+ServerSessionPrewarm::mainEvent(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+{
+  HttpConfigParams *params = HttpConfig::acquire();
+  int connections          = params->origin_prewarm_connections;
+  int64_t max_connections  = params->oride.origin_max_connections;
+  auto pool_type           = static_cast<TSServerSessionSharingPoolType>(params->server_session_sharing_pool);
+  auto match               = static_cast<TSServerSessionSharingMatchType>(params->oride.server_session_sharing_match);
+
+  for (const OriginPtr &origin : rank(params->origin_prewarm_max_origins)) {
+    if (connections <= 0) {
+      break;
+    }
+    // Sessions of the origin still in the pools, the pre-warmed ones and those released by the transactions, are as good.
+    int idle = httpSessionManager.count_idle_sessions(&origin->addr.sa, origin->hostname_hash, pool_type);
+    if (idle < 0) {
+      continue; // try again next round
+    }
+    int64_t wanted = connections - idle - origin->opening;
+    // The open sessions and those being opened count against origin_max_connections, stop there.
+    if (max_connections > 0) {
+      int count = ConnectionCount::getInstance()->getCount(origin->addr, origin->hostname_hash, match);
+      wanted    = std::min(wanted, max_connections - count - origin->opening);
+    }
+    for (; wanted > 0; --wanted) {
+      ++origin->opening;
+      eventProcessor.schedule_imm(new ServerSessionPrewarmConnect(origin), ET_NET);
+    }
+  }
+
+  if (connections > 0) {
+    eventProcessor.schedule_in(this, HRTIME_SECONDS(params->origin_prewarm_interval), ET_NET);
+  } else {
+    m_scheduled = false;
+  }
+  HttpConfig::release(params);
+  return EVENT_DONE;
+}
+
 void
 HttpSessionManager::init()
 {
   m_g_pool = new ServerSessionPool;
+  m_prewarm = new ServerSessionPrewarm;
   eventProcessor.schedule_spawn(&initialize_thread_for_http_sessions, ET_NET);
 }
 
@@ -265,6 +547,74 @@ HttpSessionManager::purge_keepalives()
   } // should we do something clever if we don't get the lock?
 }
 
+void
+HttpSessionManager::note_origin(const char *hostname, ts::string_view sni, sockaddr const *addr, ink_hrtime interval)
+{
+  m_prewarm->note(hostname, sni, addr);
+  m_prewarm->start(interval);
+}
+
+int
+HttpSessionManager::count_idle_sessions(sockaddr const *addr, CryptoHash const &host_hash, TSServerSessionSharingPoolType pool_type)
+{
+  EThread *ethread = this_ethread();
+  int count        = 0;
+
+  auto count_in = [&](ServerSessionPool *pool) {
+    MUTEX_TRY_LOCK(lock, pool->mutex, ethread);
+    if (!lock.is_locked()) {
+      return false;
+    }
+    for (auto spot = pool->m_ip_pool.find(addr); spot; ++spot) {
+      count += (spot->hostname_hash == host_hash);
+    }
+    return true;
+  };
+
+  if (TS_SERVER_SESSION_SHARING_POOL_GLOBAL == pool_type) {
+    return count_in(m_g_pool) ? count : -1;
+  }
+
+  EventProcessor::ThreadGroupDescriptor *tg = &eventProcessor.thread_group[ET_NET];
+  for (int i = 0; i < tg->_count; ++i) {
+    ServerSessionPool *pool = tg->_thread[i]->server_session_pool;
+    if (pool && !count_in(pool)) {
+      return -1;
+    }
+  }
+  return count;
+}
+
+HSMresult_t
+HttpSessionManager::acquire_remote_session(EThread *ethread, sockaddr const *ip, CryptoHash const &hostname_hash,
+                                           TSServerSessionSharingMatchType match_style, HttpSM *sm,
+                                           HttpServerSession *&to_return)
+{
+  EventProcessor::ThreadGroupDescriptor *tg = &eventProcessor.thread_group[ET_NET];
+
+  // Start at a different thread on each call so stealing is spread over the peer pools. Pools that are
+  // busy are skipped rather than waited on, this is a fallback and must never stall the local thread.
+  uint32_t start = ink_atomic_increment(&m_steal_index, 1u);
+  for (int i = 0; i < tg->_count && !to_return; ++i) {
+    EThread *peer           = tg->_thread[(start + i) % tg->_count];
+    ServerSessionPool *pool = peer->server_session_pool;
+    if (peer == ethread || nullptr == pool) {
+      continue;
+    }
+    MUTEX_TRY_LOCK(lock, pool->mutex, ethread);
+    if (!lock.is_locked()) {
+      HTTP_INCREMENT_DYN_STAT(http_origin_session_pool_lock_contention_stat);
+      continue;
+    }
+    pool->acquireSession(ip, hostname_hash, match_style, sm, to_return);
+    if (to_return && !migrate_session_to_thread(pool, to_return, sm, ethread)) {
+      to_return = nullptr;
+    }
+  }
+  Debug("http_ss", "[acquire session] remote thread pool search %s", to_return ? "successful" : "failed");
+  return to_return ? HSM_DONE : HSM_NOT_FOUND;
+}
+
 HSMresult_t
 HttpSessionManager::acquire_session(Continuation * /* cont ATS_UNUSED */, sockaddr const *ip, const char *hostname,
                                     ProxyClientTransaction *ua_txn, HttpSM *sm)
@@ -290,6 +640,7 @@ HttpSessionManager::acquire_session(Continuation * /* cont ATS_UNUSED */, sockad
     if (ServerSessionPool::match(to_return, ip, hostname_hash, match_style) &&
         ServerSessionPool::validate_sni(sm, to_return->get_netvc())) {
       Debug("http_ss", "[%" PRId64 "] [acquire session] returning attached session ", to_return->con_id);
+      HTTP_INCREMENT_DYN_STAT(http_origin_session_attached_reuse_stat);
       to_return->state = HSS_ACTIVE;
       sm->attach_server_session(to_return);
       return HSM_DONE;
@@ -310,15 +661,17 @@ HttpSessionManager::acquire_session(Continuation * /* cont ATS_UNUSED */, sockad
   // current thread and the original has been deleted. This should adequately cover TS-3266 so we
   // don't have to continue to hold the pool thread while we initialize the server session in the
   // client session
+  EThread *ethread = this_ethread();
+  TSServerSessionSharingPoolType pool_type =
+    static_cast<TSServerSessionSharingPoolType>(sm->t_state.http_config_param->server_session_sharing_pool);
+  bool remote_p = false;
   {
     // Now check to see if we have a connection in our shared connection pool
-    EThread *ethread       = this_ethread();
-    ProxyMutex *pool_mutex = (TS_SERVER_SESSION_SHARING_POOL_THREAD == sm->t_state.http_config_param->server_session_sharing_pool) ?
-                               ethread->server_session_pool->mutex.get() :
-                               m_g_pool->mutex.get();
+    ProxyMutex *pool_mutex =
+      (TS_SERVER_SESSION_SHARING_POOL_GLOBAL != pool_type) ? ethread->server_session_pool->mutex.get() : m_g_pool->mutex.get();
     MUTEX_TRY_LOCK(lock, pool_mutex, ethread);
     if (lock.is_locked()) {
-      if (TS_SERVER_SESSION_SHARING_POOL_THREAD == sm->t_state.http_config_param->server_session_sharing_pool) {
+      if (TS_SERVER_SESSION_SHARING_POOL_GLOBAL != pool_type) {
         retval = ethread->server_session_pool->acquireSession(ip, hostname_hash, match_style, sm, to_return);
         Debug("http_ss", "[acquire session] thread pool search %s", to_return ? "successful" : "failed");
       } else {
@@ -326,37 +679,36 @@ HttpSessionManager::acquire_session(Continuation * /* cont ATS_UNUSED */, sockad
         Debug("http_ss", "[acquire session] global pool search %s", to_return ? "successful" : "failed");
         // At this point to_return has been removed from the pool. Do we need to move it
         // to the same thread?
-        if (to_return) {
-          UnixNetVConnection *server_vc = dynamic_cast<UnixNetVConnection *>(to_return->get_netvc());
-          if (server_vc) {
-            UnixNetVConnection *new_vc = server_vc->migrateToCurrentThread(sm, ethread);
-            if (new_vc->thread != ethread) {
-              // Failed to migrate, put it back to global session pool
-              m_g_pool->releaseSession(to_return);
-              to_return = nullptr;
-              retval    = HSM_NOT_FOUND;
-            } else if (new_vc != server_vc) {
-              // The VC migrated, keep things from timing out on us
-              new_vc->set_inactivity_timeout(new_vc->get_inactivity_timeout());
-              to_return->set_netvc(new_vc);
-            } else {
-              // The VC moved, keep things from timing out on us
-              server_vc->set_inactivity_timeout(server_vc->get_inactivity_timeout());
-            }
-          }
+        if (to_return && !migrate_session_to_thread(m_g_pool, to_return, sm, ethread)) {
+          to_return = nullptr;
+          retval    = HSM_NOT_FOUND;
         }
       }
     } else { // Didn't get the lock.  to_return is still NULL
+      HTTP_INCREMENT_DYN_STAT(http_origin_session_pool_lock_contention_stat);
       retval = HSM_RETRY;
     }
   }
 
+  // A miss in the local pool in hybrid mode falls back to taking an idle session from another thread.
+  if (!to_return && HSM_NOT_FOUND == retval && TS_SERVER_SESSION_SHARING_POOL_HYBRID == pool_type) {
+    retval   = this->acquire_remote_session(ethread, ip, hostname_hash, match_style, sm, to_return);
+    remote_p = (to_return != nullptr);
+  }
+
   if (to_return) {
     Debug("http_ss", "[%" PRId64 "] [acquire session] return session from shared pool", to_return->con_id);
+    HTTP_INCREMENT_DYN_STAT(remote_p ? http_origin_session_pool_remote_hit_stat : http_origin_session_pool_hit_stat);
+    if (to_return->prewarmed) {
+      HTTP_INCREMENT_DYN_STAT(http_origin_session_prewarm_hit_stat);
+      to_return->prewarmed = false;
+    }
     to_return->state = HSS_ACTIVE;
     // the attach_server_session will issue the do_io_read under the sm lock
     sm->attach_server_session(to_return);
     retval = HSM_DONE;
+  } else if (HSM_NOT_FOUND == retval) {
+    HTTP_INCREMENT_DYN_STAT(http_origin_session_pool_miss_stat);
   }
   return retval;
 }
@@ -366,7 +718,7 @@ HttpSessionManager::release_session(HttpServerSession *to_release)
 {
   EThread *ethread = this_ethread();
   ServerSessionPool *pool =
-    TS_SERVER_SESSION_SHARING_POOL_THREAD == to_release->sharing_pool ? ethread->server_session_pool : m_g_pool;
+    TS_SERVER_SESSION_SHARING_POOL_GLOBAL != to_release->sharing_pool ? ethread->server_session_pool : m_g_pool;
   bool released_p = true;
 
   // The per thread lock looks like it should not be needed but if it's not locked the close checking I/O op will crash.
@@ -380,3 +732,230 @@ HttpSessionManager::release_session(HttpServerSession *to_release)
 
   return released_p ? HSM_DONE : HSM_RETRY;
 }
+
+REGRESSION_TEST(ServerSessionPrewarm)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  ServerSessionPrewarm prewarm;
+  IpEndpoint addr;
+  ats_ip_pton("127.0.0.1:443", &addr);
+
+  for (int i = 0; i < 5; ++i) {
+    prewarm.note("a.example.com", "a.example.com", &addr.sa);
+  }
+  prewarm.note("b.example.com", "b.example.com", &addr.sa);
+  for (int i = 0; i < 3; ++i) {
+    prewarm.note("c.example.com", "c.example.com", &addr.sa);
+  }
+
+  auto ranked = prewarm.rank(2);
+  box.check(ranked.size() == 2, "%zu origins ranked, expected 2", ranked.size());
+  box.check(ranked.size() == 2 && ranked[0]->hostname == "a.example.com" && ranked[1]->hostname == "c.example.com",
+            "the busiest origins come first");
+  box.check(ranked.size() == 2 && ranked[0]->score == 5, "the score counts the requests");
+
+  prewarm.note("b.example.com", "b.example.com", &addr.sa);
+  prewarm.note("b.example.com", "b.example.com", &addr.sa);
+  prewarm.note("b.example.com", "b.example.com", &addr.sa);
+  ranked = prewarm.rank(3);
+  box.check(ranked.size() == 3 && ranked[0]->hostname == "b.example.com", "a new burst outranks the older requests");
+  box.check(ranked.size() == 3 && ranked[1]->score == 2, "the older requests count half");
+
+  prewarm.rank(3);
+  prewarm.rank(3);
+  ranked = prewarm.rank(3);
+  box.check(ranked.empty(), "idle origins are forgotten, %zu left", ranked.size());
+
+  // The counts of the threads are added up.
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < 10; ++j) {
+        prewarm.note("d.example.com", "d.example.com", &addr.sa);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  ranked = prewarm.rank(3);
+  box.check(ranked.size() == 1 && ranked[0]->score == 40, "the requests of the threads are not added up");
+}
+
+/// Puts a session in the pool of one net thread and takes it from another in hybrid mode.
+struct RemoteSessionTest : public Continuation {
+  RemoteSessionTest(RegressionTest *t, int *pstatus, EThread *h, EThread *p)
+    : Continuation(new_ProxyMutex()), box(t, pstatus), home(h), peer(p)
+  {
+    SET_HANDLER(&RemoteSessionTest::openEvent);
+  }
+
+  /// Holds the lock of the pool of the peer thread until it is told to let go.
+  struct PoolLocker : public Continuation {
+    explicit PoolLocker(RemoteSessionTest *t) : Continuation(t->peer->server_session_pool->mutex), test(t)
+    {
+      SET_HANDLER(&PoolLocker::lockEvent);
+    }
+
+    int
+    lockEvent(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+    {
+      test->locked = true;
+      while (!test->unlock) {
+        sched_yield();
+      }
+      delete this;
+      return EVENT_DONE;
+    }
+
+    RemoteSessionTest *test;
+  };
+
+  bool
+  listen_on_loopback()
+  {
+    sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family      = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd                  = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)) != 0 || listen(fd, 4) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr *>(&sin), &len) != 0) {
+      return false;
+    }
+    ats_ip_copy(&addr, reinterpret_cast<sockaddr *>(&sin));
+    return true;
+  }
+
+  // On the peer thread: open a connection to the listener.
+  int
+  openEvent(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+  {
+    NetVCOptions opt;
+    opt.f_blocking_connect = false;
+    opt.ip_family          = addr.family();
+    SET_HANDLER(&RemoteSessionTest::sessionEvent);
+    netProcessor.connect_re(this, &addr.sa, &opt);
+    return EVENT_DONE;
+  }
+
+  // On the peer thread: release the connection to the pool of the thread, then lock that pool.
+  int
+  sessionEvent(int event, void *data)
+  {
+    if (!box.check(NET_EVENT_OPEN == event, "the connection to the listener failed, event %d", event)) {
+      return done();
+    }
+
+    NetVConnection *netvc  = static_cast<NetVConnection *>(data);
+    session                = httpServerSessionAllocator.alloc();
+    session->sharing_pool  = TS_SERVER_SESSION_SHARING_POOL_HYBRID;
+    session->sharing_match = TS_SERVER_SESSION_SHARING_MATCH_IP;
+    session->attach_hostname("remote.example.com");
+    session->new_connection(netvc);
+    session->release();
+
+    peer->schedule_imm(new PoolLocker(this));
+    SET_HANDLER(&RemoteSessionTest::lockedEvent);
+    home->schedule_imm(this);
+    return EVENT_DONE;
+  }
+
+  // On the home thread: the peer pool is busy, so it is skipped.
+  int
+  lockedEvent(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+  {
+    ink_hrtime deadline = Thread::get_hrtime_updated() + HRTIME_SECONDS(5);
+    while (!locked && Thread::get_hrtime_updated() < deadline) {
+      sched_yield();
+    }
+    box.check(locked, "the pool of the peer thread was not locked");
+
+    HttpServerSession *stolen = nullptr;
+    HSMresult_t r = httpSessionManager.acquire_remote_session(home, &addr.sa, hash, TS_SERVER_SESSION_SHARING_MATCH_IP, sm, stolen);
+    box.check(HSM_NOT_FOUND == r && nullptr == stolen, "a session was taken from a locked pool");
+    unlock = true;
+
+    SET_HANDLER(&RemoteSessionTest::stealEvent);
+    home->schedule_in(this, HRTIME_MSECONDS(10));
+    return EVENT_DONE;
+  }
+
+  // On the home thread: the peer pool is free again, its session is taken and moved here.
+  int
+  stealEvent(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+  {
+    HttpServerSession *stolen = nullptr;
+    HSMresult_t r = httpSessionManager.acquire_remote_session(home, &addr.sa, hash, TS_SERVER_SESSION_SHARING_MATCH_IP, sm, stolen);
+
+    // The locker may still be on its way out of the pool lock.
+    if (HSM_NOT_FOUND == r && ++tries < 100) {
+      home->schedule_in(this, HRTIME_MSECONDS(10));
+      return EVENT_DONE;
+    }
+    if (box.check(HSM_DONE == r && stolen == session, "the session in the peer pool was not taken")) {
+      box.check(stolen->get_netvc()->thread == home, "the taken session was not moved to the thread that took it");
+      stolen->do_io_close();
+    }
+    return done();
+  }
+
+  int
+  done()
+  {
+    unlock = true;
+    close(fd);
+    sm->destroy();
+    if (REGRESSION_TEST_INPROGRESS == *box._status) {
+      box = REGRESSION_TEST_PASSED;
+    }
+    delete this;
+    return EVENT_DONE;
+  }
+
+  TestBox box;
+  EThread *home;
+  EThread *peer;
+  HttpSM *sm = nullptr;
+  IpEndpoint addr;
+  CryptoHash hash;
+  int fd                     = -1;
+  HttpServerSession *session = nullptr;
+  std::atomic<bool> locked{false};
+  std::atomic<bool> unlock{false};
+  int tries = 0;
+};
+
+EXCLUSIVE_REGRESSION_TEST(HttpSessionManager_RemoteSession)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  EventProcessor::ThreadGroupDescriptor *tg = &eventProcessor.thread_group[ET_NET];
+  EThread *home                             = this_ethread();
+  EThread *peer                             = nullptr;
+
+  *pstatus = REGRESSION_TEST_INPROGRESS;
+  for (int i = 0; i < tg->_count && !peer; ++i) {
+    if (tg->_thread[i] != home && tg->_thread[i]->server_session_pool) {
+      peer = tg->_thread[i];
+    }
+  }
+  if (!peer || !home->server_session_pool) {
+    rprintf(t, "needs two net threads, there are %d\n", tg->_count);
+    *pstatus = REGRESSION_TEST_PASSED;
+    return;
+  }
+
+  RemoteSessionTest *test = new RemoteSessionTest(t, pstatus, home, peer);
+  if (!test->box.check(test->listen_on_loopback(), "can not listen on the loopback address")) {
+    close(test->fd);
+    delete test;
+    return;
+  }
+  test->sm = HttpSM::allocate();
+  test->sm->init();
+  test->sm->mutex = test->mutex;
+  peer->schedule_imm(test);
+}
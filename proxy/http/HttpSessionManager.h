@@ -35,6 +35,13 @@
 #include "P_EventSystem.h"
 #include "HttpServerSession.h"
 #include <ts/Map.h>
+#include <ts/string_view.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 class ProxyClientTransaction;
 class HttpSM;
@@ -146,10 +153,74 @@ public:
   HostHashTable m_host_pool;
 };
 
+/** Keeps idle TLS sessions open to the busiest HTTPS origins.
+
+    HttpSM counts the requests it is about to send to each HTTPS origin. Every
+    proxy.config.http.origin_prewarm.interval seconds, the origins with the most requests
+    lately get sessions opened until proxy.config.http.origin_prewarm.connections of theirs
+    are idle in the pools. A session is released to the pool as soon as it is connected
+    and does its TLS handshake there, so a burst of requests finds sessions ready instead
+    of each paying for a handshake.
+
+    The requests are counted per thread slot, and the rounds collect the counts, so the
+    transactions of different threads do not contend for a lock.
+*/
+class ServerSessionPrewarm : public Continuation
+{
+public:
+  ServerSessionPrewarm();
+  ~ServerSessionPrewarm();
+
+  struct Origin {
+    std::string hostname;
+    std::string sni;
+    IpEndpoint addr;
+    CryptoHash hostname_hash;
+    uint64_t requests = 0;       ///< Since the last round.
+    uint64_t score    = 0;       ///< Requests of the previous rounds, halved every round.
+    std::atomic<int> opening{0}; ///< Sessions being connected.
+  };
+  using OriginPtr = std::shared_ptr<Origin>;
+
+  /// Count a request to @a hostname at @a addr, reached with the server name @a sni.
+  void note(const char *hostname, ts::string_view sni, sockaddr const *addr);
+
+  /// Start the rounds if they are not running, they stop when the pre-warming is disabled.
+  void start(ink_hrtime interval);
+
+  /// Collect the counts, age the scores and return up to @a n busiest origins, the busiest first.
+  std::vector<OriginPtr> rank(size_t n);
+
+  int mainEvent(int event, void *data);
+
+private:
+  /// Requests to an origin counted in a slot since the last round.
+  struct Noted {
+    std::string hostname;
+    std::string sni;
+    IpEndpoint addr;
+    uint64_t requests = 0;
+  };
+
+  /// The counts of the threads of a slot. Threads beyond the slot count share slots.
+  struct CountSlot {
+    ink_mutex lock;
+    std::unordered_map<uint64_t, Noted> origins; ///< By hash of the host name, SNI and address.
+  };
+  static const unsigned COUNT_SLOTS = 64;
+
+  CountSlot *_thread_slot();
+
+  CountSlot *m_slots;
+  ink_mutex m_lock; ///< For @a m_origins.
+  std::unordered_map<std::string, OriginPtr> m_origins;
+  std::atomic<bool> m_scheduled{false};
+};
+
 class HttpSessionManager
 {
 public:
-  HttpSessionManager() : m_g_pool(nullptr) {}
+  HttpSessionManager() : m_g_pool(nullptr), m_steal_index(0), m_prewarm(nullptr) {}
   ~HttpSessionManager() {}
   HSMresult_t acquire_session(Continuation *cont, sockaddr const *addr, const char *hostname, ProxyClientTransaction *ua_txn,
                               HttpSM *sm);
@@ -158,10 +229,35 @@ public:
   void init();
   int main_handler(int event, void *data);
 
+  /** Count the idle sessions to @a addr and @a host_hash in the pools of @a pool_type.
+
+      @return The count, or -1 if a pool was busy.
+  */
+  int count_idle_sessions(sockaddr const *addr, CryptoHash const &host_hash, TSServerSessionSharingPoolType pool_type);
+
+  /// Count a request for the pre-warming, see ServerSessionPrewarm.
+  void note_origin(const char *hostname, ts::string_view sni, sockaddr const *addr, ink_hrtime interval);
+
+  friend struct RemoteSessionTest;
+
 private:
+  /** Take a matching session from the pool of another net thread and move it to @a ethread.
+
+      This is the fallback for a miss in the local pool when the pool type is
+      @c TS_SERVER_SESSION_SHARING_POOL_HYBRID. Peer pools whose lock is held are skipped.
+
+      @return @c HSM_DONE if @a server_session was set, @c HSM_NOT_FOUND otherwise.
+  */
+  HSMresult_t acquire_remote_session(EThread *ethread, sockaddr const *addr, CryptoHash const &host_hash,
+                                     TSServerSessionSharingMatchType match_style, HttpSM *sm, HttpServerSession *&server_session);
+
   /// Global pool, used if not per thread pools.
   /// @internal We delay creating this because the session manager is created during global statics init.
   ServerSessionPool *m_g_pool;
+  /// Rotating start index for searching the pools of other threads.
+  uint32_t m_steal_index;
+  /// Opens sessions ahead of the requests to the busiest origins.
+  ServerSessionPrewarm *m_prewarm;
 };
 
 extern HttpSessionManager httpSessionManager;
@@ -260,6 +260,25 @@ is_negative_caching_appropriate(HttpTransact::State *s)
   return false;
 }
 
+// Whether the remap rule lets the method through when the request came in TLS early data.
+inline static bool
+is_early_data_method_allowed(HttpTransact::State *s)
+{
+  int method = s->hdr_info.client_request.method_get_wksidx();
+
+  switch (s->txn_conf->early_data_methods) {
+  case 0:
+    return false;
+  case 1:
+    return method == HTTP_WKSIDX_GET || method == HTTP_WKSIDX_HEAD || method == HTTP_WKSIDX_OPTIONS;
+  case 2:
+    return method == HTTP_WKSIDX_GET || method == HTTP_WKSIDX_HEAD || method == HTTP_WKSIDX_OPTIONS || method == HTTP_WKSIDX_PUT ||
+           method == HTTP_WKSIDX_DELETE;
+  default:
+    return true;
+  }
+}
+
 inline static HttpTransact::LookingUp_t
 find_server_and_update_current_info(HttpTransact::State *s)
 {
@@ -1178,6 +1197,20 @@ HttpTransact::HandleRequest(State *s)
       TRANSACT_RETURN(SM_ACTION_SEND_ERROR_CACHE_NOOP, nullptr);
     }
 
+    // Requests in TLS early data may be replays. The methods the remap rule does not
+    // allow get a 425, the client sends them again after the handshake. The others
+    // go to the origin with an Early-Data header (RFC 8470).
+    if (s->early_data) {
+      if (!is_early_data_method_allowed(s)) {
+        TxnDebug("http_trans", "Refusing a request received in TLS early data, sending 425.");
+        HTTP_INCREMENT_DYN_STAT(http_early_data_too_early_stat);
+        build_error_response(s, HTTP_STATUS_TOO_EARLY, "Too Early", nullptr);
+        TRANSACT_RETURN(SM_ACTION_SEND_ERROR_CACHE_NOOP, nullptr);
+      }
+      HTTP_INCREMENT_DYN_STAT(http_early_data_requests_stat);
+      s->hdr_info.client_request.value_set("Early-Data", 10, "1", 1);
+    }
+
     // The following chunk of code allows you to disallow post w/ expect 100-continue (TS-3459)
     if (s->hdr_info.request_content_length && s->http_config_param->disallow_post_100_continue) {
       MIMEField *expect = s->hdr_info.client_request.field_find(MIME_FIELD_EXPECT, MIME_LEN_EXPECT);
@@ -8667,6 +8700,57 @@ HttpTransact::update_size_and_time_stats(State *s, ink_hrtime total_time, ink_hr
   HTTP_SUM_DYN_STAT(http_dns_lookup_end_time_stat, milestones.difference_msec(TS_MILESTONE_SM_START, TS_MILESTONE_DNS_LOOKUP_END));
   HTTP_SUM_DYN_STAT(http_sm_start_time_stat, milestones.difference_msec(TS_MILESTONE_SM_START, TS_MILESTONE_SM_START));
   HTTP_SUM_DYN_STAT(http_sm_finish_time_stat, milestones.difference_msec(TS_MILESTONE_SM_START, TS_MILESTONE_SM_FINISH));
+
+  // update latency histograms
+  if (milestones[TS_MILESTONE_UA_BEGIN_WRITE] != 0) {
+    HTTP_RECORD_HISTOGRAM(http_ttfb_histogram,
+                          ink_hrtime_to_usec(milestones.elapsed(TS_MILESTONE_UA_BEGIN, TS_MILESTONE_UA_BEGIN_WRITE)));
+  }
+  if (milestones[TS_MILESTONE_SERVER_CONNECT] != 0 && milestones[TS_MILESTONE_SERVER_CONNECT_END] != 0) {
+    HTTP_RECORD_HISTOGRAM(http_server_connect_histogram,
+                          ink_hrtime_to_usec(milestones.elapsed(TS_MILESTONE_SERVER_CONNECT, TS_MILESTONE_SERVER_CONNECT_END)));
+  }
+  if (milestones[TS_MILESTONE_CACHE_OPEN_READ_BEGIN] != 0 && milestones[TS_MILESTONE_CACHE_OPEN_READ_END] != 0) {
+    HTTP_RECORD_HISTOGRAM(
+      http_cache_lookup_histogram,
+      ink_hrtime_to_usec(milestones.elapsed(TS_MILESTONE_CACHE_OPEN_READ_BEGIN, TS_MILESTONE_CACHE_OPEN_READ_END)));
+  }
+  if (milestones[TS_MILESTONE_DNS_LOOKUP_BEGIN] != 0 && milestones[TS_MILESTONE_DNS_LOOKUP_END] != 0) {
+    HTTP_RECORD_HISTOGRAM(http_dns_lookup_histogram,
+                          ink_hrtime_to_usec(milestones.elapsed(TS_MILESTONE_DNS_LOOKUP_BEGIN, TS_MILESTONE_DNS_LOOKUP_END)));
+  }
+  ink_hrtime server_response = 0;
+  if (milestones[TS_MILESTONE_SERVER_BEGIN_WRITE] != 0 && milestones[TS_MILESTONE_SERVER_FIRST_READ] != 0) {
+    server_response = milestones.elapsed(TS_MILESTONE_SERVER_BEGIN_WRITE, TS_MILESTONE_SERVER_FIRST_READ);
+    HTTP_RECORD_HISTOGRAM(http_server_response_histogram, ink_hrtime_to_usec(server_response));
+  }
+  if (milestones[TS_MILESTONE_UA_CLOSE] != 0) {
+    HTTP_RECORD_HISTOGRAM(http_total_histogram,
+                          ink_hrtime_to_usec(milestones.elapsed(TS_MILESTONE_UA_BEGIN, TS_MILESTONE_UA_CLOSE)));
+  }
+
+  // and those of the origin server, if it was contacted
+  if (milestones[TS_MILESTONE_SERVER_CONNECT] != 0 && s->server_info.name != nullptr) {
+    RecHistogram *const *origin = http_origin_histograms(s->server_info.name, strlen(s->server_info.name));
+
+    if (origin != nullptr) {
+      if (milestones[TS_MILESTONE_SERVER_CONNECT_END] != 0) {
+        origin[http_origin_server_connect_histogram]->record(
+          ink_hrtime_to_usec(milestones.elapsed(TS_MILESTONE_SERVER_CONNECT, TS_MILESTONE_SERVER_CONNECT_END)));
+      }
+      if (server_response != 0) {
+        origin[http_origin_server_response_histogram]->record(ink_hrtime_to_usec(server_response));
+      }
+      if (milestones[TS_MILESTONE_UA_BEGIN_WRITE] != 0) {
+        origin[http_origin_ttfb_histogram]->record(
+          ink_hrtime_to_usec(milestones.elapsed(TS_MILESTONE_UA_BEGIN, TS_MILESTONE_UA_BEGIN_WRITE)));
+      }
+      if (milestones[TS_MILESTONE_UA_CLOSE] != 0) {
+        origin[http_origin_total_histogram]->record(
+          ink_hrtime_to_usec(milestones.elapsed(TS_MILESTONE_UA_BEGIN, TS_MILESTONE_UA_CLOSE)));
+      }
+    }
+  }
 }
 
 void
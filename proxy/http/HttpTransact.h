@@ -758,6 +758,9 @@ public:
     bool is_websocket        = false;
     bool did_upgrade_succeed = false;
 
+    // The client request came in TLS early data, before the handshake completed
+    bool early_data = false;
+
     // Some queue info
     bool origin_request_queued = false;
 
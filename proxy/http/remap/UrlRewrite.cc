@@ -28,6 +28,9 @@
 #include "RemapConfig.h"
 #include "ts/I_Layout.h"
 #include "HttpSM.h"
+#include "ts/TestBox.h"
+
+#include <fstream>
 
 #define modulePrefix "[ReverseProxy]"
 
@@ -591,6 +594,8 @@ UrlRewrite::_addToStore(MappingsStore &store, url_mapping *new_mapping, RegexMap
   new_mapping->setRank(count); // Use the mapping rules number count for rank
   if (is_cur_mapping_regex) {
     store.regex_list.enqueue(reg_map);
+    store.regex_index.push_back(reg_map);
+    store.regex_prefilter.add(src_host);
     retval = true;
   } else {
     retval = TableInsert(store.hash_lookup, new_mapping, src_host);
@@ -726,6 +731,11 @@ UrlRewrite::BuildTable(const char *path)
     forward_mappings_with_recv_port.hash_lookup = ink_hash_table_destroy(forward_mappings_with_recv_port.hash_lookup);
   }
 
+  for (MappingsStore *store : {&forward_mappings, &reverse_mappings, &permanent_redirects, &temporary_redirects,
+                               &forward_mappings_with_recv_port}) {
+    store->regex_prefilter.build();
+  }
+
   return 0;
 }
 
@@ -795,7 +805,7 @@ UrlRewrite::_mappingLookup(MappingsStore &mappings, URL *request_url, int reques
     mapping_container.set(mapping);
     retval = true;
   }
-  if (_regexMappingLookup(mappings.regex_list, request_url, request_port, request_host_lower, request_host_len, rank_ceiling,
+  if (_regexMappingLookup(mappings, request_url, request_port, request_host_lower, request_host_len, rank_ceiling,
                           mapping_container)) {
     Debug("url_rewrite", "Using regex mapping with rank %d", (mapping_container.getMapping())->getRank());
     retval = true;
@@ -852,7 +862,7 @@ lOverFlow:
 }
 
 bool
-UrlRewrite::_regexMappingLookup(RegexMappingList &regex_mappings, URL *request_url, int request_port, const char *request_host,
+UrlRewrite::_regexMappingLookup(MappingsStore &mappings, URL *request_url, int request_port, const char *request_host,
                                 int request_host_len, int rank_ceiling, UrlMappingContainer &mapping_container)
 {
   bool retval = false;
@@ -877,10 +887,15 @@ UrlRewrite::_regexMappingLookup(RegexMappingList &regex_mappings, URL *request_u
     request_scheme_len = hdrtoken_wks_to_length(request_scheme);
   }
 
-  // Loop over the entire linked list, or until we're satisfied
-  forl_LL(RegexMapping, list_iter, regex_mappings)
-  {
-    int reg_map_rank = list_iter->url_map->getRank();
+  // Only the mappings whose host regex literals are in the request host can match, in the order of their ranks.
+  std::vector<int> candidates;
+  mappings.regex_prefilter.candidates(request_host, request_host_len, candidates);
+  Debug("url_rewrite_regex", "%zu of %zu regexes may match the request host", candidates.size(), mappings.regex_index.size());
+
+  // Loop over the candidates, or until we're satisfied
+  for (int candidate : candidates) {
+    RegexMapping *list_iter = mappings.regex_index[candidate];
+    int reg_map_rank        = list_iter->url_map->getRank();
 
     if (reg_map_rank > rank_ceiling) {
       break;
@@ -952,3 +967,90 @@ UrlRewrite::_destroyList(RegexMappingList &mappings)
   }
   mappings.clear();
 }
+
+REGRESSION_TEST(UrlRewriteRegexBenchmark)(RegressionTest *t, int level, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // This is a benchmark, only run it when asked for (traffic_server -R 3 -r UrlRewriteRegexBenchmark).
+  if (REGRESSION_TEST_EXTENDED > level) {
+    return;
+  }
+
+  static const int LOOKUPS = 2000;
+  char saved[PATH_NAME_MAX] = "";
+  char path[]               = "/tmp/remap_benchmark.XXXXXX";
+  int fd                    = mkstemp(path);
+
+  if (!box.check(fd >= 0, "temporary remap.config")) {
+    return;
+  }
+  close(fd);
+  RecGetRecordString("proxy.config.url_remap.filename", saved, sizeof(saved));
+  RecSetRecordString("proxy.config.url_remap.filename", path, REC_SOURCE_EXPLICIT);
+
+  for (int rules : {100, 1000, 4000, 10000}) {
+    // A rule for each tenant, all of them under the same domain.
+    std::ofstream config(path, std::ios::trunc);
+    for (int i = 0; i < rules; ++i) {
+      config << "regex_map http://^tenant" << i << "\\.([a-z0-9]+)\\.example\\.com$/ http://$1.origin" << i << ".example.net/\n";
+    }
+    config.close();
+
+    UrlRewrite *rewrite = new UrlRewrite();
+    if (!box.check(rewrite->is_valid() && rewrite->num_rules_forward == rules, "%d rules loaded", rules)) {
+      delete rewrite;
+      break;
+    }
+
+    std::string hosts[] = {"tenant0.www.example.com", "tenant" + std::to_string(rules - 1) + ".www.example.com",
+                           "unknown.www.example.com"};
+    std::string to[]    = {"www.origin0.example.net", "www.origin" + std::to_string(rules - 1) + ".example.net", ""};
+    const char *what[]  = {"first", "last", "miss"};
+
+    for (int h = 0; h < 3; ++h) {
+      std::string url_string = "http://" + hosts[h] + "/";
+      URL url;
+      url.create(nullptr);
+      url.parse(url_string.c_str(), url_string.size());
+
+      int found        = 0;
+      std::string mapped;
+      ink_hrtime start = ink_get_hrtime_internal();
+      for (int i = 0; i < LOOKUPS; ++i) {
+        UrlMappingContainer container;
+        if (rewrite->forwardMappingLookup(&url, 80, hosts[h].data(), hosts[h].size(), container)) {
+          int length;
+          const char *host = container.getToURL()->host_get(&length);
+          mapped.assign(host, length);
+          ++found;
+        }
+      }
+      double prefiltered = static_cast<double>(ink_get_hrtime_internal() - start) / LOOKUPS;
+
+      // The regexes one after the other, as the lookup did without the prefilter.
+      start = ink_get_hrtime_internal();
+      for (int i = 0; i < LOOKUPS; ++i) {
+        int matches[UrlRewrite::MAX_REGEX_SUBS * 3];
+        forl_LL(UrlRewrite::RegexMapping, reg_map, rewrite->forward_mappings.regex_list)
+        {
+          if (reg_map->regular_expression.exec(hosts[h].data(), hosts[h].size(), matches, countof(matches))) {
+            break;
+          }
+        }
+      }
+      double sequential = static_cast<double>(ink_get_hrtime_internal() - start) / LOOKUPS;
+
+      box.check(found == (h < 2 ? LOOKUPS : 0), "%d rules, %s: %d of %d lookups found a mapping", rules, what[h], found, LOOKUPS);
+      box.check(mapped == to[h], "%d rules, %s: mapped to \"%s\"", rules, what[h], mapped.c_str());
+      rprintf(t, "%5d rules, %-5s: %8.0f ns per lookup, %8.0f ns sequential\n", rules, what[h], prefiltered, sequential);
+      url.destroy();
+    }
+
+    delete rewrite;
+  }
+
+  RecSetRecordString("proxy.config.url_remap.filename", saved, REC_SOURCE_EXPLICIT);
+  unlink(path);
+}
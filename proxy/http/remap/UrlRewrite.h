@@ -28,6 +28,8 @@
 #include "HttpTransact.h"
 #include "ts/Regex.h"
 
+#include <vector>
+
 #define URL_REMAP_FILTER_NONE 0x00000000
 #define URL_REMAP_FILTER_REFERER 0x00000001      /* enable "referer" header validation */
 #define URL_REMAP_FILTER_REDIRECT_FMT 0x00010000 /* enable redirect URL formatting */
@@ -116,6 +118,9 @@ public:
   struct MappingsStore {
     InkHashTable *hash_lookup;
     RegexMappingList regex_list;
+    // The regex mappings by rank, and the literals of their host regexes.
+    std::vector<RegexMapping *> regex_index;
+    RegexPrefilter regex_prefilter;
     bool
     empty()
     {
@@ -132,6 +137,7 @@ public:
   {
     _destroyTable(store.hash_lookup);
     _destroyList(store.regex_list);
+    store.regex_index.clear();
   }
 
   bool InsertForwardMapping(mapping_type maptype, url_mapping *mapping, const char *src_host);
@@ -199,7 +205,7 @@ private:
   bool _mappingLookup(MappingsStore &mappings, URL *request_url, int request_port, const char *request_host, int request_host_len,
                       UrlMappingContainer &mapping_container);
   url_mapping *_tableLookup(InkHashTable *h_table, URL *request_url, int request_port, char *request_host, int request_host_len);
-  bool _regexMappingLookup(RegexMappingList &regex_mappings, URL *request_url, int request_port, const char *request_host,
+  bool _regexMappingLookup(MappingsStore &mappings, URL *request_url, int request_port, const char *request_host,
                            int request_host_len, int rank_ceiling, UrlMappingContainer &mapping_container);
   int _expandSubstitutions(int *matches_info, const RegexMapping *reg_map, const char *matched_string, char *dest_buf,
                            int dest_buf_size);
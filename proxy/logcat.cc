@@ -30,6 +30,7 @@
 #define MAX_LOGBUFFER_SIZE 65536
 
 #include <poll.h>
+#include <memory>
 
 #include "LogStandalone.cc"
 
@@ -42,6 +43,7 @@
 #include "LogObject.h"
 #include "LogConfig.h"
 #include "LogBuffer.h"
+#include "LogColumnar.h"
 #include "LogUtils.h"
 #include "LogSock.h"
 #include "Log.h"
@@ -117,7 +119,7 @@ follow_rotate(const char *input_file, ino_t old_inode_num)
 }
 
 static int
-process_file(int in_fd, int out_fd)
+process_file(LogFileReader &in, int out_fd)
 {
   char buffer[MAX_LOGBUFFER_SIZE];
   int nread, buffer_bytes;
@@ -136,14 +138,15 @@ process_file(int in_fd, int out_fd)
     unsigned header_size     = sizeof(LogBufferHeader);
     LogBufferHeader *header  = (LogBufferHeader *)&buffer[0];
 
-    nread = read(in_fd, buffer, first_read_size);
+    nread = in.read(buffer, first_read_size);
     if (!nread || nread == EOF) {
+      in.clear_eof();
       return 0;
     }
 
     // ensure that this is a valid logbuffer header
     //
-    if (header->cookie != LOG_SEGMENT_COOKIE) {
+    if (header->cookie != LOG_SEGMENT_COOKIE && !LogColumnar::is_segment(header)) {
       fprintf(stderr, "Bad LogBuffer!\n");
       return 1;
     }
@@ -151,7 +154,7 @@ process_file(int in_fd, int out_fd)
     //
     unsigned second_read_size = header_size - first_read_size;
 
-    nread = read(in_fd, &buffer[first_read_size], second_read_size);
+    nread = in.read(&buffer[first_read_size], second_read_size);
     if (!nread || nread == EOF) {
       if (follow_flag) {
         return 0;
@@ -179,7 +182,7 @@ process_file(int in_fd, int out_fd)
     // Read the next full buffer (allowing for "partial" reads)
     nread = 0;
     while (nread < buffer_bytes) {
-      int rc = read(in_fd, &buffer[header_size] + nread, buffer_bytes - nread);
+      int rc = in.read(&buffer[header_size] + nread, buffer_bytes - nread);
 
       if ((rc == EOF) && (!follow_flag)) {
         fprintf(stderr, "Bad LogBuffer read!\n");
@@ -188,6 +191,8 @@ process_file(int in_fd, int out_fd)
 
       if (rc > 0) {
         nread += rc;
+      } else {
+        in.clear_eof();
       }
     }
 
@@ -199,6 +204,19 @@ process_file(int in_fd, int out_fd)
     // line
     //
     const char *alt_format = NULL;
+
+    // columnar segments are turned back into rows first
+    //
+    if (LogColumnar::is_segment(header)) {
+      static char rows[MAX_LOGBUFFER_SIZE];
+
+      if (LogColumnar::decode(header, rows, sizeof(rows)) < 0) {
+        fprintf(stderr, "Bad columnar LogBuffer!\n");
+        return 1;
+      }
+      header = (LogBufferHeader *)rows;
+    }
+
     // convert the buffer to ascii entries and place onto stdout
     //
     if (header->fmt_fieldlist()) {
@@ -343,9 +361,10 @@ main(int /* argc ATS_UNUSED */, const char *argv[])
           lseek(in_fd, 0, SEEK_END);
         }
 
+        std::unique_ptr<LogFileReader> in(new LogFileReader(in_fd));
         ino_t inode_num = get_inode_num(file_arguments[i]);
         while (true) {
-          if (process_file(in_fd, out_fd) != 0) {
+          if (process_file(*in, out_fd) != 0) {
             error = DATA_PROCESSING_ERROR;
             break;
           }
@@ -365,8 +384,10 @@ main(int /* argc ATS_UNUSED */, const char *argv[])
               } else if (fd > 0) {
                 // we got a new fd to use
                 Debug("logcat", "Detected logfile rotation. Following to new file");
+                in.reset();
                 close(in_fd);
                 in_fd = fd;
+                in.reset(new LogFileReader(in_fd));
 
                 // update the inode number for the log file
                 inode_num = get_inode_num(file_arguments[i]);
@@ -385,8 +406,9 @@ main(int /* argc ATS_UNUSED */, const char *argv[])
     // read from stdin, allow STDIN to go EOF a few times until we get synced
     //
     int tries = 3;
+    LogFileReader in(STDIN_FILENO);
     while (--tries >= 0) {
-      if (process_file(STDIN_FILENO, out_fd) != 0) {
+      if (process_file(in, out_fd) != 0) {
         tries = -1;
       }
     }
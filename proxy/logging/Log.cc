@@ -66,6 +66,7 @@ Log::LoggingMode Log::logging_mode  = LOG_MODE_NONE;
 
 // Flush thread stuff
 EventNotify *Log::preproc_notify;
+int Log::flush_threads = 1;
 EventNotify *Log::flush_notify;
 InkAtomicList *Log::flush_data_list;
 
@@ -241,6 +242,10 @@ Log::periodic_tasks(long time_now)
     //
     Log::config->log_object_manager.check_buffer_expiration(time_now);
 
+    // Publish the per object lag and drop counters
+    //
+    Log::config->log_object_manager.update_stats();
+
     // Check if we received a request to roll, and roll if so, otherwise
     // give objects a chance to roll if they need to
     //
@@ -935,6 +940,7 @@ Log::init(int flags)
     config->read_configuration_variables();
     collation_port            = config->collation_port;
     collation_preproc_threads = config->collation_preproc_threads;
+    flush_threads             = config->flush_threads;
 
     if (config_flags & STANDALONE_COLLATOR) {
       logging_mode = LOG_MODE_TRANSACTIONS;
@@ -1013,7 +1019,7 @@ Log::init_when_enabled()
 
     // create the flush thread and the collation thread
     create_threads();
-    eventProcessor.schedule_every(new PeriodicWakeup(collation_preproc_threads, 1), HRTIME_SECOND, ET_CALL);
+    eventProcessor.schedule_every(new PeriodicWakeup(collation_preproc_threads, flush_threads), HRTIME_SECOND, ET_CALL);
 
     init_status |= FULLY_INITIALIZED;
   }
@@ -1043,18 +1049,18 @@ Log::create_threads()
     eventProcessor.spawn_thread(preproc_cont, desc, stacksize);
   }
 
-  // Now, only one flush thread is supported.
-  // TODO: Enable multiple flush threads, such as
-  //       one flush thread per file.
+  // start the flush threads, each log file is written by exactly one of them
+  // (see LogFile::queue_flush_data).
   //
-  flush_notify    = new EventNotify;
-  flush_data_list = new InkAtomicList;
-
-  sprintf(desc, "Logging flush buffer list");
-  ink_atomiclist_init(flush_data_list, desc, 0);
-  Continuation *flush_cont = new LoggingFlushContinuation(0);
-  sprintf(desc, "[LOG_FLUSH]");
-  eventProcessor.spawn_thread(flush_cont, desc, stacksize);
+  flush_notify    = new EventNotify[flush_threads];
+  flush_data_list = new InkAtomicList[flush_threads];
+
+  for (int i = 0; i < flush_threads; i++) {
+    ink_atomiclist_init(&flush_data_list[i], "Logging flush buffer list", 0);
+    Continuation *flush_cont = new LoggingFlushContinuation(i);
+    sprintf(desc, "[LOG_FLUSH %d]", i);
+    eventProcessor.spawn_thread(flush_cont, desc, stacksize);
+  }
 }
 
 /*-------------------------------------------------------------------------
@@ -1261,106 +1267,170 @@ Log::preproc_thread_main(void *args)
   return nullptr;
 }
 
-void *
-Log::flush_thread_main(void * /* args ATS_UNUSED */)
-{
-  LogBuffer *logbuffer;
-  LogFlushData *fdata;
-  ink_hrtime now, last_time = 0;
-  int len, total_bytes;
-  SLL<LogFlushData, LogFlushData::Link_link> link, invert_link;
-  ProxyMutex *mutex = this_thread()->mutex.get();
+/*-------------------------------------------------------------------------
+  Log::flush_thread_main
 
-  Log::flush_notify->lock();
+  This function defines the functionality of a logging flush thread. It
+  writes out the data queued for the log files sharded to it with
+  Log::flush_queue, which gathers consecutive data for the same file into a
+  single writev(2).
+  -------------------------------------------------------------------------*/
 
-  while (true) {
-    if (unlikely(shutdown_event_system == true)) {
-      return nullptr;
-    }
-    fdata = (LogFlushData *)ink_atomiclist_popall(flush_data_list);
+static const int LOG_FLUSH_MAX_IOVECS = 64;
 
-    // invert the list
-    //
-    link.head = fdata;
-    while ((fdata = link.pop())) {
-      invert_link.push(fdata);
-    }
+// Write all of @a iov (modified), return the number of bytes written or -1 if nothing could be written.
+static int64_t
+log_flush_writev(int fd, struct iovec *iov, int iovcnt)
+{
+  int64_t written = 0;
 
-    // process each flush data
-    //
-    while ((fdata = invert_link.pop())) {
-      char *buf         = nullptr;
-      int bytes_written = 0;
-      LogFile *logfile  = fdata->m_logfile.get();
+  while (iovcnt > 0) {
+    ssize_t len = ::writev(fd, iov, iovcnt);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return written ? written : -1;
+    }
+    written += len;
+    // skip what was written, the kernel may stop anywhere
+    while (iovcnt > 0 && static_cast<size_t>(len) >= iov->iov_len) {
+      len -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + len;
+      iov->iov_len -= len;
+    }
+  }
+  return written;
+}
 
-      if (logfile->m_file_format == LOG_FILE_BINARY) {
-        logbuffer                      = (LogBuffer *)fdata->m_data;
-        LogBufferHeader *buffer_header = logbuffer->header();
+void
+Log::flush_queue(InkAtomicList *list)
+{
+  LogFlushData *fdata;
+  SLL<LogFlushData, LogFlushData::Link_link> link, invert_link;
+  ProxyMutex *mutex = this_thread()->mutex.get();
+  LogFlushData *batch[LOG_FLUSH_MAX_IOVECS];
+  struct iovec iov[LOG_FLUSH_MAX_IOVECS];
 
-        buf         = (char *)buffer_header;
-        total_bytes = buffer_header->byte_count;
+  fdata = (LogFlushData *)ink_atomiclist_popall(list);
 
-      } else if (logfile->m_file_format == LOG_FILE_ASCII || logfile->m_file_format == LOG_FILE_PIPE) {
-        buf         = (char *)fdata->m_data;
-        total_bytes = fdata->m_len;
+  // invert the list
+  //
+  link.head = fdata;
+  while ((fdata = link.pop())) {
+    invert_link.push(fdata);
+  }
 
+  // process the flush data, a batch of consecutive entries for one file at a time
+  //
+  while ((fdata = invert_link.pop())) {
+    LogFile *logfile    = fdata->m_logfile.get();
+    int64_t total_bytes = 0;
+    int n               = 0;
+
+    do {
+      if (logfile->m_file_format == LOG_FILE_BINARY && fdata->m_len < 0) {
+        LogBufferHeader *buffer_header = ((LogBuffer *)fdata->m_data)->header();
+
+        iov[n].iov_base = buffer_header;
+        iov[n].iov_len  = buffer_header->byte_count;
+      } else if (logfile->m_file_format == LOG_FILE_BINARY || logfile->m_file_format == LOG_FILE_ASCII ||
+                 logfile->m_file_format == LOG_FILE_PIPE) {
+        // columnar segments and ascii data
+        iov[n].iov_base = fdata->m_data;
+        iov[n].iov_len  = fdata->m_len;
       } else {
         ink_release_assert(!"Unknown file format type!");
       }
-
-      // make sure we're open & ready to write
-      logfile->check_fd();
-      if (!logfile->is_open()) {
-        Warning("File:%s was closed, have dropped (%d) bytes.", logfile->get_name(), total_bytes);
-
-        RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_bytes_lost_before_written_to_disk_stat, total_bytes);
-        delete fdata;
-        continue;
-      }
-
+      total_bytes += iov[n].iov_len;
+      batch[n++] = fdata;
+      // pipes get one record per write, see LogFile::write_ascii_logbuffer3
+    } while (n < LOG_FLUSH_MAX_IOVECS && logfile->m_file_format != LOG_FILE_PIPE && invert_link.head &&
+             invert_link.head->m_logfile.get() == logfile && (fdata = invert_link.pop()));
+
+    int64_t bytes_written = 0;
+    int64_t disk_bytes    = 0; // differs from bytes_written for compressed files
+
+    // make sure we're open & ready to write, a roll has to wait for the write
+    ink_mutex_acquire(&logfile->m_write_mutex);
+    logfile->check_fd();
+    if (!logfile->is_open()) {
+      Warning("File:%s was closed, have dropped (%" PRId64 ") bytes.", logfile->get_name(), total_bytes);
+    } else if (Log::config->logging_space_exhausted) {
+      Debug("log", "logging space exhausted, failed to write file:%s, have dropped (%" PRId64 ") bytes.", logfile->get_name(),
+            total_bytes);
+    } else {
       int logfilefd = logfile->get_fd();
       // This should always be true because we just checked it.
       ink_assert(logfilefd >= 0);
 
-      // write *all* data to target file as much as possible
-      //
-      while (total_bytes - bytes_written) {
-        if (Log::config->logging_space_exhausted) {
-          Debug("log", "logging space exhausted, failed to write file:%s, have dropped (%d) bytes.", logfile->get_name(),
-                (total_bytes - bytes_written));
-
-          RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_bytes_lost_before_written_to_disk_stat,
-                         total_bytes - bytes_written);
-          break;
+      if (logfile->is_compressed()) {
+        // the whole batch becomes one gzip member, it is either all there or lost
+        disk_bytes = LogFile::write_compressed(logfilefd, iov, n);
+        if (disk_bytes < 0) {
+          Error("Failed to write compressed log to %s: [tried %" PRId64 ", %s]", logfile->get_name(), total_bytes, strerror(errno));
+          disk_bytes = 0;
+        } else {
+          bytes_written = total_bytes;
+        }
+      } else {
+        bytes_written = log_flush_writev(logfilefd, iov, n);
+        if (bytes_written < total_bytes) {
+          Error("Failed to write log to %s: [tried %" PRId64 ", wrote %" PRId64 ", %s]", logfile->get_name(), total_bytes,
+                std::max<int64_t>(bytes_written, 0), strerror(errno));
+          bytes_written = std::max<int64_t>(bytes_written, 0);
         }
+        disk_bytes = bytes_written;
+      }
+      Debug("log", "Successfully wrote some stuff to %s", logfile->get_name());
+    }
+    ink_mutex_release(&logfile->m_write_mutex);
 
-        len = ::write(logfilefd, &buf[bytes_written], total_bytes - bytes_written);
+    if (bytes_written < total_bytes) {
+      RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_bytes_lost_before_written_to_disk_stat, total_bytes - bytes_written);
+      ink_atomic_increment(&logfile->m_bytes_dropped, total_bytes - bytes_written);
+    }
+    RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_bytes_written_to_disk_stat, disk_bytes);
 
-        if (len < 0) {
-          Error("Failed to write log to %s: [tried %d, wrote %d, %s]", logfile->get_name(), total_bytes - bytes_written,
-                bytes_written, strerror(errno));
+    if (logfile->m_log) {
+      ink_atomic_increment(&logfile->m_log->m_bytes_written, disk_bytes);
+    }
 
-          RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_bytes_lost_before_written_to_disk_stat,
-                         total_bytes - bytes_written);
-          break;
-        }
-        Debug("log", "Successfully wrote some stuff to %s", logfile->get_name());
-        bytes_written += len;
-      }
+    // the oldest entry of the batch has waited the longest, periodic_tasks() takes the maximum concurrently
+    ink_hrtime lag  = ink_get_hrtime_internal() - batch[0]->m_queued;
+    ink_hrtime seen = logfile->m_max_flush_lag;
+    while (lag > seen && !ink_atomic_cas(&logfile->m_max_flush_lag, seen, lag)) {
+      seen = logfile->m_max_flush_lag;
+    }
 
-      RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_bytes_written_to_disk_stat, bytes_written);
+    for (int i = 0; i < n; ++i) {
+      delete batch[i];
+    }
+  }
+}
 
-      if (logfile->m_log) {
-        ink_atomic_increment(&logfile->m_log->m_bytes_written, bytes_written);
-      }
+void *
+Log::flush_thread_main(void *args)
+{
+  int idx = *(int *)args;
+  ink_hrtime now, last_time = 0;
+
+  Log::flush_notify[idx].lock();
 
-      delete fdata;
+  while (true) {
+    if (unlikely(shutdown_event_system == true)) {
+      return nullptr;
     }
+    flush_queue(&flush_data_list[idx]);
 
-    // Time to work on periodic events??
+    // Time to work on periodic events?? They run on the first flush thread only.
     //
     now = Thread::get_hrtime() / HRTIME_SECOND;
-    if (now >= last_time + periodic_tasks_interval) {
+    if (idx == 0 && now >= last_time + periodic_tasks_interval) {
       Debug("log-preproc", "periodic tasks for %" PRId64, (int64_t)now);
       periodic_tasks(now);
       last_time = Thread::get_hrtime() / HRTIME_SECOND;
@@ -1370,11 +1440,11 @@ Log::flush_thread_main(void * /* args ATS_UNUSED */)
     // check the queue and find there is nothing to do, then wait
     // again.
     //
-    Log::flush_notify->wait();
+    Log::flush_notify[idx].wait();
   }
 
   /* NOTREACHED */
-  Log::flush_notify->unlock();
+  Log::flush_notify[idx].unlock();
   return nullptr;
 }
 
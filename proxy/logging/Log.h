@@ -81,14 +81,23 @@ public:
   LogBuffer *logbuffer = nullptr;
   void *m_data;
   int m_len;
+  ink_hrtime m_queued; // when the data was handed to the flush thread
 
-  LogFlushData(LogFile *logfile, void *data, int len = -1) : m_logfile(logfile), m_data(data), m_len(len) {}
+  LogFlushData(LogFile *logfile, void *data, int len = -1)
+    : m_logfile(logfile), m_data(data), m_len(len), m_queued(ink_get_hrtime_internal())
+  {
+  }
   ~LogFlushData()
   {
     switch (m_logfile->m_file_format) {
     case LOG_FILE_BINARY:
-      logbuffer = (LogBuffer *)m_data;
-      LogBuffer::destroy(logbuffer);
+      // a LogBuffer, unless it was converted to a columnar segment
+      if (m_len < 0) {
+        logbuffer = (LogBuffer *)m_data;
+        LogBuffer::destroy(logbuffer);
+      } else {
+        ats_free(m_data);
+      }
       break;
     case LOG_FILE_ASCII:
     case LOG_FILE_PIPE:
@@ -200,9 +209,11 @@ public:
   // logging thread stuff
   static EventNotify *preproc_notify;
   static void *preproc_thread_main(void *args);
-  static EventNotify *flush_notify;
-  static InkAtomicList *flush_data_list;
+  static int flush_threads;
+  static EventNotify *flush_notify;      // one per flush thread
+  static InkAtomicList *flush_data_list; // one per flush thread
   static void *flush_thread_main(void *args);
+  static void flush_queue(InkAtomicList *list); // write out the data queued on @a list
 
   // collation thread stuff
   static EventNotify collate_notify;
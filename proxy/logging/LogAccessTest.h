@@ -43,6 +43,12 @@ public:
   {
   }
 
+  LogEntryType
+  entry_type() const override
+  {
+    return LOG_ENTRY_HTTP;
+  }
+
   //
   // client -> proxy fields
   //
@@ -24,6 +24,7 @@
 #include "LogBindings.h"
 #include "LogFormat.h"
 #include "LogFilter.h"
+#include "LogSampler.h"
 #include "LogObject.h"
 #include "LogConfig.h"
 
@@ -72,6 +73,91 @@ refcount_object_get(lua_State *L, int index, const char *type_name)
   return dynamic_cast<T *>(*ptr);
 }
 
+// Samplers are not reference counted. The Lua state owns the samplers it creates and log objects get copies.
+static int
+sampler_object_new(lua_State *L, LogSampler *sampler)
+{
+  LogSampler **ptr = (LogSampler **)lua_newuserdata(L, sizeof(LogSampler *));
+
+  *ptr = sampler;
+  luaL_getmetatable(L, "log.sampler");
+  lua_setmetatable(L, -2);
+
+  // Leave the userdata on the stack.
+  return 1;
+}
+
+static LogSampler *
+sampler_object_get(lua_State *L, int index)
+{
+  LogSampler **ptr;
+
+  ptr = (LogSampler **)luaL_checkudata(L, index, "log.sampler");
+  if (!ptr) {
+    luaL_typerror(L, index, "log.sampler");
+    return nullptr; // Not reached, since luaL_typerror throws.
+  }
+
+  return *ptr;
+}
+
+static int
+sampler_object_gc(lua_State *L)
+{
+  LogSampler **ptr = (LogSampler **)lua_touserdata(L, -1);
+
+  delete *ptr;
+  *ptr = nullptr;
+  return 0;
+}
+
+static int
+create_sampler_object(lua_State *L, const char *name, LogSampler::Mode mode, const char *size_key)
+{
+  lua_Integer n;
+  lua_Integer interval;
+  lua_Integer burst;
+  const char *condition;
+  const char *key;
+  LogSampler *sampler;
+
+  BindingInstance::typecheck(L, name, LUA_TTABLE, LUA_TNONE);
+  n         = lua_getfield<lua_Integer>(L, -1, size_key, 0);
+  interval  = lua_getfield<lua_Integer>(L, -1, "IntervalSec", 0);
+  burst     = lua_getfield<lua_Integer>(L, -1, "Burst", 0);
+  condition = lua_getfield<const char *>(L, -1, "Condition", nullptr);
+  key       = lua_getfield<const char *>(L, -1, "Key", nullptr);
+
+  if (n <= 0) {
+    return (luaL_error(L, "missing or invalid '%s' argument", size_key));
+  }
+
+  sampler = LogSampler::create(mode, n, condition, key, interval, burst);
+  if (sampler == nullptr) {
+    return (luaL_error(L, "invalid 'Condition' or 'Key' argument"));
+  }
+
+  return sampler_object_new(L, sampler);
+}
+
+static int
+create_every_sampler_object(lua_State *L)
+{
+  return create_sampler_object(L, "sample.every", LogSampler::EVERY, "Ratio");
+}
+
+static int
+create_reservoir_sampler_object(lua_State *L)
+{
+  return create_sampler_object(L, "sample.reservoir", LogSampler::RESERVOIR, "Size");
+}
+
+static int
+create_rate_sampler_object(lua_State *L)
+{
+  return create_sampler_object(L, "sample.rate", LogSampler::RATE, "Rate");
+}
+
 static int
 create_format_object(lua_State *L)
 {
@@ -281,6 +367,52 @@ log_object_add_filters(lua_State *L, LogObject *log, int value)
   return false;
 }
 
+static bool
+log_object_add_samplers(lua_State *L, LogObject *log, int value)
+{
+  // No samplers.
+  if (lua_isnil(L, value)) {
+    return true;
+  }
+
+  // A single sampler.
+  if (lua_isuserdata(L, value)) {
+    LogSampler *sampler = sampler_object_get(L, value);
+
+    if (sampler) {
+      log->add_sampler(sampler, true /* copy */);
+      return true;
+    }
+  }
+
+  // An array of samplers, the first one with a matching condition applies.
+  if (lua_istable(L, value)) {
+    lua_scoped_stack saved(L);
+    LogSampler *sampler;
+    int count = luaL_getn(L, value);
+
+    saved.push_value(value); // Push the table to -1.
+
+    for (int i = 1; i <= count; ++i) {
+      lua_rawgeti(L, -1, i); // Push the i-th element of the array.
+      sampler = sampler_object_get(L, -1);
+      if (sampler) {
+        log->add_sampler(sampler, true /* copy */);
+      }
+
+      lua_pop(L, 1); // Pop the element.
+
+      if (sampler == nullptr) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
 static int
 create_log_object(lua_State *L, const char *name, LogFileFormat which)
 {
@@ -294,15 +426,21 @@ create_log_object(lua_State *L, const char *name, LogFileFormat which)
   lua_Integer interval;
   lua_Integer offset;
   lua_Integer size;
+  const char *compression;
+  const char *layout;
+  LogFileCompression compress = LOG_FILE_COMPRESSION_NONE;
+  LogFileLayout file_layout   = LOG_FILE_LAYOUT_ROW;
 
   BindingInstance::typecheck(L, name, LUA_TTABLE, LUA_TNONE);
 
-  filename = lua_getfield<const char *>(L, -1, "Filename", nullptr);
-  header   = lua_getfield<const char *>(L, -1, "Header", nullptr);
-  rolling  = lua_getfield<lua_Integer>(L, -1, "RollingEnabled", conf->rolling_enabled);
-  interval = lua_getfield<lua_Integer>(L, -1, "RollingIntervalSec", conf->rolling_interval_sec);
-  offset   = lua_getfield<lua_Integer>(L, -1, "RollingOffsetHr", conf->rolling_offset_hr);
-  size     = lua_getfield<lua_Integer>(L, -1, "RollingSizeMb", conf->rolling_size_mb);
+  filename    = lua_getfield<const char *>(L, -1, "Filename", nullptr);
+  header      = lua_getfield<const char *>(L, -1, "Header", nullptr);
+  rolling     = lua_getfield<lua_Integer>(L, -1, "RollingEnabled", conf->rolling_enabled);
+  interval    = lua_getfield<lua_Integer>(L, -1, "RollingIntervalSec", conf->rolling_interval_sec);
+  offset      = lua_getfield<lua_Integer>(L, -1, "RollingOffsetHr", conf->rolling_offset_hr);
+  size        = lua_getfield<lua_Integer>(L, -1, "RollingSizeMb", conf->rolling_size_mb);
+  compression = lua_getfield<const char *>(L, -1, "Compression", nullptr);
+  layout      = lua_getfield<const char *>(L, -1, "Layout", nullptr);
 
   lua_pushstring(L, "Format"); // Now key is at -1 and table is at -2.
   lua_gettable(L, -2);         // Now the result is at -1.
@@ -337,8 +475,33 @@ create_log_object(lua_State *L, const char *name, LogFileFormat which)
     luaL_error(L, "invalid 'RollingEnabled' argument");
   }
 
+  if (compression == nullptr || strcasecmp(compression, "none") == 0) {
+    compress = LOG_FILE_COMPRESSION_NONE;
+  } else if (strcasecmp(compression, "gzip") == 0) {
+    compress = LOG_FILE_COMPRESSION_GZIP;
+  } else {
+    luaL_error(L, "invalid 'Compression' argument");
+  }
+
+  if (compress != LOG_FILE_COMPRESSION_NONE && which == LOG_FILE_PIPE) {
+    luaL_error(L, "'Compression' is not supported for log.pipe");
+  }
+
+  if (layout == nullptr || strcasecmp(layout, "row") == 0) {
+    file_layout = LOG_FILE_LAYOUT_ROW;
+  } else if (strcasecmp(layout, "columnar") == 0) {
+    file_layout = LOG_FILE_LAYOUT_COLUMNAR;
+  } else {
+    luaL_error(L, "invalid 'Layout' argument");
+  }
+
+  if (file_layout != LOG_FILE_LAYOUT_ROW && which != LOG_FILE_BINARY) {
+    luaL_error(L, "'Layout' is only supported for log.binary");
+  }
+
   log = new LogObject(fmt.get(), conf->logfile_dir, filename, which, header, (Log::RollingEnabledValues)rolling,
-                      conf->collation_preproc_threads, interval, offset, size);
+                      conf->collation_preproc_threads, interval, offset, size, false /* auto_created */, compress,
+                      file_layout);
 
   lua_pushstring(L, "Filters"); // Now key is at -1 and table is at -2.
   lua_gettable(L, -2);          // Now the result is at -1.
@@ -349,6 +512,15 @@ create_log_object(lua_State *L, const char *name, LogFileFormat which)
 
   lua_pop(L, 1);
 
+  lua_pushstring(L, "Sampling"); // Now key is at -1 and table is at -2.
+  lua_gettable(L, -2);           // Now the result is at -1.
+
+  if (!log_object_add_samplers(L, log.get(), -1)) {
+    luaL_error(L, "invalid 'Sampling' argument");
+  }
+
+  lua_pop(L, 1);
+
   lua_pushstring(L, "CollationHosts"); // Now key is at -1 and table is at -2.
   lua_gettable(L, -2);                 // Now the result is at -1.
 
@@ -395,6 +567,10 @@ MakeLogBindings(BindingInstance &binding, LogConfig *conf)
     {"__gc", refcount_object_gc},
     {nullptr, nullptr},
   };
+  static const luaL_reg sampler_metatable[] = {
+    {"__gc", sampler_object_gc},
+    {nullptr, nullptr},
+  };
 
   // Register the logging object API.
   binding.bind_function("log.ascii", create_ascii_log_object);
@@ -407,6 +583,10 @@ MakeLogBindings(BindingInstance &binding, LogConfig *conf)
   binding.bind_function("filter.reject", create_reject_filter_object);
   binding.bind_function("filter.wipe", create_wipe_filter_object);
 
+  binding.bind_function("sample.every", create_every_sampler_object);
+  binding.bind_function("sample.reservoir", create_reservoir_sampler_object);
+  binding.bind_function("sample.rate", create_rate_sampler_object);
+
   // 0: Do not automatically roll.
   binding.bind_constant("log.roll.none", lua_Integer(Log::NO_ROLLING));
 
@@ -434,6 +614,7 @@ MakeLogBindings(BindingInstance &binding, LogConfig *conf)
   BindingInstance::register_metatable(binding.lua, "log.filter", metatable);
   BindingInstance::register_metatable(binding.lua, "log.object", metatable);
   BindingInstance::register_metatable(binding.lua, "log.format", metatable);
+  BindingInstance::register_metatable(binding.lua, "log.sampler", sampler_metatable);
 
   // Attach the LogConfig backpointer.
   binding.attach_ptr("log.config", conf);
@@ -507,3 +688,39 @@ EXCLUSIVE_REGRESSION_TEST(LogConfig_CollationHosts)(RegressionTest *t, int /* at
 
   config.display(stderr);
 }
+
+EXCLUSIVE_REGRESSION_TEST(LogConfig_Sampling)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+
+  LogConfig config;
+  BindingInstance binding;
+
+  const char sampled[] = R"LUA(
+    log.ascii {
+      Format = "%<chi> %<pssc>",
+      Filename = "sampled",
+      Sampling = {
+        sample.every { Ratio = 100, Condition = 'pssc MATCH 200' },
+        sample.reservoir { Size = 10, Key = 'chi', IntervalSec = 10, Condition = 'pssc MATCH 304' },
+        sample.rate { Rate = 1000, Burst = 5000 },
+      }
+    }
+  )LUA";
+
+  const char invalid[] = R"LUA(
+    log.ascii {
+      Format = "%<chi>",
+      Filename = "sampled-invalid",
+      Sampling = sample.every { Ratio = 100, Condition = 'pssc' },
+    }
+  )LUA";
+
+  box = REGRESSION_TEST_PASSED;
+
+  box.check(binding.construct(), "construct Lua binding instance");
+  box.check(MakeLogBindings(binding, &config), "load Lua log configuration API");
+
+  box.check(binding.eval(sampled), "configuring samplers");
+  box.check(!binding.eval(invalid), "configuring a sampler with an invalid condition");
+}
@@ -0,0 +1,762 @@
+/** @file
+
+  Columnar layout for binary log segments.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "ts/ink_platform.h"
+#include "ts/TestBox.h"
+
+#include <string>
+#include <unordered_map>
+
+#include "LogColumnar.h"
+#include "LogField.h"
+#include "LogFormat.h"
+#include "LogAccess.h"
+#include "HTTP.h"
+
+namespace
+{
+const int64_t USEC_PER_SEC = 1000000;
+
+// Marshalled size of the IP address at @a data, without the alignment padding.
+int
+ip_len(const char *data)
+{
+  uint16_t family;
+
+  memcpy(&family, data, sizeof(family));
+  if (AF_INET == family) {
+    return sizeof(LogFieldIp4);
+  } else if (AF_INET6 == family) {
+    return sizeof(LogFieldIp6);
+  }
+  return sizeof(LogFieldIp);
+}
+
+void
+put_varint(std::vector<unsigned char> &out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back(static_cast<unsigned char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<unsigned char>(value));
+}
+
+void
+put_delta(std::vector<unsigned char> &out, uint64_t &prev, int64_t value)
+{
+  // unsigned arithmetic, so overflowing deltas wrap instead of being undefined
+  uint64_t delta = static_cast<uint64_t>(value) - prev;
+
+  prev = static_cast<uint64_t>(value);
+  put_varint(out, (delta << 1) ^ (0 - (delta >> 63)));
+}
+
+struct StrHash {
+  size_t
+  operator()(const char *s) const
+  {
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+
+    for (; *s; ++s) {
+      hash = (hash ^ static_cast<unsigned char>(*s)) * 16777619U;
+    }
+    return hash;
+  }
+};
+
+struct StrEqual {
+  bool
+  operator()(const char *lhs, const char *rhs) const
+  {
+    return strcmp(lhs, rhs) == 0;
+  }
+};
+
+// Field types of a format, by the symbol string in the buffer header. The
+// formats don't change often, so each thread keeps the ones it has seen.
+const std::vector<int> &
+field_types(const char *fieldlist)
+{
+  static thread_local std::unordered_map<std::string, std::vector<int>> cache;
+
+  auto spot = cache.find(fieldlist);
+  if (spot == cache.end()) {
+    LogFieldList list;
+    bool has_aggregates = false;
+    std::vector<int> types;
+
+    LogFormat::parse_symbol_string(fieldlist, &list, &has_aggregates);
+    for (LogField *field = list.first(); field; field = list.next(field)) {
+      types.push_back(field->type());
+    }
+    spot = cache.emplace(fieldlist, std::move(types)).first;
+  }
+  return spot->second;
+}
+
+void
+encode_strings(std::vector<unsigned char> &out, const std::vector<const char *> &values, uint32_t &encoding)
+{
+  static thread_local std::unordered_map<const char *, uint32_t, StrHash, StrEqual> dict;
+  static thread_local std::vector<const char *> order;
+  static thread_local std::vector<uint32_t> index;
+
+  // A dictionary only pays off if the values repeat. Mostly unique columns
+  // (URLs) show that in the first few entries, give up on them early and
+  // on the others as soon as there are too many distinct values.
+  const size_t SAMPLE = 64;
+  size_t max_distinct = values.size() / 2;
+
+  dict.clear();
+  order.clear();
+  index.clear();
+  for (size_t i = 0; i < values.size(); ++i) {
+    // runs of the same value are common, skip the lookup for them
+    if (i > 0 && strcmp(values[i], values[i - 1]) == 0) {
+      index.push_back(index.back());
+      continue;
+    }
+    auto spot = dict.emplace(values[i], order.size());
+    if (spot.second) {
+      order.push_back(values[i]);
+      if (order.size() > max_distinct || (i < SAMPLE && order.size() > SAMPLE / 2)) {
+        max_distinct = 0;
+        break;
+      }
+    }
+    index.push_back(spot.first->second);
+  }
+
+  if (order.size() > max_distinct) {
+    encoding = LogColumn::PLAIN;
+    for (const char *value : values) {
+      out.insert(out.end(), value, value + ::strlen(value) + 1);
+    }
+  } else {
+    encoding = LogColumn::DICT;
+    put_varint(out, order.size());
+    for (const char *value : order) {
+      out.insert(out.end(), value, value + ::strlen(value) + 1);
+    }
+    for (uint32_t idx : index) {
+      put_varint(out, idx);
+    }
+  }
+}
+
+// Copy a header string the way LogBuffer::_add_buffer_header does.
+uint32_t
+add_header_str(char *buf, int len, int &offset, const char *str)
+{
+  uint32_t str_offset = 0;
+
+  if (str) {
+    int str_len = ::strlen(str) + 1;
+    if (offset + str_len <= len) {
+      memcpy(buf + offset, str, str_len);
+      str_offset = offset;
+    }
+    offset += str_len;
+  }
+  return str_offset;
+}
+
+} // namespace
+
+/*-------------------------------------------------------------------------
+  LogColumnReader
+  -------------------------------------------------------------------------*/
+
+bool
+LogColumnReader::init(LogBufferHeader *segment, int column)
+{
+  const char *base           = reinterpret_cast<const char *>(segment);
+  const LogColumnarHeader *h = reinterpret_cast<const LogColumnarHeader *>(base + segment->data_offset);
+  const LogColumn *col       = reinterpret_cast<const LogColumn *>(h + 1);
+
+  m_type = -1;
+  m_dict.clear();
+
+  if (!LogColumnar::is_segment(segment) || segment->data_offset + sizeof(*h) > segment->byte_count ||
+      h->version != LOG_COLUMNAR_VERSION || column < 0 || static_cast<uint32_t>(column) >= h->column_count ||
+      segment->data_offset + sizeof(*h) + h->column_count * sizeof(LogColumn) > segment->byte_count) {
+    return false;
+  }
+  col += column;
+  if (col->offset > segment->byte_count || col->length > segment->byte_count - col->offset) {
+    return false;
+  }
+
+  m_encoding = col->encoding;
+  m_cur      = reinterpret_cast<const unsigned char *>(base + col->offset);
+  m_end      = m_cur + col->length;
+  m_prev     = 0;
+
+  if (m_encoding == LogColumn::DICT) {
+    uint64_t count;
+
+    if (!read_varint(&count) || count > col->length) {
+      return false;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+      const unsigned char *nul = static_cast<const unsigned char *>(memchr(m_cur, 0, m_end - m_cur));
+      if (nul == nullptr) {
+        return false;
+      }
+      m_dict.push_back(reinterpret_cast<const char *>(m_cur));
+      m_cur = nul + 1;
+    }
+  }
+
+  m_type = col->type;
+  return true;
+}
+
+bool
+LogColumnReader::read_varint(uint64_t *value)
+{
+  uint64_t v = 0;
+
+  for (int shift = 0; m_cur < m_end && shift < 64; shift += 7) {
+    unsigned char c = *m_cur++;
+
+    v |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      *value = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+LogColumnReader::next_int(int64_t *value)
+{
+  uint64_t zigzag;
+
+  if (m_encoding != LogColumn::DELTA || !read_varint(&zigzag)) {
+    return false;
+  }
+  m_prev += (zigzag >> 1) ^ (0 - (zigzag & 1));
+  *value = static_cast<int64_t>(m_prev);
+  return true;
+}
+
+const char *
+LogColumnReader::next_str()
+{
+  if (m_encoding == LogColumn::DICT) {
+    uint64_t idx;
+
+    if (!read_varint(&idx) || idx >= m_dict.size()) {
+      return nullptr;
+    }
+    return m_dict[idx];
+  } else if (m_encoding == LogColumn::PLAIN && m_type == LogField::STRING) {
+    const unsigned char *nul = static_cast<const unsigned char *>(memchr(m_cur, 0, m_end - m_cur));
+    const char *value        = reinterpret_cast<const char *>(m_cur);
+
+    if (nul == nullptr) {
+      return nullptr;
+    }
+    m_cur = nul + 1;
+    return value;
+  }
+  return nullptr;
+}
+
+const char *
+LogColumnReader::next_ip(int *len)
+{
+  const char *value = reinterpret_cast<const char *>(m_cur);
+
+  if (m_type != LogField::IP || m_end - m_cur < static_cast<ptrdiff_t>(sizeof(LogFieldIp))) {
+    return nullptr;
+  }
+  *len = ip_len(value);
+  if (m_end - m_cur < *len) {
+    return nullptr;
+  }
+  m_cur += *len;
+  return value;
+}
+
+/*-------------------------------------------------------------------------
+  LogColumnar::encode
+
+  This runs on the thread that hands the buffer to the LogFile, so the
+  flush threads only write out the (smaller) result.
+  -------------------------------------------------------------------------*/
+
+char *
+LogColumnar::encode(LogBufferHeader *rows, int *len)
+{
+  static thread_local std::vector<std::vector<unsigned char>> columns;
+  static thread_local std::vector<std::vector<const char *>> strings;
+  static thread_local std::vector<uint64_t> prev;
+
+  if (rows->cookie != LOG_SEGMENT_COOKIE || rows->format_type != LOG_FORMAT_CUSTOM || rows->entry_count == 0 ||
+      rows->fmt_fieldlist() == nullptr) {
+    return nullptr;
+  }
+
+  const std::vector<int> &types = field_types(rows->fmt_fieldlist());
+  size_t ncols                  = types.size() + 1;
+  uint32_t row_bytes            = rows->data_offset;
+  LogBufferIterator iter(rows);
+  LogEntryHeader *entry;
+
+  if (types.empty()) {
+    return nullptr;
+  }
+
+  columns.resize(ncols);
+  strings.resize(ncols);
+  for (size_t c = 0; c < ncols; ++c) {
+    columns[c].clear();
+    strings[c].clear();
+  }
+  prev.assign(ncols, 0);
+
+  while ((entry = iter.next())) {
+    char *read_from = reinterpret_cast<char *>(entry) + sizeof(LogEntryHeader);
+    char *end       = reinterpret_cast<char *>(entry) + entry->entry_len;
+
+    put_delta(columns[0], prev[0], entry->timestamp * USEC_PER_SEC + entry->timestamp_usec);
+    for (size_t c = 1; c < ncols; ++c) {
+      if (read_from >= end) {
+        return nullptr; // doesn't match the format, leave it alone
+      }
+      switch (types[c - 1]) {
+      case LogField::sINT:
+      case LogField::dINT: {
+        int64_t value;
+        memcpy(&value, read_from, sizeof(value));
+        put_delta(columns[c], prev[c], value);
+        read_from += INK_MIN_ALIGN;
+        break;
+      }
+      case LogField::STRING:
+        strings[c].push_back(read_from);
+        read_from += LogAccess::strlen(read_from);
+        break;
+      case LogField::IP: {
+        int ip = ip_len(read_from);
+        columns[c].insert(columns[c].end(), read_from, read_from + ip);
+        read_from += INK_ALIGN_DEFAULT(ip);
+        break;
+      }
+      default:
+        return nullptr;
+      }
+    }
+    if (read_from > end) {
+      return nullptr;
+    }
+    row_bytes += read_from - reinterpret_cast<char *>(entry);
+  }
+
+  size_t dir_offset  = rows->data_offset + sizeof(LogColumnarHeader);
+  size_t data_offset = dir_offset + ncols * sizeof(LogColumn);
+  std::vector<LogColumn> dir(ncols);
+
+  dir[0].type     = LogColumn::TIMESTAMP;
+  dir[0].encoding = LogColumn::DELTA;
+  for (size_t c = 1; c < ncols; ++c) {
+    dir[c].type     = types[c - 1];
+    dir[c].encoding = types[c - 1] == LogField::IP ? LogColumn::PLAIN : LogColumn::DELTA;
+    if (types[c - 1] == LogField::STRING) {
+      encode_strings(columns[c], strings[c], dir[c].encoding);
+    }
+  }
+
+  size_t total = data_offset;
+  for (size_t c = 0; c < ncols; ++c) {
+    dir[c].offset = total;
+    dir[c].length = columns[c].size();
+    total += columns[c].size();
+  }
+
+  char *segment             = static_cast<char *>(ats_malloc(total));
+  LogBufferHeader *header   = reinterpret_cast<LogBufferHeader *>(segment);
+  LogColumnarHeader *colhdr = reinterpret_cast<LogColumnarHeader *>(segment + rows->data_offset);
+
+  memcpy(segment, rows, rows->data_offset);
+  header->cookie       = LOG_COLUMNAR_SEGMENT_COOKIE;
+  header->byte_count   = total;
+  colhdr->version      = LOG_COLUMNAR_VERSION;
+  colhdr->column_count = ncols;
+  colhdr->row_bytes    = row_bytes;
+  colhdr->reserved     = 0;
+  memcpy(segment + dir_offset, dir.data(), ncols * sizeof(LogColumn));
+  for (size_t c = 0; c < ncols; ++c) {
+    if (!columns[c].empty()) {
+      memcpy(segment + dir[c].offset, columns[c].data(), columns[c].size());
+    }
+  }
+
+  *len = total;
+  return segment;
+}
+
+/*-------------------------------------------------------------------------
+  LogColumnar::find_column
+  -------------------------------------------------------------------------*/
+
+int
+LogColumnar::find_column(LogBufferHeader *segment, const char *symbol)
+{
+  const char *fieldlist = segment->fmt_fieldlist();
+  size_t len            = ::strlen(symbol);
+  int column            = 1;
+
+  if (fieldlist == nullptr) {
+    return -1;
+  }
+  for (const char *sym = fieldlist; *sym; ++column) {
+    const char *comma = strchr(sym, ',');
+    size_t sym_len    = comma ? comma - sym : ::strlen(sym);
+
+    if (sym_len == len && memcmp(sym, symbol, len) == 0) {
+      return column;
+    }
+    if (comma == nullptr) {
+      break;
+    }
+    sym = comma + 1;
+  }
+  return -1;
+}
+
+/*-------------------------------------------------------------------------
+  LogColumnar::decode
+  -------------------------------------------------------------------------*/
+
+int
+LogColumnar::decode(LogBufferHeader *segment, char *buf, int len, const char *const *symbols, int nsymbols)
+{
+  const char *base                = reinterpret_cast<char *>(segment);
+  const LogColumnarHeader *colhdr = reinterpret_cast<const LogColumnarHeader *>(base + segment->data_offset);
+  LogColumnReader timestamps;
+
+  if (!timestamps.init(segment, 0) || timestamps.type() != LogColumn::TIMESTAMP) {
+    return -1;
+  }
+
+  int nfields = symbols ? nsymbols : colhdr->column_count - 1;
+  std::vector<LogColumnReader> fields(nfields);
+
+  for (int i = 0; i < nfields; ++i) {
+    int column = symbols ? find_column(segment, symbols[i]) : i + 1;
+    if (!fields[i].init(segment, column)) {
+      return -1;
+    }
+  }
+
+  // The header strings, with the field list cut down to the decoded fields.
+  LogBufferHeader *header = reinterpret_cast<LogBufferHeader *>(buf);
+  int offset              = sizeof(LogBufferHeader);
+
+  if (len < offset) {
+    return -1;
+  }
+  memcpy(header, segment, sizeof(LogBufferHeader));
+  header->cookie = LOG_SEGMENT_COOKIE;
+  if (symbols) {
+    std::string fieldlist;
+    for (int i = 0; i < nsymbols; ++i) {
+      fieldlist += i ? "," : "";
+      fieldlist += symbols[i];
+    }
+    header->fmt_name_offset      = add_header_str(buf, len, offset, segment->fmt_name());
+    header->fmt_fieldlist_offset = add_header_str(buf, len, offset, fieldlist.c_str());
+    header->fmt_printf_offset    = add_header_str(buf, len, offset, segment->fmt_printf());
+    header->src_hostname_offset  = add_header_str(buf, len, offset, segment->src_hostname());
+    header->log_filename_offset  = add_header_str(buf, len, offset, segment->log_filename());
+    offset                       = INK_ALIGN_DEFAULT(offset);
+  } else {
+    offset = segment->data_offset;
+    if (len < offset) {
+      return -1;
+    }
+    memcpy(buf + sizeof(LogBufferHeader), base + sizeof(LogBufferHeader), offset - sizeof(LogBufferHeader));
+  }
+  if (offset > len) {
+    return -1;
+  }
+  header->data_offset = offset;
+
+  for (uint32_t n = 0; n < segment->entry_count; ++n) {
+    LogEntryHeader *entry = reinterpret_cast<LogEntryHeader *>(buf + offset);
+    int64_t timestamp;
+
+    if (offset + static_cast<int>(sizeof(LogEntryHeader)) > len || !timestamps.next_int(&timestamp)) {
+      return -1;
+    }
+    entry->timestamp      = timestamp / USEC_PER_SEC;
+    entry->timestamp_usec = timestamp % USEC_PER_SEC;
+    offset += sizeof(LogEntryHeader);
+
+    for (int i = 0; i < nfields; ++i) {
+      switch (fields[i].type()) {
+      case LogField::sINT:
+      case LogField::dINT: {
+        int64_t value;
+        if (offset + INK_MIN_ALIGN > len || !fields[i].next_int(&value)) {
+          return -1;
+        }
+        memcpy(buf + offset, &value, sizeof(value));
+        offset += INK_MIN_ALIGN;
+        break;
+      }
+      case LogField::STRING: {
+        const char *value = fields[i].next_str();
+        if (value == nullptr) {
+          return -1;
+        }
+        int str_len    = ::strlen(value) + 1;
+        int padded_len = LogAccess::strlen(value);
+        if (offset + padded_len > len) {
+          return -1;
+        }
+        memcpy(buf + offset, value, str_len);
+        memset(buf + offset + str_len, 0, padded_len - str_len);
+        offset += padded_len;
+        break;
+      }
+      case LogField::IP: {
+        int ip_len;
+        const char *value = fields[i].next_ip(&ip_len);
+        if (value == nullptr || offset + INK_ALIGN_DEFAULT(ip_len) > len) {
+          return -1;
+        }
+        memset(buf + offset, 0, INK_ALIGN_DEFAULT(ip_len));
+        memcpy(buf + offset, value, ip_len);
+        offset += INK_ALIGN_DEFAULT(ip_len);
+        break;
+      }
+      default:
+        return -1;
+      }
+    }
+    entry->entry_len = buf + offset - reinterpret_cast<char *>(entry);
+  }
+
+  header->byte_count = offset;
+  return offset;
+}
+
+#if TS_HAS_TESTS
+
+static const char COLUMNAR_TEST_FIELDS[] = "cqtq,ttms,chi,crc,pssc,psql,cqhm,cquc,caun,phr,pqsn,psct";
+
+// Lay out a binary LogBuffer of squid entries the way LogBuffer and LogAccess do.
+static int
+make_test_rows(char *buf, int len, int entries)
+{
+  LogBufferHeader *header = reinterpret_cast<LogBufferHeader *>(buf);
+  int offset              = sizeof(LogBufferHeader);
+  char printf_str[2 * 12];
+  char str[128];
+
+  for (int i = 0; i < 12; ++i) {
+    printf_str[2 * i]     = LOG_FIELD_MARKER;
+    printf_str[2 * i + 1] = ' ';
+  }
+  printf_str[2 * 12 - 1] = '\0';
+
+  memset(buf, 0, len);
+  header->cookie               = LOG_SEGMENT_COOKIE;
+  header->version              = LOG_SEGMENT_VERSION;
+  header->format_type          = LOG_FORMAT_CUSTOM;
+  header->fmt_name_offset      = add_header_str(buf, len, offset, "squid");
+  header->fmt_fieldlist_offset = add_header_str(buf, len, offset, COLUMNAR_TEST_FIELDS);
+  header->fmt_printf_offset    = add_header_str(buf, len, offset, printf_str);
+  header->log_filename_offset  = add_header_str(buf, len, offset, "squid.blog");
+  offset                       = INK_ALIGN_DEFAULT(offset);
+  header->data_offset          = offset;
+
+  auto put_int = [&](int64_t value) {
+    memcpy(buf + offset, &value, sizeof(value));
+    offset += INK_MIN_ALIGN;
+  };
+  auto put_str = [&](const char *value) {
+    memcpy(buf + offset, value, ::strlen(value) + 1);
+    offset += LogAccess::strlen(value);
+  };
+
+  for (int i = 0; i < entries; ++i) {
+    LogEntryHeader *entry = reinterpret_cast<LogEntryHeader *>(buf + offset);
+    LogFieldIp4 ip;
+
+    if (offset + 512 > len) {
+      return -1;
+    }
+    entry->timestamp      = 1500000000 + i / 10;
+    entry->timestamp_usec = (i * 7919) % 1000000;
+    offset += sizeof(LogEntryHeader);
+
+    put_int(entry->timestamp * 1000 + entry->timestamp_usec / 1000);
+    put_int(i % 97);
+    memset(&ip, 0, sizeof(ip));
+    ip._family = AF_INET;
+    ip._addr   = htonl(0x0a000000 + i % 300);
+    memcpy(buf + offset, &ip, sizeof(ip));
+    offset += INK_ALIGN_DEFAULT(sizeof(ip));
+    put_int(i % 3 ? SQUID_LOG_TCP_MISS : SQUID_LOG_TCP_HIT);
+    put_int(i % 11 ? 200 : 404);
+    put_int(1000 + i * 13);
+    put_str(i % 5 ? "GET" : "POST");
+    snprintf(str, sizeof(str), "http://origin%d.example.com/path/%d", i % 4, i);
+    put_str(str);
+    put_str("-");
+    put_int(i % 3 ? SQUID_HIER_DIRECT : SQUID_HIER_NONE);
+    snprintf(str, sizeof(str), "origin%d.example.com", i % 4);
+    put_str(str);
+    put_str(i % 2 ? "text/html" : "image/png");
+    entry->entry_len = buf + offset - reinterpret_cast<char *>(entry);
+  }
+
+  header->entry_count    = entries;
+  header->low_timestamp  = 1500000000;
+  header->high_timestamp = 1500000000 + entries / 10;
+  header->byte_count     = offset;
+  return offset;
+}
+
+REGRESSION_TEST(LogColumnar_roundtrip)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  const int len = 256 * 1024;
+  char *rows    = static_cast<char *>(ats_malloc(len));
+  char *decoded = static_cast<char *>(ats_malloc(len));
+  int rows_len  = make_test_rows(rows, len, 500);
+  char *segment;
+  int segment_len;
+
+  segment = LogColumnar::encode(reinterpret_cast<LogBufferHeader *>(rows), &segment_len);
+  box.check(segment != nullptr, "the squid entries could not be encoded");
+  if (segment == nullptr) {
+    ats_free(rows);
+    ats_free(decoded);
+    return;
+  }
+  LogBufferHeader *header = reinterpret_cast<LogBufferHeader *>(segment);
+  rprintf(t, "%d bytes of rows, %d bytes columnar\n", rows_len, segment_len);
+  box.check(LogColumnar::is_segment(header), "segment cookie not set");
+  box.check(segment_len < rows_len / 2, "columnar segment is %d bytes for %d bytes of rows", segment_len, rows_len);
+
+  // All of the fields decode back to the very same buffer.
+  box.check(LogColumnar::decode(header, decoded, len) == rows_len && memcmp(rows, decoded, rows_len) == 0,
+            "full decode does not match the original rows");
+  box.check(LogColumnar::decode(header, decoded, rows_len - 1) < 0, "decode overflowed a short buffer");
+
+  // A projection has only the requested fields, in the requested order.
+  const char *const symbols[] = {"cquc", "pssc"};
+  box.check(LogColumnar::decode(header, decoded, len, symbols, countof(symbols)) > 0, "projection failed");
+  LogBufferHeader *projected = reinterpret_cast<LogBufferHeader *>(decoded);
+  box.check(strcmp(projected->fmt_fieldlist(), "cquc,pssc") == 0, "projected field list is '%s'", projected->fmt_fieldlist());
+
+  LogBufferIterator iter(projected);
+  LogEntryHeader *entry;
+  int i = 0, mismatches = 0;
+  char url[128];
+  while ((entry = iter.next())) {
+    char *read_from = reinterpret_cast<char *>(entry) + sizeof(LogEntryHeader);
+    int64_t status;
+
+    snprintf(url, sizeof(url), "http://origin%d.example.com/path/%d", i % 4, i);
+    memcpy(&status, read_from + LogAccess::strlen(read_from), sizeof(status));
+    if (strcmp(read_from, url) != 0 || status != (i % 11 ? 200 : 404) || entry->timestamp != 1500000000 + i / 10) {
+      ++mismatches;
+    }
+    ++i;
+  }
+  box.check(i == 500 && mismatches == 0, "projection has %d entries, %d of them wrong", i, mismatches);
+
+  const char *const missing[] = {"cquc", "xid"};
+  box.check(LogColumnar::decode(header, decoded, len, missing, countof(missing)) < 0, "projection of a missing field succeeded");
+
+  ats_free(segment);
+  ats_free(rows);
+  ats_free(decoded);
+}
+
+REGRESSION_TEST(LogColumnar_scan)(RegressionTest *t, int level, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  if (REGRESSION_TEST_EXTENDED > level) {
+    return;
+  }
+
+  const int len     = 512 * 1024;
+  const int entries = 2000;
+  const int rounds  = 200;
+  char *rows        = static_cast<char *>(ats_malloc(len));
+  char *decoded     = static_cast<char *>(ats_malloc(len));
+  int segment_len;
+
+  make_test_rows(rows, len, entries);
+  char *segment = LogColumnar::encode(reinterpret_cast<LogBufferHeader *>(rows), &segment_len);
+  if (segment == nullptr) {
+    box.check(false, "the squid entries could not be encoded");
+    ats_free(rows);
+    ats_free(decoded);
+    return;
+  }
+
+  // What an hourly origin report needs: the URL and the size of each entry.
+  const char *const report[] = {"cquc", "psql"};
+  ink_hrtime start           = ink_get_hrtime_internal();
+  for (int i = 0; i < rounds; ++i) {
+    LogColumnar::decode(reinterpret_cast<LogBufferHeader *>(segment), decoded, len);
+  }
+  ink_hrtime all = ink_get_hrtime_internal() - start;
+
+  start = ink_get_hrtime_internal();
+  for (int i = 0; i < rounds; ++i) {
+    LogColumnar::decode(reinterpret_cast<LogBufferHeader *>(segment), decoded, len, report, countof(report));
+  }
+  ink_hrtime two = ink_get_hrtime_internal() - start;
+
+  start = ink_get_hrtime_internal();
+  for (int i = 0; i < rounds; ++i) {
+    ats_free(LogColumnar::encode(reinterpret_cast<LogBufferHeader *>(rows), &segment_len));
+  }
+  ink_hrtime encode = ink_get_hrtime_internal() - start;
+
+  rprintf(t, "encode:            %" PRId64 " ns/entry\n", encode / (rounds * entries));
+  rprintf(t, "decode 12 columns: %" PRId64 " ns/entry\n", all / (rounds * entries));
+  rprintf(t, "decode  2 columns: %" PRId64 " ns/entry\n", two / (rounds * entries));
+
+  ats_free(segment);
+  ats_free(rows);
+  ats_free(decoded);
+}
+#endif
@@ -0,0 +1,134 @@
+/** @file
+
+  Columnar layout for binary log segments.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "LogBuffer.h"
+#include "LogField.h"
+
+/*-------------------------------------------------------------------------
+  Columnar segments
+
+  A columnar segment holds the same entries as a binary LogBuffer, but each
+  field is stored as a column of its own instead of row by row. It starts
+  with a LogBufferHeader (with LOG_COLUMNAR_SEGMENT_COOKIE instead of
+  LOG_SEGMENT_COOKIE) and the same header strings, so it is written, rolled
+  and read back just like a LogBuffer. The data section is laid out as:
+
+    LogColumnarHeader
+    LogColumn[column_count]   column directory
+    column data               at the offsets given in the directory
+
+  Column 0 holds the entry timestamps, column N the Nth field of the
+  format's field list. Integer columns are delta encoded as zigzag varints,
+  string columns use a dictionary if a segment has few distinct values.
+  A reader can decode any subset of the columns and skip the others.
+  -------------------------------------------------------------------------*/
+
+#define LOG_COLUMNAR_SEGMENT_COOKIE 0xc01face
+#define LOG_COLUMNAR_VERSION 1
+
+struct LogColumnarHeader {
+  uint32_t version;      // LOG_COLUMNAR_VERSION
+  uint32_t column_count; // number of fields + 1 for the timestamps
+  uint32_t row_bytes;    // size of the LogBuffer the segment decodes to
+  uint32_t reserved;
+};
+
+struct LogColumn {
+  enum Type {
+    TIMESTAMP = LogField::N_TYPES, // the other types are LogField::Type
+  };
+  enum Encoding {
+    PLAIN, // strings are nul terminated, IP addresses are LogFieldIp
+    DELTA, // zigzag varints of the difference to the previous value
+    DICT,  // varint count, nul terminated values, then a varint index per entry
+  };
+
+  uint32_t type;
+  uint32_t encoding;
+  uint32_t offset; // from the start of the segment
+  uint32_t length;
+};
+
+/** Sequential reader over one column of a columnar segment.
+ */
+class LogColumnReader
+{
+public:
+  LogColumnReader() {}
+  bool init(LogBufferHeader *segment, int column);
+
+  int
+  type() const
+  {
+    return m_type;
+  }
+
+  bool next_int(int64_t *value);
+  const char *next_str();
+  const char *next_ip(int *len);
+
+private:
+  bool read_varint(uint64_t *value);
+
+  int m_type                 = -1;
+  int m_encoding             = LogColumn::PLAIN;
+  const unsigned char *m_cur = nullptr;
+  const unsigned char *m_end = nullptr;
+  uint64_t m_prev            = 0;
+  std::vector<const char *> m_dict;
+};
+
+class LogColumnar
+{
+public:
+  static bool
+  is_segment(LogBufferHeader *header)
+  {
+    return header->cookie == LOG_COLUMNAR_SEGMENT_COOKIE;
+  }
+
+  /** Convert the binary LogBuffer @a rows to a columnar segment.
+
+      @return the ats_malloc()'d segment and its size in @a len, or nullptr if
+      the buffer can't be stored columnar.
+   */
+  static char *encode(LogBufferHeader *rows, int *len);
+
+  /** Convert @a segment back to a binary LogBuffer in @a buf.
+
+      If @a symbols is given, only the fields with those symbols are decoded,
+      in that order, and the field list of the result is changed accordingly.
+      This is much cheaper than decoding all of the fields of a wide format.
+
+      @return the size of the LogBuffer, or -1 if @a buf is too small or the
+      segment doesn't have all of the @a symbols.
+   */
+  static int decode(LogBufferHeader *segment, char *buf, int len, const char *const *symbols = nullptr, int nsymbols = 0);
+
+  /// Column index of the field with @a symbol, or -1.
+  static int find_column(LogBufferHeader *segment, const char *symbol);
+};
@@ -88,6 +88,7 @@ LogConfig::setup_default_values()
   collation_port             = 0;
   collation_host_tagged      = false;
   collation_preproc_threads  = 1;
+  flush_threads              = 1;
   collation_secret           = ats_strdup("foobar");
   collation_retry_sec        = 0;
   collation_max_send_buffers = 0;
@@ -197,6 +198,11 @@ LogConfig::read_configuration_variables()
     collation_preproc_threads = val;
   }
 
+  val = (int)REC_ConfigReadInteger("proxy.config.log.flush_threads");
+  if (val > 0 && val <= 64) {
+    flush_threads = val;
+  }
+
   ptr = REC_ConfigReadString("proxy.config.log.collation_secret");
   if (ptr != nullptr) {
     ats_free(collation_secret);
@@ -460,6 +466,7 @@ LogConfig::display(FILE *fd)
   fprintf(fd, "   collation_port = %d\n", collation_port);
   fprintf(fd, "   collation_host_tagged = %d\n", collation_host_tagged);
   fprintf(fd, "   collation_preproc_threads = %d\n", collation_preproc_threads);
+  fprintf(fd, "   flush_threads = %d\n", flush_threads);
   fprintf(fd, "   collation_secret = %s\n", collation_secret);
   fprintf(fd, "   rolling_enabled = %d\n", rolling_enabled);
   fprintf(fd, "   rolling_interval_sec = %d\n", rolling_interval_sec);
@@ -178,6 +178,7 @@ public:
   int collation_port;
   bool collation_host_tagged;
   int collation_preproc_threads;
+  int flush_threads;
   int collation_retry_sec;
   int collation_max_send_buffers;
   Log::RollingEnabledValues rolling_enabled;
@@ -36,6 +36,10 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
 #include "P_EventSystem.h"
 #include "I_Machine.h"
 #include "LogSock.h"
@@ -45,6 +49,7 @@
 #include "LogFilter.h"
 #include "LogFormat.h"
 #include "LogBuffer.h"
+#include "LogColumnar.h"
 #include "LogFile.h"
 #include "LogHost.h"
 #include "LogObject.h"
@@ -52,6 +57,15 @@
 #include "LogConfig.h"
 #include "Log.h"
 
+// Log files are spread over the flush threads round robin. All writes to a
+// file are done by the same thread, so they stay in order.
+static int
+next_flush_thread()
+{
+  static int next = 0;
+  return ink_atomic_increment(&next, 1);
+}
+
 /*-------------------------------------------------------------------------
   LogFile::LogFile
 
@@ -60,13 +74,36 @@
   -------------------------------------------------------------------------*/
 
 LogFile::LogFile(const char *name, const char *header, LogFileFormat format, uint64_t signature, size_t ascii_buffer_size,
-                 size_t max_line_size)
+                 size_t max_line_size, LogFileCompression compression, LogFileLayout layout)
   : m_file_format(format),
     m_name(ats_strdup(name)),
     m_header(ats_strdup(header)),
     m_signature(signature),
-    m_max_line_size(max_line_size)
+    m_max_line_size(max_line_size),
+    m_flush_thread(next_flush_thread()),
+    m_max_flush_lag(0),
+    m_bytes_dropped(0),
+    m_compression(compression),
+    m_layout(layout),
+    m_open_failed(false),
+    m_stat_check_count(1)
 {
+  ink_mutex_init(&m_write_mutex);
+
+#ifndef HAVE_ZLIB_H
+  if (m_compression != LOG_FILE_COMPRESSION_NONE) {
+    Warning("compression is not supported for %s, zlib is not available; writing it uncompressed", name);
+    m_compression = LOG_FILE_COMPRESSION_NONE;
+  }
+#endif
+  // a pipe reader expects one record per write, see write_ascii_logbuffer3
+  if (m_file_format == LOG_FILE_PIPE) {
+    m_compression = LOG_FILE_COMPRESSION_NONE;
+  }
+  if (m_file_format != LOG_FILE_BINARY) {
+    m_layout = LOG_FILE_LAYOUT_ROW;
+  }
+
   if (m_file_format != LOG_FILE_PIPE) {
     m_log = new BaseLogFile(name, m_signature);
     m_log->set_hostname(Machine::instance()->hostname);
@@ -94,8 +131,17 @@ LogFile::LogFile(const LogFile &copy)
     m_signature(copy.m_signature),
     m_ascii_buffer_size(copy.m_ascii_buffer_size),
     m_max_line_size(copy.m_max_line_size),
-    m_fd(copy.m_fd)
+    m_fd(copy.m_fd),
+    m_flush_thread(next_flush_thread()),
+    m_max_flush_lag(0),
+    m_bytes_dropped(0),
+    m_compression(copy.m_compression),
+    m_layout(copy.m_layout),
+    m_open_failed(false),
+    m_stat_check_count(1)
 {
+  ink_mutex_init(&m_write_mutex);
+
   ink_release_assert(m_ascii_buffer_size >= m_max_line_size);
 
   if (copy.m_log) {
@@ -116,6 +162,7 @@ LogFile::~LogFile()
   delete m_log;
   ats_free(m_header);
   ats_free(m_name);
+  ink_mutex_destroy(&m_write_mutex);
   Debug("log-file", "exiting LogFile destructor, this=%p", this);
 }
 
@@ -202,7 +249,13 @@ LogFile::open_file()
   if (!file_exists) {
     if (m_file_format != LOG_FILE_BINARY && m_header && m_log) {
       Debug("log-file", "writing header to LogFile %s", m_name);
-      writeln(m_header, strlen(m_header), fileno(m_log->m_fp), m_name);
+      size_t len = strlen(m_header);
+      if (is_compressed() && len > 0) {
+        struct iovec header[2] = {{m_header, len}, {const_cast<char *>("\n"), 1}};
+        write_compressed(fileno(m_log->m_fp), header, m_header[len - 1] == '\n' ? 1 : 2);
+      } else {
+        writeln(m_header, strlen(m_header), fileno(m_log->m_fp), m_name);
+      }
     }
   }
 
@@ -246,6 +299,9 @@ LogFile::close_file()
 int
 LogFile::roll(long interval_start, long interval_end)
 {
+  // the flush thread of this file may be writing to it
+  ink_scoped_mutex_lock lock(m_write_mutex);
+
   if (m_log) {
     return m_log->roll(interval_start, interval_end);
   }
@@ -303,17 +359,26 @@ LogFile::preproc_and_try_delete(LogBuffer *lb)
     // don't change between buffers), it's not worth trying to separate
     // out the buffer-dependent data from the buffer-independent data.
     //
-    LogFlushData *flush_data = new LogFlushData(this, lb);
-
     ProxyMutex *mutex = this_thread()->mutex.get();
+    LogFlushData *flush_data;
+    char *segment = nullptr;
+    int segment_len;
 
     RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_num_flush_to_disk_stat, lb->header()->entry_count);
 
     RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_bytes_flush_to_disk_stat, lb->header()->byte_count);
 
-    ink_atomiclist_push(Log::flush_data_list, flush_data);
+    // Columnar files get the buffer converted here, the flush thread just
+    // writes out the segment. Buffers that can't be converted are written
+    // as they are, readers handle both.
+    if (m_layout == LOG_FILE_LAYOUT_COLUMNAR && (segment = LogColumnar::encode(buffer_header, &segment_len)) != nullptr) {
+      flush_data = new LogFlushData(this, segment, segment_len);
+      LogBuffer::destroy(lb);
+    } else {
+      flush_data = new LogFlushData(this, lb);
+    }
 
-    Log::flush_notify->signal();
+    queue_flush_data(flush_data);
 
     //
     // LogBuffer will be deleted in flush thread
@@ -493,9 +558,7 @@ LogFile::write_ascii_logbuffer3(LogBufferHeader *buffer_header, const char *alt_
 
     RecIncrRawStat(log_rsb, mutex->thread_holding, log_stat_bytes_flush_to_disk_stat, fmt_buf_bytes);
 
-    ink_atomiclist_push(Log::flush_data_list, flush_data);
-
-    Log::flush_notify->signal();
+    queue_flush_data(flush_data);
 
     total_bytes += fmt_buf_bytes;
   }
@@ -503,6 +566,21 @@ LogFile::write_ascii_logbuffer3(LogBufferHeader *buffer_header, const char *alt_
   return total_bytes;
 }
 
+/*-------------------------------------------------------------------------
+  LogFile::queue_flush_data
+
+  Hand @a data to the flush thread this file is sharded to.
+  -------------------------------------------------------------------------*/
+
+void
+LogFile::queue_flush_data(LogFlushData *data)
+{
+  int idx = static_cast<unsigned>(m_flush_thread) % Log::flush_threads;
+
+  ink_atomiclist_push(&Log::flush_data_list[idx], data);
+  Log::flush_notify[idx].signal();
+}
+
 bool
 LogFile::rolled_logfile(char *file)
 {
@@ -559,6 +637,149 @@ LogFile::writeln(char *data, int len, int fd, const char *path)
   return total_bytes;
 }
 
+/*-------------------------------------------------------------------------
+  LogFile::write_compressed
+
+  Compress the data in @a iov into a single gzip member and write it to
+  @a fd. Every member is self contained and concatenated members are a valid
+  gzip stream, so a file can be rolled at any time and read back with zcat(1)
+  or LogFileReader without any state carried across writes.
+
+  Returns the number of compressed bytes written to the file, or -1 if the
+  member could not be written in full. The file is then truncated back to
+  where the member started, a partial member would end the gzip stream.
+  -------------------------------------------------------------------------*/
+
+int64_t
+LogFile::write_compressed(int fd, const struct iovec *iov, int iovcnt)
+{
+#ifdef HAVE_ZLIB_H
+  // Each flush thread keeps its own stream and output buffer, a reset is much cheaper than deflateInit2().
+  static thread_local z_stream *zs   = nullptr;
+  static thread_local Bytef *out     = nullptr;
+  static thread_local uLong out_size = 0;
+  uLong total                        = 0;
+
+  if (zs == nullptr) {
+    zs = static_cast<z_stream *>(ats_malloc(sizeof(z_stream)));
+    memset(zs, 0, sizeof(z_stream));
+    // 15 + 16 is the largest window, with a gzip header and trailer
+    if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      ats_free(zs);
+      zs = nullptr;
+      return -1;
+    }
+  } else {
+    deflateReset(zs);
+  }
+
+  for (int i = 0; i < iovcnt; ++i) {
+    total += iov[i].iov_len;
+  }
+  uLong bound = deflateBound(zs, total);
+  if (bound > out_size) {
+    out      = static_cast<Bytef *>(ats_realloc(out, bound));
+    out_size = bound;
+  }
+
+  zs->next_out  = out;
+  zs->avail_out = out_size;
+  for (int i = 0; i < iovcnt; ++i) {
+    zs->next_in  = static_cast<Bytef *>(iov[i].iov_base);
+    zs->avail_in = iov[i].iov_len;
+    if (deflate(zs, Z_NO_FLUSH) == Z_STREAM_ERROR || zs->avail_in != 0) {
+      return -1;
+    }
+  }
+  // anything short of the end of the stream would leave a truncated member
+  if (deflate(zs, Z_FINISH) != Z_STREAM_END) {
+    return -1;
+  }
+
+  int64_t len     = out_size - zs->avail_out;
+  int64_t written = 0;
+  off_t start     = ::lseek(fd, 0, SEEK_END);
+  while (written < len) {
+    ssize_t n = ::write(fd, out + written, len - written);
+    if (n > 0) {
+      written += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      int saved = n < 0 ? errno : EIO;
+      if (written > 0 && start >= 0 && ::ftruncate(fd, start) < 0) {
+        Warning("could not remove a partial gzip member from the log file, it is unreadable past offset %" PRId64 ": %s",
+                static_cast<int64_t>(start), strerror(errno));
+      }
+      errno = saved;
+      return -1;
+    }
+  }
+  return written;
+#else
+  (void)fd;
+  (void)iov;
+  (void)iovcnt;
+  return -1;
+#endif
+}
+
+/*-------------------------------------------------------------------------
+  LogFileReader
+  -------------------------------------------------------------------------*/
+
+LogFileReader::LogFileReader(int fd) : m_fd(fd), m_gz(nullptr)
+{
+#ifdef HAVE_ZLIB_H
+  // Look for the gzip magic at the start of the file, pipes and other
+  // unseekable input are read as is.
+  unsigned char magic[2];
+  if (::pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && magic[0] == 0x1f && magic[1] == 0x8b) {
+    int dup_fd = ::dup(fd);
+    if (dup_fd >= 0) {
+      // gzdopen(3) reads from the current offset, so a reader set up after
+      // seeking to the end of a file starts at the next member.
+      m_gz = gzdopen(dup_fd, "rb");
+      if (m_gz == nullptr) {
+        ::close(dup_fd);
+      }
+    }
+  }
+#endif
+}
+
+LogFileReader::~LogFileReader()
+{
+#ifdef HAVE_ZLIB_H
+  if (m_gz) {
+    gzclose(static_cast<gzFile>(m_gz));
+  }
+#endif
+}
+
+int
+LogFileReader::read(void *buf, unsigned len)
+{
+#ifdef HAVE_ZLIB_H
+  if (m_gz) {
+    return gzread(static_cast<gzFile>(m_gz), buf, len);
+  }
+#endif
+  return ::read(m_fd, buf, len);
+}
+
+// Allow reading on past the end of the file, for following a file that is
+// still being written.
+void
+LogFileReader::clear_eof()
+{
+#ifdef HAVE_ZLIB_H
+  if (m_gz) {
+    gzclearerr(static_cast<gzFile>(m_gz));
+  }
+#endif
+}
+
 /*-------------------------------------------------------------------------
   LogFile::check_fd
 
@@ -567,15 +788,13 @@ LogFile::writeln(char *data, int len, int fd, const char *path)
   and re-open it, which will create the file if it doesn't already exist.
 
   Failure to open the logfile will generate a manager alarm and a Warning.
+  The flush thread of the file calls it with m_write_mutex held.
   -------------------------------------------------------------------------*/
 
 void
 LogFile::check_fd()
 {
-  static bool failure_last_call    = false;
-  static unsigned stat_check_count = 1;
-
-  if ((stat_check_count % Log::config->file_stat_frequency) == 0) {
+  if ((m_stat_check_count % Log::config->file_stat_frequency) == 0) {
     //
     // It's time to see if the file really exists.  If we can't see
     // the file (via access), then we'll close our descriptor and
@@ -585,22 +804,22 @@ LogFile::check_fd()
     if (m_name && !LogFile::exists(m_name)) {
       close_file();
     }
-    stat_check_count = 0;
+    m_stat_check_count = 0;
   }
-  stat_check_count++;
+  m_stat_check_count++;
 
   int err = open_file();
   // XXX if open_file() returns, LOG_FILE_FILESYSTEM_CHECKS_FAILED, raise a more informative alarm ...
   if (err != LOG_FILE_NO_ERROR && err != LOG_FILE_NO_PIPE_READERS) {
-    if (!failure_last_call) {
+    if (!m_open_failed) {
       LogUtils::manager_alarm(LogUtils::LOG_ALARM_ERROR, "Traffic Server could not open logfile %s.", m_name);
       Warning("Traffic Server could not open logfile %s: %s.", m_name, strerror(errno));
     }
-    failure_last_call = true;
+    m_open_failed = true;
     return;
   }
 
-  failure_last_call = false;
+  m_open_failed = false;
 }
 
 void
@@ -27,6 +27,8 @@
 #include <cstdio>
 
 #include "ts/ink_platform.h"
+#include "ts/ink_hrtime.h"
+#include "ts/ink_mutex.h"
 #include "LogBufferSink.h"
 
 class LogSock;
@@ -35,6 +37,39 @@ struct LogBufferHeader;
 class LogObject;
 class BaseLogFile;
 class BaseMetaInfo;
+class LogFlushData;
+
+/*-------------------------------------------------------------------------
+  LogFileReader
+
+  Reads the log data from a file descriptor, decompressing it on the fly if
+  the file was written with compression enabled. Plain files are read as is,
+  so tools can use this for any log file.
+  -------------------------------------------------------------------------*/
+
+class LogFileReader
+{
+public:
+  explicit LogFileReader(int fd);
+  ~LogFileReader();
+
+  int read(void *buf, unsigned len);
+  void clear_eof();
+
+  bool
+  is_compressed() const
+  {
+    return m_gz != nullptr;
+  }
+
+  // noncopyable
+  LogFileReader(const LogFileReader &) = delete;
+  LogFileReader &operator=(const LogFileReader &) = delete;
+
+private:
+  int m_fd;
+  void *m_gz; // gzFile, if the file is compressed
+};
 
 /*-------------------------------------------------------------------------
   LogFile
@@ -44,7 +79,8 @@ class LogFile : public LogBufferSink, public RefCountObj
 {
 public:
   LogFile(const char *name, const char *header, LogFileFormat format, uint64_t signature, size_t ascii_buffer_size = 4 * 9216,
-          size_t max_line_size = 9216);
+          size_t max_line_size = 9216, LogFileCompression compression = LOG_FILE_COMPRESSION_NONE,
+          LogFileLayout layout = LOG_FILE_LAYOUT_ROW);
   LogFile(const LogFile &);
   ~LogFile() override;
 
@@ -82,8 +118,15 @@ public:
     return (m_file_format == LOG_FILE_BINARY ? "binary" : (m_file_format == LOG_FILE_PIPE ? "ascii_pipe" : "ascii"));
   }
 
+  bool
+  is_compressed() const
+  {
+    return m_compression != LOG_FILE_COMPRESSION_NONE;
+  }
+
   static int write_ascii_logbuffer(LogBufferHeader *buffer_header, int fd, const char *path, const char *alt_format = nullptr);
   int write_ascii_logbuffer3(LogBufferHeader *buffer_header, const char *alt_format = nullptr);
+  void queue_flush_data(LogFlushData *data);
   static bool rolled_logfile(char *file);
   static bool exists(const char *pathname);
 
@@ -107,6 +150,7 @@ public:
   void check_fd();
   int get_fd();
   static int writeln(char *data, int len, int fd, const char *path);
+  static int64_t write_compressed(int fd, const struct iovec *iov, int iovcnt);
 
 public:
   LogFileFormat m_file_format;
@@ -121,6 +165,16 @@ public:
   size_t m_ascii_buffer_size; // size of ascii buffer
   size_t m_max_line_size;     // size of longest log line (record)
   int m_fd;                   // this could back m_log or a pipe, depending on the situation
+  int m_flush_thread;         // flush thread all writes to this file are done by
+  ink_mutex m_write_mutex;    // held by the flush thread while it writes, and to roll the file
+  ink_hrtime m_max_flush_lag; // longest queue to disk delay since the last stats update
+  int64_t m_bytes_dropped;    // bytes that never made it to disk
+  LogFileCompression m_compression;
+  LogFileLayout m_layout;
+
+private:
+  bool m_open_failed;          // check_fd() could not open the file last time
+  unsigned m_stat_check_count; // check_fd() calls since the file was last looked for
 
 public:
   Link<LogFile> link;
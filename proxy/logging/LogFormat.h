@@ -42,6 +42,16 @@ enum LogFileFormat {
   N_LOGFILE_TYPES
 };
 
+enum LogFileCompression {
+  LOG_FILE_COMPRESSION_NONE,
+  LOG_FILE_COMPRESSION_GZIP, // each flush is written as a self contained gzip member
+};
+
+enum LogFileLayout {
+  LOG_FILE_LAYOUT_ROW,
+  LOG_FILE_LAYOUT_COLUMNAR, // binary buffers are written as columnar segments, see LogColumnar.h
+};
+
 /*-------------------------------------------------------------------------
   LogFormat
 
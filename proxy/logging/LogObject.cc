@@ -35,9 +35,13 @@
 #include "LogConfig.h"
 #include "LogAccess.h"
 #include "Log.h"
+#include "LogAccessTest.h"
 #include "ts/TestBox.h"
 
 #include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
 #include <vector>
 
 static bool
@@ -90,7 +94,8 @@ LogBufferManager::preproc_buffers(LogBufferSink *sink)
 
 LogObject::LogObject(const LogFormat *format, const char *log_dir, const char *basename, LogFileFormat file_format,
                      const char *header, Log::RollingEnabledValues rolling_enabled, int flush_threads, int rolling_interval_sec,
-                     int rolling_offset_hr, int rolling_size_mb, bool auto_created)
+                     int rolling_offset_hr, int rolling_size_mb, bool auto_created, LogFileCompression compression,
+                     LogFileLayout layout)
   : m_auto_created(auto_created),
     m_alt_filename(nullptr),
     m_flags(0),
@@ -100,7 +105,9 @@ LogObject::LogObject(const LogFormat *format, const char *log_dir, const char *b
     m_rolling_offset_hr(rolling_offset_hr),
     m_rolling_size_mb(rolling_size_mb),
     m_last_roll_time(0),
-    m_buffer_manager_idx(0)
+    m_buffer_manager_idx(0),
+    m_entries_dropped(0),
+    m_stats_registered(false)
 {
   ink_release_assert(format);
   m_format         = new LogFormat(*format);
@@ -111,6 +118,13 @@ LogObject::LogObject(const LogFormat *format, const char *log_dir, const char *b
   } else if (file_format == LOG_FILE_PIPE) {
     m_flags |= WRITES_TO_PIPE;
   }
+  // ascii and binary files can be compressed, pipes cannot, see LogFile::LogFile
+  if (file_format != LOG_FILE_PIPE && compression != LOG_FILE_COMPRESSION_NONE) {
+    m_flags |= COMPRESSED;
+  }
+  if (file_format == LOG_FILE_BINARY && layout == LOG_FILE_LAYOUT_COLUMNAR) {
+    m_flags |= COLUMNAR;
+  }
 
   generate_filenames(log_dir, basename, file_format);
 
@@ -120,11 +134,10 @@ LogObject::LogObject(const LogFormat *format, const char *log_dir, const char *b
   // by default, create a LogFile for this object, if a loghost is
   // later specified, then we will delete the LogFile object
   //
-  m_logFile = new LogFile(m_filename, header, file_format, m_signature, Log::config->ascii_buffer_size, Log::config->max_line_size);
+  m_logFile = new LogFile(m_filename, header, file_format, m_signature, Log::config->ascii_buffer_size, Log::config->max_line_size,
+                          compression, layout);
 
-  LogBuffer *b = new LogBuffer(this, Log::config->log_buffer_size);
-  ink_assert(b);
-  SET_FREELIST_POINTER_VERSION(m_log_buffer, b, 0);
+  _init_log_buffers();
 
   _setup_rolling(rolling_enabled, rolling_interval_sec, rolling_offset_hr, rolling_size_mb);
 
@@ -145,8 +158,9 @@ LogObject::LogObject(LogObject &rhs)
     m_rolling_offset_hr(rhs.m_rolling_offset_hr),
     m_rolling_size_mb(rhs.m_rolling_size_mb),
     m_last_roll_time(rhs.m_last_roll_time),
-    m_buffer_manager_idx(rhs.m_buffer_manager_idx)
-
+    m_buffer_manager_idx(rhs.m_buffer_manager_idx),
+    m_entries_dropped(0),
+    m_stats_registered(false)
 {
   m_format         = new LogFormat(*(rhs.m_format));
   m_buffer_manager = new LogBufferManager[m_flush_threads];
@@ -162,16 +176,19 @@ LogObject::LogObject(LogObject &rhs)
     add_filter(filter);
   }
 
+  LogSampler *sampler;
+  for (sampler = rhs.m_sampler_list.first(); sampler; sampler = rhs.m_sampler_list.next(sampler)) {
+    add_sampler(sampler);
+  }
+
   LogHost *host;
   for (host = rhs.m_host_list.first(); host; host = rhs.m_host_list.next(host)) {
     add_loghost(host);
   }
 
-  // copy gets a fresh log buffer
+  // copy gets fresh log buffers
   //
-  LogBuffer *b = new LogBuffer(this, Log::config->log_buffer_size);
-  ink_assert(b);
-  SET_FREELIST_POINTER_VERSION(m_log_buffer, b, 0);
+  _init_log_buffers();
 
   Debug("log-config",
         "exiting LogObject copy constructor, "
@@ -196,7 +213,10 @@ LogObject::~LogObject()
   ats_free(m_alt_filename);
   delete m_format;
   delete[] m_buffer_manager;
-  delete (LogBuffer *)FREELIST_POINTER(m_log_buffer);
+  for (unsigned i = 0; i < m_log_buffer_count; ++i) {
+    delete (LogBuffer *)FREELIST_POINTER(m_log_buffers[i].m_head);
+  }
+  delete[] m_log_buffers;
 }
 
 //-----------------------------------------------------------------------------
@@ -302,6 +322,15 @@ LogObject::set_filter_list(const LogFilterList &list, bool copy)
   m_filter_list.set_conjunction(list.does_conjunction());
 }
 
+void
+LogObject::add_sampler(LogSampler *sampler, bool copy)
+{
+  if (!sampler) {
+    return;
+  }
+  m_sampler_list.add(sampler, copy);
+}
+
 void
 LogObject::add_loghost(LogHost *host, bool copy)
 {
@@ -331,11 +360,14 @@ LogObject::compute_signature(LogFormat *format, char *filename, unsigned int fla
   uint64_t signature = 0;
 
   if (fl && ps && filename) {
-    int buf_size = strlen(fl) + strlen(ps) + strlen(filename) + 2;
-    char *buffer = (char *)ats_malloc(buf_size);
+    const char *compressed = flags & LogObject::COMPRESSED ? "Z" : "";
+    const char *columnar   = flags & LogObject::COLUMNAR ? "C" : "";
+    int buf_size           = strlen(fl) + strlen(ps) + strlen(filename) + strlen(compressed) + strlen(columnar) + 2;
+    char *buffer           = (char *)ats_malloc(buf_size);
 
     ink_string_concatenate_strings(buffer, fl, ps, filename,
-                                   flags & LogObject::BINARY ? "B" : (flags & LogObject::WRITES_TO_PIPE ? "P" : "A"), NULL);
+                                   flags & LogObject::BINARY ? "B" : (flags & LogObject::WRITES_TO_PIPE ? "P" : "A"), compressed,
+                                   columnar, NULL);
 
     CryptoHash hash;
     CryptoContext().hash_immediate(hash, buffer, buf_size - 1);
@@ -361,6 +393,7 @@ LogObject::display(FILE *fd)
     fprintf(fd, "full path = %s\n", get_full_filename());
   }
   m_filter_list.display(fd);
+  m_sampler_list.display(fd);
   fprintf(fd, "++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n");
 }
 
@@ -387,8 +420,53 @@ write_pointer_version(head_p *dst, head_p old_h, void *ptr, head_p::version_type
   return ink_atomic_cas(&dst->data, old_h.data, tmp_h.data);
 }
 
+void
+LogObject::_init_log_buffers()
+{
+  // One slot per event thread; the first is filled now, the others when their thread first logs.
+  m_log_buffer_count = std::max(eventProcessor.n_ethreads, 1);
+  m_log_buffers      = new LogBufferHead[m_log_buffer_count];
+  for (unsigned i = 0; i < m_log_buffer_count; ++i) {
+    SET_FREELIST_POINTER_VERSION(m_log_buffers[i].m_head, nullptr, 0);
+  }
+
+  LogBuffer *b = new LogBuffer(this, Log::config->log_buffer_size);
+  ink_assert(b);
+  SET_FREELIST_POINTER_VERSION(m_log_buffers[0].m_head, b, 0);
+}
+
+head_p *
+LogObject::_thread_log_buffer()
+{
+  static std::atomic<unsigned> next_thread_slot{0};
+  static thread_local unsigned thread_slot = next_thread_slot++;
+
+  head_p *log_buffer = &m_log_buffers[thread_slot % m_log_buffer_count].m_head;
+  head_p h;
+
+  INK_QUEUE_LD(h, *log_buffer);
+  if (FREELIST_POINTER(h) == nullptr) {
+    // Other threads may share this slot, only one of them gets to install its buffer.
+    LogBuffer *b = new LogBuffer(this, Log::config->log_buffer_size);
+    if (!write_pointer_version(log_buffer, h, b, 0)) {
+      delete b;
+    }
+  }
+  return log_buffer;
+}
+
+void
+LogObject::force_new_buffer()
+{
+  for (unsigned i = 0; i < m_log_buffer_count; ++i) {
+    if (FREELIST_POINTER(m_log_buffers[i].m_head) != nullptr) {
+      _checkout_write(&m_log_buffers[i].m_head, nullptr, 0);
+    }
+  }
+}
+
 LogBuffer *
-LogObject::_checkout_write(size_t *write_offset, size_t bytes_needed)
+LogObject::_checkout_write(head_p *log_buffer, size_t *write_offset, size_t bytes_needed)
 {
   LogBuffer::LB_ResultCode result_code;
   LogBuffer *buffer;
@@ -400,8 +478,8 @@ LogObject::_checkout_write(size_t *write_offset, size_t bytes_needed)
     // To avoid a race condition, we keep a count of held references in
     // the pointer itself and add this to m_outstanding_references.
 
-    // Increment the version of m_log_buffer, returning the previous version.
-    head_p h = increment_pointer_version(&m_log_buffer);
+    // Increment the version of *log_buffer, returning the previous version.
+    head_p h = increment_pointer_version(log_buffer);
 
     buffer           = (LogBuffer *)FREELIST_POINTER(h);
     result_code      = buffer->checkout_write(write_offset, bytes_needed);
@@ -423,7 +501,7 @@ LogObject::_checkout_write(size_t *write_offset, size_t bytes_needed)
       INK_WRITE_MEMORY_BARRIER;
 
       do {
-        INK_QUEUE_LD(old_h, m_log_buffer);
+        INK_QUEUE_LD(old_h, *log_buffer);
         // we may depend on comparing the old pointer to the new pointer to detect buffer swaps
         // without worrying about pointer collisions because we always allocate a new LogBuffer
         // before freeing the old one
@@ -435,7 +513,7 @@ LogObject::_checkout_write(size_t *write_offset, size_t bytes_needed)
           delete new_buffer;
           break;
         }
-      } while (!write_pointer_version(&m_log_buffer, old_h, new_buffer, 0));
+      } while (!write_pointer_version(log_buffer, old_h, new_buffer, 0));
 
       if (FREELIST_POINTER(old_h) == FREELIST_POINTER(h)) {
         ink_atomic_increment(&buffer->m_references, FREELIST_VERSION(old_h) - 1);
@@ -474,13 +552,13 @@ LogObject::_checkout_write(size_t *write_offset, size_t bytes_needed)
       // The do-while loop protects us from races while we're examining ptr(old_h) and ptr(h)
       // (essentially an optimistic lock)
       do {
-        INK_QUEUE_LD(old_h, m_log_buffer);
+        INK_QUEUE_LD(old_h, *log_buffer);
         if (FREELIST_POINTER(old_h) != FREELIST_POINTER(h)) {
           // Another thread's allocated a new LogBuffer, we don't need to do anything more
           break;
         }
 
-      } while (!write_pointer_version(&m_log_buffer, old_h, FREELIST_POINTER(h), FREELIST_VERSION(old_h) - 1));
+      } while (!write_pointer_version(log_buffer, old_h, FREELIST_POINTER(h), FREELIST_VERSION(old_h) - 1));
 
       if (FREELIST_POINTER(old_h) != FREELIST_POINTER(h)) {
         // Another thread's allocated a new LogBuffer, meaning this LogObject is no longer referencing the old LogBuffer
@@ -540,6 +618,7 @@ LogObject::log(LogAccess *lad, const char *text_entry)
   // (if there is a remote client, m_logFile will be NULL
   if (Log::config->logging_space_exhausted && !writes_to_pipe() && m_logFile) {
     Debug("log", "logging space exhausted, can't write to:%s, drop this entry", m_logFile->get_name());
+    ink_atomic_increment(&m_entries_dropped, 1);
     return Log::FULL;
   }
   // this verification must be done here in order to avoid 'dead' LogBuffers
@@ -554,6 +633,12 @@ LogObject::log(LogAccess *lad, const char *text_entry)
     return Log::SKIP;
   }
 
+  // sample after filtering so the sample counts only cover entries that would be logged
+  if (lad && m_sampler_list.toss_this_entry(lad)) {
+    Debug("log", "entry sampled out, skipping ...");
+    return Log::SKIP;
+  }
+
   if (lad && m_filter_list.wipe_this_entry(lad)) {
     Debug("log", "entry wiped, ...");
   }
@@ -604,12 +689,13 @@ LogObject::log(LogAccess *lad, const char *text_entry)
   }
 
   // Now try to place this entry in the current LogBuffer.
-  buffer = _checkout_write(&offset, bytes_needed);
+  buffer = _checkout_write(_thread_log_buffer(), &offset, bytes_needed);
 
   if (!buffer) {
     Note("Skipping the current log entry for %s because its size (%zu) exceeds "
          "the maximum payload space in a log buffer",
          m_basename, bytes_needed);
+    ink_atomic_increment(&m_entries_dropped, 1);
     return Log::FAIL;
   }
   //
@@ -790,10 +876,51 @@ LogObject::_roll_files(long last_roll_time, long time_now)
 void
 LogObject::check_buffer_expiration(long time_now)
 {
-  LogBuffer *b = (LogBuffer *)FREELIST_POINTER(m_log_buffer);
-  if (b && time_now > b->expiration_time()) {
-    force_new_buffer();
+  for (unsigned i = 0; i < m_log_buffer_count; ++i) {
+    LogBuffer *b = (LogBuffer *)FREELIST_POINTER(m_log_buffers[i].m_head);
+    if (b && time_now > b->expiration_time()) {
+      _checkout_write(&m_log_buffers[i].m_head, nullptr, 0);
+    }
+  }
+}
+
+/*-------------------------------------------------------------------------
+  LogObject::update_stats
+
+  Publish the lag, drop and sampling counters of this object as
+  proxy.process.log.object.<basename>.*, registering them on first use.
+  -------------------------------------------------------------------------*/
+
+void
+LogObject::update_stats()
+{
+  static const char *const stat_names[] = {"entries_dropped", "bytes_dropped", "flush_lag_ms", "entries_sampled",
+                                           "entries_sampled_out"};
+  char prefix[256];
+  char name[320];
+
+  snprintf(prefix, sizeof(prefix), "proxy.process.log.object.%s", m_basename);
+  // the basename is a file name, make it a single record name component
+  for (char *c = prefix + sizeof("proxy.process.log.object.") - 1; *c; ++c) {
+    if (!isalnum(static_cast<unsigned char>(*c)) && *c != '-') {
+      *c = '_';
+    }
+  }
+
+  RecInt values[] = {m_entries_dropped, 0, 0, m_sampler_list.entries_kept(), m_sampler_list.entries_tossed()};
+  if (m_logFile) {
+    values[1] = m_logFile->m_bytes_dropped;
+    values[2] = ink_hrtime_to_msec(ink_atomic_swap(&m_logFile->m_max_flush_lag, static_cast<ink_hrtime>(0)));
+  }
+
+  for (unsigned i = 0; i < countof(stat_names); ++i) {
+    snprintf(name, sizeof(name), "%s.%s", prefix, stat_names[i]);
+    if (!m_stats_registered) {
+      RecRegisterStatInt(RECT_PROCESS, name, static_cast<RecInt>(0), RECP_NON_PERSISTENT);
+    }
+    RecSetRecordInt(name, values[i], REC_SOURCE_DEFAULT);
   }
+  m_stats_registered = true;
 }
 
 /*-------------------------------------------------------------------------
@@ -1100,6 +1227,22 @@ LogObjectManager::get_object_with_signature(uint64_t signature)
   return nullptr;
 }
 
+void
+LogObjectManager::update_stats()
+{
+  for (auto &_object : this->_objects) {
+    _object->update_stats();
+  }
+
+  ACQUIRE_API_MUTEX("A LogObjectManager::update_stats");
+
+  for (auto &_APIobject : this->_APIobjects) {
+    _APIobject->update_stats();
+  }
+
+  RELEASE_API_MUTEX("R LogObjectManager::update_stats");
+}
+
 void
 LogObjectManager::check_buffer_expiration(long time_now)
 {
@@ -1404,4 +1547,237 @@ REGRESSION_TEST(LogObjectManager_Transfer)(RegressionTest *t, int /* atype ATS_U
   box = REGRESSION_TEST_PASSED;
 }
 
+REGRESSION_TEST(LogFile_compressed)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+#ifdef HAVE_ZLIB_H
+  char path[] = "/tmp/log_compressed_XXXXXX";
+  int fd      = mkstemp(path);
+  if (fd < 0) {
+    box.check(false, "can't create %s: %s", path, strerror(errno));
+    return;
+  }
+  unlink(path);
+
+  // Two flushes, the second one from several buffers, must read back as one stream.
+  char first[]           = "first flush\n";
+  char second[]          = "second flush, ";
+  char third[]           = "in two buffers\n";
+  struct iovec flush1[1] = {{first, strlen(first)}};
+  struct iovec flush2[2] = {{second, strlen(second)}, {third, strlen(third)}};
+
+  box.check(LogFile::write_compressed(fd, flush1, 1) > 0, "first flush was not written");
+  box.check(LogFile::write_compressed(fd, flush2, 2) > 0, "second flush was not written");
+
+  lseek(fd, 0, SEEK_SET);
+  {
+    LogFileReader in(fd);
+    char buf[128];
+    int len = 0, n;
+
+    box.check(in.is_compressed(), "compressed file not detected");
+    while ((n = in.read(buf + len, sizeof(buf) - len - 1)) > 0) {
+      len += n;
+    }
+    buf[len] = '\0';
+    box.check(strcmp(buf, "first flush\nsecond flush, in two buffers\n") == 0, "read back '%s'", buf);
+  }
+
+  // Plain files are read as they are.
+  ftruncate(fd, 0);
+  lseek(fd, 0, SEEK_SET);
+  write(fd, first, strlen(first));
+  lseek(fd, 0, SEEK_SET);
+  {
+    LogFileReader in(fd);
+    char buf[128];
+
+    box.check(!in.is_compressed(), "plain file taken for a compressed one");
+    box.check(in.read(buf, sizeof(buf)) == static_cast<int>(strlen(first)), "short read of a plain file");
+  }
+  close(fd);
+#endif
+}
+
+/// A flush thread of the LogFlush_threads test, it writes out one queue until the writers are done.
+struct LogFlushTestThread : public Continuation {
+  LogFlushTestThread(InkAtomicList *l, std::atomic<bool> *d, std::atomic<int> *r)
+    : Continuation(nullptr), list(l), done(d), running(r)
+  {
+    SET_HANDLER(&LogFlushTestThread::mainEvent);
+  }
+
+  int
+  mainEvent(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+  {
+    bool last = false;
+
+    // Everything queued before the writers are done is written by the flush after it.
+    while (!last) {
+      last = *done;
+      Log::flush_queue(list);
+      if (!last) {
+        usleep(100);
+      }
+    }
+    --*running;
+    delete this;
+    return EVENT_DONE;
+  }
+
+  InkAtomicList *list;
+  std::atomic<bool> *done;
+  std::atomic<int> *running;
+};
+
+REGRESSION_TEST(LogFlush_threads)(RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  static const int N_FLUSH_THREADS = 3;
+  static const int N_OBJECTS       = 6;
+  static const int N_WRITERS       = 2;
+  static const int N_BUFFERS       = 2000; // per object
+  const char *tmpdir               = getenv("TMPDIR");
+  LogFormat format("testfmt", nullptr);
+  InkAtomicList lists[N_FLUSH_THREADS];
+  std::atomic<bool> done{false};
+  std::atomic<int> running{N_FLUSH_THREADS};
+  std::vector<LogObject *> objects;
+
+  if (!tmpdir) {
+    tmpdir = "/tmp";
+  }
+
+  for (int i = 0; i < N_OBJECTS; ++i) {
+    std::string name = "log_flush_threads_" + std::to_string(getpid()) + "_" + std::to_string(i);
+    objects.push_back(new LogObject(&format, tmpdir, name.c_str(), LOG_FILE_ASCII, nullptr, Log::NO_ROLLING, 1));
+    unlink(objects.back()->get_full_filename());
+  }
+
+  size_t stacksize;
+  REC_ReadConfigInteger(stacksize, "proxy.config.thread.default.stacksize");
+  for (int i = 0; i < N_FLUSH_THREADS; ++i) {
+    ink_atomiclist_init(&lists[i], "Log flush test list", 0);
+    eventProcessor.spawn_thread(new LogFlushTestThread(&lists[i], &done, &running), "[LOG_FLUSH_TEST]", stacksize);
+  }
+
+  // Each writer queues the buffers of its objects in turns, so the queues hold the buffers of several files interleaved.
+  std::vector<std::thread> writers;
+  for (int w = 0; w < N_WRITERS; ++w) {
+    writers.emplace_back([&, w]() {
+      for (int seq = 0; seq < N_BUFFERS; ++seq) {
+        for (int i = w; i < N_OBJECTS; i += N_WRITERS) {
+          LogFile *logfile = objects[i]->m_logFile.get();
+          char *line       = static_cast<char *>(ats_malloc(64));
+          int len          = snprintf(line, 64, "object %d buffer %d\n", i, seq);
+
+          // as LogFile::queue_flush_data, sharded by the flush thread of the file
+          ink_atomiclist_push(&lists[static_cast<unsigned>(logfile->m_flush_thread) % N_FLUSH_THREADS],
+                              new LogFlushData(logfile, line, len));
+        }
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  done = true;
+
+  ink_hrtime deadline = Thread::get_hrtime_updated() + HRTIME_SECONDS(10);
+  while (running > 0 && Thread::get_hrtime_updated() < deadline) {
+    usleep(1000);
+  }
+  if (!box.check(running == 0, "the flush threads did not finish")) {
+    return; // they still use the queues, leak them
+  }
+
+  for (int i = 0; i < N_OBJECTS; ++i) {
+    std::string expected, contents;
+    char buf[4096];
+    ssize_t n;
+
+    for (int seq = 0; seq < N_BUFFERS; ++seq) {
+      expected += "object " + std::to_string(i) + " buffer " + std::to_string(seq) + "\n";
+    }
+    int fd = open(objects[i]->get_full_filename(), O_RDONLY);
+    while (fd >= 0 && (n = read(fd, buf, sizeof(buf))) > 0) {
+      contents.append(buf, n);
+    }
+    box.check(contents.size() == expected.size(), "%s has %zu bytes, expected %zu", objects[i]->get_full_filename(),
+              contents.size(), expected.size());
+    box.check(contents == expected, "the buffers of %s are not in order", objects[i]->get_full_filename());
+    if (fd >= 0) {
+      close(fd);
+    }
+
+    std::string path = objects[i]->get_full_filename();
+    std::string meta = path;
+    meta.insert(meta.rfind('/') + 1, ".");
+    delete objects[i];
+    unlink(path.c_str());
+    unlink((meta + ".meta").c_str());
+  }
+}
+
+struct LogThroughputArgs {
+  LogObject *object;
+  int entries;
+};
+
+static void *
+log_throughput_thread(void *data)
+{
+  LogThroughputArgs *args = static_cast<LogThroughputArgs *>(data);
+  LogAccessTest lad;
+
+  for (int i = 0; i < args->entries; ++i) {
+    args->object->log(&lad);
+  }
+  return nullptr;
+}
+
+REGRESSION_TEST(LogObject_throughput)(RegressionTest *t, int level, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  box = REGRESSION_TEST_PASSED;
+
+  // This is a benchmark, only run it when asked for (-R 3).
+  if (REGRESSION_TEST_EXTENDED > level) {
+    return;
+  }
+
+  static const int ENTRIES_PER_THREAD = 200000;
+  const char *tmpdir                  = getenv("TMPDIR");
+  LogFormat format("throughput", "%<chi> %<caun> \"%<cqtx>\" %<pssc> %<pscl>");
+
+  if (!tmpdir) {
+    tmpdir = "/tmp";
+  }
+
+  for (int n_threads : {1, 2, 4, 8, 16}) {
+    LogObject *object = new LogObject(&format, tmpdir, "log_throughput", LOG_FILE_BINARY, nullptr, Log::NO_ROLLING,
+                                      Log::config->collation_preproc_threads);
+    LogThroughputArgs args = {object, ENTRIES_PER_THREAD};
+    std::vector<ink_thread> threads(n_threads);
+
+    Log::config->log_object_manager.manage_api_object(object);
+    ink_hrtime start = Thread::get_hrtime_updated();
+    for (auto &tid : threads) {
+      ink_thread_create(&tid, log_throughput_thread, &args, 0, 0, nullptr);
+    }
+    for (auto &tid : threads) {
+      ink_thread_join(tid);
+    }
+    ink_hrtime elapsed = Thread::get_hrtime_updated() - start;
+    Log::config->log_object_manager.unmanage_api_object(object);
+
+    rprintf(t, "%2d threads: %.0f entries/sec\n", n_threads,
+            static_cast<double>(n_threads) * ENTRIES_PER_THREAD * HRTIME_SECOND / std::max<ink_hrtime>(elapsed, 1));
+  }
+}
+
 #endif
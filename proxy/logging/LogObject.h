@@ -28,6 +28,7 @@
 #include "LogFile.h"
 #include "LogFormat.h"
 #include "LogFilter.h"
+#include "LogSampler.h"
 #include "LogHost.h"
 #include "LogBuffer.h"
 #include "LogAccess.h"
@@ -90,21 +91,27 @@ public:
     REMOTE_DATA              = 2,
     WRITES_TO_PIPE           = 4,
     LOG_OBJECT_FMT_TIMESTAMP = 8, // always format a timestamp into each log line (for raw text logs)
+    COMPRESSED               = 16,
+    COLUMNAR                 = 32,
   };
 
   // BINARY: log is written in binary format (rather than ascii)
   // REMOTE_DATA: object receives data from remote collation clients, so
   //              it should not be destroyed during a reconfiguration
   // WRITES_TO_PIPE: object writes to a named pipe rather than to a file
+  // COMPRESSED: object writes a gzip compressed file
+  // COLUMNAR: object writes binary data as columnar segments
 
   LogObject(const LogFormat *format, const char *log_dir, const char *basename, LogFileFormat file_format, const char *header,
             Log::RollingEnabledValues rolling_enabled, int flush_threads, int rolling_interval_sec = 0, int rolling_offset_hr = 0,
-            int rolling_size_mb = 0, bool auto_created = false);
+            int rolling_size_mb = 0, bool auto_created = false, LogFileCompression compression = LOG_FILE_COMPRESSION_NONE,
+            LogFileLayout layout = LOG_FILE_LAYOUT_ROW);
   LogObject(LogObject &);
   ~LogObject() override;
 
   void add_filter(LogFilter *filter, bool copy = true);
   void set_filter_list(const LogFilterList &list, bool copy = true);
+  void add_sampler(LogSampler *sampler, bool copy = true);
   void add_loghost(LogHost *host, bool copy = true);
 
   inline void
@@ -151,6 +158,7 @@ public:
   }
 
   void check_buffer_expiration(long time_now);
+  void update_stats();
 
   void display(FILE *fd = stdout);
   static uint64_t compute_signature(LogFormat *format, char *filename, unsigned int flags);
@@ -256,11 +264,7 @@ public:
     return (m_format ? m_format->format_string() : "<none>");
   }
 
-  inline void
-  force_new_buffer()
-  {
-    _checkout_write(nullptr, 0);
-  }
+  void force_new_buffer();
 
   bool operator==(LogObject &rhs);
 
@@ -269,6 +273,7 @@ public:
   LogFormat *m_format;
   Ptr<LogFile> m_logFile;
   LogFilterList m_filter_list;
+  LogSamplerList m_sampler_list;
   LogHostList m_host_list;
 
 private:
@@ -294,16 +299,29 @@ private:
   long m_last_roll_time;   // the last time this object rolled
   // its files
 
-  head_p m_log_buffer; // current work buffer
+  // Each thread writes into its own work buffer so that the checkout CAS does
+  // not bounce a shared cache line between threads. Slots are padded to a cache
+  // line; threads beyond the slot count share slots (which remains safe).
+  struct LogBufferHead {
+    head_p m_head;
+    char m_pad[64 - sizeof(head_p)];
+  };
+  LogBufferHead *m_log_buffers; // current work buffer of each thread slot
+  unsigned m_log_buffer_count;
   unsigned m_buffer_manager_idx;
   LogBufferManager *m_buffer_manager;
 
+  int64_t m_entries_dropped; // entries that could not be put in a buffer
+  bool m_stats_registered;
+
   void generate_filenames(const char *log_dir, const char *basename, LogFileFormat file_format);
   void _setup_rolling(Log::RollingEnabledValues rolling_enabled, int rolling_interval_sec, int rolling_offset_hr,
                       int rolling_size_mb);
   unsigned _roll_files(long interval_start, long interval_end);
 
-  LogBuffer *_checkout_write(size_t *write_offset, size_t write_size);
+  void _init_log_buffers();
+  head_p *_thread_log_buffer();
+  LogBuffer *_checkout_write(head_p *log_buffer, size_t *write_offset, size_t write_size);
 
   // noncopyable
   LogObject(const LogObject &) = delete;
@@ -394,6 +412,7 @@ public:
 
   LogObject *get_object_with_signature(uint64_t signature);
   void check_buffer_expiration(long time_now);
+  void update_stats();
 
   unsigned roll_files(long time_now);
 
@@ -426,7 +445,7 @@ LogObject::operator==(LogObject &old)
             (is_collation_client() && old.is_collation_client() ?
                m_host_list == old.m_host_list :
                m_logFile && old.m_logFile && strcmp(m_logFile->get_name(), old.m_logFile->get_name()) == 0) &&
-            (m_filter_list == old.m_filter_list) &&
+            (m_filter_list == old.m_filter_list) && (m_sampler_list == old.m_sampler_list) &&
             (m_rolling_interval_sec == old.m_rolling_interval_sec && m_rolling_offset_hr == old.m_rolling_offset_hr &&
              m_rolling_size_mb == old.m_rolling_size_mb));
   }
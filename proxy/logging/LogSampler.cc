@@ -0,0 +1,423 @@
+/** @file
+
+  Sampling and rate limiting of log entries.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "ts/ink_platform.h"
+#include "ts/HashFNV.h"
+#include "LogSampler.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+const char *LogSampler::MODE_NAME[] = {"EVERY", "RESERVOIR", "RATE"};
+
+// xorshift64*, one generator per thread so that sampling needs no shared state.
+static uint64_t
+sample_random()
+{
+  static thread_local uint64_t state = 0;
+
+  if (unlikely(state == 0)) {
+    state = static_cast<uint64_t>(ink_get_hrtime_internal()) ^ reinterpret_cast<uintptr_t>(&state);
+    state |= 1;
+  }
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dULL;
+}
+
+/*-------------------------------------------------------------------------
+  LogSampler::LogSampler
+  -------------------------------------------------------------------------*/
+
+LogSampler::LogSampler(Mode mode, int64_t n, int64_t interval, int64_t burst)
+  : m_mode(mode),
+    m_n(std::max<int64_t>(n, 1)),
+    m_interval(interval > 0 ? interval : 60),
+    m_burst(burst > 0 ? burst : m_n),
+    m_condition_str(nullptr),
+    m_key_str(nullptr),
+    m_condition(nullptr),
+    m_key(nullptr),
+    m_reservoirs(nullptr),
+    m_tat(0)
+{
+  if (m_mode == RESERVOIR) {
+    m_reservoirs = new Reservoir[RESERVOIR_BUCKETS];
+    for (unsigned i = 0; i < RESERVOIR_BUCKETS; ++i) {
+      m_reservoirs[i].count = 0;
+      m_reservoirs[i].epoch = 0;
+    }
+  }
+  m_counters = new Counters[COUNTER_SLOTS];
+  for (unsigned i = 0; i < COUNTER_SLOTS; ++i) {
+    m_counters[i].kept   = 0;
+    m_counters[i].tossed = 0;
+  }
+}
+
+LogSampler::LogSampler(const LogSampler &rhs) : LogSampler(rhs.m_mode, rhs.m_n, rhs.m_interval, rhs.m_burst)
+{
+  // The condition and key were valid for rhs, so they parse again.
+  bool ok = _init(rhs.m_condition_str, rhs.m_key_str);
+  ink_release_assert(ok);
+}
+
+LogSampler::~LogSampler()
+{
+  ats_free(m_condition_str);
+  ats_free(m_key_str);
+  delete m_condition;
+  delete m_key;
+  delete[] m_reservoirs;
+  delete[] m_counters;
+}
+
+LogSampler *
+LogSampler::create(Mode mode, int64_t n, const char *condition, const char *key, int64_t interval, int64_t burst)
+{
+  ink_release_assert(mode < N_MODES);
+
+  LogSampler *sampler = new LogSampler(mode, n, interval, burst);
+  if (!sampler->_init(condition, key)) {
+    delete sampler;
+    return nullptr;
+  }
+  return sampler;
+}
+
+bool
+LogSampler::_init(const char *condition, const char *key)
+{
+  if (condition) {
+    m_condition_str = ats_strdup(condition);
+    m_condition     = LogFilter::parse("sample", LogFilter::ACCEPT, condition);
+    if (m_condition == nullptr) {
+      return false;
+    }
+  }
+
+  if (key) {
+    m_key_str = ats_strdup(key);
+    if (LogField *f = Log::global_field_list.find_by_symbol(key)) {
+      m_key = new LogField(*f);
+    } else {
+      Error("Invalid sample key field '%s'", key);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+LogSampler::Counters *
+LogSampler::_thread_counters()
+{
+  static std::atomic<unsigned> next_thread_slot{0};
+  static thread_local unsigned thread_slot = next_thread_slot++;
+
+  return &m_counters[thread_slot % COUNTER_SLOTS];
+}
+
+/*-------------------------------------------------------------------------
+  LogSampler::sample
+  -------------------------------------------------------------------------*/
+
+LogSampler::Result
+LogSampler::sample(LogAccess *lad)
+{
+  bool keep;
+
+  if (m_condition && m_condition->toss_this_entry(lad)) {
+    return NO_MATCH;
+  }
+
+  switch (m_mode) {
+  case EVERY:
+    keep = (sample_random() % m_n) == 0;
+    break;
+  case RESERVOIR:
+    keep = _keep_reservoir(lad);
+    break;
+  case RATE:
+  default:
+    keep = _keep_rate();
+    break;
+  }
+
+  Counters *c = _thread_counters();
+  (keep ? c->kept : c->tossed).fetch_add(1, std::memory_order_relaxed);
+  return keep ? KEEP : TOSS;
+}
+
+bool
+LogSampler::_keep_reservoir(LogAccess *lad)
+{
+  uint32_t bucket = 0;
+
+  if (m_key) {
+    static thread_local std::vector<char> value;
+    ATSHash32FNV1a hash;
+
+    value.resize(m_key->marshal_len(lad));
+    hash.update(value.data(), m_key->marshal(lad, value.data()));
+    hash.final();
+    bucket = hash.get() % RESERVOIR_BUCKETS;
+  }
+
+  Reservoir *r  = &m_reservoirs[bucket];
+  int64_t epoch = ink_hrtime_to_sec(ink_get_hrtime_internal()) / m_interval;
+  int64_t seen  = r->epoch.load(std::memory_order_relaxed);
+
+  // The first thread to see a new interval empties the reservoir.
+  if (seen != epoch && r->epoch.compare_exchange_strong(seen, epoch)) {
+    r->count = 0;
+  }
+
+  int64_t i = r->count.fetch_add(1, std::memory_order_relaxed) + 1;
+  return i <= m_n || static_cast<int64_t>(sample_random() % i) < m_n;
+}
+
+bool
+LogSampler::_keep_rate()
+{
+  // rates above one per nanosecond are not limited any further
+  ink_hrtime period = std::max<ink_hrtime>(HRTIME_SECOND / m_n, 1);
+  ink_hrtime limit  = period * (m_burst - 1);
+  ink_hrtime now    = ink_get_hrtime_internal();
+  ink_hrtime tat    = m_tat.load(std::memory_order_relaxed);
+
+  do {
+    if (tat - now > limit) {
+      return false; // out of tokens, no write to the shared state
+    }
+  } while (!m_tat.compare_exchange_weak(tat, std::max(tat, now) + period));
+
+  return true;
+}
+
+static bool
+strings_are_equal(const char *a, const char *b)
+{
+  return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+bool
+LogSampler::operator==(const LogSampler &rhs) const
+{
+  return m_mode == rhs.m_mode && m_n == rhs.m_n && m_interval == rhs.m_interval && m_burst == rhs.m_burst &&
+         strings_are_equal(m_condition_str, rhs.m_condition_str) && strings_are_equal(m_key_str, rhs.m_key_str);
+}
+
+int64_t
+LogSampler::entries_kept() const
+{
+  int64_t n = 0;
+  for (unsigned i = 0; i < COUNTER_SLOTS; ++i) {
+    n += m_counters[i].kept.load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+int64_t
+LogSampler::entries_tossed() const
+{
+  int64_t n = 0;
+  for (unsigned i = 0; i < COUNTER_SLOTS; ++i) {
+    n += m_counters[i].tossed.load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+void
+LogSampler::display(FILE *fd)
+{
+  fprintf(fd, "Sampler %s %" PRId64, MODE_NAME[m_mode], m_n);
+  if (m_mode == RESERVOIR) {
+    fprintf(fd, " per %" PRId64 "s", m_interval);
+  } else if (m_mode == RATE) {
+    fprintf(fd, " burst %" PRId64, m_burst);
+  }
+  if (m_key_str) {
+    fprintf(fd, " key %s", m_key_str);
+  }
+  if (m_condition_str) {
+    fprintf(fd, " if %s", m_condition_str);
+  }
+  fprintf(fd, "\n");
+}
+
+/*-------------------------------------------------------------------------
+  LogSamplerList
+  -------------------------------------------------------------------------*/
+
+LogSamplerList::~LogSamplerList()
+{
+  clear();
+}
+
+void
+LogSamplerList::clear()
+{
+  LogSampler *s;
+  while ((s = m_sampler_list.dequeue())) {
+    delete s;
+  }
+}
+
+void
+LogSamplerList::add(LogSampler *sampler, bool copy)
+{
+  ink_assert(sampler != nullptr);
+  m_sampler_list.enqueue(copy ? new LogSampler(*sampler) : sampler);
+}
+
+bool
+LogSamplerList::operator==(const LogSamplerList &rhs) const
+{
+  LogSampler *s    = first();
+  LogSampler *rhss = rhs.first();
+
+  for (; s && rhss; s = next(s), rhss = rhs.next(rhss)) {
+    if (!(*s == *rhss)) {
+      return false;
+    }
+  }
+  return s == rhss;
+}
+
+bool
+LogSamplerList::toss_this_entry(LogAccess *lad)
+{
+  for (LogSampler *s = first(); s; s = next(s)) {
+    LogSampler::Result r = s->sample(lad);
+    if (r != LogSampler::NO_MATCH) {
+      return r == LogSampler::TOSS;
+    }
+  }
+  return false;
+}
+
+int64_t
+LogSamplerList::entries_kept() const
+{
+  int64_t n = 0;
+  for (LogSampler *s = first(); s; s = next(s)) {
+    n += s->entries_kept();
+  }
+  return n;
+}
+
+int64_t
+LogSamplerList::entries_tossed() const
+{
+  int64_t n = 0;
+  for (LogSampler *s = first(); s; s = next(s)) {
+    n += s->entries_tossed();
+  }
+  return n;
+}
+
+void
+LogSamplerList::display(FILE *fd)
+{
+  for (LogSampler *s = first(); s; s = next(s)) {
+    s->display(fd);
+  }
+}
+
+#if TS_HAS_TESTS
+#include "ts/TestBox.h"
+#include "LogAccessTest.h"
+
+REGRESSION_TEST(LogSampler)(RegressionTest *t, int /* atype */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  LogAccessTest lad; // its status code (pssc) is always 7
+  box = REGRESSION_TEST_PASSED;
+
+  box.check(LogSampler::create(LogSampler::EVERY, 10, "pssc") == nullptr, "accepted an invalid condition");
+  box.check(LogSampler::create(LogSampler::RESERVOIR, 10, nullptr, "james") == nullptr, "accepted an invalid key");
+
+  // 1 in N
+  {
+    LogSampler *s = LogSampler::create(LogSampler::EVERY, 10, "pssc MATCH 7");
+    for (int i = 0; i < 100000; ++i) {
+      s->sample(&lad);
+    }
+    box.check(s->entries_kept() + s->entries_tossed() == 100000, "lost count of entries");
+    box.check(s->entries_kept() > 9000 && s->entries_kept() < 11000, "kept %" PRId64 " of 100000 entries", s->entries_kept());
+
+    LogSampler copy(*s);
+    box.check(copy.entries_kept() == 0, "a copy shares the counters");
+    delete s;
+  }
+
+  // Reservoir: all of the first N, then N / i.
+  {
+    LogSampler *s = LogSampler::create(LogSampler::RESERVOIR, 100, nullptr, "pssc", 3600);
+    int kept      = 0;
+    for (int i = 0; i < 100; ++i) {
+      kept += s->sample(&lad) == LogSampler::KEEP;
+    }
+    for (int i = 100; i < 10000; ++i) {
+      s->sample(&lad);
+    }
+    // expect 100 * (1 + ln(100)) = 560, unless the test crossed an interval
+    box.check(kept == 100, "kept %d of the first 100 entries", kept);
+    box.check(s->entries_kept() > 400 && s->entries_kept() < 800, "kept %" PRId64 " of 10000 entries", s->entries_kept());
+    delete s;
+  }
+
+  // Rate: the burst, and then N per second.
+  {
+    LogSampler *s    = LogSampler::create(LogSampler::RATE, 1000, nullptr, nullptr, 0, 50);
+    ink_hrtime start = ink_get_hrtime_internal();
+    for (int i = 0; i < 10000; ++i) {
+      s->sample(&lad);
+    }
+    double elapsed = static_cast<double>(ink_get_hrtime_internal() - start) / HRTIME_SECOND;
+    box.check(s->entries_kept() >= 50 && s->entries_kept() <= 51 + elapsed * 1000, "kept %" PRId64 " entries in %.3fs",
+              s->entries_kept(), elapsed);
+    delete s;
+  }
+
+  // The first sampler with a matching condition decides.
+  {
+    LogSamplerList list;
+    list.add(LogSampler::create(LogSampler::EVERY, 1000000, "pssc MATCH 200"), false);
+    list.add(LogSampler::create(LogSampler::EVERY, 1, "pssc MATCH 7"), false);
+    list.add(LogSampler::create(LogSampler::EVERY, 1000000), false);
+
+    int tossed = 0;
+    for (int i = 0; i < 1000; ++i) {
+      tossed += list.toss_this_entry(&lad);
+    }
+    box.check(tossed == 0, "tossed %d entries", tossed);
+    box.check(list.entries_kept() == 1000 && list.entries_tossed() == 0, "wrong sampler was used");
+  }
+}
+
+#endif
@@ -0,0 +1,190 @@
+/** @file
+
+  Sampling and rate limiting of log entries.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#pragma once
+
+#include "ts/ink_platform.h"
+#include "ts/ink_hrtime.h"
+#include "ts/List.h"
+#include "LogAccess.h"
+#include "LogField.h"
+#include "LogFilter.h"
+
+#include <atomic>
+
+/*-------------------------------------------------------------------------
+  LogSampler
+
+  A sampler keeps only part of the entries of a LogObject. It is asked by
+  LogObject::log before the entry is marshalled, so an entry that is
+  sampled out costs a random number or a clock read and nothing else.
+
+    EVERY      keep 1 in N entries, picked at random.
+    RESERVOIR  keep up to N entries per key value and interval. After the
+               first N, the i-th entry is kept with probability N / i, the
+               chance it has to enter a reservoir sample of size N. Kept
+               entries are written right away rather than at the end of the
+               interval, so n entries of a key yield about
+               N * (1 + ln(n / N)) log lines.
+    RATE       keep at most N entries per second, with bursts of up to
+               'burst' entries (a token bucket).
+
+  A sampler can be restricted to the entries matching a filter condition,
+  e.g. "pssc MATCH 200". Entries that don't match are left to the next
+  sampler of the object, or kept if there is none.
+
+  The kept and tossed counts of the samplers are published with the other
+  per object stats, so the sampled entries can be weighed back up.
+  -------------------------------------------------------------------------*/
+class LogSampler
+{
+public:
+  enum Mode {
+    EVERY = 0,
+    RESERVOIR,
+    RATE,
+    N_MODES,
+  };
+
+  enum Result {
+    NO_MATCH = 0, // the condition doesn't match, the sampler doesn't apply
+    KEEP,
+    TOSS,
+  };
+
+  static const char *MODE_NAME[];
+
+  /** Create a sampler, or return nullptr if the @a condition or the @a key
+      field symbol are invalid. @a interval is the reservoir interval in
+      seconds, @a burst the token bucket size of a rate limiter; 0 selects
+      the defaults (60 seconds, N entries).
+   */
+  static LogSampler *create(Mode mode, int64_t n, const char *condition = nullptr, const char *key = nullptr, int64_t interval = 0,
+                            int64_t burst = 0);
+
+  LogSampler(const LogSampler &rhs);
+  ~LogSampler();
+
+  Result sample(LogAccess *lad);
+  bool operator==(const LogSampler &rhs) const;
+
+  int64_t entries_kept() const;
+  int64_t entries_tossed() const;
+
+  void display(FILE *fd = stdout);
+
+  LINK(LogSampler, link);
+
+  // noncopyable
+  LogSampler &operator=(const LogSampler &rhs) = delete;
+
+private:
+  LogSampler(Mode mode, int64_t n, int64_t interval, int64_t burst);
+  bool _init(const char *condition, const char *key);
+
+  bool _keep_reservoir(LogAccess *lad);
+  bool _keep_rate();
+
+  Mode m_mode;
+  int64_t m_n;
+  int64_t m_interval; // RESERVOIR: seconds
+  int64_t m_burst;    // RATE: token bucket size
+
+  char *m_condition_str;
+  char *m_key_str;
+  LogFilter *m_condition;
+  LogField *m_key;
+
+  // RESERVOIR: entry count and interval of each key hash bucket. Keys that
+  // hash to the same bucket share a reservoir.
+  struct Reservoir {
+    std::atomic<int64_t> count;
+    std::atomic<int64_t> epoch;
+  };
+  static const unsigned RESERVOIR_BUCKETS = 1024;
+  Reservoir *m_reservoirs;
+
+  // RATE: the theoretical arrival time of the next entry (GCRA). The
+  // bucket is empty once it is 'burst' entries ahead of the clock.
+  std::atomic<ink_hrtime> m_tat;
+
+  // Counters are kept per thread slot, padded to a cache line. Threads
+  // beyond the slot count share slots.
+  struct Counters {
+    std::atomic<int64_t> kept;
+    std::atomic<int64_t> tossed;
+    char pad[64 - 2 * sizeof(std::atomic<int64_t>)];
+  };
+  static const unsigned COUNTER_SLOTS = 64;
+  Counters *m_counters;
+
+  Counters *_thread_counters();
+};
+
+/*-------------------------------------------------------------------------
+  LogSamplerList
+
+  The samplers of a LogObject. The first sampler whose condition matches an
+  entry decides whether it is kept.
+  -------------------------------------------------------------------------*/
+class LogSamplerList
+{
+public:
+  LogSamplerList() {}
+  ~LogSamplerList();
+
+  void add(LogSampler *sampler, bool copy = true);
+  void clear();
+  bool operator==(const LogSamplerList &rhs) const;
+  bool toss_this_entry(LogAccess *lad);
+
+  LogSampler *
+  first() const
+  {
+    return m_sampler_list.head;
+  }
+
+  LogSampler *
+  next(LogSampler *here) const
+  {
+    return (here->link).next;
+  }
+
+  bool
+  empty() const
+  {
+    return m_sampler_list.head == nullptr;
+  }
+
+  int64_t entries_kept() const;
+  int64_t entries_tossed() const;
+
+  void display(FILE *fd = stdout);
+
+  // noncopyable
+  LogSamplerList(const LogSamplerList &rhs) = delete;
+  LogSamplerList &operator=(const LogSamplerList &rhs) = delete;
+
+private:
+  Queue<LogSampler> m_sampler_list;
+};
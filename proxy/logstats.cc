@@ -35,6 +35,7 @@
 #include "LogStandalone.cc"
 
 #include "LogObject.h"
+#include "LogColumnar.h"
 #include "hdrs/HTTP.h"
 
 #include <sys/utsname.h>
@@ -1752,8 +1753,13 @@ process_file(int in_fd, off_t offset, unsigned max_age)
 {
   char buffer[MAX_LOGBUFFER_SIZE];
   int nread, buffer_bytes;
+  LogFileReader in(in_fd);
 
   Debug("logstats", "Processing file [offset=%" PRId64 "].", (int64_t)offset);
+  if (in.is_compressed() && offset > 0) {
+    Debug("logstats", "Can not re-align a compressed file.");
+    return 1;
+  }
   while (true) {
     Debug("logstats", "Reading initial header.");
     buffer[0] = '\0';
@@ -1779,7 +1785,7 @@ process_file(int in_fd, off_t offset, unsigned max_age)
           return 0;
         }
         // ensure that this is a valid logbuffer header
-        if (header->cookie && (LOG_SEGMENT_COOKIE == header->cookie)) {
+        if (header->cookie && (LOG_SEGMENT_COOKIE == header->cookie || LogColumnar::is_segment(header))) {
           offset = 0;
           break;
         }
@@ -1789,13 +1795,13 @@ process_file(int in_fd, off_t offset, unsigned max_age)
         return 0;
       }
     } else {
-      nread = read(in_fd, buffer, first_read_size);
+      nread = in.read(buffer, first_read_size);
       if (!nread || EOF == nread || !header->cookie) {
         return 0;
       }
 
       // ensure that this is a valid logbuffer header
-      if (header->cookie != LOG_SEGMENT_COOKIE) {
+      if (header->cookie != LOG_SEGMENT_COOKIE && !LogColumnar::is_segment(header)) {
         Debug("logstats", "Invalid segment cookie (expected %d, got %d)", LOG_SEGMENT_COOKIE, header->cookie);
         return 1;
       }
@@ -1808,7 +1814,7 @@ process_file(int in_fd, off_t offset, unsigned max_age)
 
     // read the rest of the header
     unsigned second_read_size = sizeof(LogBufferHeader) - first_read_size;
-    nread                     = read(in_fd, &buffer[first_read_size], second_read_size);
+    nread                     = in.read(&buffer[first_read_size], second_read_size);
     if (!nread || EOF == nread) {
       Debug("logstats", "Second read of header failed (attemped %d bytes at offset %d, got nothing), errno=%d.", second_read_size,
             first_read_size, errno);
@@ -1831,7 +1837,7 @@ process_file(int in_fd, off_t offset, unsigned max_age)
     int total_read           = 0;
     int read_tries_remaining = MAX_READ_TRIES; // since the data will be old anyway, let's only try a few times.
     do {
-      nread = read(in_fd, &buffer[sizeof(LogBufferHeader) + total_read], buffer_bytes - total_read);
+      nread = in.read(&buffer[sizeof(LogBufferHeader) + total_read], buffer_bytes - total_read);
       if (EOF == nread || !nread) { // just bail on error
         Debug("logstats", "Read failed while reading log buffer, wanted %d bytes, nread=%d, errno=%d", buffer_bytes - total_read,
               nread, errno);
@@ -1854,6 +1860,20 @@ process_file(int in_fd, off_t offset, unsigned max_age)
       }
     } while (total_read < buffer_bytes);
 
+    // Columnar segments only need the columns of the squid fields we look at
+    // decoded, in the order parse_log_buff() expects them.
+    if (LogColumnar::is_segment(header)) {
+      static const char *const squid_symbols[] = {"cqtq", "ttms", "chi",  "crc", "pssc", "psql",
+                                                  "cqhm", "cquc", "caun", "phr", "pqsn", "psct"};
+      static char rows[MAX_LOGBUFFER_SIZE];
+
+      if (LogColumnar::decode(header, rows, sizeof(rows), squid_symbols, countof(squid_symbols)) < 0) {
+        Debug("logstats", "Failed to decode the squid fields of a columnar segment.");
+        return 1;
+      }
+      header = reinterpret_cast<LogBufferHeader *>(rows);
+    }
+
     // Possibly skip too old entries (the entire buffer is skipped)
     if (header->high_timestamp >= max_age) {
       if (parse_log_buff(header, cl.summary != 0, cl.report_per_user != 0) != 0) {
@@ -2596,6 +2616,12 @@ main(int /* argc ATS_UNUSED */, const char *argv[])
       my_exit(exit_status);
     }
 
+    // The saved offset is a position in the file, which we can't resume from in a compressed log.
+    if (LogFileReader(main_fd).is_compressed()) {
+      exit_status.set(EXIT_CRITICAL, " incremental mode does not support compressed logs");
+      my_exit(exit_status);
+    }
+
     // Get stat's from the main log file.
     if (fstat(main_fd, &stat_buf) < 0) {
       exit_status.set(EXIT_CRITICAL, " can't stat squid.blog");